@@ -95,10 +95,19 @@ void loop()
     File ffd = SPIFFS.open(fname, FILE_WRITE);
     if (ffd) {
       Serial.println("\r\nReceiving file, start YModem transfer on the host...\r\n");
+      ymodem.setSpaceReservation(false); // The file is on SPIFFS, max_fsize already bounds its size
       rec_res = ymodem.receive(ffd, max_fsize, orig_name);
       ffd.close();
       Serial.println("\r\n");
 
+      const YmodemRxStats&      stats   = ymodem.getRxStats();
+      const YmodemSessionStats& session = ymodem.getSessionStats();
+      const YmodemWriteStats&   writes  = ymodem.getWriteStats();
+      log_i("UART wakeups=%u packets=%u retries=%u FIFO overflows=%u buffer full=%u", stats.wakeups, session.packets, session.retries,
+            stats.fifoOverflows, stats.bufferFull);
+      log_i("Session %u ms, %u writes, write latency avg=%u us max=%u us", writes.elapsedMs, writes.writes,
+            writes.writes ? writes.totalUs / writes.writes : 0, writes.maxUs);
+
       if (rec_res > 0) {
         log_i("Transfer complete. Size=%d, Original name: \"%s\"", rec_res, fname);
 
@@ -26,11 +26,16 @@ void setup()
   // Transmit the file using Ymodem
   Ymodem ymodem;
 
-  ymodem.resetExternalModule();
+  // The 'C' found by the reset is kept, transmit() answers it with the header right away
+  YmodemPacketStatus err = ymodem.resetExternalModule();
+  if (err != YMODEM_TRANSMIT_START) {
+    log_e("Error (%d): %s", err, ymodem.errorMessage(err));
+    return;
+  }
 
-  YmodemPacketStatus err = ymodem.transmit(fileName);
+  err = ymodem.transmit(fileName);
   if (err == YMODEM_TRANSMIT_OK) {
-    log_i("Success transmitting file: %s", fileName);
+    log_i("Success transmitting file: %s, header sent %u us after the reset", fileName, ymodem.getBootStats().resetToHeaderUs);
   }
   else {
     log_e("Error (%d): %s", err, ymodem.errorMessage(err));
@@ -0,0 +1,52 @@
+/**
+ * @file YmodemArena.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Packet buffer arena for Ymodem sessions
+ * @version 0.1
+ * @date 2025-05-26
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "YmodemArena.h"
+
+#include <algorithm>
+#include <new>
+
+YmodemArena::YmodemArena(size_t size) : memory(new (std::nothrow) uint8_t[size]), size(size)
+{
+  if (memory == NULL) {
+    this->size = 0;
+  }
+}
+
+YmodemArena::~YmodemArena()
+{
+  delete[] memory;
+}
+
+uint8_t* YmodemArena::allocate(size_t size)
+{
+  size_t start = (used + 3) & ~(size_t)3;
+  if (memory == NULL || start + size > this->size) {
+    return NULL;
+  }
+  used = start + size;
+  high = std::max(high, used);
+  return memory + start;
+}
+
+void YmodemArena::reset()
+{
+  used = 0;
+}
+
+size_t YmodemArena::capacity() const
+{
+  return size;
+}
+
+size_t YmodemArena::peak() const
+{
+  return high;
+}
@@ -0,0 +1,91 @@
+/**
+ * @file YmodemArena.h
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Packet buffer arena for Ymodem sessions
+ * @version 0.1
+ * @date 2025-05-26
+ *
+ * This file contains the arena the packet buffers of a session are taken from.
+ * The arena is allocated once, when its owner is constructed, and handed out
+ * again for every session, so the 1 KB packets live neither on the stack of
+ * the task running the transfer nor in a heap allocation per transfer.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef YMODEMARENA_H
+#define YMODEMARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "YmodemDef.h"
+
+#define YMODEM_FRAME_SIZE (PACKET_1K_SIZE + PACKET_OVERHEAD)                                                /*!< Bytes of a standard packet buffer */
+#define YMODEM_BLOCK_FRAME_SIZE(n) ((n) > PACKET_1K_SIZE ? (n) + PACKET_LARGE_OVERHEAD : YMODEM_FRAME_SIZE) /*!< Packet buffer for n-byte blocks */
+#define YMODEM_FEC_CODEWORDS(n) ((YMODEM_FEC_MESSAGE_SIZE(n) + YMODEM_FEC_DATA - 1) / YMODEM_FEC_DATA)         /*!< Interleaved codewords of an n-byte block */
+#define YMODEM_FEC_FRAME_SIZE(n) (1 + YMODEM_FEC_MESSAGE_SIZE(n) + YMODEM_FEC_CODEWORDS(n) * YMODEM_FEC_PARITY) /*!< Packet buffer for n-byte blocks with parity */
+
+#if YMODEM_FEC_ARENA
+#define YMODEM_ARENA_FRAME_SIZE ((YMODEM_FEC_FRAME_SIZE(YMODEM_MAX_BLOCK_SIZE) + 3) & ~3) /*!< Session frame in the arena, 4-byte aligned */
+#else
+#define YMODEM_ARENA_FRAME_SIZE ((YMODEM_BLOCK_FRAME_SIZE(YMODEM_MAX_BLOCK_SIZE) + 3) & ~3) /*!< Session frame in the arena, 4-byte aligned */
+#endif
+#define YMODEM_ARENA_SIZE (YMODEM_ARENA_FRAME_SIZE + ((YMODEM_FRAME_SIZE + 3) & ~3)) /*!< Arena of a Ymodem instance, frame and RX buffer */
+
+/**
+ * @brief Bump allocator handing out the packet buffers of a session.
+ *
+ * The memory is allocated by the constructor and released by the destructor. allocate()
+ * takes the next buffer, reset() gives every buffer back at once at the end of a session.
+ */
+class YmodemArena
+{
+public:
+  /**
+   * @brief Constructor for the YmodemArena class.
+   *
+   * @param size Capacity of the arena in bytes, YMODEM_ARENA_SIZE by default.
+   */
+  YmodemArena(size_t size = YMODEM_ARENA_SIZE);
+
+  ~YmodemArena();
+
+  YmodemArena(const YmodemArena&)            = delete;
+  YmodemArena& operator=(const YmodemArena&) = delete;
+
+  /**
+   * @brief Takes a buffer from the arena.
+   *
+   * @param size Size of the buffer in bytes.
+   * @return uint8_t* Pointer to the buffer, 4-byte aligned, or NULL if the arena is exhausted.
+   */
+  uint8_t* allocate(size_t size);
+
+  /**
+   * @brief Gives back every buffer taken from the arena.
+   */
+  void reset();
+
+  /**
+   * @brief Retrieves the capacity of the arena.
+   *
+   * @return size_t Capacity in bytes, 0 if the memory could not be allocated.
+   */
+  size_t capacity() const;
+
+  /**
+   * @brief Retrieves the largest number of bytes taken at once since the construction.
+   *
+   * @return size_t Peak usage in bytes.
+   */
+  size_t peak() const;
+
+private:
+  uint8_t* memory;   /**< Memory of the arena, NULL if the allocation failed. */
+  size_t   size;     /**< Capacity of the arena in bytes. */
+  size_t   used = 0; /**< Bytes currently taken. */
+  size_t   high = 0; /**< Peak of used. */
+};
+
+#endif // YMODEMARENA_H
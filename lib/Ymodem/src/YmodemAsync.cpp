@@ -0,0 +1,202 @@
+/**
+ * @file YmodemAsync.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Asynchronous Ymodem transfers
+ * @version 0.1
+ * @date 2025-05-12
+ *
+ * This file contains the worker implementation of the asynchronous transfer
+ * handle. On the ESP32 each transfer runs on a FreeRTOS task and completion is
+ * signalled with an event group. On the host each transfer runs on a detached
+ * std::thread and completion is signalled with a condition variable.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "YmodemAsync.h"
+#include "YmodemLog.h"
+
+#ifdef ESP_PLATFORM
+#include <Arduino.h>
+#include <freertos/task.h>
+#else
+#include <chrono>
+#include <thread>
+#endif
+
+#define COMPLETION_DONE_BIT (1 << 0) /*!< Event group bit set by YmodemCompletion::finish() */
+
+YmodemCompletion::YmodemCompletion() : finished(false), cancelRequested(false), value(PENDING)
+{
+#ifdef ESP_PLATFORM
+  events = xEventGroupCreate();
+#endif
+}
+
+YmodemCompletion::~YmodemCompletion()
+{
+#ifdef ESP_PLATFORM
+  if (events != NULL) {
+    vEventGroupDelete(events);
+  }
+#endif
+}
+
+bool YmodemCompletion::valid() const
+{
+#ifdef ESP_PLATFORM
+  return events != NULL;
+#else
+  return true;
+#endif
+}
+
+void YmodemCompletion::finish(int result)
+{
+  value    = result;
+  finished = true;
+
+#ifdef ESP_PLATFORM
+  xEventGroupSetBits(events, COMPLETION_DONE_BIT);
+#else
+  std::lock_guard<std::mutex> guard(lock);
+  doneSignal.notify_all();
+#endif
+}
+
+bool YmodemCompletion::done() const
+{
+  return finished;
+}
+
+bool YmodemCompletion::wait(uint32_t timeoutMs)
+{
+#ifdef ESP_PLATFORM
+  EventBits_t bits = xEventGroupWaitBits(events, COMPLETION_DONE_BIT, pdFALSE, pdTRUE, pdMS_TO_TICKS(timeoutMs));
+  return (bits & COMPLETION_DONE_BIT) != 0;
+#else
+  std::unique_lock<std::mutex> guard(lock);
+  return doneSignal.wait_for(guard, std::chrono::milliseconds(timeoutMs), [this]() { return finished.load(); });
+#endif
+}
+
+void YmodemCompletion::cancel()
+{
+  cancelRequested = true;
+}
+
+bool YmodemCompletion::cancelled() const
+{
+  return cancelRequested;
+}
+
+const std::atomic<bool>* YmodemCompletion::cancelFlag() const
+{
+  return &cancelRequested;
+}
+
+int YmodemCompletion::result() const
+{
+  return value;
+}
+
+struct YmodemTransfer::State
+{
+  Job              job;        // Function executed by the worker
+  CancelHook       cancelHook; // Function that makes the job return early
+  YmodemCompletion completion; // Result of the job and the cancel request
+
+  State(Job job, CancelHook cancelHook) : job(job), cancelHook(cancelHook)
+  {
+  }
+};
+
+YmodemTransfer::YmodemTransfer()
+{
+}
+
+void YmodemTransfer::run(std::shared_ptr<State> state)
+{
+  state->completion.finish(state->job());
+}
+
+#ifdef ESP_PLATFORM
+/**
+ * @brief Entry point of the FreeRTOS worker task.
+ *
+ * The task owns a heap allocated reference to the shared state, so the state
+ * stays alive until the job has returned even if every handle is destroyed.
+ *
+ * @param param Pointer to a heap allocated std::function wrapping the job.
+ */
+static void transferTask(void* param)
+{
+  std::function<void()>* body = static_cast<std::function<void()>*>(param);
+  (*body)();
+  delete body;
+  vTaskDelete(NULL);
+}
+#endif
+
+YmodemTransfer YmodemTransfer::start(Job job, CancelHook cancelHook, const YmodemTaskConfig& config)
+{
+  YmodemTransfer transfer;
+  transfer.state = std::make_shared<State>(job, cancelHook);
+
+#ifdef ESP_PLATFORM
+  if (!transfer.state->completion.valid()) {
+    YMODEM_LOGE("Failed to create transfer event group");
+    return YmodemTransfer();
+  }
+
+  std::shared_ptr<State> state = transfer.state;
+  std::function<void()>* body  = new std::function<void()>([state]() { run(state); });
+  BaseType_t             core  = (config.core < 0) ? tskNO_AFFINITY : config.core;
+  if (xTaskCreatePinnedToCore(transferTask, "ymodem", config.stackSize, body, config.priority, NULL, core) != pdPASS) {
+    YMODEM_LOGE("Failed to create transfer task");
+    delete body;
+    return YmodemTransfer();
+  }
+#else
+  (void)config;
+  std::thread(run, transfer.state).detach();
+#endif
+
+  return transfer;
+}
+
+bool YmodemTransfer::valid() const
+{
+  return state != nullptr;
+}
+
+bool YmodemTransfer::poll() const
+{
+  return state && state->completion.done();
+}
+
+bool YmodemTransfer::wait(uint32_t timeoutMs)
+{
+  return state && state->completion.wait(timeoutMs);
+}
+
+void YmodemTransfer::cancel()
+{
+  if (!state || state->completion.done()) {
+    return;
+  }
+  state->completion.cancel();
+  if (state->cancelHook) {
+    state->cancelHook();
+  }
+}
+
+bool YmodemTransfer::cancelled() const
+{
+  return state && state->completion.cancelled();
+}
+
+int YmodemTransfer::result() const
+{
+  return state ? state->completion.result() : PENDING;
+}
@@ -0,0 +1,225 @@
+/**
+ * @file YmodemAsync.h
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Asynchronous Ymodem transfers
+ * @version 0.1
+ * @date 2025-05-12
+ *
+ * This file contains the handle returned by the asynchronous transfer API.
+ * A transfer runs on its own worker: a FreeRTOS task on the ESP32 or a
+ * std::thread on the host, so the caller keeps running while the session
+ * is in progress and can poll, wait for, cancel or collect the result. The
+ * completion the handle waits on is shared with the jobs of YmodemScheduler.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef YMODEMASYNC_H
+#define YMODEMASYNC_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <stdint.h>
+
+#include "YmodemDef.h"
+
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#endif
+
+/**
+ * @brief Worker task settings for an asynchronous transfer.
+ *
+ * On the host the transfer runs on a std::thread and these settings are ignored.
+ */
+struct YmodemTaskConfig
+{
+  uint32_t stackSize = YMODEM_TASK_STACK_SIZE; /*!< Stack size of the worker task in bytes */
+  int      priority  = YMODEM_TASK_PRIORITY;   /*!< Priority of the worker task */
+  int      core      = YMODEM_TASK_CORE;       /*!< Core the worker task is pinned to, -1 for no affinity */
+};
+
+/**
+ * @brief Result of a job run by a worker, and the cancellation asked by its callers.
+ *
+ * The worker publishes the result once with finish(), the callers poll or wait for it. On
+ * the ESP32 the end is signalled with an event group, on the host with a condition variable.
+ */
+class YmodemCompletion
+{
+public:
+  /**
+   * @brief Result reported by result() until finish() is called.
+   */
+  static const int PENDING = 0x7fffffff;
+
+  YmodemCompletion();
+  ~YmodemCompletion();
+
+  YmodemCompletion(const YmodemCompletion&)            = delete;
+  YmodemCompletion& operator=(const YmodemCompletion&) = delete;
+
+  /**
+   * @brief Checks whether the completion can be waited on.
+   *
+   * @return true on the host, false on the ESP32 if its event group could not be created.
+   */
+  bool valid() const;
+
+  /**
+   * @brief Publishes the result and wakes up the callers waiting for it.
+   *
+   * @param value Result of the job. Anything the callers read once done() is true must be
+   *              written before.
+   */
+  void finish(int value);
+
+  /**
+   * @brief Checks whether finish() was called, without blocking.
+   *
+   * @return true once the result is available.
+   */
+  bool done() const;
+
+  /**
+   * @brief Blocks until finish() is called or the timeout expires.
+   *
+   * @param timeoutMs Maximum time to wait in milliseconds.
+   * @return true if the result is available, false on timeout.
+   */
+  bool wait(uint32_t timeoutMs);
+
+  /**
+   * @brief Asks the job to stop, the flag is checked by its session.
+   */
+  void cancel();
+
+  /**
+   * @brief Checks whether cancel() was called.
+   *
+   * @return true if the job was asked to stop.
+   */
+  bool cancelled() const;
+
+  /**
+   * @brief Retrieves the flag set by cancel(), to be handed to Ymodem_RunSession().
+   *
+   * @return const std::atomic<bool>* Flag set by cancel().
+   */
+  const std::atomic<bool>* cancelFlag() const;
+
+  /**
+   * @brief Retrieves the result.
+   *
+   * @return int Value given to finish(), or PENDING before.
+   */
+  int result() const;
+
+private:
+  std::atomic<bool> finished;        /**< Set once the result is available. */
+  std::atomic<bool> cancelRequested; /**< Set by cancel(). */
+  std::atomic<int>  value;           /**< Value given to finish(). */
+#ifdef ESP_PLATFORM
+  EventGroupHandle_t events; /**< Done bit set by finish(). */
+#else
+  std::mutex              lock;       /**< Protects the wait on doneSignal. */
+  std::condition_variable doneSignal; /**< Notified by finish(). */
+#endif
+};
+
+/**
+ * @brief Handle to a transfer running on a worker task.
+ *
+ * The handle can be copied freely, every copy refers to the same transfer. The
+ * transfer keeps running when all the handles are destroyed.
+ */
+class YmodemTransfer
+{
+public:
+  /**
+   * @brief Function executed by the worker, its return value is the transfer result.
+   */
+  typedef std::function<int()> Job;
+
+  /**
+   * @brief Function called by cancel() to ask the running job to stop.
+   */
+  typedef std::function<void()> CancelHook;
+
+  /**
+   * @brief Result reported by result() while the transfer is still running.
+   */
+  static const int PENDING = YmodemCompletion::PENDING;
+
+  /**
+   * @brief Constructs an empty handle that is not attached to any transfer.
+   */
+  YmodemTransfer();
+
+  /**
+   * @brief Starts a job on a new worker.
+   *
+   * @param job Function to be executed by the worker.
+   * @param cancelHook Function called by cancel() to make the job return early, may be empty.
+   * @param config Worker task settings.
+   * @return YmodemTransfer Handle to the started transfer, invalid if the worker could not be created.
+   */
+  static YmodemTransfer start(Job job, CancelHook cancelHook, const YmodemTaskConfig& config = YmodemTaskConfig());
+
+  /**
+   * @brief Checks whether the handle is attached to a transfer.
+   *
+   * @return true if the transfer was started, false otherwise.
+   */
+  bool valid() const;
+
+  /**
+   * @brief Checks whether the transfer has finished, without blocking.
+   *
+   * @return true if the transfer has finished, false if it is still running.
+   */
+  bool poll() const;
+
+  /**
+   * @brief Blocks until the transfer finishes or the timeout expires.
+   *
+   * @param timeoutMs Maximum time to wait in milliseconds.
+   * @return true if the transfer has finished, false on timeout.
+   */
+  bool wait(uint32_t timeoutMs);
+
+  /**
+   * @brief Asks the transfer to stop.
+   *
+   * The request is forwarded to the job through the cancel hook. The transfer
+   * finishes as soon as the job notices it, use wait() to know when.
+   */
+  void cancel();
+
+  /**
+   * @brief Checks whether cancel() was called on this transfer.
+   *
+   * @return true if the transfer was cancelled, false otherwise.
+   */
+  bool cancelled() const;
+
+  /**
+   * @brief Retrieves the result of the transfer.
+   *
+   * @return int Value returned by the job, or PENDING while the transfer is running.
+   */
+  int result() const;
+
+private:
+  struct State;
+  std::shared_ptr<State> state; /**< State shared between the handles and the worker. */
+
+  static void run(std::shared_ptr<State> state);
+};
+
+#endif // YMODEMASYNC_H
@@ -0,0 +1,105 @@
+/**
+ * @file YmodemBoot.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Handshake with the bootloader of a module that receives its firmware by Ymodem
+ * @version 0.1
+ * @date 2025-06-11
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "YmodemBoot.h"
+
+#include <string.h>
+
+YmodemBootTransport::YmodemBootTransport(YmodemTransport& transport) : transport(transport)
+{
+}
+
+YmodemPacketStatus YmodemBootTransport::handshake(const ResetHook& reset, const char* command, uint32_t timeoutMs)
+{
+  counters      = {};
+  pending       = false;
+  waitingHeader = false;
+
+  // Whatever the module sent before the reset is not an answer to it
+  transport.flushInput();
+  if (reset) {
+    reset();
+  }
+  resetAt = Ymodem_Micros();
+  if (command != NULL && command[0] != '\0' && transport.write((const uint8_t*)command, strlen(command)) < 0) {
+    return YMODEM_ABORTED_BY_TRANSFER;
+  }
+
+  // One byte per read: the transport returns as soon as it arrives instead of waiting for a timeout
+  uint32_t received = 0;
+  while (true) {
+    uint32_t elapsedMs = (Ymodem_Micros() - resetAt) / 1000;
+    if (elapsedMs >= timeoutMs) {
+      return YMODEM_TIMEOUT;
+    }
+    uint8_t byte;
+    int     len = transport.read(&byte, 1, timeoutMs - elapsedMs);
+    if (len == TRANSPORT_ERROR) {
+      return YMODEM_ABORTED_BY_TRANSFER;
+    }
+    if (len <= 0) {
+      continue; // Timeout, or an overrun in the banner
+    }
+
+    uint32_t at = Ymodem_Micros() - resetAt;
+    if (received++ == 0) {
+      counters.resetToFirstByteUs = at;
+    }
+    if (byte == CRC16) {
+      counters.resetToReadyUs = at;
+      pending                 = true;
+      waitingHeader           = true;
+      return YMODEM_TRANSMIT_START;
+    }
+    counters.discarded++;
+  }
+}
+
+bool YmodemBootTransport::ready() const
+{
+  return pending;
+}
+
+const YmodemBootStats& YmodemBootTransport::stats() const
+{
+  return counters;
+}
+
+int YmodemBootTransport::read(uint8_t* data, size_t size, uint32_t timeoutMs)
+{
+  if (pending && size > 0) {
+    pending = false;
+    data[0] = CRC16;
+    return 1;
+  }
+  return transport.read(data, size, timeoutMs);
+}
+
+int YmodemBootTransport::write(const uint8_t* data, size_t size)
+{
+  int len = transport.write(data, size);
+  // Control bytes are written one at a time, the header packet is the first longer write
+  if (waitingHeader && len > 1) {
+    counters.resetToHeaderUs = Ymodem_Micros() - resetAt;
+    waitingHeader            = false;
+  }
+  return len;
+}
+
+bool YmodemBootTransport::waitWriteDone(uint32_t timeoutMs)
+{
+  return transport.waitWriteDone(timeoutMs);
+}
+
+void YmodemBootTransport::flushInput()
+{
+  pending = false;
+  transport.flushInput();
+}
@@ -0,0 +1,97 @@
+/**
+ * @file YmodemBoot.h
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Handshake with the bootloader of a module that receives its firmware by Ymodem
+ * @version 0.1
+ * @date 2025-06-11
+ *
+ * A module such as the LSM1X0A is reset, told to enter its download mode, and
+ * then announces that it is ready with a 'C'. The handshake waits for that 'C'
+ * on the transport itself, so it returns as soon as the byte arrives, and keeps
+ * it for the sender session that runs next: the header packet leaves right away
+ * instead of waiting for the bootloader to repeat its 'C'.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef YMODEMBOOT_H
+#define YMODEMBOOT_H
+
+#include "YmodemSession.h"
+#include "YmodemTransport.h"
+
+#include <functional>
+
+/**
+ * @brief Latencies of the last handshake, measured from the end of the reset.
+ */
+struct YmodemBootStats
+{
+  uint32_t resetToFirstByteUs; // First byte sent by the module, banner included
+  uint32_t resetToReadyUs;     // First 'C', the module is ready to receive
+  uint32_t resetToHeaderUs;    // Header packet written by the sender session, 0 until then
+  uint32_t discarded;          // Bytes received before the 'C' (banner, menu)
+};
+
+/**
+ * @brief Transport performing the bootloader handshake before a sender session.
+ *
+ * It wraps another transport, the reads and writes are forwarded unchanged except
+ * for the 'C' found by handshake(), which the next read returns before any other
+ * byte. Run the sender session on this transport to have it answered at once.
+ */
+class YmodemBootTransport : public YmodemTransport
+{
+public:
+  /**
+   * @brief Function resetting the module, it returns once the module is out of reset.
+   */
+  typedef std::function<void()> ResetHook;
+
+  /**
+   * @brief Constructor for the YmodemBootTransport class.
+   *
+   * @param transport Transport connected to the module, it must outlive this one.
+   */
+  YmodemBootTransport(YmodemTransport& transport);
+
+  /**
+   * @brief Resets the module and waits for its first 'C'.
+   *
+   * The input is flushed, the module is reset and the command is sent. Every byte is
+   * read as soon as it arrives, the ones before the 'C' are discarded.
+   *
+   * @param reset Function resetting the module, empty if the module is reset otherwise.
+   * @param command Bytes sent once the module is out of reset to enter the download mode, NULL for none.
+   * @param timeoutMs Maximum time to wait for the 'C' after the reset, in milliseconds.
+   * @return YmodemPacketStatus YMODEM_TRANSMIT_START once the 'C' has been received, YMODEM_TIMEOUT if
+   *         it did not arrive in time, YMODEM_ABORTED_BY_TRANSFER if the transport failed.
+   */
+  YmodemPacketStatus handshake(const ResetHook& reset, const char* command, uint32_t timeoutMs);
+
+  /**
+   * @brief Tells whether the 'C' of the last handshake has not been read yet.
+   */
+  bool ready() const;
+
+  /**
+   * @brief Retrieves the latencies of the last handshake.
+   *
+   * @return const YmodemBootStats& The latencies, resetToHeaderUs is set by the first packet written after it.
+   */
+  const YmodemBootStats& stats() const;
+
+  int  read(uint8_t* data, size_t size, uint32_t timeoutMs) override;
+  int  write(const uint8_t* data, size_t size) override;
+  bool waitWriteDone(uint32_t timeoutMs) override;
+  void flushInput() override;
+
+private:
+  YmodemTransport& transport;              /**< Transport connected to the module. */
+  YmodemBootStats  counters      = {};     /**< Latencies of the last handshake. */
+  uint32_t         resetAt       = 0;      /**< Ymodem_Micros() at the end of the reset. */
+  bool             pending       = false;  /**< The 'C' is kept for the next read. */
+  bool             waitingHeader = false;  /**< The header packet of the session has not been written yet. */
+};
+
+#endif // YMODEMBOOT_H
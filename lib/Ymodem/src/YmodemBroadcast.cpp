@@ -0,0 +1,160 @@
+/**
+ * @file YmodemBroadcast.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  One-to-many Ymodem transmission
+ * @version 0.1
+ * @date 2025-05-28
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "YmodemBroadcast.h"
+
+#include <new>
+
+YmodemBlockWindow::YmodemBlockWindow(YmodemTransmitSource& source, size_t blocks)
+  : source(source), blocks(blocks), memory(new (std::nothrow) uint8_t[blocks * PACKET_1K_SIZE]), slots(new (std::nothrow) Slot[blocks]())
+{
+}
+
+bool YmodemBlockWindow::valid() const
+{
+  return blocks > 0 && memory && slots;
+}
+
+int YmodemBlockWindow::read(uint8_t* data, size_t size, uint32_t offset)
+{
+  if (size > PACKET_1K_SIZE || !valid()) {
+    return source.read(data, size, offset);
+  }
+
+  std::lock_guard<std::mutex> guard(lock);
+
+  // Block read for a session further ahead
+  for (size_t i = 0; i < blocks; i++) {
+    if (slots[i].size == size && slots[i].offset == offset) {
+      memcpy(data, memory.get() + i * PACKET_1K_SIZE, size);
+      windowHits++;
+      return (int)size;
+    }
+  }
+
+  // New block for the session furthest ahead, it replaces the oldest one
+  if (offset >= newest) {
+    uint8_t* block = memory.get() + next * PACKET_1K_SIZE;
+    int      len   = source.read(block, size, offset);
+    if (len != (int)size) {
+      slots[next].size = 0;
+      return len;
+    }
+    slots[next] = {offset, (uint32_t)size};
+    next        = (next + 1) % blocks;
+    newest      = offset + size;
+    sourceReads++;
+    memcpy(data, block, size);
+    return (int)size;
+  }
+
+  // The session is more than the window behind, the block is no longer kept
+  rereads++;
+  return source.read(data, size, offset);
+}
+
+void YmodemBlockWindow::fillStats(YmodemBroadcastStats& stats) const
+{
+  std::lock_guard<std::mutex> guard(lock);
+  stats.sourceReads = sourceReads;
+  stats.windowHits  = windowHits;
+  stats.rereads     = rereads;
+}
+
+YmodemBroadcast::YmodemBroadcast(YmodemTransmitSource& source, const char* fileName, uint32_t fileSize, size_t window)
+  : window(source, window), fileName(fileName), fileSize(fileSize), cancelRequested(false)
+{
+}
+
+bool YmodemBroadcast::addTarget(YmodemTransport& transport)
+{
+  if (count >= YMODEM_BROADCAST_MAX_TARGETS) {
+    return false;
+  }
+  targets[count++] = &transport;
+  return true;
+}
+
+void YmodemBroadcast::setAttributes(uint32_t modTime, uint32_t mode)
+{
+  this->modTime = modTime;
+  fileMode      = mode;
+}
+
+void YmodemBroadcast::setSkipUnchanged(bool enable)
+{
+  skip = enable;
+}
+
+int YmodemBroadcast::run(const YmodemTaskConfig& config, const std::atomic<bool>* cancelFlag)
+{
+  std::unique_ptr<YmodemSender> senders[YMODEM_BROADCAST_MAX_TARGETS];
+  YmodemTransfer                transfers[YMODEM_BROADCAST_MAX_TARGETS];
+
+  const std::atomic<bool>*      cancel = (cancelFlag != NULL) ? cancelFlag : &cancelRequested;
+
+  counters        = {};
+  cancelRequested = false;
+  if (!window.valid()) {
+    return YMODEM_NO_MEMORY;
+  }
+
+  // Every target gets its own session and worker, so a receiver that answers late or NAKs
+  // only delays its own port
+  uint32_t start = Ymodem_Millis();
+  for (size_t i = 0; i < count; i++) {
+    counters.results[i] = YMODEM_NO_MEMORY;
+    senders[i].reset(new (std::nothrow) YmodemSender(window, fileName, fileSize));
+    if (!senders[i]) {
+      continue;
+    }
+    YmodemSender*    sender    = senders[i].get();
+    YmodemTransport* transport = targets[i];
+    sender->setAttributes(modTime, fileMode);
+    sender->setSkipUnchanged(skip);
+
+    uint32_t*        finished  = &counters.finishedMs[i];
+
+    transfers[i] = YmodemTransfer::start(
+      [sender, transport, cancel, finished, start]() {
+        int result = Ymodem_RunSession(*sender, *transport, cancel);
+        *finished  = Ymodem_Millis() - start;
+        return result;
+      },
+      YmodemTransfer::CancelHook(), config);
+  }
+
+  int result = YMODEM_TRANSMIT_OK;
+  for (size_t i = 0; i < count; i++) {
+    if (transfers[i].valid()) {
+      while (!transfers[i].wait(NAK_TIMEOUT)) {
+      }
+      counters.results[i] = transfers[i].result();
+      counters.retries[i] = senders[i]->stats().retries;
+      counters.skipped += senders[i]->stats().skipped;
+    }
+    if (result == YMODEM_TRANSMIT_OK && counters.results[i] != YMODEM_TRANSMIT_OK) {
+      result = counters.results[i];
+    }
+  }
+  counters.elapsedMs = Ymodem_Millis() - start;
+  window.fillStats(counters);
+  return result;
+}
+
+void YmodemBroadcast::cancel()
+{
+  cancelRequested = true;
+}
+
+const YmodemBroadcastStats& YmodemBroadcast::stats() const
+{
+  return counters;
+}
@@ -0,0 +1,180 @@
+/**
+ * @file YmodemBroadcast.h
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  One-to-many Ymodem transmission
+ * @version 0.1
+ * @date 2025-05-28
+ *
+ * This file contains the broadcast transmission of one file to several
+ * receivers, each on its own transport. Every target runs its own sender
+ * session on its own worker, so ACK, NAK and retransmissions are tracked per
+ * port, and the file blocks are read once into a window shared by all the
+ * sessions.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef YMODEMBROADCAST_H
+#define YMODEMBROADCAST_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include "YmodemAsync.h"
+#include "YmodemTransmit.h"
+
+#define YMODEM_BROADCAST_MAX_TARGETS (4) /*!< Largest number of receivers of a broadcast */
+#define YMODEM_BROADCAST_WINDOW (8)      /*!< Blocks kept for the receivers lagging behind the fastest one */
+
+/**
+ * @brief Counters of a broadcast.
+ */
+struct YmodemBroadcastStats
+{
+  uint32_t sourceReads;                             // Blocks read from the source for the fastest receiver
+  uint32_t windowHits;                              // Blocks served from the window to the other receivers
+  uint32_t rereads;                                 // Blocks read again for receivers more than the window behind
+  uint32_t elapsedMs;                               // Duration of the broadcast, until the last receiver finished
+  uint32_t skipped;                                 // Targets that already held the file unchanged
+  int      results[YMODEM_BROADCAST_MAX_TARGETS];    // Result of every target, YMODEM_TRANSMIT_OK on success
+  uint32_t retries[YMODEM_BROADCAST_MAX_TARGETS];    // Packets sent again to every target
+  uint32_t finishedMs[YMODEM_BROADCAST_MAX_TARGETS]; // Time at which every target finished, from the start of the broadcast
+};
+
+/**
+ * @brief Transmit source sharing the blocks read from another source between several sessions.
+ *
+ * The most recent blocks are kept in a window. The session furthest ahead reads every block
+ * from the underlying source once, the other sessions copy it from the window. A session that
+ * falls more than the window behind reads its blocks from the underlying source again, so it
+ * never holds back the others. The source can be read from several tasks at once.
+ */
+class YmodemBlockWindow : public YmodemTransmitSource
+{
+public:
+  /**
+   * @brief Constructor for the YmodemBlockWindow class.
+   *
+   * @param source Underlying source, it must outlive the window.
+   * @param blocks Number of 1K blocks kept, allocated on the heap.
+   */
+  YmodemBlockWindow(YmodemTransmitSource& source, size_t blocks = YMODEM_BROADCAST_WINDOW);
+
+  int read(uint8_t* data, size_t size, uint32_t offset) override;
+
+  /**
+   * @brief Checks whether the window memory could be allocated.
+   *
+   * @return true if the window is usable, false otherwise.
+   */
+  bool valid() const;
+
+  /**
+   * @brief Copies the read counters of the window into the broadcast counters.
+   *
+   * @param stats Counters receiving sourceReads, windowHits and rereads.
+   */
+  void fillStats(YmodemBroadcastStats& stats) const;
+
+private:
+  struct Slot
+  {
+    uint32_t offset; // Position of the block in the file
+    uint32_t size;   // Bytes of the block, 0 while the slot is empty
+  };
+
+  YmodemTransmitSource&      source;          /**< Underlying source. */
+  size_t                     blocks;          /**< Number of slots. */
+  std::unique_ptr<uint8_t[]> memory;          /**< Data of the slots, PACKET_1K_SIZE bytes each. */
+  std::unique_ptr<Slot[]>    slots;           /**< Block held by every slot. */
+  size_t                     next        = 0; /**< Slot receiving the next new block, the oldest one. */
+  uint32_t                   newest      = 0; /**< End of the most recent block read, 0 before the first one. */
+  uint32_t                   sourceReads = 0; /**< Blocks read for the fastest session. */
+  uint32_t                   windowHits  = 0; /**< Blocks copied from the window. */
+  uint32_t                   rereads     = 0; /**< Blocks read again for a lagging session. */
+  mutable std::mutex         lock;            /**< Serializes the sessions and the underlying reads. */
+};
+
+/**
+ * @brief Transmission of one file to several receivers at once.
+ *
+ * run() starts one YmodemSender per target, each on its own worker (a FreeRTOS task on the
+ * ESP32, a std::thread on the host), and waits for all of them. A target that fails or cancels
+ * does not stop the others, and a slow target only costs extra source reads once it falls more
+ * than the window behind.
+ */
+class YmodemBroadcast
+{
+public:
+  /**
+   * @brief Constructor for the YmodemBroadcast class.
+   *
+   * @param source Origin of the file data, it must outlive the broadcast.
+   * @param fileName Name announced in the file header.
+   * @param fileSize Size of the file in bytes.
+   * @param window Number of 1K blocks kept for the lagging receivers.
+   */
+  YmodemBroadcast(YmodemTransmitSource& source, const char* fileName, uint32_t fileSize, size_t window = YMODEM_BROADCAST_WINDOW);
+
+  /**
+   * @brief Adds a receiver.
+   *
+   * @param transport Transport of the receiver, it must outlive the broadcast.
+   * @return true if the target was added, false if there are already YMODEM_BROADCAST_MAX_TARGETS.
+   */
+  bool addTarget(YmodemTransport& transport);
+
+  /**
+   * @brief Announces the modification time and the mode of the file, see YmodemSender::setAttributes().
+   *
+   * @param modTime Modification time in seconds since 1970, 0 to leave both out.
+   * @param mode Unix file mode, 0 if unknown.
+   */
+  void setAttributes(uint32_t modTime, uint32_t mode);
+
+  /**
+   * @brief Lets every target skip the file when it holds it unchanged, see YmodemSender::setSkipUnchanged().
+   *
+   * A retried broadcast then only sends the file to the targets that did not get it.
+   *
+   * @param enable true to let the targets skip the file, false by default.
+   */
+  void setSkipUnchanged(bool enable);
+
+  /**
+   * @brief Sends the file to every target and waits until all of them have finished.
+   *
+   * @param config Settings of the worker of every target.
+   * @param cancelFlag Optional flag cancelling every target as soon as it becomes true, used instead of cancel().
+   * @return int YMODEM_TRANSMIT_OK if every target received the file, otherwise the result of the
+   *         first target that failed. The result of each target is in stats().
+   */
+  int run(const YmodemTaskConfig& config = YmodemTaskConfig(), const std::atomic<bool>* cancelFlag = NULL);
+
+  /**
+   * @brief Cancels the targets still running, CA CA is sent to each of them.
+   */
+  void cancel();
+
+  /**
+   * @brief Retrieves the counters of the last run.
+   *
+   * @return const YmodemBroadcastStats& Reference to the counters.
+   */
+  const YmodemBroadcastStats& stats() const;
+
+private:
+  YmodemBlockWindow    window;                                /**< Blocks shared by the sessions. */
+  const char*          fileName;                              /**< Name announced in the file header. */
+  uint32_t             fileSize;                              /**< Size of the file in bytes. */
+  YmodemTransport*     targets[YMODEM_BROADCAST_MAX_TARGETS]; /**< Transports of the receivers. */
+  size_t               count    = 0;                          /**< Number of targets. */
+  uint32_t             modTime  = 0;                          /**< Modification time announced in the header. */
+  uint32_t             fileMode = 0;                          /**< Mode announced in the header. */
+  bool                 skip     = false;                      /**< True to let the targets skip the file. */
+  std::atomic<bool>    cancelRequested;                       /**< Set by cancel(). */
+  YmodemBroadcastStats counters = {};                         /**< Counters reported by stats(). */
+};
+
+#endif // YMODEMBROADCAST_H
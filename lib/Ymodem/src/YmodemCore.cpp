@@ -14,10 +14,14 @@
  */
 
 #include "YmodemCore.h"
+#include "fileAppender.h"
 
-Ymodem::Ymodem()
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+Ymodem::Ymodem() : Ymodem(YMODEM_RX_PIN, YMODEM_TX_PIN)
 {
-  Ymodem(YMODEM_RX_PIN, YMODEM_TX_PIN);
 }
 
 Ymodem::Ymodem(int rxPin, int txPin)
@@ -28,17 +32,9 @@ Ymodem::Ymodem(int rxPin, int txPin)
 
 void Ymodem::Ymodem_Config(int rxPin, int txPin)
 {
-  uart_config_t uart_config = {
-    .baud_rate  = 115200,
-    .data_bits  = UART_DATA_8_BITS,
-    .parity     = UART_PARITY_DISABLE,
-    .stop_bits  = UART_STOP_BITS_1,
-    .flow_ctrl  = UART_HW_FLOWCTRL_DISABLE,
-    .source_clk = UART_SCLK_APB,
-  };
-  uart_param_config(EX_UART_NUM, &uart_config);
-  uart_driver_install(EX_UART_NUM, BUF_SIZE * 2, 0, 0, NULL, 0);
-  setYmodemPins(rxPin, txPin);
+  uart.begin(rxPin, txPin);
+  Ymodem_SetTransport(&link);
+  Ymodem_StartLogTask();
 }
 
 void Ymodem::setLedPin(int pin)
@@ -53,8 +49,7 @@ void Ymodem::setLedPin(int pin)
   };
   gpio_config(&conf);
 
-  std::string doneMsg = std::string("LED pin set to ") + std::to_string(ledPin) + "\n";
-  uart_write_bytes(UART_NUM_0, doneMsg.c_str(), doneMsg.length());
+  YMODEM_LOGI("LED pin set to %d", ledPin);
 }
 
 int Ymodem::getLedPin()
@@ -62,10 +57,142 @@ int Ymodem::getLedPin()
   return ledPin;
 }
 
+const YmodemRxStats& Ymodem::getRxStats()
+{
+  return uart.getStats();
+}
+
+const YmodemTxStats& Ymodem::getTxStats()
+{
+  return uart.getTxStats();
+}
+
+const YmodemSessionStats& Ymodem::getSessionStats()
+{
+  return sessionStats;
+}
+
+const YmodemBroadcastStats& Ymodem::getBroadcastStats()
+{
+  return broadcastStats;
+}
+
+const YmodemFootprint& Ymodem::getFootprint()
+{
+  return footprint;
+}
+
+void Ymodem::measureFootprint()
+{
+  footprint.stackFree   = uxTaskGetStackHighWaterMark(NULL); // In bytes on the ESP32
+  footprint.heapMinFree = heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT);
+  footprint.arenaPeak   = arena.peak();
+}
+
+const YmodemWriteStats& Ymodem::getWriteStats()
+{
+  return writeStats;
+}
+
+void Ymodem::setSpaceReservation(bool enabled)
+{
+  reserveSpace = enabled;
+}
+
+void Ymodem::setProtocol(YmodemProtocol protocol)
+{
+  this->protocol = protocol;
+}
+
+void Ymodem::setResume(bool enabled)
+{
+  resume = enabled;
+}
+
+bool Ymodem::setBlockSize(size_t size)
+{
+  if (size != PACKET_1K_SIZE && size != PACKET_4K_SIZE && size != PACKET_8K_SIZE) {
+    return false;
+  }
+  if (size > YMODEM_MAX_BLOCK_SIZE) {
+    YMODEM_LOGW("Blocks of %u bytes need YMODEM_MAX_BLOCK_SIZE of at least as much", (unsigned)size);
+    return false;
+  }
+  blockSize = size;
+  return true;
+}
+
+void Ymodem::setSkipUnchanged(bool enabled)
+{
+  skipUnchanged = enabled;
+}
+
+bool Ymodem::setFec(bool enabled)
+{
+  if (enabled && YMODEM_ARENA_FRAME_SIZE < YMODEM_FEC_FRAME_SIZE(YMODEM_MAX_BLOCK_SIZE)) {
+    YMODEM_LOGW("Packets with parity need YMODEM_FEC_ARENA set to 1");
+    return false;
+  }
+  fec = enabled;
+  return true;
+}
+
+void Ymodem::setDigest(YmodemDigestType type)
+{
+  digestType = type;
+}
+
+const YmodemDigest& Ymodem::getDigest()
+{
+  return lastDigest;
+}
+
+void Ymodem::setTrace(YmodemTrace* trace)
+{
+  this->trace = trace;
+  link.setTrace(trace);
+}
+
+error_code_littefs Ymodem::dumpTrace(const char* path)
+{
+  if (trace == NULL) {
+    return ERROR_OPENNING_FILE;
+  }
+
+  FileSystem fs;
+  fs.deleteFile(path);
+  FileAppender file(fs, path);
+  if (!file.isOpen()) {
+    return ERROR_OPENNING_FILE;
+  }
+
+  error_code_littefs err = LITTLEFS_OK;
+  trace->dump([&file, &err](const uint8_t* data, size_t size) {
+    err = file.append(data, size);
+    return err == LITTLEFS_OK;
+  });
+  error_code_littefs closed = file.close();
+  return (err != LITTLEFS_OK) ? err : closed;
+}
+
 void Ymodem::setYmodemPins(int rxPin, int txPin)
 {
-  uart_set_pin(EX_UART_NUM, txPin, rxPin, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
-  uart_set_baudrate(EX_UART_NUM, 115200);
+  uart.setPins(rxPin, txPin);
+}
+
+void Ymodem::setBaudRate(uint32_t baudRate)
+{
+  uart.setBaudRate(baudRate);
+}
+
+void Ymodem::setFlowControl(int rtsPin, int ctsPin, uint8_t threshold)
+{
+  uart.setFlowControl(rtsPin, ctsPin, threshold);
+}
+
+void Ymodem::setTransport(YmodemTransport* transport)
+{
+  link.setTransport((transport != NULL) ? *transport : uart);
 }
 
 #ifdef YMODEM_LSM1X0A
@@ -90,35 +217,26 @@ void performResetCycle(int pin, int delayMs)
   vTaskDelay(pdMS_TO_TICKS(delayMs));
 }
 
-void sendResetCommand()
+YmodemPacketStatus Ymodem::resetExternalModule(int resetPin)
 {
-  uart_write_bytes(EX_UART_NUM, "1", 1);
-}
+  constexpr uint32_t timeoutMs    = 10000; // Timeout in milliseconds
+  constexpr int      resetDelayMs = 10;    // Delay in milliseconds
 
-void waitForModuleResponse(int timeoutMs)
-{
-  unsigned long startTime = millis();
-  while (millis() - startTime < timeoutMs) {
-    char response[2] = {0};
-    int  bytesRead   = uart_read_bytes(EX_UART_NUM, (uint8_t*)response, sizeof(response) - 1, 100 / portTICK_RATE_MS);
-    if (bytesRead > 0 && response[0] == 'C') {
-      log_i("Module ready for Ymodem transfer");
-      return; // Exit loop if 'C' is received
-    }
-    // uart_write_bytes(UART_NUM_0, response, bytesRead); // Send response to UART_NUM_0 for debugging
+  configureGpioPin(resetPin); // Configure the GPIO pin as output
+  // Reset, send the command selecting the download, and keep the first 'C' for transmit()
+  YmodemPacketStatus err = boot.handshake([resetPin]() { performResetCycle(resetPin, resetDelayMs); }, "1", timeoutMs);
+  if (err != YMODEM_TRANSMIT_START) {
+    YMODEM_LOGE("Module not responding after reset");
+    return err;
   }
-  log_e("Module not responding after reset");
+  YMODEM_LOGI("Module ready for Ymodem transfer, first byte after %u us, 'C' after %u us", boot.stats().resetToFirstByteUs,
+              boot.stats().resetToReadyUs);
+  return err;
 }
 
-void Ymodem::resetExternalModule(int resetPin)
+const YmodemBootStats& Ymodem::getBootStats()
 {
-  constexpr int timeoutMs    = 10000; // Timeout in milliseconds
-  constexpr int resetDelayMs = 10;    // Delay in milliseconds
-
-  configureGpioPin(resetPin);                // Configure the GPIO pin as output
-  performResetCycle(resetPin, resetDelayMs); // Perform reset cycle
-  sendResetCommand();                        // Send reset command to the module
-  waitForModuleResponse(timeoutMs);          // Wait for response from the module
+  return boot.stats();
 }
 #endif
 
@@ -140,26 +258,126 @@ void Ymodem::endYmodemSession()
 
 int Ymodem::receive(fs::File& ffd, unsigned int maxsize, char* getname)
 {
-  int          size         = 0;
-  unsigned int session_done = 0, errors = 0;
+  arena.reset();
+  uint8_t*       frame = arena.allocate(YMODEM_ARENA_FRAME_SIZE);
+  uint8_t*       rx    = arena.allocate(YMODEM_FRAME_SIZE);
+  YmodemFileSink sink(ffd, getname, reserveSpace);
+  YmodemReceiver ymodem(sink, maxsize, frame, YMODEM_ARENA_FRAME_SIZE);
+  ZmodemReceiver zmodem(sink, maxsize, frame);
+  // Escaped subpackets may take twice their size in the RX buffer of BUF_SIZE * 2 bytes, with
+  // flow control RTS holds the sender back and the whole file is streamed
+  zmodem.setWindow(uart.flowControl() ? 0 : BUF_SIZE);
+  zmodem.setResume(resume);
+  ymodem.setBlockSize(blockSize);
+  ymodem.setFec(fec);
+  YmodemSession& receiver = (protocol == YMODEM_PROTOCOL_ZMODEM) ? (YmodemSession&)zmodem : ymodem;
+  receiver.setDigest(digestType);
 
-  while (!session_done) {
-    int result = handleFileSession(ffd, maxsize, getname, &session_done, &errors);
-    if (result < 0) {
-      size = result; // Código de error
-      break;
-    }
-    size = result; // Tamaño del archivo recibido
+  uint32_t start       = millis();
+  int      size        = Ymodem_RunSession(receiver, link, &cancelRequested, YmodemEventHook(), rx);
+  sessionStats         = receiver.stats();
+  lastDigest           = receiver.digest();
+  writeStats           = sink.stats();
+  writeStats.elapsedMs = millis() - start;
+  cancelRequested      = false;
+  measureFootprint();
+  if (sessionStats.repaired > 0) {
+    YMODEM_LOGI("%u damaged packets repaired with their parity", sessionStats.repaired);
   }
 
   endYmodemSession();
   return size;
 }
 
-YmodemPacketStatus Ymodem::transmit(const char* sendFileName)
+YmodemPacketStatus Ymodem::transmit(const char* sendFileName, const char* headerDigest)
+{
+  YmodemPacketStatus err = transmitFile(sendFileName, headerDigest);
+  cancelRequested        = false;
+  return err;
+}
+
+YmodemPacketStatus Ymodem::broadcast(const char* sendFileName, YmodemTransport* const targets[], size_t count, const YmodemTaskConfig& config)
+{
+  if (count > YMODEM_BROADCAST_MAX_TARGETS) {
+    YMODEM_LOGE("Broadcast to %u targets, at most %d are supported", (unsigned)count, YMODEM_BROADCAST_MAX_TARGETS);
+    return YMODEM_BUFFER_OVERFLOW;
+  }
+
+  FileSystem   fs;
+  unsigned int sizeFile = fs.getFileSize(sendFileName);
+  if (sizeFile == 0) {
+    return YMODEM_READ_ERROR;
+  }
+  const char* fileName = (sendFileName[0] == '/') ? sendFileName + 1 : sendFileName;
+
+  YmodemFileSource source(fs, sendFileName);
+  YmodemBroadcast  sender(source, fileName, sizeFile);
+  for (size_t i = 0; i < count; i++) {
+    sender.addTarget(*targets[i]);
+  }
+  if (skipUnchanged) {
+    sender.setAttributes(fs.getLastWrite(sendFileName), 0);
+    sender.setSkipUnchanged(true);
+  }
+
+  int err         = sender.run(config, &cancelRequested);
+  broadcastStats  = sender.stats();
+  cancelRequested = false;
+  YMODEM_LOGI("Broadcast to %u targets in %u ms, %u blocks read, %u read again, %u skipped", (unsigned)count, broadcastStats.elapsedMs,
+              broadcastStats.sourceReads, broadcastStats.rereads, broadcastStats.skipped);
+  return (YmodemPacketStatus)err;
+}
+
+YmodemTransfer Ymodem::receiveAsync(fs::File& ffd, unsigned int maxsize, char* getname, const YmodemTaskConfig& config)
+{
+  fs::File file = ffd;
+  return YmodemTransfer::start([this, file, maxsize, getname]() mutable { return receive(file, maxsize, getname); }, [this]() { cancel(); },
+                               config);
+}
+
+YmodemTransfer Ymodem::transmitAsync(const char* sendFileName, const YmodemTaskConfig& config)
 {
-  YmodemPacketStatus err;
-  FileSystem         fs;
+  std::string fileName(sendFileName);
+  return YmodemTransfer::start([this, fileName]() { return (int)transmit(fileName.c_str()); }, [this]() { cancel(); }, config);
+}
+
+void Ymodem::cancel()
+{
+  cancelRequested = true;
+}
+
+/**
+ * @brief Formats a progress record of a transmission, the drain task prints it.
+ *
+ * @param text Buffer receiving the progress bar.
+ * @param size Size of the buffer.
+ * @param args Bytes acknowledged by the receiver, size of the file and milliseconds since the start.
+ * @return int Length of the text.
+ */
+static int formatProgress(char* text, size_t size, const uint32_t* args)
+{
+  uint32_t offset      = args[0];
+  uint32_t totalSize   = args[1];
+  uint32_t elapsedTime = args[2];
+  int      progress    = ((uint64_t)offset * 100) / totalSize;
+  int      filled      = ((uint64_t)offset * PROGRESS_BAR_WIDTH) / totalSize;
+
+  uint32_t remainingTime = 0;
+  if (offset > 0 && offset < totalSize) {
+    uint32_t estimatedTotalTime = ((uint64_t)elapsedTime * totalSize) / offset;
+    remainingTime               = (estimatedTotalTime > elapsedTime) ? (estimatedTotalTime - elapsedTime) / 1000 : 0;
+  }
+
+  // One color change per run of cells instead of one per cell keeps the line short
+  char cells[PROGRESS_BAR_WIDTH];
+  memset(cells, ' ', sizeof(cells));
+  return snprintf(text, size, "Progress: [\033[42m%.*s\033[41m%.*s\033[0m] %d%% Time: %um %us  \r%s", filled, cells, PROGRESS_BAR_WIDTH - filled,
+                  cells, progress, (unsigned)(remainingTime / 60), (unsigned)(remainingTime % 60), (offset >= totalSize) ? "\n" : "");
+}
+
+YmodemPacketStatus Ymodem::transmitFile(const char* sendFileName, const char* headerDigest)
+{
+  FileSystem fs;
 
   unsigned int sizeFile = fs.getFileSize(sendFileName);
   if (sizeFile == 0) {
@@ -167,42 +385,59 @@ YmodemPacketStatus Ymodem::transmit(const char* sendFileName)
   }
 
   // Correct the file name if it starts with '/'
-  char* fileName = (char*)sendFileName;
+  const char* fileName = sendFileName;
   if (fileName[0] == '/') {
     fileName++;
   }
 
-  // Wait for response from receiver
-  err = waitForReceiverResponse();
-  if (err != YMODEM_TRANSMIT_START) {
-    return err;
+  arena.reset();
+  uint8_t*         frame = arena.allocate(YMODEM_ARENA_FRAME_SIZE);
+  uint8_t*         rx    = arena.allocate(YMODEM_FRAME_SIZE);
+  YmodemFileSource source(fs, sendFileName);
+  YmodemSender     ymodem(source, fileName, sizeFile, frame, YMODEM_ARENA_FRAME_SIZE);
+  ZmodemSender     zmodem(source, fileName, sizeFile, frame);
+  ymodem.setHeaderDigest(headerDigest);
+  ymodem.setBlockSize(blockSize);
+  if (skipUnchanged) {
+    ymodem.setAttributes(fs.getLastWrite(sendFileName), 0);
+    ymodem.setSkipUnchanged(true);
   }
+  ymodem.setFec(fec);
+  zmodem.setResume(resume);
+  YmodemSession& sender = (protocol == YMODEM_PROTOCOL_ZMODEM) ? (YmodemSession&)zmodem : ymodem;
+  sender.setDigest(digestType);
+  unsigned long startTime = millis();
 
-  // Send initial packet
-  err = sendInitialPacket(fileName, sizeFile);
-  if (err != YMODEM_RECEIVED_OK) {
-    return err;
+  // The hook runs between two blocks, it only stores the progress for the drain task
+  static const YmodemLogEvent progressEvent = {YMODEM_LOG_INFO, NULL, formatProgress};
+  YmodemEventHook             progress      = [sizeFile, startTime](YmodemSession& session, uint8_t events) {
+    if (events & YMODEM_EVENT_BLOCK) {
+      Ymodem_Log().log(&progressEvent, session.stats().bytes, sizeFile, millis() - startTime);
+      LED_toggle();
+    }
+  };
+  bool handover = boot.ready();
+  int  err      = Ymodem_RunSession(sender, boot, &cancelRequested, progress, rx);
+  sessionStats  = sender.stats();
+  lastDigest    = sender.digest();
+  measureFootprint();
+  if (sessionStats.skipped > 0) {
+    YMODEM_LOGI("File skipped, the receiver holds it unchanged, %u bytes not sent", sessionStats.skippedBytes);
   }
-
-  // Send file blocks
-  err = sendFileBlocks(sendFileName, fs);
-  if (err != YMODEM_TRANSMIT_OK) {
-    return err;
+  if (ymodem.droppedFields() != YMODEM_FIELD_NONE) {
+    YMODEM_LOGW("Header fields 0x%02x left out, the file name is too long for them", ymodem.droppedFields());
   }
-
-  // Send EOT
-  err = sendEOT();
-  if (err != YMODEM_RECEIVED_OK) {
-    return err;
+  if (handover) {
+    YMODEM_LOGI("Header sent %u us after the reset of the module", boot.stats().resetToHeaderUs);
   }
 
-  // Send last packet
-  err = sendLastPacket();
-  if (err != YMODEM_RECEIVED_OK) {
-    return err;
+#if YMODEM_LED_ACT
+  if (err == YMODEM_TRANSMIT_OK) {
+    digitalWrite(YMODEM_LED_ACT, YMODEM_LED_ACT_ON ^ 1);
   }
+#endif
 
-  return YMODEM_TRANSMIT_OK; // file transmitted successfully
+  return (YmodemPacketStatus)err;
 }
 
 const char* Ymodem::errorMessage(YmodemPacketStatus err)
@@ -271,6 +506,18 @@ const char* Ymodem::errorMessage(YmodemPacketStatus err)
     case YMODEM_READ_ERROR:
       return "Error reading file, check file system";
       break;
+    case YMODEM_DIGEST_ERROR:
+      return "File digest does not match the header";
+      break;
+    case YMODEM_NO_SPACE:
+      return "Not enough space for the file size announced in the header";
+      break;
+    case YMODEM_NO_MEMORY:
+      return "Not enough memory for the packet buffers";
+      break;
+    case YMODEM_HEADER_OVERFLOW:
+      return "File name or digest too long for the header";
+      break;
     default:
       return "Unknown error";
       break;
@@ -15,8 +15,38 @@
 #ifndef YMODEMCORE_H
 #define YMODEMCORE_H
 
+#include "YmodemAsync.h"
+#include "YmodemBoot.h"
+#include "YmodemBroadcast.h"
+#include "YmodemFile.h"
+#include "YmodemLog.h"
 #include "YmodemReceive.h"
+#include "YmodemScheduler.h"
+#include "YmodemTcp.h"
+#include "YmodemTrace.h"
 #include "YmodemTransmit.h"
+#include "YmodemUart.h"
+#include "ZmodemReceive.h"
+#include "ZmodemTransmit.h"
+
+/**
+ * @brief Protocol spoken by the transfers of the Ymodem class.
+ */
+enum YmodemProtocol : uint8_t
+{
+  YMODEM_PROTOCOL_YMODEM, // Ymodem batch with 1K blocks, the default
+  YMODEM_PROTOCOL_ZMODEM, // Zmodem streaming with positional error recovery, compatible with lrzsz
+};
+
+/**
+ * @brief Memory taken by the last transfer.
+ */
+struct YmodemFootprint
+{
+  uint32_t stackFree;   // Smallest amount of free stack of the task that ran the transfer, in bytes
+  uint32_t heapMinFree; // Smallest amount of free heap since boot, in bytes
+  uint32_t arenaPeak;   // Bytes of the packet arena used by the sessions
+};
 
 /**
  * @brief  Ymodem class
@@ -25,6 +55,10 @@
  * using the Ymodem protocol. It encapsulates the low-level packet processing
  * and communication functions to simplify the file transfer process.
  *
+ * The packet buffers of every transfer are taken from an arena of YMODEM_ARENA_SIZE
+ * bytes allocated by the constructor, so a transfer needs no 1 KB array on the stack
+ * of the calling task and no heap allocation of its own.
+ *
  */
 class Ymodem
 {
@@ -68,10 +102,12 @@ public:
    * - Data bits: 8
    * - Parity: Disabled
    * - Stop bits: 1
-   * - Flow control: Disabled
+   * - Flow control: Disabled, see setFlowControl()
    * - Source clock: APB
    *
-   * It also installs the UART driver and sets the RX and TX pins for Ymodem communication.
+   * It also installs the UART driver with an event queue, tunes the RX timeout and RX FIFO
+   * threshold so that the protocol task is only woken up by UART events, and sets the RX and
+   * TX pins for Ymodem communication.
    */
   void Ymodem_Config(int rxPin = YMODEM_RX_PIN, int txPin = YMODEM_TX_PIN);
 
@@ -92,16 +128,80 @@ public:
    *         - -7: User abort
    *         - -8: Timeout
    *         - -9: File size exceeds maxsize
+   *
+   * @note Worst-case stack, besides the file system write: about 0.9 KB for the sink, the
+   *       YmodemReceiver, the ZmodemReceiver and Ymodem_RunSession, the packets are in the arena.
    */
   int receive(fs::File& ffd, unsigned int maxsize, char* getname);
 
   /**
-   * @brief Transmits a file using the Ymodem protocol.
+   * @brief Transmits a file using the Ymodem protocol, or Zmodem after setProtocol().
    *
    * @param sendFileName The name of the file to be transmitted.
+   * @param headerDigest Optional digest of the file announced in the header, such as "sha256:<hex>".
+   *                     The receiver verifies the file against it before its final ACK.
    * @return YmodemPacketStatus Status code indicating the result of the transmission.
+   *
+   * @note Worst-case stack, besides the file system read: about 1 KB for the source, the
+   *       YmodemSender, the ZmodemSender, Ymodem_RunSession and the progress bar, the packets
+   *       are in the arena.
+   */
+  YmodemPacketStatus transmit(const char* sendFileName, const char* headerDigest = NULL);
+
+  /**
+   * @brief Transmits a file to several receivers at once.
+   *
+   * Every block is read once from LittleFS and sent to all the targets. Each target runs its
+   * own session on its own worker task, so its ACK, NAK and retransmissions do not wait on the
+   * other ports, and a target that fails does not stop the others. The UART of this instance
+   * is only used if it is passed as one of the targets.
+   *
+   * @param sendFileName The name of the file to be transmitted.
+   * @param targets Transports of the receivers, such as UartTransport instances already started with begin().
+   * @param count Number of targets, at most YMODEM_BROADCAST_MAX_TARGETS.
+   * @param config Settings of the worker task of every target.
+   * @return YmodemPacketStatus YMODEM_TRANSMIT_OK if every target received the file, otherwise the
+   *         status of the first target that failed. The status of each target is in getBroadcastStats().
+   */
+  YmodemPacketStatus broadcast(const char* sendFileName, YmodemTransport* const targets[], size_t count,
+                               const YmodemTaskConfig& config = YmodemTaskConfig());
+
+  /**
+   * @brief Receives a file on a worker task without blocking the caller.
+   *
+   * The session runs exactly like receive(), on a task created with the given settings.
+   * The file handle is copied into the task, but the buffer pointed to by getname must
+   * stay valid until the transfer has finished.
+   *
+   * @param ffd File where the received data will be written.
+   * @param maxsize Maximum size of the data to be received.
+   * @param getname Pointer to a character array where the name of the received file will be stored.
+   * @param config Worker task stack size, priority and core affinity.
+   * @return YmodemTransfer Handle to poll, wait for or cancel the transfer. Its result is the
+   *         value returned by receive().
    */
-  YmodemPacketStatus transmit(const char* sendFileName);
+  YmodemTransfer receiveAsync(fs::File& ffd, unsigned int maxsize, char* getname, const YmodemTaskConfig& config = YmodemTaskConfig());
+
+  /**
+   * @brief Transmits a file on a worker task without blocking the caller.
+   *
+   * The session runs exactly like transmit(), on a task created with the given settings.
+   * The file name is copied into the task.
+   *
+   * @param sendFileName The name of the file to be transmitted.
+   * @param config Worker task stack size, priority and core affinity.
+   * @return YmodemTransfer Handle to poll, wait for or cancel the transfer. Its result is the
+   *         YmodemPacketStatus returned by transmit().
+   */
+  YmodemTransfer transmitAsync(const char* sendFileName, const YmodemTaskConfig& config = YmodemTaskConfig());
+
+  /**
+   * @brief Asks the transfer in progress to stop.
+   *
+   * The transfer sends CA to the peer and returns YMODEM_ABORTED_BY_TRANSFER the next
+   * time it waits for data. It can be called from any task.
+   */
+  void cancel();
 
   /**
    * @brief Sets the pin number for the LED.
@@ -119,6 +219,176 @@ public:
    */
   int getLedPin();
 
+  /**
+   * @brief Retrieves the UART receive counters.
+   *
+   * The counters report how many times the protocol task was woken up by the UART
+   * driver, how many reads completed, and how many FIFO overflow and buffer full
+   * events were handled since the last call to Ymodem_Config().
+   *
+   * @return const YmodemRxStats& Reference to the current counters.
+   */
+  const YmodemRxStats& getRxStats();
+
+  /**
+   * @brief Retrieves the UART transmit counters.
+   *
+   * The packets are queued in the TX ring buffer of the driver and sent in the background,
+   * blockedUs reports how long write() still kept the protocol task waiting for room.
+   *
+   * @return const YmodemTxStats& Reference to the current counters.
+   */
+  const YmodemTxStats& getTxStats();
+
+  /**
+   * @brief Retrieves the counters of the last transfer.
+   *
+   * @return const YmodemSessionStats& Packets, retries, timeouts and file bytes of the last
+   *         receive() or transmit().
+   */
+  const YmodemSessionStats& getSessionStats();
+
+  /**
+   * @brief Retrieves the counters of the last broadcast().
+   *
+   * @return const YmodemBroadcastStats& Status and retries of every target, source reads and durations.
+   */
+  const YmodemBroadcastStats& getBroadcastStats();
+
+  /**
+   * @brief Retrieves the memory taken by the last transfer.
+   *
+   * The free stack is the high water mark of the task that ran the transfer. An asynchronous
+   * transfer runs on its own task, so it is the peak of that transfer alone, use it to size
+   * YmodemTaskConfig::stackSize.
+   *
+   * @return const YmodemFootprint& Reference to the figures.
+   */
+  const YmodemFootprint& getFootprint();
+
+  /**
+   * @brief Retrieves the write counters of the last receive().
+   *
+   * The size announced in the header is reserved before the first block, so a file that does
+   * not fit fails with YMODEM_NO_SPACE right away. The counters report the reservation, the
+   * write latency and the duration of the session, which is the time to failure when it failed.
+   *
+   * @return const YmodemWriteStats& Reference to the counters.
+   */
+  const YmodemWriteStats& getWriteStats();
+
+  /**
+   * @brief Enables or disables the space reservation of receive().
+   *
+   * The space is reserved in the LittleFS FileSystem. Disable it when the files are
+   * received on another file system. It is enabled by default.
+   *
+   * @param enabled true to reserve the announced size, false to write without reserving.
+   */
+  void setSpaceReservation(bool enabled);
+
+  /**
+   * @brief Selects the protocol of the next receive() and transmit().
+   *
+   * Zmodem streams the file without waiting for an acknowledgement per block, and a damaged
+   * subpacket only costs the data sent since, so it keeps the line busy on links with latency
+   * or errors. The header digest of transmit() is not sent with Zmodem. The broadcasts always
+   * use Ymodem.
+   *
+   * @param protocol YMODEM_PROTOCOL_YMODEM by default.
+   */
+  void setProtocol(YmodemProtocol protocol);
+
+  /**
+   * @brief Continues the interrupted Zmodem transfers instead of starting over.
+   *
+   * A receive() keeps the bytes the file already holds and asks the sender for the rest, so the
+   * file must be opened for appending. A transmit() asks the receiver for the same with ZCRESUM.
+   * It has no effect with Ymodem.
+   *
+   * @param enabled true to resume, false by default.
+   */
+  void setResume(bool enabled);
+
+  /**
+   * @brief Negotiates blocks larger than 1 KB with the peers running this library.
+   *
+   * transmit() announces the size in the file header and receive() accepts it, so the header,
+   * the ACK turnaround and the flash write call are paid once per 4 or 8 KB. A peer that does
+   * not announce or accept it keeps the standard 1K packets. It has no effect with Zmodem and
+   * the broadcasts.
+   *
+   * @param size PACKET_1K_SIZE by default, PACKET_4K_SIZE or PACKET_8K_SIZE, up to
+   *             YMODEM_MAX_BLOCK_SIZE, which sizes the packet buffer of the arena.
+   * @return true if the size is supported, false otherwise.
+   */
+  bool setBlockSize(size_t size);
+
+  /**
+   * @brief Lets the receivers skip a file they already hold unchanged.
+   *
+   * transmit() and broadcast() then announce the LittleFS modification time of the file next to
+   * the digest given to transmit(), which keeps its room when both do not fit; a receiver holding the same file answers with SKIP and the
+   * data is not sent. getSessionStats() counts the skipped files and bytes. receive() writes
+   * into the file opened by the caller, so it has nothing to compare and never skips.
+   *
+   * @param enabled true to let the receivers skip unchanged files, false by default.
+   */
+  void setSkipUnchanged(bool enabled);
+
+  /**
+   * @brief Adds Reed-Solomon parity to the blocks exchanged with the peers running this library.
+   *
+   * On a noisy link the receiver repairs most damaged blocks itself instead of asking for
+   * them again, at the cost of about 7 % more bytes per block. transmit() offers it in the
+   * file header and receive() accepts it; other peers keep the standard packets.
+   * getSessionStats() counts the repaired packets. It has no effect with Zmodem and the
+   * broadcasts.
+   *
+   * @param enabled true to use the parity with the peers that support it, false by default.
+   * @return true if the packet buffer of the arena holds the packets with parity, which
+   *         needs YMODEM_FEC_ARENA, false otherwise.
+   */
+  bool setFec(bool enabled);
+
+  /**
+   * @brief Selects the digest computed over the file payload by the next transfers.
+   *
+   * The digest is computed as the blocks flow, so the file does not have to be read
+   * again to be checked. A received file whose header announces a digest is always
+   * verified with the announced algorithm, and refused with YMODEM_DIGEST_ERROR when
+   * it does not match.
+   *
+   * @param type Digest algorithm, YMODEM_DIGEST_NONE by default.
+   */
+  void setDigest(YmodemDigestType type);
+
+  /**
+   * @brief Retrieves the digest of the last file transferred.
+   *
+   * @return const YmodemDigest& Reference to the digest, YMODEM_DIGEST_NONE if none was computed.
+   */
+  const YmodemDigest& getDigest();
+
+  /**
+   * @brief Records the bytes sent and received on the UART into a trace.
+   *
+   * Every byte of the next transfers is copied with its timestamp into the ring of the trace,
+   * nothing is formatted while the session runs. The broadcast targets are not recorded.
+   *
+   * @param trace Trace receiving the records, NULL to stop recording. It must outlive the transfers.
+   */
+  void setTrace(YmodemTrace* trace);
+
+  /**
+   * @brief Writes the trace set with setTrace() into a file of the LittleFS FileSystem.
+   *
+   * @param path Path of the file, it is replaced.
+   * @return error_code_littefs LITTLEFS_OK on success, ERROR_OPENNING_FILE if there is no trace
+   *         or the file cannot be created, or the error of the write.
+   */
+  error_code_littefs dumpTrace(const char* path);
+
   /**
    * @brief Configures the UART pins and sets the baud rate for Ymodem communication.
    *
@@ -130,6 +400,40 @@ public:
    */
   void setYmodemPins(int rxPin, int txPin);
 
+  /**
+   * @brief Sets the baud rate of the UART, 115200 by default.
+   *
+   * Above 460800 baud, enable setFlowControl() as well: the flash writes of LittleFS keep the
+   * UART interrupt from draining its 128-byte FIFO for longer than it takes to fill it.
+   *
+   * @param baudRate Baud rate in bits per second.
+   */
+  void setBaudRate(uint32_t baudRate);
+
+  /**
+   * @brief Enables RTS/CTS hardware flow control on the UART.
+   *
+   * The receiver holds the sender back with RTS while it writes to LittleFS, instead of losing
+   * the bytes that arrive meanwhile and asking for them again. A Zmodem receive() then lets
+   * the sender stream the whole file without waiting for acknowledgements.
+   *
+   * @param rtsPin The GPIO pin number driving RTS, UART_PIN_NO_CHANGE to disable flow control.
+   * @param ctsPin The GPIO pin number reading CTS.
+   * @param threshold RX FIFO level, in bytes, at which RTS is deasserted.
+   */
+  void setFlowControl(int rtsPin = YMODEM_RTS_PIN, int ctsPin = YMODEM_CTS_PIN, uint8_t threshold = UART_RX_FLOW_THRESHOLD);
+
+  /**
+   * @brief Carries the next receive() and transmit() over another transport instead of the UART.
+   *
+   * A TcpTransport connected with connect() or accept() moves the files over WiFi, at the speed of
+   * the network instead of the baud rate. setTrace() records the bytes of that transport as well,
+   * getRxStats() and getTxStats() keep reporting the UART.
+   *
+   * @param transport Transport already connected, it must outlive the transfers. NULL to go back to the UART.
+   */
+  void setTransport(YmodemTransport* transport);
+
 #ifdef YMODEM_LSM1X0A
   /**
    * @brief Resets an external module connected to the ESP32 using a specified GPIO pin.
@@ -138,12 +442,23 @@ public:
    * and toggles the pin to reset the external module. After resetting, it sends a reset command via UART
    * and waits for a specific response ('C') from the module to confirm the reset process.
    *
+   * The 'C' is read as soon as it arrives and kept for the next transmit(), which sends its header
+   * packet right away instead of waiting for the module to repeat it. The latencies are in getBootStats().
+   *
    * @param resetPin The GPIO pin number used to reset the external module.
+   * @return YmodemPacketStatus YMODEM_TRANSMIT_START once the module is ready, YMODEM_TIMEOUT if it did not answer.
    *
    * @note The function assumes that the UART interface (EX_UART_NUM) is already initialized and configured.
-   *       It also sends any received response from the module to the default UART (UART_NUM_0) for debugging purposes.
    */
-  void resetExternalModule(int resetPin = YMODEM_RESET_PIN);
+  YmodemPacketStatus resetExternalModule(int resetPin = YMODEM_RESET_PIN);
+
+  /**
+   * @brief Retrieves the latencies of the last resetExternalModule().
+   *
+   * @return const YmodemBootStats& Time from the reset to the first byte of the module, to its 'C' and,
+   *         once transmit() has run, to the header packet.
+   */
+  const YmodemBootStats& getBootStats();
 #endif
 
   /**
@@ -154,8 +469,29 @@ public:
   const char* errorMessage(YmodemPacketStatus err);
 
 private:
-  int  ledPin = YMODEM_LED_ACT; /**< Pin number associated with the LED. */
-  void endYmodemSession();
+  int                  ledPin = YMODEM_LED_ACT;                 /**< Pin number associated with the LED. */
+  UartTransport        uart;                                    /**< UART carrying the Ymodem sessions. */
+  YmodemTraceTransport link{uart};                              /**< UART, or the transport of setTransport(), recorded by setTrace(). */
+  YmodemBootTransport  boot{link};                              /**< Link of transmit(), holds the 'C' found by resetExternalModule(). */
+  YmodemTrace*         trace = NULL;                            /**< Trace of the transfers, NULL when not recording. */
+  std::atomic<bool>    cancelRequested{false};                  /**< Set by cancel(), checked by the running session. */
+  YmodemSessionStats   sessionStats   = {};                     /**< Counters of the last transfer. */
+  YmodemWriteStats     writeStats     = {};                     /**< Write counters of the last receive. */
+  YmodemBroadcastStats broadcastStats = {};                     /**< Counters of the last broadcast. */
+  YmodemFootprint      footprint      = {};                     /**< Memory taken by the last transfer. */
+  YmodemArena          arena;                                   /**< Packet buffers of the transfers. */
+  bool                 reserveSpace   = true;                   /**< Reserve the announced size on receive. */
+  YmodemProtocol       protocol       = YMODEM_PROTOCOL_YMODEM; /**< Protocol of receive() and transmit(). */
+  bool                 resume         = false;                  /**< Continue interrupted Zmodem transfers. */
+  size_t               blockSize      = PACKET_1K_SIZE;         /**< Largest block negotiated by receive() and transmit(). */
+  bool                 skipUnchanged  = false;                  /**< Let the receivers skip unchanged files. */
+  bool                 fec            = false;                  /**< Add parity to the blocks, see setFec(). */
+  YmodemDigestType     digestType     = YMODEM_DIGEST_NONE;     /**< Digest computed by the transfers. */
+  YmodemDigest         lastDigest;                              /**< Digest of the last file transferred. */
+  void                 endYmodemSession();
+  void                 measureFootprint();
+
+  YmodemPacketStatus transmitFile(const char* sendFileName, const char* headerDigest);
 };
 
 #endif // YMODEMCORE_H
\ No newline at end of file
@@ -19,14 +19,30 @@
 #define BUF_SIZE (1080)        /*!< UART buffer size */
 #define MAX_BUFFER_SIZE (1024) /*!< Maximum buffer size */
 
+// === UART RX event mode ===
+// === Set YMODEM_RX_EVENTS to 0 to fall back to timed blocking reads ===
+#define YMODEM_RX_EVENTS 1           /*!< Wait on the UART driver event queue instead of polling the RX buffer */
+#define UART_EVENT_QUEUE_SIZE (20)   /*!< UART driver event queue length */
+#define UART_RX_TIMEOUT_SYMBOLS (3)  /*!< RX line idle time, in symbols, before the driver posts a data event */
+#define UART_RX_FULL_THRESHOLD (120) /*!< RX FIFO level, in bytes, that makes the driver drain the hardware FIFO */
+
+// === UART TX ring buffer, write() returns once a packet is queued and it drains in the background ===
+// === Set UART_TX_BUFFER_SIZE to 0 to block write() until the bytes are in the hardware FIFO       ===
+#define UART_TX_BUFFER_SIZE (BUF_SIZE * 2) /*!< UART driver TX ring buffer size, above the 128-byte FIFO or 0 */
+
+// === UART hardware flow control, enabled with Ymodem::setFlowControl() ===
+#define UART_RX_FLOW_THRESHOLD (100) /*!< RX FIFO level, in bytes, at which RTS is deasserted to hold the sender back */
+
 // === LED pin used to show transfer activity ===
 // === Set to 0 if you don't want to use it   ===
 #define YMODEM_LED_ACT 0    /*!< GPIO pin number for activity LED, set to 0 if you dont have LED*/
 #define YMODEM_LED_ACT_ON 1 /*!< LED ON state, 1 for active high, 0 for active low */
 
-#define YMODEM_RX_PIN GPIO_NUM_14 /*!< RX pin number */
-#define YMODEM_TX_PIN GPIO_NUM_33 /*!< TX pin number */
-#define YMODEM_LED_PIN GPIO_NUM_2 /*!< LED pin number */
+#define YMODEM_RX_PIN GPIO_NUM_14  /*!< RX pin number */
+#define YMODEM_TX_PIN GPIO_NUM_33  /*!< TX pin number */
+#define YMODEM_LED_PIN GPIO_NUM_2  /*!< LED pin number */
+#define YMODEM_RTS_PIN GPIO_NUM_25 /*!< RTS pin number, used with hardware flow control */
+#define YMODEM_CTS_PIN GPIO_NUM_26 /*!< CTS pin number, used with hardware flow control */
 
 // ==== Y-MODEM defines ====
 #define PACKET_SEQNO_INDEX (1)                           /*!< Packet sequence number index */
@@ -36,26 +52,82 @@
 #define PACKET_OVERHEAD (PACKET_HEADER + PACKET_TRAILER) /*!< Packet overhead size */
 #define PACKET_SIZE (128)                                /*!< Packet data size */
 #define PACKET_1K_SIZE (1024)                            /*!< Packet 1K data size */
+#define PACKET_4K_SIZE (4096)                            /*!< Packet 4K data size, negotiated large-block extension */
+#define PACKET_8K_SIZE (8192)                            /*!< Packet 8K data size, negotiated large-block extension */
 #define FILE_SIZE_LENGTH (16)                            /*!< File size length */
+#define FILE_NAME_LENGTH (64)                            /*!< Maximum file name length */
+
+// === Large-block extension, negotiated between two peers of this library ===
+// === LTX seq(16) ~seq(16) length(16) data CRC-32, all big endian       ===
+#define PACKET_LARGE_SEQNO_INDEX (1)                                       /*!< Large packet 16-bit sequence number index */
+#define PACKET_LARGE_SEQNO_COMP_INDEX (3)                                  /*!< Large packet sequence number complement index */
+#define PACKET_LARGE_LENGTH_INDEX (5)                                      /*!< Large packet 16-bit data length index */
+#define PACKET_LARGE_HEADER (7)                                            /*!< Large packet header size */
+#define PACKET_LARGE_TRAILER (4)                                           /*!< Large packet trailer size, CRC-32 */
+#define PACKET_LARGE_OVERHEAD (PACKET_LARGE_HEADER + PACKET_LARGE_TRAILER) /*!< Large packet overhead size */
+#define BLOCK_SIZE_FIELD "blk:"                                            /*!< Header field announcing the largest block of the sender */
+#define SKIP_FIELD "skip"                                                  /*!< Header field of a sender that accepts SKIP for unchanged files */
+#define YMODEM_MAX_BLOCK_SIZE (PACKET_1K_SIZE)                             /*!< Largest block of the Ymodem class, sizes its packet buffer */
+
+// === Forward error correction, negotiated between two peers of this library ===
+// === FTX seq(16) ~seq(16) length(16) data(block) CRC-32, then RS parity    ===
+#define FEC_FIELD "fec"                                              /*!< Header field of a sender that can add parity to its blocks */
+#define YMODEM_FEC_PARITY (16)                                       /*!< Parity bytes per codeword, they repair up to half as many bytes */
+#define YMODEM_FEC_CODEWORD (255)                                    /*!< Largest Reed-Solomon codeword over GF(256) */
+#define YMODEM_FEC_DATA (YMODEM_FEC_CODEWORD - YMODEM_FEC_PARITY)    /*!< Largest number of protected bytes in a codeword */
+#define YMODEM_FEC_MESSAGE_SIZE(n) (PACKET_LARGE_OVERHEAD - 1 + (n)) /*!< Bytes protected by the parity of an n-byte block, FTX excluded */
+#define YMODEM_FEC_ARENA (0)                                         /*!< 1 to size the packet buffer of the Ymodem class for FEC packets */
 
 #define SOH (0x01)   /*!< start of 128-byte data packet */
 #define STX (0x02)   /*!< start of 1024-byte data packet */
+#define LTX (0x03)   /*!< start of a large data packet, once negotiated */
 #define EOT (0x04)   /*!< end of transmission */
+#define FTX (0x05)   /*!< start of a data packet with parity, once negotiated */
 #define ACK (0x06)   /*!< acknowledge */
 #define NAK (0x15)   /*!< negative acknowledge */
 #define CA (0x18)    /*!< two of these in succession aborts transfer */
 #define CRC16 (0x43) /*!< 'C' == 0x43, request 16-bit CRC */
 
+#define LARGE_4K (0x34) /*!< '4' == 0x34, sent instead of 'C' after a header to accept 4K packets */
+#define LARGE_8K (0x38) /*!< '8' == 0x38, sent instead of 'C' after a header to accept 8K packets */
+#define SKIP (0x53)     /*!< 'S' == 0x53, sent after the ACK of a header when the receiver holds the file unchanged */
+#define FEC (0x46)      /*!< 'F' == 0x46, sent before the request for data when the receiver accepts packets with parity */
+
 #define ABORT1 (0x41) /*!< 'A' == 0x41, abort by sender */
 #define ABORT2 (0x61) /*!< 'a' == 0x61, abort by receiver */
 
 #define NAK_TIMEOUT (1000) /*!< Timeout for NAK response */
 #define WAIT_TIMEOUT (10)  /*!< Timeout for response waiting */
 #define MAX_ERRORS (100)   /*!< Maximum number of errors allowed */
+#define END_REQUESTS (3)   /*!< Header requests sent after a file before ending a session that has no empty header */
 
 #define YM_MAX_FILESIZE (10 * 1024 * 1024) /*!< Maximum file size allowed */
 #define PROGRESS_BAR_WIDTH (50)            /*!< Progress bar width in characters */
 
+// === Asynchronous transfer worker task ===
+#define YMODEM_TASK_STACK_SIZE (8192) /*!< Stack size of the transfer worker task in bytes */
+#define YMODEM_TASK_PRIORITY (5)      /*!< Priority of the transfer worker task */
+#define YMODEM_TASK_CORE (-1)         /*!< Core the worker task is pinned to, -1 for no affinity */
+
+// === Deferred logging, records are formatted and printed by a low-priority task ===
+// === YMODEM_LOG_LEVEL: 0: None / 1: Error / 2: Warn / 3: Info / 4: Debug / 5: Verbose ===
+#define YMODEM_LOG_LEVEL (3)              /*!< Most verbose level compiled in, the others cost nothing */
+#define YMODEM_LOG_SIZE (64)              /*!< Records in the log ring, a power of two */
+#define YMODEM_LOG_MAX_ARGS (6)           /*!< Integer arguments kept by a record */
+#define YMODEM_LOG_LINE_SIZE (160)        /*!< Longest formatted line */
+#define YMODEM_LOG_DRAIN_MS (20)          /*!< Period of the drain task */
+#define YMODEM_LOG_TASK_STACK_SIZE (3072) /*!< Stack size of the drain task in bytes */
+#define YMODEM_LOG_TASK_PRIORITY (1)      /*!< Priority of the drain task, above the idle task only */
+
+// === TCP transport, small writes are batched and sent with Nagle's algorithm disabled ===
+#define YMODEM_TCP_PORT (5555)               /*!< Port listened to and connected to by default */
+#define YMODEM_TCP_BATCH_SIZE (BUF_SIZE)     /*!< Bytes batched before a send(), a 1K frame fits in one batch */
+#define YMODEM_TCP_CONNECT_TIMEOUT_MS (5000) /*!< Time allowed to connect to the peer */
+
+// === Transfer scheduler, one worker per port runs the queued jobs by priority ===
+#define YMODEM_SCHEDULER_MAX_PORTS (4) /*!< Ports served by a scheduler */
+#define YMODEM_SCHEDULER_MAX_JOBS (16) /*!< Jobs waiting on a port, submit() refuses more */
+
 #ifdef YMODEM_LSM1X0A
 #define YMODEM_RESET_PIN GPIO_NUM_15 /*!< Reset LSM1X0A Modem pin number */
 #endif
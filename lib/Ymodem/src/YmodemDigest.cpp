@@ -0,0 +1,328 @@
+/**
+ * @file YmodemDigest.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Whole-file digest computed while the blocks flow
+ * @version 0.1
+ * @date 2025-05-26
+ *
+ * This file contains the CRC-32 and SHA-256 implementations of the running
+ * file digest. On the ESP32 the CRC-32 comes from the ROM and the SHA-256
+ * from mbedtls, which uses the SHA accelerator.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "YmodemDigest.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include <esp_rom_crc.h>
+#include <mbedtls/version.h>
+#endif
+
+static const char* const DIGEST_NAMES[] = {"", "crc32", "sha256"};
+
+#ifdef ESP_PLATFORM
+static uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t size)
+{
+  return esp_rom_crc32_le(crc, data, size);
+}
+#else
+/**
+ * @brief Lookup table of the reflected CRC-32 polynomial.
+ */
+struct Crc32Table
+{
+  uint32_t entries[256];
+
+  Crc32Table()
+  {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++) {
+        c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+      }
+      entries[i] = c;
+    }
+  }
+};
+
+/**
+ * @brief Updates a CRC-32 (IEEE 802.3, reflected, initial and final XOR 0xFFFFFFFF).
+ *
+ * Same chaining as the ESP32 ROM function: start with 0 and pass the previous result.
+ */
+static uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t size)
+{
+  static const Crc32Table table;
+
+  crc = ~crc;
+  while (size--) {
+    crc = table.entries[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+static const uint32_t SHA256_K[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be,
+  0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa,
+  0x5cb0a9dc, 0x76f988da, 0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967, 0x27b70a85,
+  0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+  0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f,
+  0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+static inline uint32_t rotr(uint32_t x, int n)
+{
+  return (x >> n) | (x << (32 - n));
+}
+
+void YmodemDigest::transform(const uint8_t* data)
+{
+  uint32_t w[64];
+  for (int i = 0; i < 16; i++) {
+    w[i] = ((uint32_t)data[4 * i] << 24) | ((uint32_t)data[4 * i + 1] << 16) | ((uint32_t)data[4 * i + 2] << 8) | data[4 * i + 3];
+  }
+  for (int i = 16; i < 64; i++) {
+    uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i]        = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+
+  uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+  for (int i = 0; i < 64; i++) {
+    uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + SHA256_K[i] + w[i];
+    uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+    h           = g;
+    g           = f;
+    f           = e;
+    e           = d + t1;
+    d           = c;
+    c           = b;
+    b           = a;
+    a           = t1 + t2;
+  }
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+  state[5] += f;
+  state[6] += g;
+  state[7] += h;
+}
+#endif
+
+YmodemDigest::YmodemDigest()
+{
+#ifdef ESP_PLATFORM
+  mbedtls_sha256_init(&sha);
+#endif
+}
+
+YmodemDigest::~YmodemDigest()
+{
+#ifdef ESP_PLATFORM
+  mbedtls_sha256_free(&sha);
+#endif
+}
+
+YmodemDigest::YmodemDigest(const YmodemDigest& other) : YmodemDigest()
+{
+  *this = other;
+}
+
+YmodemDigest& YmodemDigest::operator=(const YmodemDigest& other)
+{
+  if (this == &other) {
+    return *this;
+  }
+  digestType = other.digestType;
+  crc        = other.crc;
+  memcpy(digest, other.digest, sizeof(digest));
+#ifdef ESP_PLATFORM
+  mbedtls_sha256_clone(&sha, &other.sha);
+#else
+  memcpy(state, other.state, sizeof(state));
+  memcpy(block, other.block, sizeof(block));
+  blockSize = other.blockSize;
+  totalSize = other.totalSize;
+#endif
+  return *this;
+}
+
+void YmodemDigest::begin(YmodemDigestType type)
+{
+  digestType = type;
+  crc        = 0;
+  memset(digest, 0, sizeof(digest));
+  if (type != YMODEM_DIGEST_SHA256) {
+    return;
+  }
+
+#ifdef ESP_PLATFORM
+#if MBEDTLS_VERSION_MAJOR < 3
+  mbedtls_sha256_starts_ret(&sha, 0);
+#else
+  mbedtls_sha256_starts(&sha, 0);
+#endif
+#else
+  static const uint32_t initial[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+  memcpy(state, initial, sizeof(state));
+  blockSize = 0;
+  totalSize = 0;
+#endif
+}
+
+void YmodemDigest::update(const uint8_t* data, size_t size)
+{
+  if (digestType == YMODEM_DIGEST_CRC32) {
+    crc = crc32Update(crc, data, size);
+    return;
+  }
+  if (digestType != YMODEM_DIGEST_SHA256) {
+    return;
+  }
+
+#ifdef ESP_PLATFORM
+#if MBEDTLS_VERSION_MAJOR < 3
+  mbedtls_sha256_update_ret(&sha, data, size);
+#else
+  mbedtls_sha256_update(&sha, data, size);
+#endif
+#else
+  totalSize += size;
+  while (size > 0) {
+    // Whole blocks are hashed in place, only the remainder is copied
+    if (blockSize == 0 && size >= sizeof(block)) {
+      transform(data);
+      data += sizeof(block);
+      size -= sizeof(block);
+      continue;
+    }
+    size_t chunk = sizeof(block) - blockSize;
+    if (chunk > size) {
+      chunk = size;
+    }
+    memcpy(block + blockSize, data, chunk);
+    blockSize += chunk;
+    data += chunk;
+    size -= chunk;
+    if (blockSize == sizeof(block)) {
+      transform(block);
+      blockSize = 0;
+    }
+  }
+#endif
+}
+
+void YmodemDigest::finish()
+{
+  if (digestType == YMODEM_DIGEST_CRC32) {
+    digest[0] = crc >> 24;
+    digest[1] = crc >> 16;
+    digest[2] = crc >> 8;
+    digest[3] = crc;
+    return;
+  }
+  if (digestType != YMODEM_DIGEST_SHA256) {
+    return;
+  }
+
+#ifdef ESP_PLATFORM
+#if MBEDTLS_VERSION_MAJOR < 3
+  mbedtls_sha256_finish_ret(&sha, digest);
+#else
+  mbedtls_sha256_finish(&sha, digest);
+#endif
+#else
+  uint64_t bits = totalSize * 8;
+  uint8_t  pad  = 0x80;
+  update(&pad, 1);
+  pad = 0;
+  while (blockSize != 56) {
+    update(&pad, 1);
+  }
+  uint8_t length[8];
+  for (int i = 0; i < 8; i++) {
+    length[i] = bits >> (56 - 8 * i);
+  }
+  update(length, sizeof(length));
+  for (int i = 0; i < 8; i++) {
+    digest[4 * i]     = state[i] >> 24;
+    digest[4 * i + 1] = state[i] >> 16;
+    digest[4 * i + 2] = state[i] >> 8;
+    digest[4 * i + 3] = state[i];
+  }
+#endif
+}
+
+YmodemDigestType YmodemDigest::type() const
+{
+  return digestType;
+}
+
+const uint8_t* YmodemDigest::value() const
+{
+  return digest;
+}
+
+size_t YmodemDigest::size() const
+{
+  switch (digestType) {
+    case YMODEM_DIGEST_CRC32:
+      return 4;
+    case YMODEM_DIGEST_SHA256:
+      return 32;
+    default:
+      return 0;
+  }
+}
+
+bool YmodemDigest::format(char* text, size_t size) const
+{
+  const char* name = DIGEST_NAMES[digestType];
+  if (digestType == YMODEM_DIGEST_NONE || size < strlen(name) + 2 * this->size() + 2) {
+    return false;
+  }
+
+  int length = sprintf(text, "%s:", name);
+  for (size_t i = 0; i < this->size(); i++) {
+    length += sprintf(text + length, "%02x", digest[i]);
+  }
+  return true;
+}
+
+bool YmodemDigest::matches(const char* text) const
+{
+  char own[YMODEM_DIGEST_TEXT_SIZE];
+  if (parseType(text) != digestType || !format(own, sizeof(own))) {
+    return false;
+  }
+  return strncasecmp(own, text, strlen(own)) == 0;
+}
+
+YmodemDigestType YmodemDigest::parseType(const char* text)
+{
+  static const size_t sizes[] = {0, 4, 32};
+
+  for (uint8_t type = YMODEM_DIGEST_CRC32; type <= YMODEM_DIGEST_SHA256; type++) {
+    size_t name = strlen(DIGEST_NAMES[type]);
+    if (strncmp(text, DIGEST_NAMES[type], name) != 0 || text[name] != ':') {
+      continue;
+    }
+    // Exactly twice the digest size in hex digits, up to the end of the field
+    const char* hex = text + name + 1;
+    size_t      len = strspn(hex, "0123456789abcdefABCDEF");
+    if (len == 2 * sizes[type] && (hex[len] == 0 || hex[len] == ' ')) {
+      return (YmodemDigestType)type;
+    }
+  }
+  return YMODEM_DIGEST_NONE;
+}
+
+uint32_t Ymodem_Crc32(uint32_t crc, const uint8_t* data, size_t size)
+{
+  return crc32Update(crc, data, size);
+}
@@ -0,0 +1,146 @@
+/**
+ * @file YmodemDigest.h
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Whole-file digest computed while the blocks flow
+ * @version 0.1
+ * @date 2025-05-26
+ *
+ * This file contains the running CRC-32 or SHA-256 of the file payload of a
+ * session. The digest is updated with the file bytes of every block, without
+ * the padding of the last block, so the file never has to be read again to be
+ * checked. SHA-256 uses mbedtls on the ESP32 and a software implementation on
+ * the host.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef YMODEMDIGEST_H
+#define YMODEMDIGEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef ESP_PLATFORM
+#include <mbedtls/sha256.h>
+#endif
+
+#define YMODEM_DIGEST_MAX_SIZE (32)                                 /*!< Size of the largest digest, SHA-256 */
+#define YMODEM_DIGEST_TEXT_SIZE (7 + 2 * YMODEM_DIGEST_MAX_SIZE + 1) /*!< Size of "sha256:<hex>" with the terminator */
+
+/**
+ * @brief Digest algorithms.
+ */
+enum YmodemDigestType : uint8_t
+{
+  YMODEM_DIGEST_NONE,   // No digest
+  YMODEM_DIGEST_CRC32,  // CRC-32 (IEEE 802.3), announced as "crc32:<8 hex digits>"
+  YMODEM_DIGEST_SHA256, // SHA-256, announced as "sha256:<64 hex digits>"
+};
+
+/**
+ * @brief Running digest of a file.
+ */
+class YmodemDigest
+{
+public:
+  YmodemDigest();
+  ~YmodemDigest();
+
+  YmodemDigest(const YmodemDigest& other);
+  YmodemDigest& operator=(const YmodemDigest& other);
+
+  /**
+   * @brief Starts a new digest.
+   *
+   * @param type Algorithm to use, YMODEM_DIGEST_NONE ignores the updates.
+   */
+  void begin(YmodemDigestType type);
+
+  /**
+   * @brief Adds bytes to the digest.
+   *
+   * @param data Pointer to the bytes.
+   * @param size Number of bytes.
+   */
+  void update(const uint8_t* data, size_t size);
+
+  /**
+   * @brief Completes the digest, value() is valid afterwards.
+   */
+  void finish();
+
+  /**
+   * @brief Retrieves the algorithm of the digest.
+   *
+   * @return YmodemDigestType Algorithm.
+   */
+  YmodemDigestType type() const;
+
+  /**
+   * @brief Retrieves the digest once finished, in big-endian order.
+   *
+   * @return const uint8_t* Pointer to size() bytes.
+   */
+  const uint8_t* value() const;
+
+  /**
+   * @brief Retrieves the size of the digest.
+   *
+   * @return size_t 4 for CRC-32, 32 for SHA-256, 0 for none.
+   */
+  size_t size() const;
+
+  /**
+   * @brief Formats the digest as announced in the file header, for example "crc32:cbf43926".
+   *
+   * @param text Pointer to the buffer, YMODEM_DIGEST_TEXT_SIZE bytes are always enough.
+   * @param size Size of the buffer.
+   * @return true on success, false if there is no digest or the buffer is too small.
+   */
+  bool format(char* text, size_t size) const;
+
+  /**
+   * @brief Checks whether the digest matches one announced in a file header.
+   *
+   * @param text Announced digest, for example "crc32:cbf43926".
+   * @return true if the algorithm and the value are the same, false otherwise.
+   */
+  bool matches(const char* text) const;
+
+  /**
+   * @brief Retrieves the algorithm of a digest announced in a file header.
+   *
+   * @param text Announced digest, for example "sha256:ba7816bf...".
+   * @return YmodemDigestType Algorithm, YMODEM_DIGEST_NONE if the text is not a valid digest.
+   */
+  static YmodemDigestType parseType(const char* text);
+
+private:
+  YmodemDigestType digestType                     = YMODEM_DIGEST_NONE; /**< Algorithm in use. */
+  uint8_t          digest[YMODEM_DIGEST_MAX_SIZE] = {};                 /**< Value, valid after finish(). */
+  uint32_t         crc                            = 0;                  /**< Running CRC-32. */
+#ifdef ESP_PLATFORM
+  mbedtls_sha256_context sha; /**< Running SHA-256. */
+#else
+  uint32_t state[8];  /**< Running SHA-256 hash. */
+  uint8_t  block[64]; /**< SHA-256 input not hashed yet. */
+  size_t   blockSize; /**< Bytes in block. */
+  uint64_t totalSize; /**< Bytes added to the SHA-256. */
+
+  void transform(const uint8_t* data);
+#endif
+};
+
+/**
+ * @brief Updates a CRC-32 (IEEE 802.3), the algorithm of the crc32 digest.
+ *
+ * It is the ROM function on the ESP32. The Zmodem frames use it for their 32-bit checks.
+ *
+ * @param crc Result of the previous call, 0 to start.
+ * @param data Pointer to the bytes.
+ * @param size Number of bytes.
+ * @return uint32_t CRC-32 of all the bytes so far.
+ */
+uint32_t Ymodem_Crc32(uint32_t crc, const uint8_t* data, size_t size);
+
+#endif // YMODEMDIGEST_H
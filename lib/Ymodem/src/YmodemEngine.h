@@ -0,0 +1,566 @@
+/**
+ * @file YmodemEngine.h
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Compile-time specialized Ymodem engine
+ * @version 0.1
+ * @date 2025-05-26
+ *
+ * This file contains a header-only Ymodem engine whose transport, sink, block
+ * size, CRC routine and LED handling are template parameters. The packet layout
+ * and the CRC table are compile-time constants and every call is resolved
+ * statically, so the receive and send loops inline into the caller and the
+ * features that are not selected are not compiled at all.
+ *
+ * The engine runs blocking transfers of a single file, without digest, space
+ * reservation or cancellation. The Ymodem class and the session state machines
+ * remain the full featured path.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef YMODEMENGINE_H
+#define YMODEMENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "YmodemDef.h"
+#include "YmodemReceive.h"
+#include "YmodemSession.h"
+#include "YmodemTransport.h"
+#include "YmodemUtils.h"
+
+/**
+ * @brief Compile-time list of the integers 0 to N - 1, std::index_sequence is not available in C++11.
+ */
+template <size_t... I> struct YmodemIndices
+{
+};
+
+template <size_t N, size_t... I> struct YmodemMakeIndices : YmodemMakeIndices<N - 1, N - 1, I...>
+{
+};
+
+template <size_t... I> struct YmodemMakeIndices<0, I...>
+{
+  typedef YmodemIndices<I...> type;
+};
+
+/**
+ * @brief Shifts the 8 bits of a byte out of a CRC-16, MSB first.
+ */
+constexpr uint16_t Ymodem_CrcShift(uint16_t crc, uint16_t poly, int bits)
+{
+  return (bits == 0) ? crc : Ymodem_CrcShift((uint16_t)((crc & 0x8000) ? (crc << 1) ^ poly : (crc << 1)), poly, bits - 1);
+}
+
+/**
+ * @brief CRC-16 lookup table computed by the compiler.
+ */
+template <uint16_t Poly, class Indices> struct YmodemCrcTableData;
+
+template <uint16_t Poly, size_t... I> struct YmodemCrcTableData<Poly, YmodemIndices<I...>>
+{
+  static constexpr uint16_t value[sizeof...(I)] = {Ymodem_CrcShift((uint16_t)(I << 8), Poly, 8)...};
+};
+
+template <uint16_t Poly, size_t... I> constexpr uint16_t YmodemCrcTableData<Poly, YmodemIndices<I...>>::value[sizeof...(I)];
+
+/**
+ * @brief Table driven CRC-16 policy, the fastest one. The table takes 512 bytes of flash.
+ *
+ * @tparam Poly Polynomial, 0x1021 (CCITT) for Ymodem.
+ */
+template <uint16_t Poly = 0x1021> struct YmodemCrcTable
+{
+  typedef YmodemCrcTableData<Poly, typename YmodemMakeIndices<256>::type> Table;
+
+  /**
+   * @brief Computes the CRC-16 of a buffer, 0 for a block followed by its own CRC.
+   */
+  static inline uint16_t compute(const uint8_t* data, size_t size)
+  {
+    uint16_t crc = 0;
+    while (size--) {
+      crc = (uint16_t)((crc << 8) ^ Table::value[(uint8_t)((crc >> 8) ^ *data++)]);
+    }
+    return crc;
+  }
+
+  /**
+   * @brief Computes the CRC-16 of a string at compile time.
+   */
+  static constexpr uint16_t of(const char* text, size_t size, uint16_t crc = 0)
+  {
+    return (size == 0) ? crc : of(text + 1, size - 1, (uint16_t)((crc << 8) ^ Table::value[(uint8_t)((crc >> 8) ^ (uint8_t)*text)]));
+  }
+};
+
+static_assert(YmodemCrcTable<>::Table::value[1] == 0x1021, "CRC-16 table");
+static_assert(YmodemCrcTable<>::of("123456789", 9) == 0x31C3, "CRC-16/XMODEM check value");
+
+/**
+ * @brief Bitwise CRC-16 policy, slower but without a table, for the builds short of flash.
+ *
+ * @tparam Poly Polynomial, 0x1021 (CCITT) for Ymodem.
+ */
+template <uint16_t Poly = 0x1021> struct YmodemCrcBitwise
+{
+  static inline uint16_t compute(const uint8_t* data, size_t size)
+  {
+    uint16_t crc = 0;
+    while (size--) {
+      crc = Ymodem_CrcShift((uint16_t)(crc ^ (*data++ << 8)), Poly, 8);
+    }
+    return crc;
+  }
+};
+
+/**
+ * @brief LED policy of the builds without an activity LED, it compiles to nothing.
+ */
+struct YmodemNoLed
+{
+  static inline void toggle()
+  {
+  }
+};
+
+#ifdef ESP_PLATFORM
+/**
+ * @brief LED policy toggling the YMODEM_LED_ACT activity LED after every block.
+ */
+struct YmodemActivityLed
+{
+  static inline void toggle()
+  {
+    LED_toggle();
+  }
+};
+#endif
+
+/**
+ * @brief Blocking Ymodem engine specialized at compile time.
+ *
+ * @tparam Transport Link, any class with the read() and write() of YmodemTransport.
+ * @tparam Sink Destination of the received file, any class with the reserve(), open(),
+ *         write() and close() of YmodemReceiveSink.
+ * @tparam BlockSize Data block size, PACKET_SIZE or PACKET_1K_SIZE. With PACKET_SIZE the
+ *         frame is 133 bytes and a sender using 1K blocks is refused with YMODEM_BUFFER_OVERFLOW.
+ * @tparam CrcPolicy CRC-16 routine, YmodemCrcTable or YmodemCrcBitwise.
+ * @tparam Led Activity LED, YmodemNoLed or YmodemActivityLed.
+ *
+ * The calls on the transport and on the sink are static, declare the concrete classes
+ * final so the compiler can inline their methods too. The file source of transmit() is
+ * any class with the read() of YmodemTransmitSource.
+ */
+template <class Transport, class Sink, size_t BlockSize = PACKET_1K_SIZE, class CrcPolicy = YmodemCrcTable<>, class Led = YmodemNoLed>
+class YmodemEngine
+{
+public:
+  static_assert(BlockSize == PACKET_SIZE || BlockSize == PACKET_1K_SIZE, "Ymodem blocks are 128 or 1024 bytes");
+
+  static constexpr size_t  FRAME_SIZE  = BlockSize + PACKET_OVERHEAD;               /**< Bytes of the largest packet. */
+  static constexpr uint8_t BLOCK_START = (BlockSize == PACKET_1K_SIZE) ? STX : SOH; /**< First byte of a data block. */
+
+  /**
+   * @brief Constructor for the YmodemEngine class.
+   *
+   * @param transport Link carrying the transfers, it must outlive the engine.
+   */
+  explicit YmodemEngine(Transport& transport) : transport(transport)
+  {
+  }
+
+  /**
+   * @brief Receives a file.
+   *
+   * @param sink Destination of the file.
+   * @param maxsize Maximum size of the file.
+   * @return int Size of the file on success, or a negative YmodemPacketStatus.
+   */
+  int receive(Sink& sink, uint32_t maxsize);
+
+  /**
+   * @brief Sends a file.
+   *
+   * @param source Origin of the file data.
+   * @param fileName Name announced in the file header, the transfer is cancelled with
+   *                 YMODEM_HEADER_OVERFLOW if it does not fit whole in the header.
+   * @param fileSize Size of the file in bytes.
+   * @return int YMODEM_TRANSMIT_OK on success, or a negative YmodemPacketStatus.
+   */
+  template <class Source> int transmit(Source& source, const char* fileName, uint32_t fileSize);
+
+  /**
+   * @brief Retrieves the counters of the last transfer.
+   *
+   * @return const YmodemSessionStats& Reference to the counters.
+   */
+  const YmodemSessionStats& stats() const
+  {
+    return counters;
+  }
+
+private:
+  Transport&         transport;         /**< Link carrying the transfers. */
+  uint8_t            frame[FRAME_SIZE]; /**< Packet being received or sent. */
+  YmodemSessionStats counters = {};     /**< Counters of the last transfer. */
+
+  inline void sendByte(uint8_t byte)
+  {
+    transport.write(&byte, 1);
+  }
+
+  inline int readByte(uint32_t timeoutMs)
+  {
+    uint8_t byte;
+    int     len = transport.read(&byte, 1, timeoutMs);
+    return (len == 1) ? byte : ((len == TRANSPORT_ERROR) ? (int)TRANSPORT_ERROR : (int)YMODEM_TIMEOUT);
+  }
+
+  inline bool readAll(uint8_t* data, size_t size, uint32_t timeoutMs)
+  {
+    while (size > 0) {
+      int len = transport.read(data, size, timeoutMs);
+      if (len <= 0) {
+        return false;
+      }
+      data += len;
+      size -= len;
+    }
+    return true;
+  }
+
+  inline int cancel(int result)
+  {
+    sendByte(CA);
+    sendByte(CA);
+    return result;
+  }
+
+  int  readPacket();
+  int  sendFrame(size_t size, bool first = false);
+  int  waitFor(uint8_t expected, bool first = false);
+  void prepareFrame(uint8_t start, uint8_t seq, size_t size);
+};
+
+template <class Transport, class Sink, size_t BlockSize, class CrcPolicy, class Led>
+constexpr size_t YmodemEngine<Transport, Sink, BlockSize, CrcPolicy, Led>::FRAME_SIZE;
+
+template <class Transport, class Sink, size_t BlockSize, class CrcPolicy, class Led>
+constexpr uint8_t YmodemEngine<Transport, Sink, BlockSize, CrcPolicy, Led>::BLOCK_START;
+
+/**
+ * @brief Reads one packet into the frame.
+ *
+ * @return int Data size of the packet, 0 for EOT, or a negative YmodemPacketStatus.
+ */
+template <class Transport, class Sink, size_t BlockSize, class CrcPolicy, class Led>
+int YmodemEngine<Transport, Sink, BlockSize, CrcPolicy, Led>::readPacket()
+{
+  int start = readByte(NAK_TIMEOUT);
+  if (start < 0) {
+    return (start == TRANSPORT_ERROR) ? YMODEM_ABORTED_BY_TRANSFER : YMODEM_TIMEOUT;
+  }
+
+  size_t size;
+  switch (start) {
+    case SOH:
+      size = PACKET_SIZE;
+      break;
+    case STX:
+      if (BlockSize < PACKET_1K_SIZE) {
+        return YMODEM_BUFFER_OVERFLOW;
+      }
+      size = PACKET_1K_SIZE;
+      break;
+    case EOT:
+      return 0;
+    case CA:
+      return (readByte(NAK_TIMEOUT) == CA) ? YMODEM_ABORTED_BY_SENDER : YMODEM_INVALID_CA;
+    default:
+      return YMODEM_INVALID_HEADER;
+  }
+
+  frame[0] = (uint8_t)start;
+  if (!readAll(frame + 1, size + PACKET_OVERHEAD - 1, NAK_TIMEOUT)) {
+    return YMODEM_TIMEOUT;
+  }
+  if (frame[PACKET_SEQNO_INDEX] != (uint8_t)(frame[PACKET_SEQNO_COMP_INDEX] ^ 0xff)) {
+    return YMODEM_SEQ_ERROR;
+  }
+  if (CrcPolicy::compute(frame + PACKET_HEADER, size + PACKET_TRAILER) != 0) {
+    return YMODEM_CRC_ERROR;
+  }
+  return (int)size;
+}
+
+template <class Transport, class Sink, size_t BlockSize, class CrcPolicy, class Led>
+int YmodemEngine<Transport, Sink, BlockSize, CrcPolicy, Led>::receive(Sink& sink, uint32_t maxsize)
+{
+  uint32_t fileSize = 0;
+  uint32_t written  = 0;
+  uint8_t  expected = 1;
+  uint8_t  eotCount = 0;
+  bool     inFile   = false;
+  uint32_t errors   = 0;
+  counters          = {};
+
+  sendByte(CRC16);
+  while (true) {
+    int size = readPacket();
+    if (size == YMODEM_ABORTED_BY_SENDER || size == YMODEM_ABORTED_BY_TRANSFER) {
+      return size;
+    }
+    if (size == YMODEM_BUFFER_OVERFLOW) {
+      return cancel(size);
+    }
+    if (size < 0) {
+      // Timeout or damaged packet: ask again, with 'C' while no file has been accepted and until its
+      // first block arrives, a NAK would be ignored by a sender that lost the request for data
+      counters.retries++;
+      if (size == YMODEM_TIMEOUT) {
+        counters.timeouts++;
+      }
+      if (++errors > MAX_ERRORS) {
+        return cancel(YMODEM_MAX_ERRORS);
+      }
+      transport.flushInput();
+      sendByte((inFile && (expected > 1 || eotCount > 0)) ? NAK : CRC16);
+      continue;
+    }
+    errors = 0;
+
+    // The first EOT is answered with NAK to make sure it is not line noise
+    if (size == 0) {
+      if (inFile && ++eotCount == 1) {
+        sendByte(NAK);
+        continue;
+      }
+      if (inFile) {
+        sink.close();
+        inFile = false;
+      }
+      sendByte(ACK);
+      sendByte(CRC16);
+      continue;
+    }
+
+    uint8_t seq = frame[PACKET_SEQNO_INDEX];
+    if (inFile && seq == expected) {
+      size_t length = (size_t)size;
+      if (length > fileSize - written) {
+        length = fileSize - written;
+      }
+      if (length > 0 && sink.write(frame + PACKET_HEADER, length) != (int)length) {
+        return cancel(YMODEM_ERROR_WRITING);
+      }
+      Led::toggle();
+      written += length;
+      expected++;
+      counters.packets++;
+      counters.bytes += length;
+      sendByte(ACK);
+      continue;
+    }
+
+    // The sender missed the last ACK and repeated the previous packet, the header included
+    if (inFile && seq == (uint8_t)(expected - 1)) {
+      sendByte(ACK);
+      if (seq == 0) {
+        sendByte(CRC16);
+      }
+      continue;
+    }
+    if (inFile || seq != 0) {
+      return cancel(YMODEM_SEQ_ERROR);
+    }
+
+    // Empty header, the sender has no more files
+    if (frame[PACKET_HEADER] == 0) {
+      sendByte(ACK);
+      return (int)fileSize;
+    }
+
+    char name[FILE_NAME_LENGTH + 1];
+    int  announced = 0;
+    extractFileInfo(frame, name, &announced);
+    if (announced < 1 || (uint32_t)announced > maxsize) {
+      return cancel((announced < 1) ? YMODEM_SIZE_NULL : YMODEM_SIZE_OVERFLOW);
+    }
+    if (!sink.reserve(announced)) {
+      return cancel(YMODEM_NO_SPACE);
+    }
+    if (!sink.open(name, announced)) {
+      return cancel(YMODEM_ERROR_WRITING);
+    }
+    fileSize = announced;
+    written  = 0;
+    expected = 1;
+    eotCount = 0;
+    inFile   = true;
+    counters.packets++;
+    sendByte(ACK);
+    sendByte(CRC16);
+  }
+}
+
+/**
+ * @brief Adds the framing and the CRC to the data already in the frame.
+ */
+template <class Transport, class Sink, size_t BlockSize, class CrcPolicy, class Led>
+void YmodemEngine<Transport, Sink, BlockSize, CrcPolicy, Led>::prepareFrame(uint8_t start, uint8_t seq, size_t size)
+{
+  frame[0]                       = start;
+  frame[PACKET_SEQNO_INDEX]      = seq;
+  frame[PACKET_SEQNO_COMP_INDEX] = (uint8_t)~seq;
+
+  uint16_t crc                    = CrcPolicy::compute(frame + PACKET_HEADER, size);
+  frame[PACKET_HEADER + size]     = crc >> 8;
+  frame[PACKET_HEADER + size + 1] = crc & 0xFF;
+}
+
+/**
+ * @brief Sends the frame until the receiver acknowledges it.
+ *
+ * @param first True for the header and the first block of a file, which a repeated 'C' asks for again.
+ * @return int YMODEM_TRANSMIT_OK once acknowledged, or a negative YmodemPacketStatus.
+ */
+template <class Transport, class Sink, size_t BlockSize, class CrcPolicy, class Led>
+int YmodemEngine<Transport, Sink, BlockSize, CrcPolicy, Led>::sendFrame(size_t size, bool first)
+{
+  for (uint32_t errors = 0; errors <= MAX_ERRORS; errors++) {
+    if (errors > 0) {
+      counters.retries++;
+    }
+    if (transport.write(frame, size + PACKET_OVERHEAD) != (int)(size + PACKET_OVERHEAD)) {
+      return YMODEM_ABORTED_BY_TRANSFER;
+    }
+
+    int response = waitFor(ACK, first);
+    if (response != YMODEM_RECEIVED_NAK) {
+      return response;
+    }
+  }
+  return cancel(YMODEM_MAX_ERRORS);
+}
+
+/**
+ * @brief Waits for a control byte, the repeated 'C' of the receiver are skipped.
+ *
+ * @param first True while the receiver repeats its request until the header or the first block
+ *              arrives, a 'C' is then taken as a NAK.
+ * @return int YMODEM_TRANSMIT_OK once it arrived, YMODEM_RECEIVED_NAK, or a negative YmodemPacketStatus.
+ */
+template <class Transport, class Sink, size_t BlockSize, class CrcPolicy, class Led>
+int YmodemEngine<Transport, Sink, BlockSize, CrcPolicy, Led>::waitFor(uint8_t expected, bool first)
+{
+  while (true) {
+    int byte = readByte(WAIT_TIMEOUT * NAK_TIMEOUT);
+    if (byte == expected) {
+      return YMODEM_TRANSMIT_OK;
+    }
+    switch (byte) {
+      case NAK:
+        return YMODEM_RECEIVED_NAK;
+      case CA:
+        return YMODEM_ABORTED_BY_SENDER;
+      case CRC16:
+        if (first) {
+          return YMODEM_RECEIVED_NAK;
+        }
+        break;
+      case TRANSPORT_ERROR:
+        return YMODEM_ABORTED_BY_TRANSFER;
+      case YMODEM_TIMEOUT:
+        counters.timeouts++;
+        return cancel(YMODEM_TIMEOUT);
+      default:
+        return cancel(YMODEM_INVALID_HEADER);
+    }
+  }
+}
+
+template <class Transport, class Sink, size_t BlockSize, class CrcPolicy, class Led>
+template <class Source>
+int YmodemEngine<Transport, Sink, BlockSize, CrcPolicy, Led>::transmit(Source& source, const char* fileName, uint32_t fileSize)
+{
+  counters = {};
+
+  // Some receivers only answer once they see activity on the line
+  int byte;
+  for (uint32_t errors = 0; (byte = readByte(NAK_TIMEOUT)) != CRC16; errors++) {
+    if (byte == TRANSPORT_ERROR) {
+      return YMODEM_ABORTED_BY_TRANSFER;
+    }
+    if (byte != YMODEM_TIMEOUT || errors >= MAX_ERRORS) {
+      return cancel((byte == YMODEM_TIMEOUT) ? YMODEM_TIMEOUT : YMODEM_CRC_ERROR);
+    }
+    counters.timeouts++;
+    sendByte(CRC16);
+  }
+
+  // File header: name, size and a space, like Ymodem_PrepareIntialPacket(). A cut name would write another file
+  char   size[FILE_SIZE_LENGTH];
+  size_t sizeLength = snprintf(size, sizeof(size), "%u ", (unsigned)fileSize);
+  size_t nameLength = strlen(fileName);
+  if (nameLength + 1 + sizeLength > PACKET_SIZE - 1) {
+    return cancel(YMODEM_HEADER_OVERFLOW);
+  }
+  memset(frame + PACKET_HEADER, 0, PACKET_SIZE);
+  memcpy(frame + PACKET_HEADER, fileName, nameLength);
+  memcpy(frame + PACKET_HEADER + nameLength + 1, size, sizeLength);
+  prepareFrame(SOH, 0, PACKET_SIZE);
+  // Without the 'C' left from the handshake, a 'C' before the ACK means the header or its ACK was lost
+  transport.flushInput();
+  int result = sendFrame(PACKET_SIZE, true);
+  if (result == YMODEM_TRANSMIT_OK) {
+    counters.packets++;
+    result = waitFor(CRC16);
+  }
+
+  // Data blocks, read straight into the frame
+  uint8_t seq = 1;
+  for (uint32_t offset = 0; offset < fileSize && result == YMODEM_TRANSMIT_OK; offset += BlockSize, seq++) {
+    size_t length = (fileSize - offset < BlockSize) ? fileSize - offset : BlockSize;
+    if (source.read(frame + PACKET_HEADER, length, offset) != (int)length) {
+      return cancel(YMODEM_READ_ERROR);
+    }
+    memset(frame + PACKET_HEADER + length, 0, BlockSize - length);
+    prepareFrame(BLOCK_START, seq, BlockSize);
+    result = sendFrame(BlockSize, offset == 0);
+    if (result == YMODEM_TRANSMIT_OK) {
+      Led::toggle();
+      counters.packets++;
+      counters.bytes += length;
+    }
+  }
+
+  // EOT, the first one is always answered with NAK
+  for (uint32_t errors = 0; result == YMODEM_TRANSMIT_OK; errors++) {
+    sendByte(EOT);
+    result = waitFor(ACK);
+    if (result == YMODEM_RECEIVED_NAK) {
+      result = (errors < MAX_ERRORS) ? YMODEM_TRANSMIT_OK : cancel(YMODEM_MAX_ERRORS);
+      continue;
+    }
+    break;
+  }
+
+  // Empty header that ends the batch
+  if (result == YMODEM_TRANSMIT_OK) {
+    result = waitFor(CRC16);
+  }
+  if (result == YMODEM_TRANSMIT_OK) {
+    memset(frame + PACKET_HEADER, 0, PACKET_SIZE);
+    prepareFrame(SOH, 0, PACKET_SIZE);
+    result = sendFrame(PACKET_SIZE);
+  }
+  // A NAK while waiting for 'C' is out of sequence
+  return (result == YMODEM_RECEIVED_NAK) ? cancel(YMODEM_INVALID_HEADER) : result;
+}
+
+#endif // YMODEMENGINE_H
@@ -0,0 +1,236 @@
+/**
+ * @file YmodemFec.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Reed-Solomon parity of the Ymodem packets
+ * @version 0.1
+ * @date 2025-06-18
+ *
+ * The code is systematic, over GF(256) with the polynomial 0x11d, and the
+ * roots of its generator are alpha^0 to alpha^(YMODEM_FEC_PARITY - 1). The
+ * codewords shorter than 255 bytes are shortened codes, the missing leading
+ * bytes are zeros. The decoder finds the error locator with Berlekamp-Massey,
+ * its roots with a Chien search and the error values with Forney's formula.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "YmodemFec.h"
+
+#include <string.h>
+
+/**
+ * @brief Logarithm and exponential tables of GF(256), and the generator of the code.
+ */
+struct YmodemGalois
+{
+  uint8_t exp[2 * 255];                     /**< alpha^i, twice so that a sum of two logarithms needs no modulo. */
+  uint8_t log[256];                         /**< Logarithm of every non-zero element. */
+  uint8_t generator[YMODEM_FEC_PARITY + 1]; /**< Generator polynomial, highest degree first. */
+
+  YmodemGalois()
+  {
+    uint16_t x = 1;
+    for (int i = 0; i < 255; i++) {
+      exp[i]       = x;
+      exp[i + 255] = x;
+      log[x]       = i;
+      x <<= 1;
+      if (x & 0x100) {
+        x ^= 0x11d;
+      }
+    }
+    log[0] = 0;
+
+    // Product of (x - alpha^i), the subtraction is an addition in GF(256)
+    memset(generator, 0, sizeof(generator));
+    generator[0] = 1;
+    for (int i = 0; i < YMODEM_FEC_PARITY; i++) {
+      for (int j = i + 1; j > 0; j--) {
+        generator[j] ^= mul(generator[j - 1], exp[i]);
+      }
+    }
+  }
+
+  uint8_t mul(uint8_t a, uint8_t b) const
+  {
+    return (a == 0 || b == 0) ? 0 : exp[log[a] + log[b]];
+  }
+
+  uint8_t div(uint8_t a, uint8_t b) const
+  {
+    return (a == 0) ? 0 : exp[log[a] + 255 - log[b]];
+  }
+
+  /**
+   * @brief Evaluates a polynomial, lowest degree first, at alpha^power.
+   */
+  uint8_t eval(const uint8_t* poly, int count, int power) const
+  {
+    uint8_t value = 0;
+    for (int i = 0; i < count; i++) {
+      if (poly[i] != 0) {
+        value ^= exp[(log[poly[i]] + power * i) % 255];
+      }
+    }
+    return value;
+  }
+};
+
+static const YmodemGalois& galois()
+{
+  static const YmodemGalois tables;
+  return tables;
+}
+
+/**
+ * @brief Repairs one codeword of size bytes, message and parity, in place.
+ *
+ * @return int Number of bytes repaired, -1 if there are too many errors.
+ */
+static int repairCodeword(uint8_t* codeword, int size)
+{
+  const YmodemGalois& gf = galois();
+  uint8_t             syndromes[YMODEM_FEC_PARITY];
+  bool                damaged = false;
+
+  for (int i = 0; i < YMODEM_FEC_PARITY; i++) {
+    uint8_t value = 0;
+    for (int j = 0; j < size; j++) {
+      value = ((value == 0) ? 0 : gf.exp[gf.log[value] + i]) ^ codeword[j];
+    }
+    syndromes[i] = value;
+    damaged |= (value != 0);
+  }
+  if (!damaged) {
+    return 0;
+  }
+
+  // Berlekamp-Massey: error locator, lowest degree first
+  uint8_t locator[YMODEM_FEC_PARITY + 1]  = {1};
+  uint8_t previous[YMODEM_FEC_PARITY + 1] = {1};
+  uint8_t saved[YMODEM_FEC_PARITY + 1];
+  int     errors  = 0;
+  int     shift   = 1;
+  uint8_t lastGap = 1;
+  for (int r = 0; r < YMODEM_FEC_PARITY; r++) {
+    uint8_t gap = syndromes[r];
+    for (int i = 1; i <= errors; i++) {
+      gap ^= gf.mul(locator[i], syndromes[r - i]);
+    }
+    if (gap == 0) {
+      shift++;
+      continue;
+    }
+    uint8_t scale = gf.div(gap, lastGap);
+    memcpy(saved, locator, sizeof(saved));
+    for (int i = 0; i + shift <= YMODEM_FEC_PARITY; i++) {
+      locator[i + shift] ^= gf.mul(scale, previous[i]);
+    }
+    if (2 * errors <= r) {
+      errors = r + 1 - errors;
+      memcpy(previous, saved, sizeof(previous));
+      lastGap = gap;
+      shift   = 1;
+    }
+    else {
+      shift++;
+    }
+  }
+  if (errors > YMODEM_FEC_PARITY / 2) {
+    return -1;
+  }
+
+  // Error evaluator, the syndromes times the locator up to the degree of the parity
+  uint8_t evaluator[YMODEM_FEC_PARITY];
+  for (int k = 0; k < YMODEM_FEC_PARITY; k++) {
+    evaluator[k] = 0;
+    for (int i = 0; i <= k && i <= errors; i++) {
+      evaluator[k] ^= gf.mul(locator[i], syndromes[k - i]);
+    }
+  }
+  // Formal derivative of the locator, only its odd terms remain
+  uint8_t derivative[YMODEM_FEC_PARITY];
+  for (int i = 0; i < YMODEM_FEC_PARITY; i++) {
+    derivative[i] = (i % 2 == 0) ? locator[i + 1] : 0;
+  }
+
+  // Chien search over the positions of the codeword, the byte j is the term of degree size - 1 - j
+  int found = 0;
+  for (int j = 0; j < size; j++) {
+    int degree  = size - 1 - j;
+    int inverse = (255 - degree) % 255;
+    if (gf.eval(locator, errors + 1, inverse) != 0) {
+      continue;
+    }
+    uint8_t denominator = gf.eval(derivative, errors, inverse);
+    if (denominator == 0) {
+      return -1;
+    }
+    // Forney, with alpha^0 as the first root of the generator: X * evaluator(1/X) / locator'(1/X)
+    uint8_t value = gf.div(gf.eval(evaluator, YMODEM_FEC_PARITY, inverse), denominator);
+    codeword[j] ^= gf.mul(value, gf.exp[degree]);
+    found++;
+  }
+  return (found == errors) ? found : -1;
+}
+
+size_t Ymodem_FecEncode(uint8_t* data, size_t size)
+{
+  const YmodemGalois& gf     = galois();
+  size_t              count  = (size + YMODEM_FEC_DATA - 1) / YMODEM_FEC_DATA;
+  uint8_t*            parity = data + size;
+
+  for (size_t c = 0; c < count; c++) {
+    // Division by the generator in a shift register, the remainder is the parity
+    uint8_t remainder[YMODEM_FEC_PARITY] = {};
+    for (size_t i = c; i < size; i += count) {
+      uint8_t feedback = data[i] ^ remainder[0];
+      memmove(remainder, remainder + 1, YMODEM_FEC_PARITY - 1);
+      remainder[YMODEM_FEC_PARITY - 1] = 0;
+      if (feedback != 0) {
+        for (int j = 0; j < YMODEM_FEC_PARITY; j++) {
+          remainder[j] ^= gf.mul(gf.generator[j + 1], feedback);
+        }
+      }
+    }
+    for (int j = 0; j < YMODEM_FEC_PARITY; j++) {
+      parity[j * count + c] = remainder[j];
+    }
+  }
+  return count * YMODEM_FEC_PARITY;
+}
+
+int Ymodem_FecRepair(uint8_t* data, size_t size)
+{
+  size_t   count  = (size + YMODEM_FEC_DATA - 1) / YMODEM_FEC_DATA;
+  uint8_t* parity = data + size;
+  int      total  = 0;
+
+  for (size_t c = 0; c < count; c++) {
+    uint8_t codeword[YMODEM_FEC_CODEWORD];
+    int     length = 0;
+    for (size_t i = c; i < size; i += count) {
+      codeword[length++] = data[i];
+    }
+    for (int j = 0; j < YMODEM_FEC_PARITY; j++) {
+      codeword[length++] = parity[j * count + c];
+    }
+
+    int repaired = repairCodeword(codeword, length);
+    if (repaired < 0) {
+      return -1;
+    }
+    if (repaired == 0) {
+      continue;
+    }
+    length = 0;
+    for (size_t i = c; i < size; i += count) {
+      data[i] = codeword[length++];
+    }
+    for (int j = 0; j < YMODEM_FEC_PARITY; j++) {
+      parity[j * count + c] = codeword[length++];
+    }
+    total += repaired;
+  }
+  return total;
+}
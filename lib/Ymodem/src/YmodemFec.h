@@ -0,0 +1,48 @@
+/**
+ * @file YmodemFec.h
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Reed-Solomon parity of the Ymodem packets
+ * @version 0.1
+ * @date 2025-06-18
+ *
+ * This file contains the forward error correction of the packets negotiated
+ * between two peers of this library. The protected bytes are split into
+ * interleaved Reed-Solomon codewords over GF(256), byte i going to codeword
+ * i % n, so a burst of damaged bytes is shared between the codewords. Every
+ * codeword carries YMODEM_FEC_PARITY parity bytes and repairs up to half as
+ * many damaged bytes; the parity is interleaved the same way after the bytes.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef YMODEMFEC_H
+#define YMODEMFEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "YmodemArena.h"
+
+/**
+ * @brief Computes the parity of a message.
+ *
+ * @param data Pointer to the message, followed by room for its parity.
+ * @param size Number of bytes in the message, YMODEM_FEC_MESSAGE_SIZE() of a block.
+ * @return size_t Number of parity bytes written after the message.
+ */
+size_t Ymodem_FecEncode(uint8_t* data, size_t size);
+
+/**
+ * @brief Repairs a message with its parity, in place.
+ *
+ * A repaired message is not guaranteed to be the one sent when the damage is beyond the
+ * parity, the caller checks it again with the CRC of the packet.
+ *
+ * @param data Pointer to the message followed by its parity, as written by Ymodem_FecEncode().
+ * @param size Number of bytes in the message.
+ * @return int Number of bytes repaired, 0 if there was nothing to repair, -1 if a codeword
+ *             has too many damaged bytes.
+ */
+int Ymodem_FecRepair(uint8_t* data, size_t size);
+
+#endif // YMODEMFEC_H
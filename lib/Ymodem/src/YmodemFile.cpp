@@ -0,0 +1,119 @@
+/**
+ * @file YmodemFile.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  File adapters for Ymodem sessions
+ * @version 0.1
+ * @date 2025-05-19
+ *
+ * This file contains the adapters between the Ymodem session state machines
+ * and the ESP32 filesystems.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "YmodemFile.h"
+#include "YmodemLog.h"
+
+#include <algorithm>
+
+YmodemFileSink::YmodemFileSink(fs::File& file, char* getname, bool reserveSpace) : file(file), getname(getname), reserveSpace(reserveSpace)
+{
+}
+
+YmodemFileSink::~YmodemFileSink()
+{
+  release();
+}
+
+bool YmodemFileSink::reserve(uint32_t size)
+{
+  if (!reserveSpace) {
+    return true;
+  }
+  if (FileSystem::reserveSpace(size) != LITTLEFS_OK) {
+    return false;
+  }
+  reserved          = size;
+  pending           = size;
+  counters.reserved = size;
+  return true;
+}
+
+bool YmodemFileSink::open(const char* name, uint32_t size)
+{
+  if (opened || !file) {
+    return false;
+  }
+  if (getname) {
+    strcpy(getname, name);
+  }
+  opened = true;
+  return true;
+}
+
+bool YmodemFileSink::resume(const char* name, uint32_t size, uint32_t* offset)
+{
+  if (!open(name, size)) {
+    return false;
+  }
+  *offset = std::min<uint32_t>(file.size(), size);
+  file.seek(*offset);
+
+  uint32_t kept = std::min(*offset, pending);
+  FileSystem::releaseReservedSpace(reserved - pending, kept);
+  pending           -= kept;
+  counters.reserved -= kept;
+  return true;
+}
+
+int YmodemFileSink::write(const uint8_t* data, size_t size)
+{
+  uint32_t start   = micros();
+  int      written = file.write(data, size);
+  uint32_t elapsed = micros() - start;
+  LED_toggle();
+
+  counters.writes++;
+  counters.totalUs += elapsed;
+  counters.maxUs = std::max(counters.maxUs, elapsed);
+
+  if (written > 0) {
+    uint32_t consumed = std::min<uint32_t>(written, pending);
+    FileSystem::consumeReservedSpace(reserved - pending, consumed);
+    pending -= consumed;
+  }
+  return written;
+}
+
+void YmodemFileSink::close()
+{
+  file.flush();
+  release();
+  FileSystem::invalidateCache(); // The file was written behind the back of FileSystem
+}
+
+const YmodemWriteStats& YmodemFileSink::stats() const
+{
+  return counters;
+}
+
+void YmodemFileSink::release()
+{
+  if (pending > 0) {
+    FileSystem::releaseReservedSpace(reserved - pending, pending);
+    pending = 0;
+  }
+}
+
+YmodemFileSource::YmodemFileSource(FileSystem& fs, const char* path) : fs(fs), path(path)
+{
+}
+
+int YmodemFileSource::read(uint8_t* data, size_t size, uint32_t offset)
+{
+  if (fs.readFromFile(path, data, size, offset) != LITTLEFS_OK) {
+    YMODEM_LOGE("Failed to read the file at offset %u", offset);
+    return -1;
+  }
+  return size;
+}
@@ -0,0 +1,98 @@
+/**
+ * @file YmodemFile.h
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  File adapters for Ymodem sessions
+ * @version 0.1
+ * @date 2025-05-19
+ *
+ * This file contains the adapters between the Ymodem session state machines
+ * and the ESP32 filesystems: an open fs::File receives the incoming data and
+ * a LittleFS file provides the outgoing data.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef YMODEMFILE_H
+#define YMODEMFILE_H
+
+#include "fileSystem.h"
+
+#include "YmodemSession.h"
+
+/**
+ * @brief Receive sink writing into a file opened by the caller.
+ *
+ * The sink accepts a single file per session, the file is neither opened nor closed by the sink.
+ * The size announced in the header is reserved in the LittleFS FileSystem metadata cache, so a file
+ * that does not fit is refused before its first block.
+ */
+class YmodemFileSink : public YmodemReceiveSink
+{
+public:
+  /**
+   * @brief Constructor for the YmodemFileSink class.
+   *
+   * @param file File where the received data will be written.
+   * @param getname Pointer to a character array where the name of the received file will be stored, may be NULL.
+   * @param reserveSpace True to reserve the file size in LittleFS, false for files on another file system.
+   */
+  YmodemFileSink(fs::File& file, char* getname, bool reserveSpace = true);
+
+  /**
+   * @brief Destructor for the YmodemFileSink class, releases what is left of the reservation.
+   */
+  ~YmodemFileSink();
+
+  bool reserve(uint32_t size) override;
+  bool open(const char* name, uint32_t size) override;
+  int  write(const uint8_t* data, size_t size) override;
+  void close() override;
+
+  /**
+   * @brief Continues the file after the bytes it already holds.
+   *
+   * The caller opens the file for appending; the part already written is taken off the reservation.
+   */
+  bool resume(const char* name, uint32_t size, uint32_t* offset) override;
+
+  /**
+   * @brief Retrieves the write counters.
+   *
+   * @return const YmodemWriteStats& Reference to the counters.
+   */
+  const YmodemWriteStats& stats() const;
+
+private:
+  fs::File&        file;             /**< File where the received data is written. */
+  char*            getname;          /**< Buffer receiving the file name, may be NULL. */
+  bool             opened   = false; /**< True once a file has been accepted. */
+  bool             reserveSpace;     /**< True to reserve the file size in LittleFS. */
+  uint32_t         reserved = 0;     /**< Bytes reserved from the start of the file. */
+  uint32_t         pending  = 0;     /**< Bytes reserved and not written yet. */
+  YmodemWriteStats counters = {};    /**< Counters reported by stats(). */
+
+  void release();
+};
+
+/**
+ * @brief Transmit source reading a file from LittleFS.
+ */
+class YmodemFileSource : public YmodemTransmitSource
+{
+public:
+  /**
+   * @brief Constructor for the YmodemFileSource class.
+   *
+   * @param fs File system the file is read from.
+   * @param path Path of the file, it must outlive the source.
+   */
+  YmodemFileSource(FileSystem& fs, const char* path);
+
+  int read(uint8_t* data, size_t size, uint32_t offset) override;
+
+private:
+  FileSystem& fs;   /**< File system the file is read from. */
+  const char* path; /**< Path of the file. */
+};
+
+#endif // YMODEMFILE_H
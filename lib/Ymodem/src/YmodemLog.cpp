@@ -0,0 +1,224 @@
+/**
+ * @file YmodemLog.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Deferred binary log of the library
+ * @version 0.1
+ * @date 2025-06-13
+ *
+ * The ring is a bounded queue with one sequence number per slot. A writer
+ * claims a position with a compare-and-swap on head, fills the slot and
+ * publishes it by storing the position plus one in its sequence. The drain
+ * reads a slot once its sequence says it is published, then hands it back to
+ * the writers by storing the position of the next lap.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "YmodemLog.h"
+#include "YmodemSession.h"
+
+#include <algorithm>
+#include <new>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include <driver/uart.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#include <chrono>
+#include <thread>
+#endif
+
+YmodemLog::YmodemLog(size_t capacity)
+{
+  uint32_t size = 1;
+  while (size < capacity) {
+    size <<= 1;
+  }
+  slots = new (std::nothrow) Slot[size];
+  if (slots == NULL) {
+    return;
+  }
+  this->capacity = size;
+  for (uint32_t i = 0; i < size; i++) {
+    slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+YmodemLog::~YmodemLog()
+{
+  delete[] slots;
+}
+
+bool YmodemLog::record(const YmodemLogEvent* event, const uint32_t* args, size_t count)
+{
+  if (event->level > level.load(std::memory_order_relaxed)) {
+    return false;
+  }
+
+  // Errors and warnings may take the whole ring, the other levels leave them a quarter of it
+  uint32_t limit    = (event->level <= YMODEM_LOG_WARN) ? capacity : capacity - capacity / 4;
+  uint32_t position = head.load(std::memory_order_relaxed);
+  Slot*    slot;
+  while (true) {
+    if (position - tail.load(std::memory_order_acquire) >= limit) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    slot             = &slots[position & (capacity - 1)];
+    uint32_t written = slot->sequence.load(std::memory_order_acquire);
+    if (written == position) {
+      if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    }
+    else {
+      position = head.load(std::memory_order_relaxed); // Another writer took the position
+    }
+  }
+
+  slot->record.event = event;
+  slot->record.time  = Ymodem_Millis();
+  count              = (count < YMODEM_LOG_MAX_ARGS) ? count : YMODEM_LOG_MAX_ARGS;
+  memcpy(slot->record.args, args, count * sizeof(uint32_t));
+  slot->sequence.store(position + 1, std::memory_order_release);
+
+  recorded.fetch_add(1, std::memory_order_relaxed);
+  // The drain may already be past this record, the difference is then negative
+  int32_t  waiting = (int32_t)(position + 1 - tail.load(std::memory_order_relaxed));
+  uint32_t highest = peak.load(std::memory_order_relaxed);
+  while (waiting > (int32_t)highest && !peak.compare_exchange_weak(highest, waiting, std::memory_order_relaxed)) {
+  }
+  return true;
+}
+
+size_t YmodemLog::drain(const Writer& write, size_t maxRecords)
+{
+  char   line[YMODEM_LOG_LINE_SIZE];
+  size_t count = 0;
+
+  while (count < maxRecords && capacity > 0) {
+    uint32_t position = tail.load(std::memory_order_relaxed);
+    Slot&    slot     = slots[position & (capacity - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != position + 1) {
+      break;
+    }
+    YmodemLogRecord record = slot.record;
+    slot.sequence.store(position + capacity, std::memory_order_release);
+    tail.store(position + 1, std::memory_order_release);
+
+    write(line, format(record, line, sizeof(line)));
+    drained++;
+    count++;
+  }
+
+  uint32_t lost = dropped.load(std::memory_order_relaxed);
+  if (lost != reported) {
+    int length = snprintf(line, sizeof(line), "[%6u][W] %u log records dropped\n", (unsigned)Ymodem_Millis(), (unsigned)(lost - reported));
+    write(line, std::min<size_t>(length, sizeof(line) - 1));
+    reported = lost;
+  }
+  return count;
+}
+
+size_t YmodemLog::format(const YmodemLogRecord& record, char* text, size_t size)
+{
+  static const char levels[] = "NEWIDV";
+  const uint32_t*   args     = record.args;
+  const char*       format   = record.event->format;
+
+  int length;
+  if (record.event->formatter != NULL) {
+    length = record.event->formatter(text, size, args);
+  }
+  else {
+    int prefix = snprintf(text, size, "[%6u][%c] ", (unsigned)record.time, levels[record.event->level % 6]);
+    prefix     = std::min<int>(prefix, size - 1);
+    length     = prefix + snprintf(text + prefix, size - prefix, format, args[0], args[1], args[2], args[3], args[4], args[5]);
+    if (length < (int)size - 1) {
+      text[length++] = '\n';
+      text[length]   = '\0';
+    }
+  }
+  return (length < 0) ? 0 : std::min<size_t>(length, size - 1);
+}
+
+void YmodemLog::setLevel(YmodemLogLevel level)
+{
+  this->level.store(level, std::memory_order_relaxed);
+}
+
+YmodemLogStats YmodemLog::stats() const
+{
+  return {recorded.load(std::memory_order_relaxed), dropped.load(std::memory_order_relaxed), drained, peak.load(std::memory_order_relaxed)};
+}
+
+void YmodemLog::resetStats()
+{
+  recorded.store(0, std::memory_order_relaxed);
+  dropped.store(0, std::memory_order_relaxed);
+  peak.store(0, std::memory_order_relaxed);
+  drained  = 0;
+  reported = 0;
+}
+
+YmodemLog& Ymodem_Log()
+{
+  static YmodemLog log;
+  return log;
+}
+
+/**
+ * @brief Writes the lines of the drain task when no writer was given.
+ */
+static void writeConsole(const char* text, size_t size)
+{
+#ifdef ESP_PLATFORM
+  uart_write_bytes(UART_NUM_0, text, size);
+#else
+  fwrite(text, 1, size, stderr);
+#endif
+}
+
+#ifdef ESP_PLATFORM
+/**
+ * @brief Body of the drain task, it never returns.
+ */
+static void logTask(void* param)
+{
+  YmodemLog::Writer* write = static_cast<YmodemLog::Writer*>(param);
+  while (true) {
+    Ymodem_Log().drain(*write);
+    vTaskDelay(pdMS_TO_TICKS(YMODEM_LOG_DRAIN_MS));
+  }
+}
+#endif
+
+bool Ymodem_StartLogTask(const YmodemLog::Writer& write, const YmodemTaskConfig& config)
+{
+  static std::atomic<bool> started{false};
+  if (started.exchange(true)) {
+    return true;
+  }
+
+  YmodemLog::Writer* writer = new YmodemLog::Writer(write ? write : YmodemLog::Writer(writeConsole));
+#ifdef ESP_PLATFORM
+  BaseType_t core = (config.core < 0) ? tskNO_AFFINITY : config.core;
+  if (xTaskCreatePinnedToCore(logTask, "ymodem_log", config.stackSize, writer, config.priority, NULL, core) != pdPASS) {
+    delete writer;
+    started = false;
+    return false;
+  }
+#else
+  (void)config;
+  std::thread([writer]() {
+    while (true) {
+      Ymodem_Log().drain(*writer);
+      std::this_thread::sleep_for(std::chrono::milliseconds(YMODEM_LOG_DRAIN_MS));
+    }
+  }).detach();
+#endif
+  return true;
+}
@@ -0,0 +1,228 @@
+/**
+ * @file YmodemLog.h
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Deferred binary log of the library
+ * @version 0.1
+ * @date 2025-06-13
+ *
+ * The transfer code does not format text. A log call stores the address of a
+ * static event, which holds the level and the format, and its integer arguments
+ * into a lock-free ring. A low-priority task formats and prints the records
+ * later, so a log call during a transfer costs a few stores. When the ring is
+ * full the new records are dropped and counted. Info and debug records are
+ * dropped once the ring is three quarters full, so that errors and warnings
+ * still fit.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef YMODEMLOG_H
+#define YMODEMLOG_H
+
+#include "YmodemAsync.h"
+#include "YmodemDef.h"
+
+#include <atomic>
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Levels of the log records, the same as CORE_DEBUG_LEVEL.
+ */
+enum YmodemLogLevel : uint8_t
+{
+  YMODEM_LOG_NONE    = 0,
+  YMODEM_LOG_ERROR   = 1,
+  YMODEM_LOG_WARN    = 2,
+  YMODEM_LOG_INFO    = 3,
+  YMODEM_LOG_DEBUG   = 4,
+  YMODEM_LOG_VERBOSE = 5,
+};
+
+/**
+ * @brief Function formatting a record instead of the format of its event.
+ *
+ * @param text Buffer receiving the text, the drain writes it without the level prefix.
+ * @param size Size of the buffer.
+ * @param args Arguments of the record.
+ * @return int Length of the text, as snprintf() returns it.
+ */
+typedef int (*YmodemLogFormatter)(char* text, size_t size, const uint32_t* args);
+
+/**
+ * @brief Static description of a log message, its address identifies the records.
+ */
+struct YmodemLogEvent
+{
+  YmodemLogLevel     level;     // Level of the message
+  const char*        format;    // printf() format with 32-bit integer conversions only (%d, %u, %x, %c)
+  YmodemLogFormatter formatter; // Formats the record instead of format, NULL to use format
+};
+
+/**
+ * @brief Record stored in the ring, 32 bytes on the ESP32.
+ */
+struct YmodemLogRecord
+{
+  const YmodemLogEvent* event;                     // Message logged
+  uint32_t              time;                      // Ymodem_Millis() when it was logged
+  uint32_t              args[YMODEM_LOG_MAX_ARGS]; // Integer arguments
+};
+
+/**
+ * @brief Counters of a log, cumulative until resetStats() is called.
+ */
+struct YmodemLogStats
+{
+  uint32_t recorded; // Records stored
+  uint32_t dropped;  // Records dropped because the ring was full
+  uint32_t drained;  // Records formatted and written by drain()
+  uint32_t peak;     // Highest number of records waiting in the ring
+};
+
+/**
+ * @brief Lock-free ring of log records, written by any task and drained by one.
+ */
+class YmodemLog
+{
+public:
+  /**
+   * @brief Function receiving the formatted lines.
+   */
+  typedef std::function<void(const char* text, size_t size)> Writer;
+
+  /**
+   * @brief Constructor for the YmodemLog class.
+   *
+   * @param capacity Records in the ring, rounded up to a power of two.
+   */
+  YmodemLog(size_t capacity = YMODEM_LOG_SIZE);
+
+  /**
+   * @brief Destructor for the YmodemLog class.
+   */
+  ~YmodemLog();
+
+  YmodemLog(const YmodemLog&)            = delete;
+  YmodemLog& operator=(const YmodemLog&) = delete;
+
+  /**
+   * @brief Stores a record, it never blocks.
+   *
+   * @param event Static event of the message.
+   * @param args Integer arguments of the message.
+   * @param count Number of arguments, at most YMODEM_LOG_MAX_ARGS.
+   * @return true if the record was stored, false if it was filtered out or dropped.
+   */
+  bool record(const YmodemLogEvent* event, const uint32_t* args, size_t count);
+
+  /**
+   * @brief Stores a record with the given arguments, integers only.
+   */
+  template <typename... Args> bool log(const YmodemLogEvent* event, Args... args)
+  {
+    static_assert(sizeof...(Args) <= YMODEM_LOG_MAX_ARGS, "Too many log arguments");
+    const uint32_t values[] = {(uint32_t)args..., 0};
+    return record(event, values, sizeof...(Args));
+  }
+
+  /**
+   * @brief Formats the waiting records and writes them, oldest first.
+   *
+   * Only one task may drain a log. Dropped records are reported by a warning line.
+   *
+   * @param write Function receiving every formatted line.
+   * @param maxRecords Largest number of records drained by this call.
+   * @return size_t Number of records drained.
+   */
+  size_t drain(const Writer& write, size_t maxRecords = SIZE_MAX);
+
+  /**
+   * @brief Formats a record the way drain() does.
+   *
+   * @param record Record to format.
+   * @param text Buffer receiving the line.
+   * @param size Size of the buffer.
+   * @return size_t Length of the line, truncated to the buffer.
+   */
+  static size_t format(const YmodemLogRecord& record, char* text, size_t size);
+
+  /**
+   * @brief Sets the most verbose level recorded, YMODEM_LOG_LEVEL still bounds it.
+   *
+   * @param level Records above this level are discarded without being stored.
+   */
+  void setLevel(YmodemLogLevel level);
+
+  /**
+   * @brief Retrieves the counters of the log.
+   *
+   * @return YmodemLogStats The counters.
+   */
+  YmodemLogStats stats() const;
+
+  /**
+   * @brief Clears the counters of the log.
+   */
+  void resetStats();
+
+private:
+  struct Slot
+  {
+    std::atomic<uint32_t> sequence; /**< Position the slot is written at next, or the position plus one once written. */
+    YmodemLogRecord       record;   /**< Record of the slot. */
+  };
+
+  Slot*                 slots    = NULL;           /**< Ring of capacity slots. */
+  uint32_t              capacity = 0;              /**< Records in the ring, a power of two. */
+  std::atomic<uint32_t> head{0};                   /**< Next position written by record(). */
+  std::atomic<uint32_t> tail{0};                   /**< Next position read by drain(). */
+  std::atomic<uint8_t>  level{YMODEM_LOG_VERBOSE}; /**< Most verbose level recorded. */
+  std::atomic<uint32_t> recorded{0};               /**< Records stored. */
+  std::atomic<uint32_t> dropped{0};                /**< Records dropped. */
+  std::atomic<uint32_t> peak{0};                   /**< Highest number of records waiting. */
+  uint32_t              drained  = 0;              /**< Records drained. */
+  uint32_t              reported = 0;              /**< Dropped records already reported by drain(). */
+};
+
+/**
+ * @brief Retrieves the log of the library, used by the YMODEM_LOGx macros.
+ *
+ * @return YmodemLog& The log, YMODEM_LOG_SIZE records.
+ */
+YmodemLog& Ymodem_Log();
+
+/**
+ * @brief Starts the task draining the log of the library every YMODEM_LOG_DRAIN_MS.
+ *
+ * Calling it again does nothing. The Ymodem class starts it.
+ *
+ * @param write Function receiving the lines, empty to print them on UART0 (stderr on the host).
+ * @param config Settings of the drain task.
+ * @return true if the task runs, false if it could not be created.
+ */
+bool Ymodem_StartLogTask(const YmodemLog::Writer& write = YmodemLog::Writer(),
+                         const YmodemTaskConfig& config = YmodemTaskConfig{YMODEM_LOG_TASK_STACK_SIZE, YMODEM_LOG_TASK_PRIORITY, YMODEM_TASK_CORE});
+
+/**
+ * @brief Logs a message of the given level into the log of the library.
+ *
+ * The event is a static constant, only its address and the integer arguments are stored.
+ * Levels above YMODEM_LOG_LEVEL are compiled out.
+ */
+#define YMODEM_LOG_AT(logLevel, logFormat, ...)                                      \
+  do {                                                                               \
+    if ((logLevel) <= YMODEM_LOG_LEVEL) {                                            \
+      static const YmodemLogEvent ymodemLogEvent = {(logLevel), (logFormat), NULL};  \
+      Ymodem_Log().log(&ymodemLogEvent, ##__VA_ARGS__);                              \
+    }                                                                                \
+  } while (0)
+
+#define YMODEM_LOGE(format, ...) YMODEM_LOG_AT(YMODEM_LOG_ERROR, format, ##__VA_ARGS__)   /*!< Logs an error */
+#define YMODEM_LOGW(format, ...) YMODEM_LOG_AT(YMODEM_LOG_WARN, format, ##__VA_ARGS__)    /*!< Logs a warning */
+#define YMODEM_LOGI(format, ...) YMODEM_LOG_AT(YMODEM_LOG_INFO, format, ##__VA_ARGS__)    /*!< Logs an information */
+#define YMODEM_LOGD(format, ...) YMODEM_LOG_AT(YMODEM_LOG_DEBUG, format, ##__VA_ARGS__)   /*!< Logs a debug message */
+#define YMODEM_LOGV(format, ...) YMODEM_LOG_AT(YMODEM_LOG_VERBOSE, format, ##__VA_ARGS__) /*!< Logs a verbose message */
+
+#endif // YMODEMLOG_H
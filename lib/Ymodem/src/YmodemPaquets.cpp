@@ -12,15 +12,54 @@
  *
  */
 #include "YmodemPaquets.h"
+#include "YmodemDigest.h"
+#include "YmodemFec.h"
 
-void Ymodem_PrepareIntialPacket(uint8_t* data, const char* fileName, uint32_t length)
+/**
+ * @brief Appends a field to the fields of a header, with a space before it when needed.
+ *
+ * @param fields Fields of the header, after the name.
+ * @param room Bytes left for the fields, the terminating zero excluded. Updated.
+ * @param field Field to append.
+ * @return true if the field was appended, false if it does not fit whole and nothing was written.
+ */
+static bool Ymodem_AppendField(char* fields, int& room, const char* field)
 {
+  const char* separator = (fields[strlen(fields) - 1] == ' ') ? "" : " ";
+  int         len       = strlen(separator) + strlen(field);
+  if (len > room) {
+    return false;
+  }
+  strcat(fields, separator);
+  strcat(fields, field);
+  room -= len;
+  return true;
+}
+
+uint8_t Ymodem_PrepareIntialPacket(uint8_t* data, const char* fileName, uint32_t length, const char* digest, uint32_t blockSize, uint32_t modTime,
+                                   uint32_t mode, bool skip, bool fec)
+{
+  uint8_t dropped = YMODEM_FIELD_NONE;
+
   memset(data, 0, PACKET_SIZE + PACKET_HEADER);
   // Make first three packet
   data[0] = SOH;
   data[1] = 0x00;
   data[2] = 0xff;
 
+  // the name, its zero, the size and a space must fit, a packet without them would end the batch
+  char size[FILE_SIZE_LENGTH];
+  snprintf(size, sizeof(size), "%lu ", (unsigned long)length);
+  if (strlen(fileName) + 1 + strlen(size) > PACKET_SIZE - 1) {
+    uint8_t requested = YMODEM_FIELD_NAME;
+    requested |= (digest != NULL) ? YMODEM_FIELD_DIGEST : YMODEM_FIELD_NONE;
+    requested |= (blockSize > PACKET_1K_SIZE) ? YMODEM_FIELD_BLOCK_SIZE : YMODEM_FIELD_NONE;
+    requested |= (modTime != 0 || mode != 0) ? YMODEM_FIELD_ATTRIBUTES : YMODEM_FIELD_NONE;
+    requested |= skip ? YMODEM_FIELD_SKIP : YMODEM_FIELD_NONE;
+    requested |= fec ? YMODEM_FIELD_FEC : YMODEM_FIELD_NONE;
+    return requested;
+  }
+
   // add filename
   sprintf((char*)(data + PACKET_HEADER), "%s", fileName);
 
@@ -28,11 +67,50 @@ void Ymodem_PrepareIntialPacket(uint8_t* data, const char* fileName, uint32_t le
   sprintf((char*)(data + PACKET_HEADER + strlen((char*)(data + PACKET_HEADER)) + 1), "%d", length);
   data[PACKET_HEADER + strlen((char*)(data + PACKET_HEADER)) + 1 +
        strlen((char*)(data + PACKET_HEADER + strlen((char*)(data + PACKET_HEADER)) + 1))] = ' ';
+  char* fields = (char*)(data + PACKET_HEADER + strlen((char*)(data + PACKET_HEADER)) + 1);
+
+  // add modification time and mode, the standard fields that follow the size. A truncated time would
+  // be taken for another one, so both are written whole or reported. The digest after them keeps its
+  // room: without the attributes only the skip is lost, without the digest the transfer fails
+  int room = PACKET_SIZE - (fields - (char*)(data + PACKET_HEADER)) - strlen(fields) - 1;
+  if (modTime != 0 || mode != 0) {
+    char attributes[2 * FILE_SIZE_LENGTH];
+    int  digestRoom = (digest != NULL) ? strlen(digest) + 1 : 0;
+    snprintf(attributes, sizeof(attributes), "%lo %lo", (unsigned long)modTime, (unsigned long)mode);
+    room -= digestRoom;
+    if (!Ymodem_AppendField(fields, room, attributes)) {
+      dropped |= YMODEM_FIELD_ATTRIBUTES;
+    }
+    room += digestRoom;
+  }
+
+  // add digest, receivers that do not know it stop parsing at the ':'. A truncated digest would be ignored
+  // and the file accepted unverified, so it is written whole or reported
+  if (digest != NULL && !Ymodem_AppendField(fields, room, digest)) {
+    dropped |= YMODEM_FIELD_DIGEST;
+  }
+
+  // add the largest block, the skip and the fec, only if they fit: a truncated field would announce something else.
+  // Without them the transfer still works, with 1K blocks, no skip and no parity
+  char field[16];
+  if (blockSize > PACKET_1K_SIZE) {
+    snprintf(field, sizeof(field), "%s%u", BLOCK_SIZE_FIELD, (unsigned)blockSize);
+    if (!Ymodem_AppendField(fields, room, field)) {
+      dropped |= YMODEM_FIELD_BLOCK_SIZE;
+    }
+  }
+  if (skip && !Ymodem_AppendField(fields, room, SKIP_FIELD)) {
+    dropped |= YMODEM_FIELD_SKIP;
+  }
+  if (fec && !Ymodem_AppendField(fields, room, FEC_FIELD)) {
+    dropped |= YMODEM_FIELD_FEC;
+  }
 
   // add crc
   uint16_t tempCRC                      = crc16(&data[PACKET_HEADER], PACKET_SIZE);
   data[PACKET_SIZE + PACKET_HEADER]     = tempCRC >> 8;
   data[PACKET_SIZE + PACKET_HEADER + 1] = tempCRC & 0xFF;
+  return dropped;
 }
 
 void Ymodem_PrepareLastPacket(uint8_t* data)
@@ -55,7 +133,10 @@ void Ymodem_PreparePacket(uint8_t* data, uint8_t packetNum, uint32_t sizeBlock,
   data[1] = (packetNum & 0x000000ff);
   data[2] = (~(packetNum & 0x000000ff));
 
-  memcpy(data + PACKET_HEADER, buffer, sizeBlock);
+  // The block may already be in place when it was read straight into the packet
+  if (buffer != data + PACKET_HEADER) {
+    memcpy(data + PACKET_HEADER, buffer, sizeBlock);
+  }
 
   // Rellenar con ceros si el bloque es menor que PACKET_1K_SIZE
   if (sizeBlock < PACKET_1K_SIZE) {
@@ -69,6 +150,57 @@ void Ymodem_PreparePacket(uint8_t* data, uint8_t packetNum, uint32_t sizeBlock,
   data[PACKET_1K_SIZE + PACKET_HEADER + 1] = tempCRC & 0xFF;
 }
 
+size_t Ymodem_PrepareLargePacket(uint8_t* data, uint16_t packetNum, uint32_t sizeBlock, const uint8_t* buffer)
+{
+  data[0]                                 = LTX;
+  data[PACKET_LARGE_SEQNO_INDEX]          = packetNum >> 8;
+  data[PACKET_LARGE_SEQNO_INDEX + 1]      = packetNum & 0xFF;
+  data[PACKET_LARGE_SEQNO_COMP_INDEX]     = ~packetNum >> 8;
+  data[PACKET_LARGE_SEQNO_COMP_INDEX + 1] = ~packetNum & 0xFF;
+  data[PACKET_LARGE_LENGTH_INDEX]         = sizeBlock >> 8;
+  data[PACKET_LARGE_LENGTH_INDEX + 1]     = sizeBlock & 0xFF;
+
+  if (buffer != data + PACKET_LARGE_HEADER) {
+    memcpy(data + PACKET_LARGE_HEADER, buffer, sizeBlock);
+  }
+
+  // The CRC covers the sequence number and the length as well, the data is not padded
+  uint32_t tempCRC = Ymodem_Crc32(0, &data[PACKET_LARGE_SEQNO_INDEX], PACKET_LARGE_HEADER - 1 + sizeBlock);
+  uint8_t* crc     = data + PACKET_LARGE_HEADER + sizeBlock;
+  crc[0]           = tempCRC >> 24;
+  crc[1]           = (tempCRC >> 16) & 0xFF;
+  crc[2]           = (tempCRC >> 8) & 0xFF;
+  crc[3]           = tempCRC & 0xFF;
+  return sizeBlock + PACKET_LARGE_OVERHEAD;
+}
+
+size_t Ymodem_PrepareFecPacket(uint8_t* data, uint16_t packetNum, uint32_t sizeBlock, uint32_t blockSize, const uint8_t* buffer)
+{
+  data[0]                                 = FTX;
+  data[PACKET_LARGE_SEQNO_INDEX]          = packetNum >> 8;
+  data[PACKET_LARGE_SEQNO_INDEX + 1]      = packetNum & 0xFF;
+  data[PACKET_LARGE_SEQNO_COMP_INDEX]     = ~packetNum >> 8;
+  data[PACKET_LARGE_SEQNO_COMP_INDEX + 1] = ~packetNum & 0xFF;
+  data[PACKET_LARGE_LENGTH_INDEX]         = sizeBlock >> 8;
+  data[PACKET_LARGE_LENGTH_INDEX + 1]     = sizeBlock & 0xFF;
+
+  if (buffer != data + PACKET_LARGE_HEADER) {
+    memcpy(data + PACKET_LARGE_HEADER, buffer, sizeBlock);
+  }
+  memset(data + PACKET_LARGE_HEADER + sizeBlock, 0, blockSize - sizeBlock);
+
+  // The CRC covers the padding, it sits at the same place in every packet of the file
+  uint32_t tempCRC = Ymodem_Crc32(0, &data[PACKET_LARGE_SEQNO_INDEX], PACKET_LARGE_HEADER - 1 + blockSize);
+  uint8_t* crc     = data + PACKET_LARGE_HEADER + blockSize;
+  crc[0]           = tempCRC >> 24;
+  crc[1]           = (tempCRC >> 16) & 0xFF;
+  crc[2]           = (tempCRC >> 8) & 0xFF;
+  crc[3]           = tempCRC & 0xFF;
+
+  return 1 + YMODEM_FEC_MESSAGE_SIZE(blockSize) + Ymodem_FecEncode(data + 1, YMODEM_FEC_MESSAGE_SIZE(blockSize));
+}
+
+#ifdef ESP_PLATFORM
 YmodemPacketStatus Ymodem_WaitResponse(uint8_t ackchr, uint8_t timeout)
 {
   unsigned char receivedC;
@@ -95,4 +227,5 @@ YmodemPacketStatus Ymodem_WaitResponse(uint8_t ackchr, uint8_t timeout)
     }
   } while (errors < timeout);
   return YMODEM_TIMEOUT;
-}
\ No newline at end of file
+}
+#endif
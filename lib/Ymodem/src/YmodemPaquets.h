@@ -13,6 +13,20 @@
 
 #include "YmodemUtils.h"
 
+/**
+ * @brief Header fields left out by Ymodem_PrepareIntialPacket() because the packet had no room for them.
+ */
+enum YmodemHeaderField : uint8_t
+{
+  YMODEM_FIELD_NONE       = 0x00, // Every field requested is in the header
+  YMODEM_FIELD_NAME       = 0x01, // The name and the size, the header is empty
+  YMODEM_FIELD_DIGEST     = 0x02, // The digest, the receiver cannot verify the file
+  YMODEM_FIELD_BLOCK_SIZE = 0x04, // The largest block, the receiver asks for 1K blocks
+  YMODEM_FIELD_ATTRIBUTES = 0x08, // The modification time and the mode, the receiver cannot compare them
+  YMODEM_FIELD_SKIP       = 0x10, // The skip, the file is sent even if the receiver holds it
+  YMODEM_FIELD_FEC        = 0x20, // The fec, the blocks are sent without parity
+};
+
 /**
  * @brief Prepares the initial packet for Ymodem transmission.
  *
@@ -23,8 +37,19 @@
  * @param data Pointer to the buffer where the initial packet will be prepared.
  * @param fileName Pointer to a null-terminated string containing the name of the file.
  * @param length The length of the file in bytes.
+ * @param digest Optional digest of the file, such as "crc32:cbf43926", added as a field after the length.
+ * @param blockSize Largest block the sender can use. Above PACKET_1K_SIZE it is announced in a
+ *                  "blk:" field, left out when the packet has no room for it.
+ * @param modTime Modification time in seconds since 1970, sent in octal after the length with the
+ *                mode, as the standard header fields. 0 with a mode of 0 leaves both out. Both are
+ *                left out first when the packet has no room for them and the digest.
+ * @param mode Unix file mode, sent in octal after the modification time.
+ * @param skip True to add a "skip" field, the sender accepts SKIP when the receiver holds the file.
+ * @param fec True to add a "fec" field, the sender can add parity to its blocks when the receiver asks for it.
+ * @return uint8_t YmodemHeaderField bits of the fields left out, a field is written whole or not at all.
  */
-void Ymodem_PrepareIntialPacket(uint8_t* data, const char* fileName, uint32_t length);
+uint8_t Ymodem_PrepareIntialPacket(uint8_t* data, const char* fileName, uint32_t length, const char* digest = NULL, uint32_t blockSize = PACKET_1K_SIZE,
+                                   uint32_t modTime = 0, uint32_t mode = 0, bool skip = false, bool fec = false);
 
 /**
  * @brief Prepares the last packet for Ymodem transmission.
@@ -43,10 +68,44 @@ void Ymodem_PrepareLastPacket(uint8_t* data);
  * @param data Pointer to the buffer where the packet will be prepared.
  * @param packetNum Packet number to be included in the packet.
  * @param sizeBlk Size of the block to be included in the packet.
- * @param buffer Pointer to the data buffer to be included in the packet.
+ * @param buffer Pointer to the data buffer to be included in the packet. It may point to
+ *               data + PACKET_HEADER when the block was read straight into the packet.
  */
 void Ymodem_PreparePacket(uint8_t* data, uint8_t packetNum, uint32_t sizeBlk, const uint8_t* buffer);
 
+/**
+ * @brief Prepares a packet of the negotiated large-block extension.
+ *
+ * The packet carries a 16-bit sequence number and the length of its data, so the last block
+ * is not padded, and a CRC-32: a CRC-16 no longer detects every 3-bit error beyond 4 KB.
+ *
+ * @param data Pointer to the buffer where the packet will be prepared, sizeBlk + PACKET_LARGE_OVERHEAD bytes.
+ * @param packetNum Packet number to be included in the packet.
+ * @param sizeBlk Size of the block, at most PACKET_8K_SIZE.
+ * @param buffer Pointer to the data buffer to be included in the packet. It may point to
+ *               data + PACKET_LARGE_HEADER when the block was read straight into the packet.
+ * @return size_t Size of the packet in bytes.
+ */
+size_t Ymodem_PrepareLargePacket(uint8_t* data, uint16_t packetNum, uint32_t sizeBlk, const uint8_t* buffer);
+
+/**
+ * @brief Prepares a packet with the Reed-Solomon parity of the negotiated forward error correction.
+ *
+ * The header and the CRC-32 are those of the large packets, but the data is padded to the
+ * block size so that the packet size does not depend on a length that may arrive damaged.
+ * The parity of Ymodem_FecEncode() follows the CRC.
+ *
+ * @param data Pointer to the buffer where the packet will be prepared, YMODEM_FEC_FRAME_SIZE(blockSize) bytes.
+ * @param packetNum Packet number to be included in the packet.
+ * @param sizeBlk Size of the data, at most blockSize.
+ * @param blockSize Block size negotiated for the file, PACKET_1K_SIZE, PACKET_4K_SIZE or PACKET_8K_SIZE.
+ * @param buffer Pointer to the data buffer to be included in the packet. It may point to
+ *               data + PACKET_LARGE_HEADER when the block was read straight into the packet.
+ * @return size_t Size of the packet in bytes.
+ */
+size_t Ymodem_PrepareFecPacket(uint8_t* data, uint16_t packetNum, uint32_t sizeBlk, uint32_t blockSize, const uint8_t* buffer);
+
+#ifdef ESP_PLATFORM
 /**
  * @brief Waits for a specific response character within a given timeout period.
  *
@@ -59,5 +118,6 @@ void Ymodem_PreparePacket(uint8_t* data, uint8_t packetNum, uint32_t sizeBlk, co
  * @return YmodemPacketStatus Returns a status code indicating the result of the wait operation.
  */
 YmodemPacketStatus Ymodem_WaitResponse(uint8_t ackchr, uint8_t timeout = WAIT_TIMEOUT);
+#endif
 
 #endif // YMODEMPAQUETS_H
\ No newline at end of file
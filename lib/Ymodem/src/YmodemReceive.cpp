@@ -5,51 +5,17 @@
  * @version 0.1
  * @date 2025-01-24
  *
- * This file contains the functions to receive files using the Ymodem protocol.
- * It processes the incoming packets, extracts the file information, and writes
- * the data to the filesystem.
+ * This file contains the receiver state machine of the Ymodem protocol.
+ * It assembles the incoming packets, extracts the file information, and
+ * hands the data to a YmodemReceiveSink.
  *
  * @copyright Copyright (c) 2025
  *
  */
 #include "YmodemReceive.h"
+#include "YmodemFec.h"
 
-YmodemPacketStatus processDataPacket(uint8_t* packet_data, int packet_length, fs::File& ffd, unsigned int file_size)
-{
-  static unsigned int file_len = 0;
-
-  if (file_len < file_size) {
-    unsigned int write_len = packet_length;
-    file_len += packet_length;
-    if (file_len > file_size) {
-      write_len -= (file_len - file_size);
-      file_len = file_size;
-    }
-
-    int written_bytes = ffd.write(packet_data + PACKET_HEADER, write_len);
-    if (written_bytes != write_len) {
-      send_CA();
-      return YMODEM_ERROR_WRITING;
-    }
-    LED_toggle();
-  }
-  send_ACK();
-  return YMODEM_RECEIVED_OK;
-}
-
-void handleEOFPacket(unsigned int* file_done, unsigned int* errors)
-{
-  static int eof_cnt = 0;
-
-  eof_cnt++;
-  if (eof_cnt == 1) {
-    send_NAK();
-  }
-  else {
-    send_ACK();
-    *file_done = 1;
-  }
-}
+#include <algorithm>
 
 void extractFileInfo(uint8_t* packet_data, char* getname, int* size)
 {
@@ -59,7 +25,7 @@ void extractFileInfo(uint8_t* packet_data, char* getname, int* size)
 
   // Extraer el nombre del archivo
   if (getname) {
-    while ((*file_ptr != 0) && (i < 64)) { // Máximo 64 caracteres para el nombre
+    while ((*file_ptr != 0) && (i < FILE_NAME_LENGTH)) { // Máximo 64 caracteres para el nombre
       *getname = *file_ptr++;
       getname++;
       i++;
@@ -89,90 +55,447 @@ void extractFileInfo(uint8_t* packet_data, char* getname, int* size)
   }
 }
 
-YmodemPacketStatus processHeaderPacket(uint8_t* packet_data, int packet_length, unsigned int maxsize, char* getname, int* size, unsigned int* errors)
+YmodemDigestType extractFileDigest(uint8_t* packet_data, char* digest, size_t size)
+{
+  const char* field = (const char*)packet_data + PACKET_HEADER;
+  const char* end   = field + PACKET_SIZE;
+
+  // Skip the file name, then look at every field after the size
+  field += strnlen(field, PACKET_SIZE) + 1;
+  while (field < end && *field != 0) {
+    size_t length = strcspn(field, " ");
+    if (YmodemDigest::parseType(field) != YMODEM_DIGEST_NONE && length < size) {
+      memcpy(digest, field, length);
+      digest[length] = '\0';
+      return YmodemDigest::parseType(digest);
+    }
+    field += length;
+    while (*field == ' ') {
+      field++;
+    }
+  }
+  return YMODEM_DIGEST_NONE;
+}
+
+/**
+ * @brief Finds a field of the header after the file name, the fields are separated by spaces.
+ */
+static const char* findField(uint8_t* packet_data, const char* prefix)
 {
-  if (packet_data[PACKET_HEADER] != 0) { // Paquete válido
-    extractFileInfo(packet_data, getname, size);
-    if (*size < 1 || *size > maxsize) {
-      send_CA();
-      return (*size > maxsize) ? YMODEM_SIZE_OVERFLOW : YMODEM_SIZE_NULL;
+  const char* field = (const char*)packet_data + PACKET_HEADER;
+  const char* end   = field + PACKET_SIZE;
+
+  field += strnlen(field, PACKET_SIZE) + 1;
+  while (field < end && *field != 0) {
+    if (strncmp(field, prefix, strlen(prefix)) == 0) {
+      return field;
     }
-    send_ACKCRC16();
-    return YMODEM_RECEIVED_OK;
-  }
-  else { // Paquete de encabezado vacío
-    (*errors)++;
-    if (*errors > 5) {
-      send_CA();
-      return YMODEM_MAX_ERRORS;
+    field += strcspn(field, " ");
+    while (*field == ' ') {
+      field++;
     }
-    send_NAK();
-    return YMODEM_RECEIVED_OK;
   }
+  return NULL;
 }
 
-YmodemPacketStatus processPacket(uint8_t* packet_data, int packet_length, fs::File& ffd, unsigned int maxsize, char* getname,
-                                 unsigned int packets_received, int* size, unsigned int* file_done, unsigned int* errors)
+uint32_t extractFileBlockSize(uint8_t* packet_data)
 {
-  if (packet_length == 0) { // Paquete EOF
-    handleEOFPacket(file_done, errors);
-    return YMODEM_RECEIVED_OK;
+  const char* field = findField(packet_data, BLOCK_SIZE_FIELD);
+  return (field != NULL) ? strtoul(field + strlen(BLOCK_SIZE_FIELD), NULL, 10) : PACKET_1K_SIZE;
+}
+
+void extractFileAttributes(uint8_t* packet_data, uint32_t* modTime, uint32_t* mode)
+{
+  const char* field = (const char*)packet_data + PACKET_HEADER;
+  char*       next  = NULL;
+
+  // The two octal fields after the size, the digest and the extensions are not numbers
+  *modTime = 0;
+  *mode    = 0;
+  field += strnlen(field, PACKET_SIZE) + 1;
+  strtoul(field, &next, 10);
+  if (next == field || *next != ' ') {
+    return;
   }
-  else if (packet_length == -1) { // Abortado por transmisor
-    send_ACK();
-    return YMODEM_ABORTED_BY_SENDER;
+  field         = next;
+  uint32_t time = strtoul(field, &next, 8);
+  if (next == field || (*next != ' ' && *next != 0)) {
+    return;
   }
-  else if (packet_length == -2) { // Error de recepción
-    (*errors)++;
-    if (*errors > 5) {
-      send_CA();
-      return YMODEM_MAX_ERRORS;
-    }
-    send_NAK();
-    return YMODEM_RECEIVED_OK;
+  field         = next;
+  uint32_t bits = strtoul(field, &next, 8);
+  if (next == field || (*next != ' ' && *next != 0)) {
+    return;
   }
+  *modTime = time;
+  *mode    = bits;
+}
 
-  // Paquete normal
-  if (packets_received == 0) {
-    return processHeaderPacket(packet_data, packet_length, maxsize, getname, size, errors);
+bool extractFileSkip(uint8_t* packet_data)
+{
+  const char* field = findField(packet_data, SKIP_FIELD);
+  return field != NULL && (field[strlen(SKIP_FIELD)] == ' ' || field[strlen(SKIP_FIELD)] == 0);
+}
+
+bool extractFileFec(uint8_t* packet_data)
+{
+  const char* field = findField(packet_data, FEC_FIELD);
+  return field != NULL && (field[strlen(FEC_FIELD)] == ' ' || field[strlen(FEC_FIELD)] == 0);
+}
+
+YmodemReceiver::YmodemReceiver(YmodemReceiveSink& sink, uint32_t maxsize, uint8_t* frame, size_t frameSize)
+    : YmodemSession(frame, frameSize), sink(sink), maxsize(maxsize)
+{
+}
+
+uint8_t YmodemReceiver::start(uint32_t now)
+{
+  bool ready   = reset();
+  state        = WAIT_HEADER;
+  frameLength  = 0;
+  fileSize     = 0;
+  fileWritten  = 0;
+  expectedSeq  = 1;
+  block        = PACKET_1K_SIZE;
+  fecFile      = false;
+  eotCount     = 0;
+  caPending    = false;
+  fileDone     = false;
+  errors       = 0;
+  endRequests  = 0;
+  announced[0] = '\0';
+  if (!ready) {
+    return finish(YMODEM_NO_MEMORY);
   }
-  else {
-    return processDataPacket(packet_data, packet_length, ffd, *size);
+
+  armTimer(now, NAK_TIMEOUT);
+  return queueByte(CRC16);
+}
+
+size_t YmodemReceiver::expectedBytes() const
+{
+  return (frameLength > 0) ? frameSize - frameLength : 1;
+}
+
+bool YmodemReceiver::setBlockSize(size_t size)
+{
+  if (size != PACKET_1K_SIZE && size != PACKET_4K_SIZE && size != PACKET_8K_SIZE) {
+    return false;
+  }
+  if (!reserveFrame(fec ? YMODEM_FEC_FRAME_SIZE(size) : YMODEM_BLOCK_FRAME_SIZE(size))) {
+    return false;
   }
+  maxBlock = size;
+  return true;
 }
 
-int handleFileSession(fs::File& ffd, unsigned int maxsize, char* getname, unsigned int* session_done, unsigned int* errors)
+bool YmodemReceiver::setFec(bool enable)
 {
-  unsigned int file_done = 0, packets_received = 0;
-  int          size = 0;
+  if (enable && !reserveFrame(YMODEM_FEC_FRAME_SIZE(maxBlock))) {
+    return false;
+  }
+  fec = enable;
+  return true;
+}
 
-  while (!file_done) {
-    LED_toggle();
-    int     packet_length = 0;
-    uint8_t packet_data[PACKET_1K_SIZE + PACKET_OVERHEAD];
+uint8_t YmodemReceiver::onByte(uint8_t byte, uint32_t now)
+{
+  // The idle timer restarts with every byte received
+  armTimer(now, NAK_TIMEOUT);
 
-    YmodemPacketStatus result = ReceiveAndValidatePacket(packet_data, &packet_length, NAK_TIMEOUT);
-    if (result == YMODEM_RECEIVED_OK) {
-      int process_result = processPacket(packet_data, packet_length, ffd, maxsize, getname, packets_received, &size, &file_done, errors);
-      if (process_result != YMODEM_RECEIVED_OK) {
-        return process_result; // Error durante el procesamiento
+  if (frameLength > 0) {
+    frame[frameLength++] = byte;
+    // The size of a large packet is known once its header is complete
+    if (frame[0] == LTX && frameLength == PACKET_LARGE_HEADER) {
+      size_t length = (frame[PACKET_LARGE_LENGTH_INDEX] << 8) | frame[PACKET_LARGE_LENGTH_INDEX + 1];
+      if (length == 0 || length > block) {
+        frameLength = 0; // Line noise, the packet is asked again when the timer expires
+        return YMODEM_EVENT_NONE;
       }
-      packets_received++;
+      frameSize = length + PACKET_LARGE_OVERHEAD;
     }
-    else if (result == YMODEM_ABORTED_BY_SENDER) {
-      send_CA();
-      return YMODEM_ABORTED_BY_SENDER;
+    if (frameLength < frameSize) {
+      return YMODEM_EVENT_NONE;
     }
-    else { // Timeout o error
-      (*errors)++;
-      if (*errors > MAX_ERRORS) {
-        send_CA();
-        return YMODEM_MAX_ERRORS;
+    frameLength = 0;
+    return onPacket();
+  }
+
+  bool secondCA = caPending && byte == CA;
+  caPending     = (byte == CA);
+
+  switch (byte) {
+    case SOH:
+    case STX:
+      frameSize   = ((byte == SOH) ? PACKET_SIZE : PACKET_1K_SIZE) + PACKET_OVERHEAD;
+      frame[0]    = byte;
+      frameLength = 1;
+      return YMODEM_EVENT_NONE;
+    case LTX:
+      if (state != WAIT_DATA || block == PACKET_1K_SIZE) {
+        return YMODEM_EVENT_NONE; // Not negotiated for this file, line noise
       }
-      send_CRC16();
+      frameSize   = PACKET_LARGE_HEADER;
+      frame[0]    = byte;
+      frameLength = 1;
+      return YMODEM_EVENT_NONE;
+    case FTX:
+      if (state != WAIT_DATA || !fecFile) {
+        return YMODEM_EVENT_NONE; // Not negotiated for this file, line noise
+      }
+      // Padded to the block, the size does not depend on the length field
+      frameSize   = YMODEM_FEC_FRAME_SIZE(block);
+      frame[0]    = byte;
+      frameLength = 1;
+      return YMODEM_EVENT_NONE;
+    case EOT:
+      return onEOT();
+    case CA:
+      if (!secondCA) {
+        return YMODEM_EVENT_NONE;
+      }
+      queueByte(ACK);
+      return finish(YMODEM_ABORTED_BY_SENDER);
+    case ABORT1:
+    case ABORT2:
+      return abort(YMODEM_ABORTED_BY_SENDER);
+    default:
+      return YMODEM_EVENT_NONE; // Line noise, resynchronised on the next SOH or STX
+  }
+}
+
+uint8_t YmodemReceiver::onTimeout(uint32_t now)
+{
+  frameLength = 0;
+  caPending   = false;
+  armTimer(now, NAK_TIMEOUT);
+
+  // A sender that does not close the batch with an empty header still gets its file
+  if (fileDone && ++endRequests > END_REQUESTS) {
+    return finish(fileSize);
+  }
+  // While waiting for a header the request is repeated with 'C'
+  if (state == WAIT_HEADER) {
+    return reject(CRC16);
+  }
+  // Until the first block arrives the request for data is repeated, a NAK would be ignored by a sender
+  // that lost it
+  if (expectedSeq == 1 && eotCount == 0) {
+    counters.retries++;
+    if (++errors > MAX_ERRORS) {
+      return abort(YMODEM_MAX_ERRORS);
     }
+    return YMODEM_EVENT_RETRY | requestData();
   }
+  return reject(NAK);
+}
 
-  *session_done = 1;
-  return size;
-}
\ No newline at end of file
+uint8_t YmodemReceiver::onPacket()
+{
+  if (frame[0] == LTX || frame[0] == FTX) {
+    // The packets with parity are padded to the block, their CRC is always at the same place
+    size_t size = (frame[0] == FTX) ? block : frameSize - PACKET_LARGE_OVERHEAD;
+    if (!largePacketValid(size)) {
+      // A packet with parity is repaired and checked again, it is only asked again when that fails
+      if (frame[0] != FTX || Ymodem_FecRepair(frame + 1, YMODEM_FEC_MESSAGE_SIZE(block)) <= 0 || !largePacketValid(size)) {
+        return reject();
+      }
+      counters.repaired++;
+    }
+
+    uint16_t seq    = (frame[PACKET_LARGE_SEQNO_INDEX] << 8) | frame[PACKET_LARGE_SEQNO_INDEX + 1];
+    size_t   length = (frame[PACKET_LARGE_LENGTH_INDEX] << 8) | frame[PACKET_LARGE_LENGTH_INDEX + 1];
+    if (length == 0 || length > size) {
+      return reject();
+    }
+    return onData(seq, 0xffff, frame + PACKET_LARGE_HEADER, length);
+  }
+
+  uint8_t seq  = frame[PACKET_SEQNO_INDEX];
+  size_t  size = frameSize - PACKET_OVERHEAD;
+
+  if (seq != (uint8_t)(frame[PACKET_SEQNO_COMP_INDEX] ^ 0xff) || crc16(&frame[PACKET_HEADER], size + PACKET_TRAILER) != 0) {
+    return reject();
+  }
+  if (state == WAIT_HEADER) {
+    return onHeader(seq);
+  }
+  return onData(seq, 0xff, frame + PACKET_HEADER, size);
+}
+
+/**
+ * @brief Checks the sequence number and the CRC-32 of a large packet or a packet with parity.
+ *
+ * @param size Bytes of data covered by the CRC, which follows them.
+ */
+bool YmodemReceiver::largePacketValid(size_t size) const
+{
+  uint16_t       seq  = (frame[PACKET_LARGE_SEQNO_INDEX] << 8) | frame[PACKET_LARGE_SEQNO_INDEX + 1];
+  uint16_t       comp = (frame[PACKET_LARGE_SEQNO_COMP_INDEX] << 8) | frame[PACKET_LARGE_SEQNO_COMP_INDEX + 1];
+  const uint8_t* crc  = frame + PACKET_LARGE_HEADER + size;
+  uint32_t       sent = ((uint32_t)crc[0] << 24) | ((uint32_t)crc[1] << 16) | ((uint32_t)crc[2] << 8) | crc[3];
+
+  return seq == (uint16_t)~comp && Ymodem_Crc32(0, &frame[PACKET_LARGE_SEQNO_INDEX], PACKET_LARGE_HEADER - 1 + size) == sent;
+}
+
+uint8_t YmodemReceiver::onHeader(uint8_t seq)
+{
+  if (seq != 0) {
+    return reject();
+  }
+
+  // Empty header, the sender has no more files
+  if (frame[PACKET_HEADER] == 0) {
+    queueByte(ACK);
+    return finish(fileSize);
+  }
+
+  char name[FILE_NAME_LENGTH + 1];
+  int  size = 0;
+  extractFileInfo(frame, name, &size);
+  if (size < 1 || (uint32_t)size > maxsize) {
+    return abort((size < 1) ? YMODEM_SIZE_NULL : YMODEM_SIZE_OVERFLOW);
+  }
+
+  // An announced digest is always verified, with its own algorithm
+  YmodemDigestType type = extractFileDigest(frame, announced, sizeof(announced));
+  if (type == YMODEM_DIGEST_NONE) {
+    announced[0] = '\0';
+    type         = digestType;
+  }
+  extractFileAttributes(frame, &modTime, &fileMode);
+
+  // A file the sink already holds is skipped in one round trip, when the sender accepts it
+  YmodemFileInfo info = {name, (uint32_t)size, modTime, fileMode, announced};
+  if (extractFileSkip(frame) && sink.unchanged(info)) {
+    fileSize    = size;
+    fileDone    = true;
+    endRequests = 0;
+    counters.packets++;
+    counters.skipped++;
+    counters.skippedBytes += size;
+
+    queueByte(ACK);
+    queueByte(SKIP);
+    queueByte(CRC16);
+    return YMODEM_EVENT_FILE | YMODEM_EVENT_FILE_DONE | YMODEM_EVENT_OUTPUT;
+  }
+
+  if (!sink.reserve(size)) {
+    return abort(YMODEM_NO_SPACE);
+  }
+  if (!sink.open(name, size)) {
+    return abort(YMODEM_ERROR_WRITING);
+  }
+  fileDigest.begin(type);
+  verified = false;
+
+  // Larger blocks only when the sender announced them, up to what this receiver accepts
+  size_t offered = std::min<size_t>(extractFileBlockSize(frame), maxBlock);
+  block          = (offered >= PACKET_8K_SIZE) ? PACKET_8K_SIZE : (offered >= PACKET_4K_SIZE) ? PACKET_4K_SIZE : PACKET_1K_SIZE;
+  fecFile        = fec && extractFileFec(frame);
+
+  state       = WAIT_DATA;
+  fileSize    = size;
+  fileWritten = 0;
+  expectedSeq = 1;
+  eotCount    = 0;
+  fileDone    = false;
+  counters.packets++;
+
+  queueByte(ACK);
+  requestData();
+  return YMODEM_EVENT_FILE | YMODEM_EVENT_OUTPUT;
+}
+
+uint8_t YmodemReceiver::onData(uint16_t seq, uint16_t seqMask, const uint8_t* data, size_t size)
+{
+  if (seq == (expectedSeq & seqMask)) {
+    size_t length = std::min<size_t>(size, fileSize - fileWritten);
+    if (length > 0 && sink.write(data, length) != (int)length) {
+      return abort(YMODEM_ERROR_WRITING);
+    }
+    fileDigest.update(data, length);
+    fileWritten += length;
+    expectedSeq++;
+    counters.packets++;
+    counters.bytes += length;
+
+    queueByte(ACK);
+    return YMODEM_EVENT_BLOCK | YMODEM_EVENT_OUTPUT;
+  }
+
+  // The sender missed the last ACK and repeated the previous packet, the header included
+  if (seq == ((expectedSeq - 1) & seqMask)) {
+    queueByte(ACK);
+    if (expectedSeq == 1) {
+      requestData();
+    }
+    return YMODEM_EVENT_OUTPUT;
+  }
+
+  return abort(YMODEM_SEQ_ERROR);
+}
+
+uint8_t YmodemReceiver::onEOT()
+{
+  if (state == WAIT_DATA) {
+    // The first EOT is answered with NAK to make sure it is not line noise
+    if (++eotCount == 1) {
+      return queueByte(NAK);
+    }
+
+    // The file is refused before its final ACK when it does not match the announced digest
+    fileDigest.finish();
+    if (announced[0] != '\0') {
+      if (!fileDigest.matches(announced)) {
+        return abort(YMODEM_DIGEST_ERROR);
+      }
+      verified = true;
+    }
+    sink.close();
+    if (modTime != 0) {
+      sink.attributes(modTime, fileMode);
+    }
+    state       = WAIT_HEADER;
+    fileDone    = true;
+    endRequests = 0;
+
+    queueByte(ACK);
+    queueByte(CRC16);
+    return YMODEM_EVENT_FILE_DONE | YMODEM_EVENT_OUTPUT;
+  }
+
+  // The sender missed the ACK of its last EOT
+  if (fileDone) {
+    queueByte(ACK);
+    return queueByte(CRC16);
+  }
+  return YMODEM_EVENT_NONE;
+}
+
+uint8_t YmodemReceiver::requestData()
+{
+  // FEC comes first, the sender starts sending once it has the request for data
+  if (fecFile) {
+    queueByte(FEC);
+  }
+  // 'C' keeps the standard 1K packets
+  switch (block) {
+    case PACKET_8K_SIZE:
+      return queueByte(LARGE_8K);
+    case PACKET_4K_SIZE:
+      return queueByte(LARGE_4K);
+    default:
+      return queueByte(CRC16);
+  }
+}
+
+uint8_t YmodemReceiver::reject(uint8_t response)
+{
+  counters.retries++;
+  if (++errors > MAX_ERRORS) {
+    return abort(YMODEM_MAX_ERRORS);
+  }
+  return YMODEM_EVENT_RETRY | queueByte(response);
+}
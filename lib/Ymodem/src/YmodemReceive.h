@@ -5,9 +5,9 @@
  * @version 0.1
  * @date 2025-01-24
  *
- * This file contains the functions to receive files using the Ymodem protocol.
- * It processes the incoming packets, extracts the file information, and writes
- * the data to the filesystem.
+ * This file contains the receiver state machine of the Ymodem protocol.
+ * It assembles the incoming packets, extracts the file information, and
+ * hands the data to a YmodemReceiveSink.
  *
  * @copyright Copyright (c) 2025
  *
@@ -15,100 +15,157 @@
 #ifndef YMODEMRECEIVE_H
 #define YMODEMRECEIVE_H
 
-#include "YmodemUtils.h"
+#include "YmodemSession.h"
 
 /**
- * @brief Processes a data packet received via Ymodem protocol.
+ * @brief Extracts file information from a Ymodem packet.
  *
- * This function handles the data packet, writing its contents to the specified file,
- * and updating the error count if any issues are encountered.
+ * This function parses the given packet data to extract the file name and size.
  *
- * @param packet_data Pointer to the data packet to be processed.
- * @param packet_length Length of the data packet.
- * @param ffd Reference to the file object where the data will be written.
- * @param file_size Total size of the file being received.
- * @param errors Pointer to an unsigned int where the error count will be updated.
- * @return YmodemPacketStatus Status of the packet processing.
- *         - YMODEM_RECEIVED_OK: Packet processed successfully.
- *         - YMODEM_ERROR_WRITING: Error writing to the file in the filesystem.
+ * @param packet_data Pointer to the packet data containing the file information.
+ * @param getname Pointer to a character array where the extracted file name will be stored.
+ * @param size Pointer to an integer where the extracted file size will be stored.
  */
-YmodemPacketStatus processDataPacket(uint8_t* packet_data, int packet_length, fs::File& ffd, unsigned int file_size);
+void extractFileInfo(uint8_t* packet_data, char* getname, int* size);
 
 /**
- * @brief Handles the End Of File (EOF) packet in the Ymodem protocol.
+ * @brief Extracts the file digest announced in a Ymodem header packet.
  *
- * This function processes the EOF packet received during a Ymodem file transfer.
- * It updates the status of the file transfer and tracks any errors encountered.
+ * The digest is the field after the file size that starts with an algorithm name and ':'.
  *
- * @param file_done Pointer to an unsigned int that indicates whether the file transfer is complete.
- *                  A non-zero value indicates completion.
- * @param errors Pointer to an unsigned int that tracks the number of errors encountered during the transfer.
+ * @param packet_data Pointer to the packet data containing the file information.
+ * @param digest Pointer to a character array where the digest will be stored.
+ * @param size Size of the digest array, YMODEM_DIGEST_TEXT_SIZE is enough.
+ * @return YmodemDigestType Algorithm of the digest, YMODEM_DIGEST_NONE if there is none.
  */
-void handleEOFPacket(unsigned int* file_done, unsigned int* errors);
+YmodemDigestType extractFileDigest(uint8_t* packet_data, char* digest, size_t size);
 
 /**
- * @brief Extracts file information from a Ymodem packet.
- *
- * This function parses the given packet data to extract the file name and size.
+ * @brief Extracts the largest block announced by the sender in a Ymodem header packet.
  *
  * @param packet_data Pointer to the packet data containing the file information.
- * @param getname Pointer to a character array where the extracted file name will be stored.
- * @param size Pointer to an integer where the extracted file size will be stored.
+ * @return uint32_t Size of the "blk:" field, PACKET_1K_SIZE if there is none.
  */
-void extractFileInfo(uint8_t* packet_data, char* getname, int* size);
+uint32_t extractFileBlockSize(uint8_t* packet_data);
 
 /**
- * @brief Processes the header packet of a Ymodem transfer.
- *
- * This function extracts information from the header packet, such as the file name and size,
- * and performs validation checks.
+ * @brief Extracts the modification time and the mode sent after the size in a Ymodem header packet.
  *
- * @param packet_data Pointer to the packet data.
- * @param packet_length Length of the packet data.
- * @param maxsize Maximum allowed size for the file.
- * @param getname Pointer to a buffer where the file name will be stored.
- * @param size Pointer to an integer where the file size will be stored.
- * @param errors Pointer to an unsigned integer where the error count will be stored.
- * @return YmodemPacketStatus Status of the packet processing.
- *         - YMODEM_RECEIVED_OK: Packet processed successfully.
- *         - YMODEM_SIZE_OVERFLOW: File size exceeds the maximum allowed size.
- *         - YMODEM_SIZE_NULL: File size is null or invalid.
- *         - YMODEM_MAX_ERRORS: Maximum number of errors reached.
+ * @param packet_data Pointer to the packet data containing the file information.
+ * @param modTime Set to the modification time in seconds since 1970, 0 if there is none.
+ * @param mode Set to the Unix file mode, 0 if there is none.
  */
-YmodemPacketStatus processHeaderPacket(uint8_t* packet_data, int packet_length, unsigned int maxsize, char* getname, int* size, unsigned int* errors);
+void extractFileAttributes(uint8_t* packet_data, uint32_t* modTime, uint32_t* mode);
 
 /**
- * @brief Processes a received Ymodem packet.
- *
- * This function handles the processing of a Ymodem packet, including writing data to a file,
- * managing packet counts, and handling errors.
+ * @brief Checks whether the sender of a Ymodem header packet accepts SKIP for a file the receiver holds.
  *
- * @param packet_data Pointer to the data of the received packet.
- * @param packet_length Length of the received packet.
- * @param ffd Reference to the file object where data will be written.
- * @param maxsize Maximum allowed size of the file.
- * @param getname Pointer to a buffer where the filename will be stored.
- * @param packets_received Number of packets received so far.
- * @param size Pointer to an integer where the size of the file will be stored.
- * @param file_done Pointer to an unsigned integer that indicates if the file transfer is complete.
- * @param errors Pointer to an unsigned integer that counts the number of errors encountered.
+ * @param packet_data Pointer to the packet data containing the file information.
+ * @return true if the header has a "skip" field, false otherwise.
+ */
+bool extractFileSkip(uint8_t* packet_data);
+
+/**
+ * @brief Checks whether the sender of a Ymodem header packet can add parity to its blocks.
  *
- * @return An integer indicating the status of the packet processing.
- *         0 indicates success, while non-zero values indicate different error conditions.
+ * @param packet_data Pointer to the packet data containing the file information.
+ * @return true if the header has a "fec" field, false otherwise.
  */
-YmodemPacketStatus processPacket(uint8_t* packet_data, int packet_length, fs::File& ffd, unsigned int maxsize, char* getname,
-                                 unsigned int packets_received, int* size, unsigned int* file_done, unsigned int* errors);
+bool extractFileFec(uint8_t* packet_data);
 
 /**
- * @brief Handles a file session for receiving data.
+ * @brief Ymodem receiver state machine.
+ *
+ * The receiver requests the file header with 'C', accepts the file through the sink,
+ * acknowledges every data block, and ends the session when the sender closes the batch
+ * with an empty header. The result of the session is the size of the last file received.
+ *
+ * After setBlockSize(), a header announcing larger blocks is answered with LARGE_4K or
+ * LARGE_8K instead of 'C', and the file comes in LTX packets. Other senders are not affected.
+ *
+ * When the header has a "skip" field, the sink is asked whether it holds the file unchanged;
+ * if so the header is answered with ACK, SKIP and 'C', and the receiver waits for the next one.
  *
- * @param ffd Reference to the file object where the received data will be stored.
- * @param maxsize Maximum size of the file to be received.
- * @param getname Pointer to a character array where the name of the received file will be stored.
- * @param session_done Pointer to an unsigned int that will be set to 1 if the session is completed successfully, 0 otherwise.
- * @param errors Pointer to an unsigned int that will be incremented if any errors occur during the session.
- * @return int Status code indicating the result of the file session handling.
+ * After setFec(), a header with a "fec" field is answered with FEC before the request for data,
+ * and the file comes in FTX packets. A packet that fails its CRC is repaired with its parity,
+ * and only rejected with NAK when the repair fails.
  */
-int handleFileSession(fs::File& ffd, unsigned int maxsize, char* getname, unsigned int* session_done, unsigned int* errors);
+class YmodemReceiver : public YmodemSession
+{
+public:
+  /**
+   * @brief Constructor for the YmodemReceiver class.
+   *
+   * @param sink Destination of the received data, it must outlive the receiver.
+   * @param maxsize Maximum size of the file to be received.
+   * @param frame Packet buffer of frameSize bytes, NULL to allocate one, see YmodemSession().
+   * @param frameSize Size of the packet buffer, YMODEM_BLOCK_FRAME_SIZE() of the largest block.
+   */
+  YmodemReceiver(YmodemReceiveSink& sink, uint32_t maxsize, uint8_t* frame = NULL, size_t frameSize = YMODEM_FRAME_SIZE);
+
+  uint8_t start(uint32_t now) override;
+  size_t  expectedBytes() const override;
+
+  /**
+   * @brief Accepts blocks of up to size bytes from the senders that announce them.
+   *
+   * Call it before start(). A packet buffer allocated by the session grows to fit.
+   *
+   * @param size PACKET_1K_SIZE, the default, PACKET_4K_SIZE or PACKET_8K_SIZE.
+   * @return true if the size is supported and the packet buffer holds it, false otherwise.
+   */
+  bool setBlockSize(size_t size);
+
+  /**
+   * @brief Asks the senders that offer it for packets with Reed-Solomon parity, for noisy links.
+   *
+   * Call it before start(). A packet buffer allocated by the session grows to fit. The
+   * packets repaired are counted in stats().
+   *
+   * @param enable true to answer the "fec" field, false by default.
+   * @return true if the packet buffer holds the packets with parity, false otherwise.
+   */
+  bool setFec(bool enable);
+
+protected:
+  uint8_t onByte(uint8_t byte, uint32_t now) override;
+  uint8_t onTimeout(uint32_t now) override;
+
+private:
+  enum State : uint8_t
+  {
+    WAIT_HEADER, // Waiting for a file header or the empty header that ends the batch
+    WAIT_DATA,   // Waiting for the data blocks or the EOT of the current file
+  };
+
+  YmodemReceiveSink& sink;                               /**< Destination of the received data. */
+  uint32_t           maxsize;                            /**< Maximum size of the file to be received. */
+  State              state       = WAIT_HEADER;          /**< Current step of the session. */
+  size_t             frameLength = 0;                    /**< Bytes of the packet in progress already received. */
+  size_t             frameSize   = 0;                    /**< Total size of the packet in progress. */
+  uint32_t           fileSize    = 0;                    /**< Size announced in the file header. */
+  uint32_t           fileWritten = 0;                    /**< Bytes of the file handed to the sink. */
+  uint32_t           modTime     = 0;                    /**< Modification time announced in the file header. */
+  uint32_t           fileMode    = 0;                    /**< Mode announced in the file header. */
+  uint16_t           expectedSeq = 1;                    /**< Sequence number of the next data block. */
+  size_t             maxBlock    = PACKET_1K_SIZE;       /**< Largest block accepted, set with setBlockSize(). */
+  size_t             block       = PACKET_1K_SIZE;       /**< Block size negotiated for the current file. */
+  bool               fec         = false;                /**< True to ask for packets with parity, set with setFec(). */
+  bool               fecFile     = false;                /**< True when the current file comes with parity. */
+  uint8_t            eotCount    = 0;                    /**< EOT received for the current file. */
+  bool               caPending   = false;                /**< True after a first CA. */
+  bool               fileDone    = false;                /**< True once a file has been completely received. */
+  uint32_t           errors      = 0;                    /**< Rejected packets and timeouts in the session. */
+  uint32_t           endRequests = 0;                    /**< Header requests sent after the last file. */
+  char               announced[YMODEM_DIGEST_TEXT_SIZE]; /**< Digest announced in the file header. */
+
+  uint8_t onPacket();
+  bool    largePacketValid(size_t size) const;
+  uint8_t onHeader(uint8_t seq);
+  uint8_t onData(uint16_t seq, uint16_t seqMask, const uint8_t* data, size_t size);
+  uint8_t onEOT();
+  uint8_t requestData();
+  uint8_t reject(uint8_t response = NAK);
+};
 
 #endif // YMODEMRECEIVE_H
@@ -0,0 +1,212 @@
+/**
+ * @file YmodemReplay.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Replay of wire traces against the Ymodem sessions
+ * @version 0.1
+ * @date 2025-05-30
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef ESP_PLATFORM
+
+#include "YmodemReplay.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @brief Reads a 16 or 32-bit little endian value.
+ */
+static uint32_t getLE(const uint8_t* data, size_t size)
+{
+  uint32_t value = 0;
+  for (size_t i = 0; i < size; i++) {
+    value |= (uint32_t)data[i] << (8 * i);
+  }
+  return value;
+}
+
+bool YmodemReplay::load(const uint8_t* data, size_t size)
+{
+  trace.clear();
+  payload.clear();
+  recorded.clear();
+  drops = 0;
+
+  if (size < YMODEM_TRACE_FILE_HEADER || memcmp(data, YMODEM_TRACE_MAGIC, 4) != 0 || data[4] != YMODEM_TRACE_VERSION ||
+      getLE(data + 6, 2) != YMODEM_TRACE_RECORD_HEADER || getLE(data + 12, 4) != size - YMODEM_TRACE_FILE_HEADER) {
+    return false;
+  }
+  drops = getLE(data + 8, 4);
+
+  size_t   position = YMODEM_TRACE_FILE_HEADER;
+  uint32_t first    = 0;
+  while (position < size) {
+    if (size - position < YMODEM_TRACE_RECORD_HEADER) {
+      return false;
+    }
+    const uint8_t* header = data + position;
+    uint32_t       time   = getLE(header, 4);
+    uint32_t       info   = getLE(header + 4, 2);
+    Record         record;
+    record.type     = (YmodemTraceType)(info >> 12);
+    record.size     = info & YMODEM_TRACE_MAX_CHUNK;
+    record.position = payload.size();
+    record.txBefore = recorded.size();
+    position       += YMODEM_TRACE_RECORD_HEADER;
+    if (size - position < record.size) {
+      return false;
+    }
+
+    // The timestamps wrap around, they are kept relative to the first record
+    first           = trace.empty() ? time : first;
+    record.offsetUs = time - first;
+    payload.insert(payload.end(), data + position, data + position + record.size);
+    if (record.type == YMODEM_TRACE_TX) {
+      recorded.insert(recorded.end(), data + position, data + position + record.size);
+    }
+    position += record.size;
+    trace.push_back(record);
+  }
+  return true;
+}
+
+bool YmodemReplay::load(const char* path)
+{
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    return false;
+  }
+  std::vector<uint8_t> data;
+  uint8_t              buffer[4096];
+  size_t               len;
+  while ((len = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    data.insert(data.end(), buffer, buffer + len);
+  }
+  fclose(file);
+  return load(data.data(), data.size());
+}
+
+const YmodemReplayStats& YmodemReplay::run(YmodemSession& session, uint32_t speedup)
+{
+  counters                 = {};
+  counters.recordedBytes   = recorded.size();
+  counters.recordedMs      = trace.empty() ? 0 : trace.back().offsetUs / 1000;
+  counters.firstDivergence = -1;
+
+  std::vector<uint8_t> produced;
+  uint64_t             clockUs = 0;
+  size_t               next    = 0;
+  bool                 force   = false;
+  auto                 start   = std::chrono::steady_clock::now();
+
+  session.start(0);
+  while (true) {
+    while (session.outputSize() > 0) {
+      produced.insert(produced.end(), session.output(), session.output() + session.outputSize());
+      session.consumeOutput(session.outputSize());
+    }
+    if (session.isDone()) {
+      break;
+    }
+
+    while (next < trace.size() && trace[next].type != YMODEM_TRACE_RX) {
+      next++;
+    }
+    bool     input      = next < trace.size();
+    uint32_t nowMs      = (uint32_t)(clockUs / 1000);
+    uint64_t deadlineUs = (uint64_t)(nowMs + std::max<int32_t>(0, (int32_t)(session.nextDeadline() - nowMs))) * 1000;
+    uint64_t dueUs      = clockUs;
+    bool     due        = input;
+    if (input && speedup == YMODEM_REPLAY_ASAP) {
+      due = produced.size() >= trace[next].txBefore;
+    }
+    else if (input && session.streaming()) {
+      // A streaming session does not wait for its peer, which answered what it had received so far
+      due   = produced.size() >= trace[next].txBefore;
+      dueUs = std::max<uint64_t>(clockUs, trace[next].offsetUs / speedup);
+    }
+    else if (input) {
+      dueUs = std::max<uint64_t>(clockUs, trace[next].offsetUs / speedup);
+      due   = dueUs <= deadlineUs;
+    }
+
+    // The peer answers before the session times out, or the session is idle without a timer
+    if (due || force) {
+      const Record& record = trace[next++];
+      clockUs              = dueUs;
+      nowMs                = (uint32_t)(clockUs / 1000);
+      force                = false;
+      session.feed(payload.data() + record.position, record.size, nowMs);
+      session.poll(nowMs);
+      counters.delivered++;
+      continue;
+    }
+
+    if (session.streaming()) {
+      session.poll(nowMs);
+      continue;
+    }
+
+    uint64_t before = clockUs;
+    clockUs         = std::max(clockUs, deadlineUs);
+    if (session.poll((uint32_t)(clockUs / 1000)) == YMODEM_EVENT_NONE && clockUs == before) {
+      if (!input) {
+        break; // Stalled, nothing left to feed and no timer
+      }
+      force = true;
+    }
+  }
+
+  counters.hostUs    = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+  counters.result    = session.result();
+  counters.packets   = session.stats().packets;
+  counters.retries   = session.stats().retries;
+  counters.timeouts  = session.stats().timeouts;
+  counters.sessionMs = (uint32_t)(clockUs / 1000);
+  compare(produced);
+  return counters;
+}
+
+void YmodemReplay::compare(const std::vector<uint8_t>& produced)
+{
+  counters.producedBytes = produced.size();
+  for (const Record& record : trace) {
+    if (record.type != YMODEM_TRACE_TX) {
+      continue;
+    }
+    if (record.txBefore + record.size > produced.size() ||
+        memcmp(produced.data() + record.txBefore, recorded.data() + record.txBefore, record.size) != 0) {
+      counters.divergences++;
+    }
+  }
+  if (produced.size() > recorded.size()) {
+    counters.divergences++;
+  }
+
+  size_t common = std::min(produced.size(), recorded.size());
+  size_t offset = std::mismatch(produced.begin(), produced.begin() + common, recorded.begin()).first - produced.begin();
+  if (offset < common || produced.size() != recorded.size()) {
+    counters.firstDivergence = (int32_t)offset;
+  }
+}
+
+size_t YmodemReplay::records() const
+{
+  return trace.size();
+}
+
+uint32_t YmodemReplay::dropped() const
+{
+  return drops;
+}
+
+const YmodemReplayStats& YmodemReplay::stats() const
+{
+  return counters;
+}
+
+#endif // ESP_PLATFORM
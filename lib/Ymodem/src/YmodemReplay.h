@@ -0,0 +1,134 @@
+/**
+ * @file YmodemReplay.h
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Replay of wire traces against the Ymodem sessions
+ * @version 0.1
+ * @date 2025-05-30
+ *
+ * This file contains a host harness replaying a trace recorded with
+ * YmodemTrace. The bytes the recorded side received from its peer are fed to
+ * a new sender or receiver session on a simulated clock, at their recorded
+ * times or with the time compressed, and the bytes the session writes are
+ * compared with the ones the recorded side wrote. A captured field session
+ * becomes a deterministic regression test of the timeout and retry paths.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef YMODEMREPLAY_H
+#define YMODEMREPLAY_H
+
+#ifndef ESP_PLATFORM
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "YmodemSession.h"
+#include "YmodemTrace.h"
+
+#define YMODEM_REPLAY_ASAP (0) /*!< Speedup delivering every peer record as soon as the session has written what preceded it */
+
+/**
+ * @brief Outcome of a replay.
+ */
+struct YmodemReplayStats
+{
+  int      result;          // Result of the replayed session
+  uint32_t packets;         // Packets accepted or acknowledged by the session
+  uint32_t retries;         // Packets rejected or sent again by the session
+  uint32_t timeouts;        // Timers of the session that expired
+  uint32_t sessionMs;       // Duration of the session on the simulated clock
+  uint32_t recordedMs;      // Duration of the trace, from its first to its last record
+  uint32_t delivered;       // Peer records fed to the session
+  uint32_t divergences;     // Recorded writes the session did not reproduce, plus one for extra output
+  int32_t  firstDivergence; // Offset in the written bytes of the first difference, -1 if none
+  uint32_t producedBytes;   // Bytes written by the session
+  uint32_t recordedBytes;   // Bytes written by the recorded side
+  uint32_t hostUs;          // Host time spent in the session, in microseconds
+};
+
+/**
+ * @brief Replays one side of a wire trace against a session.
+ *
+ * The trace must have been recorded on the side the session plays: the RX records are the
+ * peer and are fed to the session, the TX records are the reference its output is compared
+ * with. FLUSH and OVERRUN records are informative and not replayed. Nothing waits on a real
+ * clock, so a replay takes the time of the session code only and always gives the same result.
+ * While a session streams, as the Zmodem sender does, each peer record is delivered once the
+ * session has written the bytes written before it in the trace, whatever the speedup.
+ */
+class YmodemReplay
+{
+public:
+  /**
+   * @brief Loads a dumped trace.
+   *
+   * @param data Bytes of the trace, as written by YmodemTrace::dump().
+   * @param size Number of bytes.
+   * @return true if the trace is valid, false otherwise.
+   */
+  bool load(const uint8_t* data, size_t size);
+
+  /**
+   * @brief Loads a trace file.
+   *
+   * @param path Path of the file written by YmodemTrace::dump().
+   * @return true if the file was read and the trace is valid, false otherwise.
+   */
+  bool load(const char* path);
+
+  /**
+   * @brief Replays the peer of the loaded trace against a session.
+   *
+   * @param session Session playing the recorded side, not started yet.
+   * @param speedup Factor dividing the recorded times of the peer records, 1 for the original
+   *                timing, or YMODEM_REPLAY_ASAP to deliver each of them as soon as the session
+   *                has written the bytes written before it in the trace.
+   * @return const YmodemReplayStats& Reference to the outcome.
+   */
+  const YmodemReplayStats& run(YmodemSession& session, uint32_t speedup = 1);
+
+  /**
+   * @brief Retrieves the number of records of the loaded trace.
+   *
+   * @return size_t Number of records.
+   */
+  size_t records() const;
+
+  /**
+   * @brief Retrieves the number of records dropped by the recorder before the first one of the trace.
+   *
+   * @return uint32_t Records dropped, the start of the session is missing when it is not 0.
+   */
+  uint32_t dropped() const;
+
+  /**
+   * @brief Retrieves the outcome of the last run().
+   *
+   * @return const YmodemReplayStats& Reference to the outcome.
+   */
+  const YmodemReplayStats& stats() const;
+
+private:
+  struct Record
+  {
+    uint32_t        offsetUs; // Time since the first record of the trace
+    YmodemTraceType type;     // Type of the record
+    uint32_t        position; // Position of the bytes in payload
+    uint32_t        size;     // Number of bytes
+    uint32_t        txBefore; // Bytes written by the recorded side before this record
+  };
+
+  std::vector<Record>  trace;         /**< Records, oldest first. */
+  std::vector<uint8_t> payload;       /**< Bytes of all the records. */
+  std::vector<uint8_t> recorded;      /**< Bytes written by the recorded side, in order. */
+  uint32_t             drops    = 0;  /**< Records dropped by the recorder. */
+  YmodemReplayStats    counters = {}; /**< Outcome of the last run. */
+
+  void compare(const std::vector<uint8_t>& produced);
+};
+
+#endif // ESP_PLATFORM
+
+#endif // YMODEMREPLAY_H
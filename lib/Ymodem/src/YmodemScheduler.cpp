@@ -0,0 +1,515 @@
+/**
+ * @file YmodemScheduler.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Prioritized queue of Ymodem transfers
+ * @version 0.1
+ * @date 2025-06-20
+ *
+ * This file contains the queues and the workers of the scheduler. The queue of
+ * a port is a binary heap protected by a mutex. On the ESP32 the worker task
+ * waits for jobs on a counting semaphore, on the host the worker is a
+ * std::thread waiting on a condition variable. A finished job is signalled with
+ * the YmodemCompletion of the asynchronous transfers.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "YmodemScheduler.h"
+#include "YmodemLog.h"
+
+#include <algorithm>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#else
+#include <condition_variable>
+#include <thread>
+#endif
+
+/**
+ * @brief Life cycle of a job, the worker and cancel() race to move it out of QUEUED.
+ */
+enum YmodemJobPhase : uint8_t
+{
+  JOB_QUEUED,   // Waiting on its port
+  JOB_RUNNING,  // Taken by the worker
+  JOB_FINISHED, // Result available
+};
+
+struct YmodemJobFuture::State
+{
+  YmodemJob            job;             // Transfer requested, its file name points to fileName
+  std::string          fileName;        // Copy of the name announced in the header
+  uint32_t             sequence;        // Order of submission
+  uint32_t             submittedMs;     // Time of submit()
+  std::atomic<uint8_t> phase;         // YmodemJobPhase
+  YmodemCompletion     completion;    // Result, final with times and stats, and the cancel request
+  YmodemJobTimes       times    = {}; // Queue wait and service time
+  YmodemSessionStats   counters = {}; // Counters of the session
+
+  State(const YmodemJob& job, uint32_t sequence)
+    : job(job), fileName(job.fileName != NULL ? job.fileName : ""), sequence(sequence), submittedMs(Ymodem_Millis()), phase(JOB_QUEUED)
+  {
+    this->job.fileName = fileName.c_str();
+  }
+
+  /**
+   * @brief Publishes the result and wakes up the callers waiting for it.
+   */
+  void finish(int value)
+  {
+    phase = JOB_FINISHED;
+    completion.finish(value);
+  }
+
+  /**
+   * @brief Finishes a job that never ran, if the worker has not taken it yet.
+   *
+   * @return true if the job was still queued and is now finished, false otherwise.
+   */
+  bool drop(int value)
+  {
+    uint8_t expected = JOB_QUEUED;
+    if (!phase.compare_exchange_strong(expected, JOB_RUNNING)) {
+      return false;
+    }
+    times.waitMs = Ymodem_Millis() - submittedMs;
+    finish(value);
+    return true;
+  }
+
+  /**
+   * @brief Time by which the job must have started, compared with the wrap of the clock.
+   */
+  uint32_t startBy() const
+  {
+    return submittedMs + job.deadlineMs;
+  }
+};
+
+struct YmodemScheduler::Port
+{
+  typedef std::shared_ptr<YmodemJobFuture::State> Entry;
+
+  YmodemTransport&     transport;        // Transport of the port, started by its owner
+  YmodemArena          arena;            // Packet buffers reused by every job
+  std::vector<Entry>   queue;            // Heap of the waiting jobs, the next one in front
+  Entry                current;          // Job being run, empty when the worker is idle
+  YmodemSchedulerStats counters = {};    // Counters reported by stats()
+  bool                 stopping = false; // Set by stop(), the worker exits
+  mutable std::mutex   lock;             // Protects queue, current, counters and stopping
+#ifdef ESP_PLATFORM
+  SemaphoreHandle_t jobsSignal; // Given once per job queued and by stop()
+  SemaphoreHandle_t exited;     // Given by the worker task before it deletes itself
+#else
+  std::condition_variable jobsSignal;
+  std::thread             worker;
+#endif
+
+  explicit Port(YmodemTransport& transport) : transport(transport)
+  {
+    queue.reserve(YMODEM_SCHEDULER_MAX_JOBS);
+#ifdef ESP_PLATFORM
+    jobsSignal = xSemaphoreCreateCounting(YMODEM_SCHEDULER_MAX_JOBS + 1, 0);
+    exited     = xSemaphoreCreateBinary();
+#endif
+  }
+
+  ~Port()
+  {
+#ifdef ESP_PLATFORM
+    if (jobsSignal != NULL) {
+      vSemaphoreDelete(jobsSignal);
+    }
+    if (exited != NULL) {
+      vSemaphoreDelete(exited);
+    }
+#endif
+  }
+
+  /**
+   * @brief Orders the heap, true if a runs after b.
+   *
+   * The highest priority runs first, then the earliest deadline, the jobs without one last,
+   * then the first submitted.
+   */
+  static bool runsAfter(const Entry& a, const Entry& b)
+  {
+    if (a->job.priority != b->job.priority) {
+      return a->job.priority < b->job.priority;
+    }
+    if ((a->job.deadlineMs == 0) != (b->job.deadlineMs == 0)) {
+      return a->job.deadlineMs == 0;
+    }
+    if (a->job.deadlineMs != 0 && a->startBy() != b->startBy()) {
+      return (int32_t)(a->startBy() - b->startBy()) > 0;
+    }
+    return (int32_t)(a->sequence - b->sequence) > 0;
+  }
+
+  /**
+   * @brief Removes the jobs cancelled while they were waiting, called with the lock held.
+   */
+  void purge()
+  {
+    auto end = std::remove_if(queue.begin(), queue.end(), [this](const Entry& entry) {
+      if (entry->phase != JOB_QUEUED) {
+        counters.cancelled++;
+        return true;
+      }
+      return false;
+    });
+    if (end != queue.end()) {
+      queue.erase(end, queue.end());
+      std::make_heap(queue.begin(), queue.end(), runsAfter);
+    }
+  }
+
+  /**
+   * @brief Wakes up the worker.
+   */
+  void signal()
+  {
+#ifdef ESP_PLATFORM
+    xSemaphoreGive(jobsSignal);
+#else
+    jobsSignal.notify_one();
+#endif
+  }
+
+  /**
+   * @brief Waits for the next job to run and marks it as running.
+   *
+   * @return Entry Job to run, empty once the scheduler is stopped.
+   */
+  Entry next()
+  {
+    while (true) {
+#ifdef ESP_PLATFORM
+      xSemaphoreTake(jobsSignal, portMAX_DELAY);
+      std::unique_lock<std::mutex> guard(lock);
+#else
+      std::unique_lock<std::mutex> guard(lock);
+      jobsSignal.wait(guard, [this]() { return stopping || !queue.empty(); });
+#endif
+      while (!stopping && !queue.empty()) {
+        std::pop_heap(queue.begin(), queue.end(), runsAfter);
+        Entry entry = queue.back();
+        queue.pop_back();
+
+        uint8_t expected = JOB_QUEUED;
+        if (!entry->phase.compare_exchange_strong(expected, JOB_RUNNING)) {
+          counters.cancelled++;
+          continue;
+        }
+        if (entry->job.deadlineMs != 0 && (int32_t)(Ymodem_Millis() - entry->startBy()) > 0) {
+          // Its caller no longer wants it, the port goes on with the next one
+          counters.expired++;
+          entry->times.waitMs = Ymodem_Millis() - entry->submittedMs;
+          entry->finish(YMODEM_TIMEOUT);
+          continue;
+        }
+        current = entry;
+        return entry;
+      }
+      if (stopping) {
+        return Entry();
+      }
+    }
+  }
+};
+
+YmodemJobFuture::YmodemJobFuture()
+{
+}
+
+bool YmodemJobFuture::valid() const
+{
+  return state != nullptr;
+}
+
+bool YmodemJobFuture::poll() const
+{
+  return state && state->completion.done();
+}
+
+bool YmodemJobFuture::wait(uint32_t timeoutMs)
+{
+  return state && state->completion.wait(timeoutMs);
+}
+
+void YmodemJobFuture::cancel()
+{
+  if (!state || state->completion.done()) {
+    return;
+  }
+  state->completion.cancel();
+  // A queued job finishes here, the worker discards it when it reaches the front
+  state->drop(YMODEM_ABORTED_BY_TRANSFER);
+}
+
+bool YmodemJobFuture::cancelled() const
+{
+  return state && state->completion.cancelled();
+}
+
+int YmodemJobFuture::result() const
+{
+  return state ? state->completion.result() : PENDING;
+}
+
+YmodemJobTimes YmodemJobFuture::times() const
+{
+  YmodemJobTimes times = {};
+  if (state && state->completion.done()) {
+    times = state->times;
+  }
+  return times;
+}
+
+YmodemSessionStats YmodemJobFuture::stats() const
+{
+  YmodemSessionStats stats = {};
+  if (state && state->completion.done()) {
+    stats = state->counters;
+  }
+  return stats;
+}
+
+YmodemScheduler::YmodemScheduler() : sequence(0), stopped(false)
+{
+}
+
+YmodemScheduler::~YmodemScheduler()
+{
+  stop();
+}
+
+#ifdef ESP_PLATFORM
+/**
+ * @brief Entry point of the FreeRTOS worker task of a port.
+ *
+ * @param param Pointer to a heap allocated std::function wrapping the worker loop.
+ */
+static void schedulerTask(void* param)
+{
+  std::function<void()>* body = static_cast<std::function<void()>*>(param);
+  (*body)();
+  delete body;
+  vTaskDelete(NULL);
+}
+#endif
+
+int YmodemScheduler::addPort(YmodemTransport& transport, const YmodemTaskConfig& config)
+{
+  if (count >= YMODEM_SCHEDULER_MAX_PORTS || stopped) {
+    YMODEM_LOGE("Scheduler port refused, at most %d ports are supported", YMODEM_SCHEDULER_MAX_PORTS);
+    return -1;
+  }
+  std::unique_ptr<Port> port(new (std::nothrow) Port(transport));
+  if (!port || port->arena.capacity() == 0) {
+    YMODEM_LOGE("Not enough memory for a scheduler port");
+    return -1;
+  }
+
+#ifdef ESP_PLATFORM
+  if (port->jobsSignal == NULL || port->exited == NULL) {
+    YMODEM_LOGE("Failed to create the semaphores of a scheduler port");
+    return -1;
+  }
+  Port*                  raw  = port.get();
+  std::function<void()>* body = new std::function<void()>([raw]() {
+    work(raw);
+    xSemaphoreGive(raw->exited);
+  });
+  BaseType_t             core = (config.core < 0) ? tskNO_AFFINITY : config.core;
+  if (xTaskCreatePinnedToCore(schedulerTask, "ymodem-sched", config.stackSize, body, config.priority, NULL, core) != pdPASS) {
+    YMODEM_LOGE("Failed to create the worker task of a scheduler port");
+    delete body;
+    return -1;
+  }
+#else
+  (void)config;
+  port->worker = std::thread(work, port.get());
+#endif
+
+  ports[count] = std::move(port);
+  return (int)count++;
+}
+
+YmodemJobFuture YmodemScheduler::submit(const YmodemJob& job)
+{
+  YmodemJobFuture future;
+  if (job.port >= count || stopped) {
+    YMODEM_LOGE("Job refused, there is no port %u", (unsigned)job.port);
+    return future;
+  }
+  bool complete = (job.direction == YMODEM_JOB_TRANSMIT) ? (job.source != NULL && job.fileName != NULL) : (job.sink != NULL);
+  if (!complete) {
+    YMODEM_LOGE("Job refused, its source or sink is missing");
+    return future;
+  }
+  if ((job.blockSize != PACKET_1K_SIZE && job.blockSize != PACKET_4K_SIZE && job.blockSize != PACKET_8K_SIZE) ||
+      job.blockSize > YMODEM_MAX_BLOCK_SIZE) {
+    YMODEM_LOGE("Job refused, blocks of %u bytes need YMODEM_MAX_BLOCK_SIZE of at least as much", (unsigned)job.blockSize);
+    return future;
+  }
+
+  std::shared_ptr<YmodemJobFuture::State> state(new (std::nothrow) YmodemJobFuture::State(job, sequence++));
+  if (state && !state->completion.valid()) {
+    state.reset();
+  }
+  if (!state) {
+    YMODEM_LOGE("Not enough memory for a job");
+    return future;
+  }
+
+  Port& port = *ports[job.port];
+  {
+    std::lock_guard<std::mutex> guard(port.lock);
+    if (port.stopping) {
+      return future;
+    }
+    if (port.queue.size() >= YMODEM_SCHEDULER_MAX_JOBS) {
+      port.purge();
+    }
+    if (port.queue.size() >= YMODEM_SCHEDULER_MAX_JOBS) {
+      YMODEM_LOGW("Job refused, %d jobs are already waiting on port %u", YMODEM_SCHEDULER_MAX_JOBS, (unsigned)job.port);
+      return future;
+    }
+    port.queue.push_back(state);
+    std::push_heap(port.queue.begin(), port.queue.end(), Port::runsAfter);
+    port.counters.maxDepth = std::max(port.counters.maxDepth, (uint32_t)port.queue.size());
+  }
+  port.signal();
+
+  future.state = state;
+  return future;
+}
+
+size_t YmodemScheduler::pending(size_t port) const
+{
+  if (port >= count) {
+    return 0;
+  }
+  std::lock_guard<std::mutex> guard(ports[port]->lock);
+  size_t                      queued = 0;
+  for (const Port::Entry& entry : ports[port]->queue) {
+    queued += (entry->phase == JOB_QUEUED) ? 1 : 0;
+  }
+  return queued;
+}
+
+YmodemSchedulerStats YmodemScheduler::stats(size_t port) const
+{
+  YmodemSchedulerStats stats = {};
+  if (port < count) {
+    std::lock_guard<std::mutex> guard(ports[port]->lock);
+    stats = ports[port]->counters;
+  }
+  return stats;
+}
+
+void YmodemScheduler::stop()
+{
+  stopped = true;
+  for (size_t i = 0; i < count; i++) {
+    Port& port = *ports[i];
+    {
+      std::lock_guard<std::mutex> guard(port.lock);
+      if (port.stopping) {
+        continue;
+      }
+      port.stopping = true;
+      // The jobs still queued were either cancelled by their caller or are cancelled now
+      for (const Port::Entry& entry : port.queue) {
+        entry->drop(YMODEM_ABORTED_BY_TRANSFER);
+        port.counters.cancelled++;
+      }
+      port.queue.clear();
+      if (port.current) {
+        port.current->completion.cancel();
+      }
+    }
+    port.signal();
+  }
+
+  // The cancelled sessions send CA and return, then every worker exits
+  for (size_t i = 0; i < count; i++) {
+#ifdef ESP_PLATFORM
+    xSemaphoreTake(ports[i]->exited, portMAX_DELAY);
+    xSemaphoreGive(ports[i]->exited);
+#else
+    if (ports[i]->worker.joinable()) {
+      ports[i]->worker.join();
+    }
+#endif
+  }
+}
+
+void YmodemScheduler::work(Port* port)
+{
+  while (true) {
+    Port::Entry entry = port->next();
+    if (!entry) {
+      return;
+    }
+    int result = runJob(*port, *entry);
+
+    // The counters of the port are final before the caller of the job is woken up
+    {
+      std::lock_guard<std::mutex> guard(port->lock);
+      YmodemSchedulerStats&       counters = port->counters;
+      bool                        failed   = (entry->job.direction == YMODEM_JOB_TRANSMIT) ? (result != YMODEM_TRANSMIT_OK) : (result < 0);
+      counters.completed++;
+      counters.failed += failed ? 1 : 0;
+      counters.totalWaitMs += entry->times.waitMs;
+      counters.maxWaitMs = std::max(counters.maxWaitMs, entry->times.waitMs);
+      counters.totalServiceMs += entry->times.serviceMs;
+      counters.maxServiceMs = std::max(counters.maxServiceMs, entry->times.serviceMs);
+      port->current.reset();
+    }
+    entry->finish(result);
+  }
+}
+
+/**
+ * @brief Runs the session of a job on the transport of its port.
+ *
+ * The packet buffers are taken from the arena of the port. The input is not flushed, the request
+ * of a receiver that is already waiting for the file starts the session right away.
+ *
+ * @return int Result of the session.
+ */
+int YmodemScheduler::runJob(Port& port, YmodemJobFuture::State& job)
+{
+  uint32_t start   = Ymodem_Millis();
+  job.times.waitMs = start - job.submittedMs;
+
+  port.arena.reset();
+  uint8_t* frame = port.arena.allocate(YMODEM_ARENA_FRAME_SIZE);
+  uint8_t* rx    = port.arena.allocate(YMODEM_FRAME_SIZE);
+
+  int result = YMODEM_NO_MEMORY;
+  if (frame != NULL && rx != NULL && job.job.direction == YMODEM_JOB_TRANSMIT) {
+    YmodemSender sender(*job.job.source, job.job.fileName, job.job.fileSize, frame, YMODEM_ARENA_FRAME_SIZE);
+    sender.setBlockSize(job.job.blockSize);
+    result       = Ymodem_RunSession(sender, port.transport, job.completion.cancelFlag(), YmodemEventHook(), rx);
+    job.counters = sender.stats();
+  }
+  else if (frame != NULL && rx != NULL) {
+    YmodemReceiver receiver(*job.job.sink, job.job.maxSize, frame, YMODEM_ARENA_FRAME_SIZE);
+    receiver.setBlockSize(job.job.blockSize);
+    result       = Ymodem_RunSession(receiver, port.transport, job.completion.cancelFlag(), YmodemEventHook(), rx);
+    job.counters = receiver.stats();
+  }
+
+  job.times.serviceMs = Ymodem_Millis() - start;
+  return result;
+}
@@ -0,0 +1,248 @@
+/**
+ * @file YmodemScheduler.h
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Prioritized queue of Ymodem transfers
+ * @version 0.1
+ * @date 2025-06-20
+ *
+ * This file contains the scheduler of the transfers requested from several
+ * places of the firmware. Every port is started once by its owner and given
+ * to the scheduler, which runs one worker per port: a FreeRTOS task on the
+ * ESP32 or a std::thread on the host. The worker takes the queued jobs one at
+ * a time, by priority, over the same transport and packet buffers, so two
+ * callers never install the driver of a UART or talk on it at once.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef YMODEMSCHEDULER_H
+#define YMODEMSCHEDULER_H
+
+#include <atomic>
+#include <memory>
+
+#include "YmodemAsync.h"
+#include "YmodemReceive.h"
+#include "YmodemTransmit.h"
+
+/**
+ * @brief Direction of a scheduled transfer.
+ */
+enum YmodemJobDirection : uint8_t
+{
+  YMODEM_JOB_TRANSMIT, // Sends the file read from the source
+  YMODEM_JOB_RECEIVE,  // Receives a file into the sink
+};
+
+/**
+ * @brief Transfer submitted to a YmodemScheduler.
+ */
+struct YmodemJob
+{
+  YmodemJobDirection    direction  = YMODEM_JOB_TRANSMIT; /*!< Transmission or reception */
+  size_t                port       = 0;                   /*!< Port returned by YmodemScheduler::addPort() */
+  YmodemTransmitSource* source     = NULL;                /*!< Origin of the file data of a transmission, it must outlive the job */
+  const char*           fileName   = NULL;                /*!< Name announced in the header of a transmission, copied by submit() */
+  uint32_t              fileSize   = 0;                   /*!< Size of the file of a transmission in bytes */
+  YmodemReceiveSink*    sink       = NULL;                /*!< Destination of a received file, it must outlive the job */
+  uint32_t              maxSize    = YM_MAX_FILESIZE;     /*!< Largest file accepted by a reception */
+  int                   priority   = 0;                   /*!< Jobs with a higher priority run first */
+  uint32_t              deadlineMs = 0;                   /*!< Time after submit() by which the job must have started, 0 for none */
+  size_t                blockSize  = PACKET_1K_SIZE;      /*!< Largest block negotiated, up to YMODEM_MAX_BLOCK_SIZE */
+};
+
+/**
+ * @brief Time a job spent in the scheduler.
+ */
+struct YmodemJobTimes
+{
+  uint32_t waitMs;    // From submit() to the start of the session, or to the end of a job that never ran
+  uint32_t serviceMs; // Duration of the session, 0 for a job that never ran
+};
+
+/**
+ * @brief Counters of a port of the scheduler.
+ */
+struct YmodemSchedulerStats
+{
+  uint32_t completed;      // Jobs run to the end, whatever their result
+  uint32_t failed;         // Jobs run that did not transfer their file
+  uint32_t expired;        // Jobs dropped because their deadline passed before they could start
+  uint32_t cancelled;      // Jobs cancelled before they started
+  uint32_t maxDepth;       // Largest number of jobs waiting at once
+  uint32_t totalWaitMs;    // Time spent in the queue by the jobs run
+  uint32_t maxWaitMs;      // Longest time a job run spent in the queue
+  uint32_t totalServiceMs; // Time spent running the jobs
+  uint32_t maxServiceMs;   // Longest job
+};
+
+/**
+ * @brief Result of a job submitted to a YmodemScheduler.
+ *
+ * The future can be copied freely, every copy refers to the same job. The job stays queued or
+ * keeps running when all the copies are destroyed.
+ */
+class YmodemJobFuture
+{
+public:
+  /**
+   * @brief Result reported by result() while the job is queued or running.
+   */
+  static const int PENDING = YmodemCompletion::PENDING;
+
+  /**
+   * @brief Constructs an empty future that is not attached to any job.
+   */
+  YmodemJobFuture();
+
+  /**
+   * @brief Checks whether the job was accepted by the scheduler.
+   *
+   * @return true if the job was queued, false if submit() refused it.
+   */
+  bool valid() const;
+
+  /**
+   * @brief Checks whether the job has finished, without blocking.
+   *
+   * @return true if the job has finished, false if it is queued or running.
+   */
+  bool poll() const;
+
+  /**
+   * @brief Blocks until the job finishes or the timeout expires.
+   *
+   * @param timeoutMs Maximum time to wait in milliseconds.
+   * @return true if the job has finished, false on timeout.
+   */
+  bool wait(uint32_t timeoutMs);
+
+  /**
+   * @brief Cancels the job.
+   *
+   * A queued job finishes right away with YMODEM_ABORTED_BY_TRANSFER and is never started. A
+   * running job sends CA to the peer and finishes the next time it waits for data, use wait()
+   * to know when.
+   */
+  void cancel();
+
+  /**
+   * @brief Checks whether cancel() was called on this job.
+   *
+   * @return true if the job was cancelled, false otherwise.
+   */
+  bool cancelled() const;
+
+  /**
+   * @brief Retrieves the result of the job.
+   *
+   * @return int PENDING while the job is queued or running. Then the size of the received file or
+   *         the YmodemPacketStatus of the transmission, YMODEM_TIMEOUT if the deadline passed before
+   *         the job started, YMODEM_ABORTED_BY_TRANSFER if it was cancelled before it started.
+   */
+  int result() const;
+
+  /**
+   * @brief Retrieves the time the job spent queued and running, once it has finished.
+   *
+   * @return YmodemJobTimes Queue wait and service time, zeros while the job has not finished.
+   */
+  YmodemJobTimes times() const;
+
+  /**
+   * @brief Retrieves the counters of the session of the job, once it has finished.
+   *
+   * @return YmodemSessionStats Packets, retries, timeouts and file bytes, zeros if the job never ran.
+   */
+  YmodemSessionStats stats() const;
+
+private:
+  friend class YmodemScheduler;
+
+  struct State;
+  std::shared_ptr<State> state; /**< State shared between the futures and the worker. */
+};
+
+/**
+ * @brief Queue of transfers served by one worker per port.
+ *
+ * A port is a transport already started by its owner, such as a UartTransport after begin(). Its
+ * worker runs the jobs submitted for it one after the other, the highest priority first, then the
+ * earliest deadline, then the order of submission, and reuses the transport and a packet arena of
+ * YMODEM_ARENA_SIZE bytes for all of them. The jobs of different ports run at the same time.
+ */
+class YmodemScheduler
+{
+public:
+  /**
+   * @brief Constructor for the YmodemScheduler class.
+   */
+  YmodemScheduler();
+
+  /**
+   * @brief Destructor for the YmodemScheduler class, see stop().
+   */
+  ~YmodemScheduler();
+
+  YmodemScheduler(const YmodemScheduler&)            = delete;
+  YmodemScheduler& operator=(const YmodemScheduler&) = delete;
+
+  /**
+   * @brief Adds a port and starts its worker.
+   *
+   * Every port is added before the first submit().
+   *
+   * @param transport Transport of the port, already started, it must outlive the scheduler.
+   * @param config Settings of the worker task of the port.
+   * @return int Port number to use in YmodemJob::port, -1 if there are already
+   *         YMODEM_SCHEDULER_MAX_PORTS ports or the worker could not be created.
+   */
+  int addPort(YmodemTransport& transport, const YmodemTaskConfig& config = YmodemTaskConfig());
+
+  /**
+   * @brief Queues a job on its port. It can be called from any task.
+   *
+   * @param job Transfer to run, the file name is copied.
+   * @return YmodemJobFuture Future of the job, invalid if the port does not exist, the job misses
+   *         its source or sink, its block size is not supported, YMODEM_SCHEDULER_MAX_JOBS jobs
+   *         are already waiting on the port or the scheduler is stopped.
+   */
+  YmodemJobFuture submit(const YmodemJob& job);
+
+  /**
+   * @brief Retrieves the number of jobs waiting on a port, without the running one.
+   *
+   * @param port Port number returned by addPort().
+   * @return size_t Number of jobs queued.
+   */
+  size_t pending(size_t port) const;
+
+  /**
+   * @brief Retrieves the counters of a port.
+   *
+   * @param port Port number returned by addPort().
+   * @return YmodemSchedulerStats Copy of the counters, zeros for a port that does not exist.
+   */
+  YmodemSchedulerStats stats(size_t port) const;
+
+  /**
+   * @brief Stops the workers.
+   *
+   * The queued jobs finish with YMODEM_ABORTED_BY_TRANSFER, the running ones are cancelled, and the
+   * call returns once every worker has exited. The jobs submitted afterwards are refused.
+   */
+  void stop();
+
+private:
+  struct Port;
+
+  std::unique_ptr<Port> ports[YMODEM_SCHEDULER_MAX_PORTS]; /**< Queue and worker of every port. */
+  size_t                count = 0;                         /**< Number of ports. */
+  std::atomic<uint32_t> sequence;                          /**< Order of submission of the next job. */
+  std::atomic<bool>     stopped;                           /**< Set by stop(). */
+
+  static void work(Port* port);
+  static int  runJob(Port& port, YmodemJobFuture::State& job);
+};
+
+#endif // YMODEMSCHEDULER_H
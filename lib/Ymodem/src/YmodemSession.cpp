@@ -0,0 +1,313 @@
+/**
+ * @file YmodemSession.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Push-based Ymodem session state machines
+ * @version 0.1
+ * @date 2025-05-19
+ *
+ * This file contains the output queue and timer shared by the Ymodem sender
+ * and receiver state machines, and the blocking driver that runs a session
+ * over a transport.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "YmodemSession.h"
+
+#include <algorithm>
+#include <new>
+
+#ifdef ESP_PLATFORM
+#include <Arduino.h>
+#else
+#include <chrono>
+#endif
+
+YmodemSession::YmodemSession(uint8_t* frame, size_t frameSize) : frame(frame), frameCapacity(frameSize)
+{
+  if (frame == NULL) {
+    ownFrame.reset(new (std::nothrow) uint8_t[frameSize]);
+    this->frame = ownFrame.get();
+  }
+}
+
+uint8_t YmodemSession::feed(const uint8_t* data, size_t size, uint32_t now)
+{
+  uint8_t events = YMODEM_EVENT_NONE;
+
+  for (size_t i = 0; i < size && !done; i++) {
+    events |= onByte(data[i], now);
+  }
+  return events;
+}
+
+uint8_t YmodemSession::poll(uint32_t now)
+{
+  uint8_t events = YMODEM_EVENT_NONE;
+
+  if (!done && outputSize() == 0 && streaming()) {
+    events = onStream(now);
+  }
+  if (done || !timerArmed || (int32_t)(now - deadline) < 0) {
+    return events;
+  }
+  timerArmed = false;
+  counters.timeouts++;
+  return events | onTimeout(now);
+}
+
+uint8_t YmodemSession::cancel()
+{
+  if (done) {
+    return YMODEM_EVENT_NONE;
+  }
+  return abort(YMODEM_ABORTED_BY_TRANSFER);
+}
+
+bool YmodemSession::isDone() const
+{
+  return done;
+}
+
+int YmodemSession::result() const
+{
+  return sessionResult;
+}
+
+const uint8_t* YmodemSession::output() const
+{
+  if (controlSent < controlSize) {
+    return control + controlSent;
+  }
+  return frame + frameOutSent;
+}
+
+size_t YmodemSession::outputSize() const
+{
+  if (controlSent < controlSize) {
+    return controlSize - controlSent;
+  }
+  return frameOutSize - frameOutSent;
+}
+
+void YmodemSession::consumeOutput(size_t size)
+{
+  if (controlSent < controlSize) {
+    controlSent += std::min(size, controlSize - controlSent);
+    return;
+  }
+  frameOutSent += std::min(size, frameOutSize - frameOutSent);
+}
+
+uint32_t YmodemSession::nextDeadline() const
+{
+  return deadline;
+}
+
+size_t YmodemSession::expectedBytes() const
+{
+  return 1;
+}
+
+bool YmodemSession::streaming() const
+{
+  return false;
+}
+
+const YmodemSessionStats& YmodemSession::stats() const
+{
+  return counters;
+}
+
+void YmodemSession::setDigest(YmodemDigestType type)
+{
+  digestType = type;
+}
+
+const YmodemDigest& YmodemSession::digest() const
+{
+  return fileDigest;
+}
+
+bool YmodemSession::digestVerified() const
+{
+  return verified;
+}
+
+bool YmodemSession::reset()
+{
+  controlSize   = 0;
+  controlSent   = 0;
+  frameOutSize  = 0;
+  frameOutSent  = 0;
+  timerArmed    = false;
+  done          = false;
+  sessionResult = YMODEM_TIMEOUT;
+  counters      = {};
+  verified      = false;
+  fileDigest.begin(digestType);
+  return frame != NULL;
+}
+
+bool YmodemSession::reserveFrame(size_t size)
+{
+  if (frame != NULL && frameCapacity >= size) {
+    return true;
+  }
+  if (frame != ownFrame.get()) {
+    return false;
+  }
+  ownFrame.reset(new (std::nothrow) uint8_t[size]);
+  frame         = ownFrame.get();
+  frameCapacity = size;
+  return frame != NULL;
+}
+
+uint8_t YmodemSession::queueByte(uint8_t byte)
+{
+  // Everything queued so far has been sent, start again from the beginning
+  if (controlSent == controlSize) {
+    controlSize = 0;
+    controlSent = 0;
+  }
+  if (controlSize < CONTROL_SIZE) {
+    control[controlSize++] = byte;
+  }
+  return YMODEM_EVENT_OUTPUT;
+}
+
+uint8_t YmodemSession::queueBytes(const uint8_t* data, size_t size)
+{
+  for (size_t i = 0; i < size; i++) {
+    queueByte(data[i]);
+  }
+  return YMODEM_EVENT_OUTPUT;
+}
+
+uint8_t YmodemSession::queueFrame(size_t size)
+{
+  frameOutSize = size;
+  frameOutSent = 0;
+  return YMODEM_EVENT_OUTPUT;
+}
+
+uint8_t YmodemSession::onStream(uint32_t now)
+{
+  return YMODEM_EVENT_NONE;
+}
+
+void YmodemSession::armTimer(uint32_t now, uint32_t timeoutMs)
+{
+  deadline   = now + timeoutMs;
+  timerArmed = true;
+}
+
+uint8_t YmodemSession::finish(int result)
+{
+  done          = true;
+  timerArmed    = false;
+  sessionResult = result;
+  return YMODEM_EVENT_DONE | (outputSize() > 0 ? YMODEM_EVENT_OUTPUT : YMODEM_EVENT_NONE);
+}
+
+uint8_t YmodemSession::abort(int result)
+{
+  frameOutSize = 0;
+  frameOutSent = 0;
+  queueByte(CA);
+  queueByte(CA);
+  return finish(result);
+}
+
+uint32_t Ymodem_Millis()
+{
+#ifdef ESP_PLATFORM
+  return millis();
+#else
+  using namespace std::chrono;
+  return (uint32_t)duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+uint32_t Ymodem_Micros()
+{
+#ifdef ESP_PLATFORM
+  return micros();
+#else
+  using namespace std::chrono;
+  return (uint32_t)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/**
+ * @brief Sends the bytes queued by a session.
+ *
+ * @return true if everything was sent, false if the transport failed.
+ */
+static bool flushOutput(YmodemSession& session, YmodemTransport& transport)
+{
+  while (session.outputSize() > 0) {
+    int len = transport.write(session.output(), session.outputSize());
+    if (len <= 0) {
+      return false;
+    }
+    session.consumeOutput(len);
+  }
+  return true;
+}
+
+int Ymodem_RunSession(YmodemSession& session, YmodemTransport& transport, const std::atomic<bool>* cancelRequested, YmodemEventHook hook,
+                      uint8_t* buffer)
+{
+  // The packets never live on the stack, so the session can run on a small task
+  std::unique_ptr<uint8_t[]> ownBuffer;
+  uint8_t*                   rx = buffer;
+  if (rx == NULL) {
+    ownBuffer.reset(new (std::nothrow) uint8_t[YMODEM_FRAME_SIZE]);
+    rx = ownBuffer.get();
+    if (rx == NULL) {
+      return YMODEM_NO_MEMORY;
+    }
+  }
+
+  uint8_t events = session.start(Ymodem_Millis());
+
+  while (true) {
+    if (hook && (events & ~YMODEM_EVENT_OUTPUT)) {
+      hook(session, events);
+    }
+
+    bool sent = flushOutput(session, transport);
+    if (session.isDone()) {
+      // The last answer may still be queued, the caller could change the link before it is sent
+      transport.waitWriteDone(NAK_TIMEOUT);
+      return session.result();
+    }
+    if (!sent || (cancelRequested && *cancelRequested)) {
+      events = session.cancel();
+      continue;
+    }
+
+    // Sleep until the packet in progress is complete or the session timer expires. The wait is
+    // bounded so that a cancel request is noticed within NAK_TIMEOUT.
+    uint32_t now  = Ymodem_Millis();
+    int32_t  wait = (int32_t)(session.nextDeadline() - now);
+    wait          = std::max<int32_t>(0, std::min<int32_t>(wait, NAK_TIMEOUT));
+    if (session.streaming()) {
+      wait = 0;
+    }
+
+    int len = transport.read(rx, std::min<size_t>(session.expectedBytes(), YMODEM_FRAME_SIZE), wait);
+    now     = Ymodem_Millis();
+    events  = YMODEM_EVENT_NONE;
+    if (len > 0) {
+      events = session.feed(rx, len, now);
+    }
+    else if (len == TRANSPORT_ERROR) {
+      events = session.cancel();
+      continue;
+    }
+    // On TRANSPORT_OVERRUN the packet in progress is incomplete, it is retried when its timer expires
+    events |= session.poll(now);
+  }
+}
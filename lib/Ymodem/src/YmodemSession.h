@@ -0,0 +1,447 @@
+/**
+ * @file YmodemSession.h
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Push-based Ymodem session state machines
+ * @version 0.1
+ * @date 2025-05-19
+ *
+ * This file contains the interface shared by the Ymodem sender and receiver
+ * state machines. A session never blocks: the received bytes are pushed with
+ * feed(), the timers are driven with poll(), and the bytes to send are pulled
+ * with output(). Ymodem_RunSession() drives a session over a transport for
+ * the callers that just want a blocking transfer.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef YMODEMSESSION_H
+#define YMODEMSESSION_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+#include "YmodemArena.h"
+#include "YmodemDigest.h"
+#include "YmodemTransport.h"
+#include "YmodemUtils.h"
+
+/**
+ * @brief Events reported by the session entry points, several can be combined.
+ */
+enum YmodemEvent : uint8_t
+{
+  YMODEM_EVENT_NONE      = 0x00, // Nothing happened
+  YMODEM_EVENT_OUTPUT    = 0x01, // Bytes are waiting in output()
+  YMODEM_EVENT_FILE      = 0x02, // A file header was accepted
+  YMODEM_EVENT_BLOCK     = 0x04, // A data block was accepted
+  YMODEM_EVENT_RETRY     = 0x08, // A packet was rejected or a timer expired, the last step is repeated
+  YMODEM_EVENT_FILE_DONE = 0x10, // The file was completely transferred
+  YMODEM_EVENT_DONE      = 0x20, // The session has finished, see result()
+};
+
+/**
+ * @brief Counters collected by a session.
+ */
+struct YmodemSessionStats
+{
+  uint32_t packets;      // Packets accepted (receiver) or acknowledged (sender)
+  uint32_t retries;      // Packets rejected (receiver) or sent again (sender)
+  uint32_t timeouts;     // Timers that expired
+  uint32_t bytes;        // File bytes transferred
+  uint32_t skipped;      // Files skipped because the receiver held them unchanged
+  uint32_t skippedBytes; // Bytes of the skipped files, not sent
+  uint32_t repaired;     // Packets repaired with their parity instead of being rejected (receiver)
+};
+
+/**
+ * @brief File attributes announced in a Ymodem header, compared by the sinks that skip unchanged files.
+ */
+struct YmodemFileInfo
+{
+  const char* name;    // Name of the file
+  uint32_t    size;    // Size of the file in bytes
+  uint32_t    modTime; // Modification time in seconds since 1970, 0 if not announced
+  uint32_t    mode;    // Unix file mode, 0 if not announced
+  const char* digest;  // Digest such as "sha256:<hex>", empty if not announced
+};
+
+/**
+ * @brief Write counters of the sinks backed by a file, such as YmodemFileSink.
+ */
+struct YmodemWriteStats
+{
+  uint32_t reserved;  // Bytes reserved for the file, 0 if the reservation failed
+  uint32_t writes;    // Blocks written
+  uint32_t totalUs;   // Time spent in the writes, in microseconds
+  uint32_t maxUs;     // Slowest write, in microseconds
+  uint32_t elapsedMs; // Duration of the session, the time to failure when it failed
+};
+
+/**
+ * @brief Destination of the files received by a YmodemReceiver or a ZmodemReceiver.
+ */
+class YmodemReceiveSink
+{
+public:
+  virtual ~YmodemReceiveSink()
+  {
+  }
+
+  /**
+   * @brief Called with the size announced in a file header, before open().
+   *
+   * Sinks backed by a storage set the space aside here, so a transfer that cannot fit is
+   * refused before its first block instead of failing once the storage is full.
+   *
+   * @param size Size of the file in bytes.
+   * @return true if the file fits, false to cancel the session with YMODEM_NO_SPACE.
+   */
+  virtual bool reserve(uint32_t size)
+  {
+    return true;
+  }
+
+  /**
+   * @brief Called when a file header has been accepted.
+   *
+   * @param name Name of the file announced by the sender.
+   * @param size Size of the file in bytes.
+   * @return true to accept the file, false to cancel the session.
+   */
+  virtual bool open(const char* name, uint32_t size) = 0;
+
+  /**
+   * @brief Called for every new data block, trimmed to the size of the file.
+   *
+   * @param data Pointer to the file data.
+   * @param size Number of bytes to write.
+   * @return int Number of bytes written, anything other than size cancels the session.
+   */
+  virtual int write(const uint8_t* data, size_t size) = 0;
+
+  /**
+   * @brief Called instead of open() when the receiver may continue an interrupted transfer.
+   *
+   * Sinks that kept the part of the file received before the interruption open it for
+   * appending and report its size, the sender then restarts after it.
+   *
+   * @param name Name of the file announced by the sender.
+   * @param size Size of the file in bytes.
+   * @param offset Set to the bytes of the file already stored.
+   * @return true if the file is open for appending, false to receive it from the start with open().
+   */
+  virtual bool resume(const char* name, uint32_t size, uint32_t* offset)
+  {
+    return false;
+  }
+
+  /**
+   * @brief Called before reserve() when the sender accepts skipping the file.
+   *
+   * Sinks that find the file already stored with the same size and the same announced
+   * attributes or digest report it, the sender then goes on without sending the data.
+   *
+   * @param info Name, size and attributes announced in the header.
+   * @return true to skip the file, false to receive it.
+   */
+  virtual bool unchanged(const YmodemFileInfo& info)
+  {
+    return false;
+  }
+
+  /**
+   * @brief Called after close() with the modification time and the mode announced in the header.
+   *
+   * Sinks that keep them let a later push of the same file be skipped.
+   *
+   * @param modTime Modification time in seconds since 1970.
+   * @param mode Unix file mode, 0 if not announced.
+   */
+  virtual void attributes(uint32_t modTime, uint32_t mode)
+  {
+  }
+
+  /**
+   * @brief Called when the sender has confirmed the end of the file.
+   */
+  virtual void close()
+  {
+  }
+};
+
+/**
+ * @brief Origin of the file sent by a YmodemSender or a ZmodemSender.
+ */
+class YmodemTransmitSource
+{
+public:
+  virtual ~YmodemTransmitSource()
+  {
+  }
+
+  /**
+   * @brief Reads a block of the file.
+   *
+   * @param data Pointer to the buffer where the block will be stored.
+   * @param size Number of bytes to read.
+   * @param offset Position of the block in the file.
+   * @return int Number of bytes read, anything other than size cancels the session.
+   */
+  virtual int read(uint8_t* data, size_t size, uint32_t offset) = 0;
+};
+
+/**
+ * @brief Base class of the Ymodem sender and receiver state machines.
+ *
+ * All the timestamps are in milliseconds and may wrap around. Every entry point returns
+ * a mask of YmodemEvent. The bytes queued in output() must be sent and consumed before
+ * the next call to feed() or poll(), otherwise control bytes beyond the queue capacity are dropped.
+ */
+class YmodemSession
+{
+public:
+  /**
+   * @brief Constructor for the YmodemSession class.
+   *
+   * @param frame Packet buffer of frameSize bytes, it must outlive the session. NULL to allocate
+   *              one on the heap, start() fails with YMODEM_NO_MEMORY if that is not possible.
+   * @param frameSize Size of the packet buffer, at least YMODEM_FRAME_SIZE.
+   */
+  YmodemSession(uint8_t* frame = NULL, size_t frameSize = YMODEM_FRAME_SIZE);
+
+  virtual ~YmodemSession()
+  {
+  }
+
+  /**
+   * @brief Starts the session.
+   *
+   * @param now Current time in milliseconds.
+   * @return uint8_t Mask of YmodemEvent.
+   */
+  virtual uint8_t start(uint32_t now) = 0;
+
+  /**
+   * @brief Pushes received bytes into the session. All the bytes are consumed.
+   *
+   * @param data Pointer to the received bytes.
+   * @param size Number of received bytes.
+   * @param now Current time in milliseconds.
+   * @return uint8_t Mask of YmodemEvent.
+   */
+  uint8_t feed(const uint8_t* data, size_t size, uint32_t now);
+
+  /**
+   * @brief Checks the timers of the session.
+   *
+   * A streaming session also produces its next block here once the previous one has been sent.
+   *
+   * @param now Current time in milliseconds.
+   * @return uint8_t Mask of YmodemEvent.
+   */
+  uint8_t poll(uint32_t now);
+
+  /**
+   * @brief Cancels the session, CA CA is queued for the peer.
+   *
+   * @return uint8_t Mask of YmodemEvent.
+   */
+  uint8_t cancel();
+
+  /**
+   * @brief Checks whether the session has finished.
+   *
+   * @return true once the session has finished, false otherwise.
+   */
+  bool isDone() const;
+
+  /**
+   * @brief Retrieves the result of the session.
+   *
+   * @return int YMODEM_TRANSMIT_OK or the file size on success, or a negative YmodemPacketStatus.
+   */
+  int result() const;
+
+  /**
+   * @brief Retrieves the bytes waiting to be sent.
+   *
+   * Queued control bytes come first, then the packet being sent, which is not copied.
+   *
+   * @return const uint8_t* Pointer to the bytes to send, valid until the next call on the session.
+   */
+  const uint8_t* output() const;
+
+  /**
+   * @brief Retrieves the number of bytes waiting in output().
+   *
+   * @return size_t Number of bytes to send.
+   */
+  size_t outputSize() const;
+
+  /**
+   * @brief Marks bytes of output() as sent.
+   *
+   * @param size Number of bytes sent.
+   */
+  void consumeOutput(size_t size);
+
+  /**
+   * @brief Retrieves the time at which poll() has something to do.
+   *
+   * @return uint32_t Deadline in milliseconds.
+   */
+  uint32_t nextDeadline() const;
+
+  /**
+   * @brief Retrieves the number of bytes that would complete the packet being received.
+   *
+   * Transports that can wait for a given amount of data use it to be woken up once per packet.
+   *
+   * @return size_t Number of bytes expected, at least 1.
+   */
+  virtual size_t expectedBytes() const;
+
+  /**
+   * @brief Checks whether the session is sending without waiting for the peer.
+   *
+   * A streaming session writes its data as fast as the transport takes it, so its driver polls
+   * the line for answers without waiting and calls poll() as soon as output() is empty.
+   *
+   * @return true while the session streams, false for the Ymodem sessions.
+   */
+  virtual bool streaming() const;
+
+  /**
+   * @brief Retrieves the session counters.
+   *
+   * @return const YmodemSessionStats& Reference to the counters.
+   */
+  const YmodemSessionStats& stats() const;
+
+  /**
+   * @brief Selects the digest computed over the file payload, none by default.
+   *
+   * The receiver uses the algorithm announced in the file header instead, when there is one.
+   * Call it before start().
+   *
+   * @param type Digest algorithm.
+   */
+  void setDigest(YmodemDigestType type);
+
+  /**
+   * @brief Retrieves the digest of the last file, complete once its transfer has finished.
+   *
+   * @return const YmodemDigest& Reference to the digest.
+   */
+  const YmodemDigest& digest() const;
+
+  /**
+   * @brief Checks whether the receiver has verified the digest announced in the file header.
+   *
+   * @return true if the last file matched the announced digest, false if none was announced.
+   */
+  bool digestVerified() const;
+
+protected:
+  static const size_t CONTROL_SIZE = 64; /**< Capacity of the control byte queue, a few Zmodem hex headers fit. */
+
+  std::unique_ptr<uint8_t[]> ownFrame;                           /**< Packet buffer allocated when none was given. */
+  uint8_t*                   frame;                              /**< Packet being received or sent. */
+  size_t                     frameCapacity;                      /**< Size of frame in bytes. */
+  uint8_t                    control[CONTROL_SIZE];              /**< Control bytes waiting to be sent. */
+  size_t                     controlSize   = 0;                  /**< Number of bytes in control. */
+  size_t                     controlSent   = 0;                  /**< Bytes of control already sent. */
+  size_t                     frameOutSize  = 0;                  /**< Bytes of frame waiting to be sent. */
+  size_t                     frameOutSent  = 0;                  /**< Bytes of frame already sent. */
+  uint32_t                   deadline      = 0;                  /**< Time at which onTimeout() is called. */
+  bool                       timerArmed    = false;              /**< True while deadline is valid. */
+  bool                       done          = false;              /**< True once the session has finished. */
+  int                        sessionResult = YMODEM_TIMEOUT;     /**< Result reported by result(). */
+  YmodemSessionStats         counters      = {};                 /**< Counters reported by stats(). */
+  YmodemDigestType           digestType    = YMODEM_DIGEST_NONE; /**< Digest selected with setDigest(). */
+  YmodemDigest               fileDigest;                         /**< Digest of the file payload. */
+  bool                       verified      = false;              /**< True once the announced digest has matched. */
+
+  /**
+   * @brief Resets the output queue, the timer and the counters.
+   *
+   * @return true if the session has a packet buffer, false otherwise.
+   */
+  bool reset();
+
+  /**
+   * @brief Makes sure the packet buffer holds size bytes.
+   *
+   * A buffer the session allocated itself is replaced by a larger one, a buffer given to the
+   * constructor is kept.
+   *
+   * @param size Bytes of the largest packet.
+   * @return true if the buffer is large enough, false otherwise.
+   */
+  bool reserveFrame(size_t size);
+
+  /**
+   * @brief Handles one received byte.
+   */
+  virtual uint8_t onByte(uint8_t byte, uint32_t now) = 0;
+
+  /**
+   * @brief Handles the expiry of the timer.
+   */
+  virtual uint8_t onTimeout(uint32_t now) = 0;
+
+  /**
+   * @brief Produces the next block of a streaming session, called by poll() once output() is empty.
+   */
+  virtual uint8_t onStream(uint32_t now);
+
+  uint8_t queueByte(uint8_t byte);
+  uint8_t queueBytes(const uint8_t* data, size_t size);
+  uint8_t queueFrame(size_t size);
+  void    armTimer(uint32_t now, uint32_t timeoutMs);
+  uint8_t finish(int result);
+
+  /**
+   * @brief Drops the packet being sent, queues the cancel sequence of the protocol and finishes.
+   */
+  virtual uint8_t abort(int result);
+};
+
+/**
+ * @brief Function called by Ymodem_RunSession() after every step that reported events.
+ */
+typedef std::function<void(YmodemSession& session, uint8_t events)> YmodemEventHook;
+
+/**
+ * @brief Retrieves a millisecond clock for the session timestamps.
+ *
+ * @return uint32_t Milliseconds since an arbitrary origin.
+ */
+uint32_t Ymodem_Millis();
+
+/**
+ * @brief Retrieves a microsecond clock for the latencies that are shorter than a millisecond.
+ *
+ * @return uint32_t Microseconds since an arbitrary origin, it wraps around after 71 minutes.
+ */
+uint32_t Ymodem_Micros();
+
+/**
+ * @brief Runs a session over a transport until it finishes.
+ *
+ * The transport is read with the number of bytes that completes the packet in progress,
+ * so a transport that can wait for a given amount of data wakes the caller once per packet.
+ * While the session streams, the transport is read without waiting between two blocks.
+ *
+ * @param session Session to run, it is started by this function.
+ * @param transport Transport carrying the session.
+ * @param cancelRequested Optional flag, the session is cancelled as soon as it becomes true.
+ * @param hook Optional function called with the events of every step.
+ * @param buffer Optional receive buffer of YMODEM_FRAME_SIZE bytes. NULL to allocate one on the heap for the session.
+ * @return int Result of the session, YMODEM_NO_MEMORY if the receive buffer could not be allocated.
+ */
+int Ymodem_RunSession(YmodemSession& session, YmodemTransport& transport, const std::atomic<bool>* cancelRequested = NULL,
+                      YmodemEventHook hook = YmodemEventHook(), uint8_t* buffer = NULL);
+
+#endif // YMODEMSESSION_H
@@ -0,0 +1,330 @@
+/**
+ * @file YmodemTcp.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  TCP transport for Ymodem sessions
+ * @version 0.1
+ * @date 2025-06-16
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "YmodemTcp.h"
+#include "YmodemLog.h"
+#include "YmodemSession.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include <lwip/netdb.h>
+#include <lwip/sockets.h>
+#else
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/**
+ * @brief Waits until a socket can be read or written.
+ *
+ * @param fd Socket to wait on.
+ * @param writing true to wait for room to write, false to wait for data or a connection.
+ * @param timeoutMs Maximum time to wait, in milliseconds.
+ * @return int 1 if the socket is ready, 0 on timeout, -1 on error.
+ */
+static int waitSocket(int fd, bool writing, uint32_t timeoutMs)
+{
+  fd_set set;
+  FD_ZERO(&set);
+  FD_SET(fd, &set);
+  struct timeval timeout = {(time_t)(timeoutMs / 1000), (suseconds_t)((timeoutMs % 1000) * 1000)};
+  return select(fd + 1, writing ? NULL : &set, writing ? &set : NULL, NULL, &timeout);
+}
+
+TcpTransport::TcpTransport()
+{
+}
+
+TcpTransport::~TcpTransport()
+{
+  end();
+}
+
+bool TcpTransport::connect(const char* host, uint16_t port, uint32_t timeoutMs)
+{
+  closePeer();
+
+  struct addrinfo hints = {};
+  hints.ai_family       = AF_UNSPEC;
+  hints.ai_socktype     = SOCK_STREAM;
+  char service[8];
+  snprintf(service, sizeof(service), "%u", port);
+  struct addrinfo* list  = NULL;
+  int              error = getaddrinfo(host, service, &hints, &list);
+  if (error != 0 || list == NULL) {
+    YMODEM_LOGE("TCP host lookup failed, error %d", error);
+    return false;
+  }
+
+  // The connection is made non-blocking so that it gives up after timeoutMs
+  for (struct addrinfo* entry = list; entry != NULL && peer < 0; entry = entry->ai_next) {
+    int fd = socket(entry->ai_family, entry->ai_socktype, entry->ai_protocol);
+    if (fd < 0) {
+      continue;
+    }
+    int flags  = fcntl(fd, F_GETFL, 0);
+    int result = -1;
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    if (::connect(fd, entry->ai_addr, entry->ai_addrlen) == 0) {
+      result = 0;
+    }
+    else if (errno == EINPROGRESS && waitSocket(fd, true, timeoutMs) > 0) {
+      socklen_t length = sizeof(result);
+      if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &result, &length) != 0) {
+        result = -1;
+      }
+    }
+    if (result != 0) {
+      close(fd);
+      continue;
+    }
+    fcntl(fd, F_SETFL, flags);
+    configure(fd);
+    peer = fd;
+  }
+  freeaddrinfo(list);
+
+  if (peer < 0) {
+    YMODEM_LOGE("TCP connection to port %u failed", port);
+    return false;
+  }
+  return true;
+}
+
+bool TcpTransport::listen(uint16_t port)
+{
+  if (server >= 0) {
+    close(server);
+    server = -1;
+  }
+
+  int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (fd < 0) {
+    YMODEM_LOGE("TCP socket creation failed, errno %d", errno);
+    return false;
+  }
+  int enable = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+  struct sockaddr_in address = {};
+  address.sin_family         = AF_INET;
+  address.sin_port           = htons(port);
+  address.sin_addr.s_addr    = htonl(INADDR_ANY);
+  if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 || ::listen(fd, 1) != 0) {
+    YMODEM_LOGE("TCP listen on port %u failed, errno %d", port, errno);
+    close(fd);
+    return false;
+  }
+  server = fd;
+  return true;
+}
+
+bool TcpTransport::accept(uint32_t timeoutMs)
+{
+  if (server < 0 || waitSocket(server, false, timeoutMs) <= 0) {
+    return false;
+  }
+  int fd = ::accept(server, NULL, NULL);
+  if (fd < 0) {
+    YMODEM_LOGE("TCP accept failed, errno %d", errno);
+    return false;
+  }
+  closePeer();
+  configure(fd);
+  peer = fd;
+  return true;
+}
+
+void TcpTransport::end()
+{
+  if (peer >= 0) {
+    flush();
+  }
+  closePeer();
+  if (server >= 0) {
+    close(server);
+    server = -1;
+  }
+}
+
+bool TcpTransport::connected() const
+{
+  return peer >= 0;
+}
+
+uint16_t TcpTransport::localPort() const
+{
+  struct sockaddr_in address = {};
+  socklen_t          length  = sizeof(address);
+  if (server < 0 || getsockname(server, (struct sockaddr*)&address, &length) != 0) {
+    return 0;
+  }
+  return ntohs(address.sin_port);
+}
+
+void TcpTransport::setNoDelay(bool enabled)
+{
+  noDelay = enabled;
+  if (peer >= 0) {
+    configure(peer);
+  }
+}
+
+/**
+ * @brief Applies the socket options of the transport to a new connection.
+ */
+void TcpTransport::configure(int fd)
+{
+  int value = noDelay ? 1 : 0;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value));
+}
+
+/**
+ * @brief Closes the connection and discards the bytes still batched.
+ */
+void TcpTransport::closePeer()
+{
+  if (peer >= 0) {
+    close(peer);
+    peer = -1;
+  }
+  pending = 0;
+}
+
+/**
+ * @brief Hands bytes to the socket with one send() call, more if the socket buffer is full.
+ *
+ * @return true if all the bytes were accepted, false if the connection failed and was closed.
+ */
+bool TcpTransport::send(const uint8_t* data, size_t size)
+{
+  uint32_t start = Ymodem_Micros();
+  size_t   sent  = 0;
+  while (sent < size) {
+    ssize_t len = ::send(peer, data + sent, size - sent, MSG_NOSIGNAL);
+    if (len < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      YMODEM_LOGE("TCP send failed, errno %d", errno);
+      closePeer();
+      return false;
+    }
+    sent += len;
+  }
+  stats.sends++;
+  stats.bytesSent += size;
+  stats.blockedUs += Ymodem_Micros() - start;
+  return true;
+}
+
+/**
+ * @brief Sends the batched bytes.
+ */
+bool TcpTransport::flush()
+{
+  if (pending == 0) {
+    return true;
+  }
+  size_t size = pending;
+  pending     = 0;
+  return send(batch, size);
+}
+
+int TcpTransport::read(uint8_t* data, size_t size, uint32_t timeoutMs)
+{
+  // The session waits for the peer, which cannot answer bytes still in the batch
+  if (peer < 0 || !flush()) {
+    return TRANSPORT_ERROR;
+  }
+
+  size_t   got   = 0;
+  uint32_t start = Ymodem_Millis();
+  while (got < size) {
+    // Once the timeout has expired the socket is still polled without waiting, so a read with
+    // no timeout returns the bytes already there
+    uint32_t elapsed = Ymodem_Millis() - start;
+    int      ready   = waitSocket(peer, false, (elapsed < timeoutMs) ? timeoutMs - elapsed : 0);
+    if (ready < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ready <= 0) {
+      break;
+    }
+    ssize_t len = recv(peer, data + got, size - got, 0);
+    if (len == 0) {
+      return got > 0 ? (int)got : TRANSPORT_ERROR; // The peer closed the connection
+    }
+    if (len < 0) {
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+      return got > 0 ? (int)got : TRANSPORT_ERROR;
+    }
+    got += len;
+    stats.bytesReceived += len;
+  }
+  return (int)got;
+}
+
+int TcpTransport::write(const uint8_t* data, size_t size)
+{
+  if (peer < 0) {
+    return TRANSPORT_ERROR;
+  }
+  stats.writes++;
+
+  if (pending + size > sizeof(batch) && !flush()) {
+    return TRANSPORT_ERROR;
+  }
+  if (size > sizeof(batch)) {
+    // A block larger than the batch goes out on its own
+    return send(data, size) ? (int)size : TRANSPORT_ERROR;
+  }
+  memcpy(batch + pending, data, size);
+  pending += size;
+  return (int)size;
+}
+
+bool TcpTransport::waitWriteDone(uint32_t timeoutMs)
+{
+  // TCP delivers what the socket has accepted, or the next read fails
+  return peer >= 0 && flush();
+}
+
+void TcpTransport::flushInput()
+{
+  uint8_t discard[64];
+  while (peer >= 0 && waitSocket(peer, false, 0) > 0 && recv(peer, discard, sizeof(discard), 0) > 0) {
+  }
+}
+
+const YmodemTcpStats& TcpTransport::getStats() const
+{
+  return stats;
+}
+
+void TcpTransport::resetStats()
+{
+  stats = {};
+}
@@ -0,0 +1,139 @@
+/**
+ * @file YmodemTcp.h
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  TCP transport for Ymodem sessions
+ * @version 0.1
+ * @date 2025-06-16
+ *
+ * This file contains the Ymodem transport over a TCP stream, built on the BSD
+ * sockets of lwIP on the ESP32 and of the host on Linux. One side listens and
+ * accepts the peer, the other connects to it, then both run the usual sessions.
+ *
+ * Nagle's algorithm is disabled by default: a session writes a whole frame and
+ * waits for the answer, so holding back the last segment of a frame until the
+ * previous one is acknowledged only adds a round trip to every block. Instead,
+ * the transport batches the small writes itself. The bytes given to write() are
+ * kept until the batch is full or the session waits for the peer, then sent with
+ * one send() call, so a frame or an ACK leaves in one segment.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef YMODEMTCP_H
+#define YMODEMTCP_H
+
+#include "YmodemDef.h"
+#include "YmodemTransport.h"
+
+/**
+ * @brief Counters of a TCP transport, cumulative until resetStats() is called.
+ */
+struct YmodemTcpStats
+{
+  uint32_t writes;        // Calls to write()
+  uint32_t sends;         // send() calls, one per batch or per write larger than the batch
+  uint32_t bytesSent;     // Bytes handed to the socket
+  uint32_t bytesReceived; // Bytes read from the socket
+  uint32_t blockedUs;     // Time spent in send() waiting for room in the socket buffer, in microseconds
+};
+
+/**
+ * @brief Ymodem transport over a TCP connection, as a client or as a server.
+ */
+class TcpTransport final : public YmodemTransport
+{
+public:
+  TcpTransport();
+
+  /**
+   * @brief Destructor for the TcpTransport class, closes the connection and the listening socket.
+   */
+  ~TcpTransport();
+
+  TcpTransport(const TcpTransport&)            = delete;
+  TcpTransport& operator=(const TcpTransport&) = delete;
+
+  /**
+   * @brief Connects to a peer listening on the given host and port.
+   *
+   * @param host Name or address of the peer.
+   * @param port TCP port of the peer.
+   * @param timeoutMs Maximum time to wait for the connection, in milliseconds.
+   * @return true if the connection was established, false otherwise.
+   */
+  bool connect(const char* host, uint16_t port = YMODEM_TCP_PORT, uint32_t timeoutMs = YMODEM_TCP_CONNECT_TIMEOUT_MS);
+
+  /**
+   * @brief Listens for a peer on the given port, on every interface.
+   *
+   * @param port TCP port, 0 to let the system pick one, see localPort().
+   * @return true if the socket is listening, false otherwise.
+   */
+  bool listen(uint16_t port = YMODEM_TCP_PORT);
+
+  /**
+   * @brief Waits for a peer on the listening socket and takes its connection.
+   *
+   * The previous connection, if any, is closed. The socket keeps listening for the next peer.
+   *
+   * @param timeoutMs Maximum time to wait for a peer, in milliseconds.
+   * @return true if a peer is connected, false if none came in time or listen() was not called.
+   */
+  bool accept(uint32_t timeoutMs);
+
+  /**
+   * @brief Sends the batched bytes and closes the connection and the listening socket.
+   */
+  void end();
+
+  /**
+   * @brief Tells whether a peer is connected.
+   */
+  bool connected() const;
+
+  /**
+   * @brief Retrieves the port of the listening socket.
+   *
+   * @return uint16_t The port, 0 when not listening.
+   */
+  uint16_t localPort() const;
+
+  /**
+   * @brief Disables or enables Nagle's algorithm on the connection.
+   *
+   * @param enabled true to send every batch at once (the default), false to let TCP coalesce them.
+   */
+  void setNoDelay(bool enabled);
+
+  int  read(uint8_t* data, size_t size, uint32_t timeoutMs) override;
+  int  write(const uint8_t* data, size_t size) override;
+  bool waitWriteDone(uint32_t timeoutMs) override;
+  void flushInput() override;
+
+  /**
+   * @brief Retrieves the counters of the transport.
+   *
+   * @return const YmodemTcpStats& Reference to the current counters.
+   */
+  const YmodemTcpStats& getStats() const;
+
+  /**
+   * @brief Clears the counters of the transport.
+   */
+  void resetStats();
+
+private:
+  int            peer    = -1;                 /**< Socket of the connection, -1 when not connected. */
+  int            server  = -1;                 /**< Listening socket, -1 when not listening. */
+  bool           noDelay = true;               /**< Nagle's algorithm is disabled on the connection. */
+  uint8_t        batch[YMODEM_TCP_BATCH_SIZE]; /**< Bytes written and not sent yet. */
+  size_t         pending = 0;                  /**< Bytes waiting in batch. */
+  YmodemTcpStats stats   = {};                 /**< Counters collected by write(), read() and flush(). */
+
+  void configure(int fd);
+  void closePeer();
+  bool send(const uint8_t* data, size_t size);
+  bool flush();
+};
+
+#endif // YMODEMTCP_H
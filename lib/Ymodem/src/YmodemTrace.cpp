@@ -0,0 +1,211 @@
+/**
+ * @file YmodemTrace.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Wire-level trace of Ymodem sessions
+ * @version 0.1
+ * @date 2025-05-29
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "YmodemTrace.h"
+
+#include <algorithm>
+#include <new>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include <Arduino.h>
+#else
+#include <chrono>
+#endif
+
+/**
+ * @brief Stores a 16 or 32-bit value in little endian order.
+ */
+static void putLE(uint8_t* data, uint32_t value, size_t size)
+{
+  for (size_t i = 0; i < size; i++) {
+    data[i] = (uint8_t)(value >> (8 * i));
+  }
+}
+
+YmodemTrace::YmodemTrace(size_t capacity) : ring(new (std::nothrow) uint8_t[capacity]), length(capacity)
+{
+  if (!ring) {
+    length = 0;
+  }
+}
+
+uint32_t YmodemTrace::now()
+{
+#ifdef ESP_PLATFORM
+  return micros();
+#else
+  using namespace std::chrono;
+  return (uint32_t)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+void YmodemTrace::put(const uint8_t* data, size_t size)
+{
+  size_t tail  = (head + used) % length;
+  size_t first = std::min(size, length - tail);
+  memcpy(ring.get() + tail, data, first);
+  memcpy(ring.get(), data + first, size - first);
+  used += size;
+}
+
+void YmodemTrace::get(size_t position, uint8_t* data, size_t size) const
+{
+  size_t start = (head + position) % length;
+  size_t first = std::min(size, length - start);
+  memcpy(data, ring.get() + start, first);
+  memcpy(data + first, ring.get(), size - first);
+}
+
+void YmodemTrace::dropOldest()
+{
+  uint8_t header[YMODEM_TRACE_RECORD_HEADER];
+  get(0, header, sizeof(header));
+  size_t size = sizeof(header) + ((header[4] | header[5] << 8) & YMODEM_TRACE_MAX_CHUNK);
+  head        = (head + size) % length;
+  used       -= size;
+  drops++;
+}
+
+void YmodemTrace::record(YmodemTraceType type, const uint8_t* data, size_t size)
+{
+  uint32_t time = now();
+
+  std::lock_guard<std::mutex> guard(lock);
+  do {
+    size_t  chunk = std::min<size_t>(size, YMODEM_TRACE_MAX_CHUNK);
+    uint8_t header[YMODEM_TRACE_RECORD_HEADER];
+    if (sizeof(header) + chunk > length) {
+      drops++;
+      return;
+    }
+    while (used + sizeof(header) + chunk > length) {
+      dropOldest();
+    }
+
+    putLE(header, time, 4);
+    putLE(header + 4, (uint32_t)type << 12 | chunk, 2);
+    put(header, sizeof(header));
+    put(data, chunk);
+    data += chunk;
+    size -= chunk;
+  } while (size > 0);
+}
+
+void YmodemTrace::clear()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  head  = 0;
+  used  = 0;
+  drops = 0;
+}
+
+bool YmodemTrace::dump(const Writer& write) const
+{
+  std::lock_guard<std::mutex> guard(lock);
+
+  uint8_t header[YMODEM_TRACE_FILE_HEADER] = {};
+  memcpy(header, YMODEM_TRACE_MAGIC, 4);
+  header[4] = YMODEM_TRACE_VERSION;
+  putLE(header + 6, YMODEM_TRACE_RECORD_HEADER, 2);
+  putLE(header + 8, drops, 4);
+  putLE(header + 12, used, 4);
+  if (!write(header, sizeof(header))) {
+    return false;
+  }
+
+  // The records are written as they lie in the ring, in at most two parts
+  size_t first = std::min(used, length - head);
+  if (first > 0 && !write(ring.get() + head, first)) {
+    return false;
+  }
+  return (used == first) || write(ring.get(), used - first);
+}
+
+#ifndef ESP_PLATFORM
+bool YmodemTrace::dump(const char* path) const
+{
+  FILE* file = fopen(path, "wb");
+  if (file == NULL) {
+    return false;
+  }
+  bool written = dump([file](const uint8_t* data, size_t size) { return fwrite(data, 1, size, file) == size; });
+  return (fclose(file) == 0) && written;
+}
+#endif
+
+size_t YmodemTrace::capacity() const
+{
+  return length;
+}
+
+size_t YmodemTrace::size() const
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return used;
+}
+
+uint32_t YmodemTrace::dropped() const
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return drops;
+}
+
+YmodemTraceTransport::YmodemTraceTransport(YmodemTransport& transport, YmodemTrace* trace) : transport(&transport), trace(trace)
+{
+}
+
+void YmodemTraceTransport::setTrace(YmodemTrace* trace)
+{
+  this->trace = trace;
+}
+
+void YmodemTraceTransport::setTransport(YmodemTransport& transport)
+{
+  this->transport = &transport;
+}
+
+int YmodemTraceTransport::read(uint8_t* data, size_t size, uint32_t timeoutMs)
+{
+  int len = transport->read(data, size, timeoutMs);
+  if (trace == NULL) {
+    return len;
+  }
+  if (len > 0) {
+    trace->record(YMODEM_TRACE_RX, data, len);
+  }
+  else if (len == TRANSPORT_OVERRUN) {
+    trace->record(YMODEM_TRACE_OVERRUN, NULL, 0);
+  }
+  return len;
+}
+
+int YmodemTraceTransport::write(const uint8_t* data, size_t size)
+{
+  int len = transport->write(data, size);
+  if (trace != NULL && len > 0) {
+    trace->record(YMODEM_TRACE_TX, data, len);
+  }
+  return len;
+}
+
+bool YmodemTraceTransport::waitWriteDone(uint32_t timeoutMs)
+{
+  return transport->waitWriteDone(timeoutMs);
+}
+
+void YmodemTraceTransport::flushInput()
+{
+  transport->flushInput();
+  if (trace != NULL) {
+    trace->record(YMODEM_TRACE_FLUSH, NULL, 0);
+  }
+}
@@ -0,0 +1,190 @@
+/**
+ * @file YmodemTrace.h
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Wire-level trace of Ymodem sessions
+ * @version 0.1
+ * @date 2025-05-29
+ *
+ * This file contains a recorder of every byte sent and received on a
+ * transport. The bytes are copied with a small binary header into a ring
+ * buffer of fixed size allocated once, nothing is formatted while the
+ * session runs, and the oldest records are dropped when the ring is full.
+ * The trace is dumped afterwards as a binary file:
+ *
+ *   File header, 16 bytes, little endian:
+ *     "YMTR", uint8_t version (1), uint8_t reserved, uint16_t record header size (6),
+ *     uint32_t records dropped, uint32_t bytes of records that follow
+ *   Records, oldest first:
+ *     uint32_t time in microseconds (wraps around), uint16_t type << 12 | size, size bytes
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef YMODEMTRACE_H
+#define YMODEMTRACE_H
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "YmodemTransport.h"
+
+#define YMODEM_TRACE_SIZE (16 * 1024)   /*!< Default capacity of a trace in bytes, about 15 1K packets with their answers */
+#define YMODEM_TRACE_MAGIC "YMTR"       /*!< First bytes of a dumped trace */
+#define YMODEM_TRACE_VERSION (1)        /*!< Version of the dumped trace format */
+#define YMODEM_TRACE_FILE_HEADER (16)   /*!< Size of the header of a dumped trace */
+#define YMODEM_TRACE_RECORD_HEADER (6)  /*!< Size of the header of a record */
+#define YMODEM_TRACE_MAX_CHUNK (0x0fff) /*!< Largest payload of a record, longer reads and writes are split */
+
+/**
+ * @brief Type of a trace record, stored in the top 4 bits of its size field.
+ */
+enum YmodemTraceType : uint8_t
+{
+  YMODEM_TRACE_RX      = 0, // Bytes returned by read()
+  YMODEM_TRACE_TX      = 1, // Bytes given to write()
+  YMODEM_TRACE_FLUSH   = 2, // flushInput() was called, no payload
+  YMODEM_TRACE_OVERRUN = 3, // read() reported TRANSPORT_OVERRUN, no payload
+};
+
+/**
+ * @brief Ring buffer of wire records.
+ *
+ * record() only copies bytes, so it can stay enabled on production transfers. The ring is
+ * protected by a mutex, so it can be dumped from another task.
+ */
+class YmodemTrace
+{
+public:
+  /**
+   * @brief Function receiving the bytes of a dumped trace, in order.
+   */
+  typedef std::function<bool(const uint8_t* data, size_t size)> Writer;
+
+  /**
+   * @brief Constructor for the YmodemTrace class.
+   *
+   * @param capacity Size of the ring in bytes, allocated on the heap. capacity() is 0 if it could not be allocated.
+   */
+  YmodemTrace(size_t capacity = YMODEM_TRACE_SIZE);
+
+  YmodemTrace(const YmodemTrace&)            = delete;
+  YmodemTrace& operator=(const YmodemTrace&) = delete;
+
+  /**
+   * @brief Appends a record, dropping the oldest ones if the ring is full.
+   *
+   * @param type Type of the record.
+   * @param data Bytes of the record, may be NULL if size is 0.
+   * @param size Number of bytes, split in several records above YMODEM_TRACE_MAX_CHUNK.
+   */
+  void record(YmodemTraceType type, const uint8_t* data, size_t size);
+
+  /**
+   * @brief Removes every record.
+   */
+  void clear();
+
+  /**
+   * @brief Writes the trace, file header first, through a writer.
+   *
+   * @param write Function called with the consecutive parts of the trace, it returns false to stop.
+   * @return true if every part was written, false otherwise.
+   */
+  bool dump(const Writer& write) const;
+
+#ifndef ESP_PLATFORM
+  /**
+   * @brief Writes the trace into a file.
+   *
+   * @param path Path of the file, it is replaced.
+   * @return true if the file was written, false otherwise.
+   */
+  bool dump(const char* path) const;
+#endif
+
+  /**
+   * @brief Retrieves the capacity of the ring.
+   *
+   * @return size_t Capacity in bytes.
+   */
+  size_t capacity() const;
+
+  /**
+   * @brief Retrieves the bytes of records held by the ring.
+   *
+   * @return size_t Bytes used.
+   */
+  size_t size() const;
+
+  /**
+   * @brief Retrieves the number of records dropped because the ring was full.
+   *
+   * @return uint32_t Records dropped since the construction or the last clear().
+   */
+  uint32_t dropped() const;
+
+  /**
+   * @brief Retrieves a microsecond clock, the one of the record timestamps.
+   *
+   * @return uint32_t Microseconds since an arbitrary origin, it wraps around.
+   */
+  static uint32_t now();
+
+private:
+  std::unique_ptr<uint8_t[]> ring;      /**< Records, oldest first from head. */
+  size_t                     length;    /**< Capacity of the ring in bytes. */
+  size_t                     head  = 0; /**< Position of the oldest record. */
+  size_t                     used  = 0; /**< Bytes of records in the ring. */
+  uint32_t                   drops = 0; /**< Records dropped because the ring was full. */
+  mutable std::mutex         lock;      /**< Serializes record() and dump(). */
+
+  void put(const uint8_t* data, size_t size);
+  void get(size_t position, uint8_t* data, size_t size) const;
+  void dropOldest();
+};
+
+/**
+ * @brief Transport recording every byte it carries into a trace.
+ *
+ * It wraps another transport, the reads and writes are forwarded unchanged. Without a trace
+ * it only forwards them, so it can stay in place while the recording is turned on and off.
+ */
+class YmodemTraceTransport : public YmodemTransport
+{
+public:
+  /**
+   * @brief Constructor for the YmodemTraceTransport class.
+   *
+   * @param transport Transport carrying the session, it must outlive this one.
+   * @param trace Trace receiving the records, NULL to record nothing. It must outlive this transport.
+   */
+  YmodemTraceTransport(YmodemTransport& transport, YmodemTrace* trace = NULL);
+
+  /**
+   * @brief Replaces the trace receiving the records.
+   *
+   * @param trace Trace receiving the records, NULL to record nothing. Do not change it while a session runs.
+   */
+  void setTrace(YmodemTrace* trace);
+
+  /**
+   * @brief Replaces the transport carrying the session.
+   *
+   * @param transport Transport carrying the session, it must outlive this one. Do not change it while a session runs.
+   */
+  void setTransport(YmodemTransport& transport);
+
+  int  read(uint8_t* data, size_t size, uint32_t timeoutMs) override;
+  int  write(const uint8_t* data, size_t size) override;
+  bool waitWriteDone(uint32_t timeoutMs) override;
+  void flushInput() override;
+
+private:
+  YmodemTransport* transport; /**< Transport carrying the session. */
+  YmodemTrace*     trace;     /**< Trace receiving the records, NULL to record nothing. */
+};
+
+#endif // YMODEMTRACE_H
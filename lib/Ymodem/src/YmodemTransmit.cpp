@@ -5,219 +5,269 @@
  * @version 0.1
  * @date 2025-01-24
  *
- * This file contains the functions to transmit files using the Ymodem protocol.
- * Format the packets and send them to the receiver or wait for the receiver response.
+ * This file contains the sender state machine of the Ymodem protocol.
+ * It formats the packets and reacts to the responses of the receiver.
  *
  * @copyright Copyright (c) 2025
  *
  */
 #include "YmodemTransmit.h"
 
-YmodemPacketStatus waitForReceiverResponse()
-{
-  unsigned char receivedC;
-  int           err = 0;
-
-  do {
-    send_CRC16();
-    LED_toggle();
-  } while (Receive_Byte(&receivedC, NAK_TIMEOUT) != BYTE_OK && err++ < MAX_ERRORS);
-
-  if (err >= MAX_ERRORS) {
-    send_CA();
-    return YMODEM_TIMEOUT;
-  }
-  else if (receivedC != CRC16) {
-    send_CA();
-    return YMODEM_CRC_ERROR;
-  }
+#include <algorithm>
 
-  return YMODEM_TRANSMIT_START;
+YmodemSender::YmodemSender(YmodemTransmitSource& source, const char* fileName, uint32_t fileSize, uint8_t* frame, size_t frameSize)
+    : YmodemSession(frame, frameSize), source(source), fileName(fileName), fileSize(fileSize)
+{
 }
 
-YmodemPacketStatus sendInitialPacket(const char* sendFileName, unsigned int sizeFile)
+uint8_t YmodemSender::start(uint32_t now)
 {
-  uint8_t            packet_data[PACKET_1K_SIZE + PACKET_OVERHEAD];
-  YmodemPacketStatus err;
-
-  Ymodem_PrepareIntialPacket(packet_data, sendFileName, sizeFile);
-  do {
-    // Send Packet
-    uart_write_bytes(EX_UART_NUM, (char*)packet_data, PACKET_SIZE + PACKET_OVERHEAD);
-
-    // Wait for Ack
-    err = Ymodem_WaitResponse(ACK);
-    if (err == YMODEM_TIMEOUT || err == YMODEM_INVALID_HEADER) {
-      send_CA();
-      return err;
-    }
-    else if (err == YMODEM_ABORTED_BY_SENDER)
-      return err; // abort
-    LED_toggle();
-  } while (err != YMODEM_RECEIVED_CORRECT);
-
-  // After initial block the receiver sends 'C' after ACK
-  err = Ymodem_WaitResponse(CRC16);
-  if (err != YMODEM_RECEIVED_CORRECT) {
-    send_CA();
-    return err;
+  bool ready = reset();
+  state      = WAIT_START;
+  offset     = 0;
+  block      = PACKET_1K_SIZE;
+  seq        = 1;
+  errors     = 0;
+  if (!ready) {
+    return finish(YMODEM_NO_MEMORY);
   }
 
-  return YMODEM_RECEIVED_OK; // Success
+  // Some receivers only answer once they see activity on the line
+  armTimer(now, NAK_TIMEOUT);
+  return queueByte(CRC16);
 }
 
-YmodemPacketStatus readFileBlock(const char* fileName, FileSystem& fs, uint8_t* buffer, size_t& fileSize, size_t offset)
+void YmodemSender::setHeaderDigest(const char* digest)
 {
-  size_t bytesToRead = std::min(fileSize, static_cast<size_t>(PACKET_1K_SIZE));
-  int    err         = fs.readFromFile(fileName, buffer, bytesToRead, offset);
-  if (err != LITTLEFS_OK) {
-    const char* errorMsg = "Failed to read file\n";
-    uart_write_bytes(UART_NUM_0, errorMsg, strlen(errorMsg));
-    send_CA();
-    return YMODEM_READ_ERROR; // Error al leer el archivo
-  }
-  return YMODEM_READ_FILE_OK;
+  announced = digest;
 }
 
-void displayProgress(size_t offset, size_t totalSize, unsigned long startTime)
+bool YmodemSender::setBlockSize(size_t size)
 {
-  int progress = (offset * 100) / totalSize;
-  int filled   = (offset * PROGRESS_BAR_WIDTH) / totalSize;
-
-  unsigned long elapsedTime        = millis() - startTime;
-  unsigned long estimatedTotalTime = 0;
-  unsigned long remainingTime      = 0;
-
-  if (offset > 0 && offset < totalSize) {
-    estimatedTotalTime = (elapsedTime * totalSize) / offset;
-    remainingTime      = (estimatedTotalTime > elapsedTime) ? (estimatedTotalTime - elapsedTime) / 1000 : 0;
+  if (size != PACKET_1K_SIZE && size != PACKET_4K_SIZE && size != PACKET_8K_SIZE) {
+    return false;
   }
+  if (!reserveFrame(fec ? YMODEM_FEC_FRAME_SIZE(size) : YMODEM_BLOCK_FRAME_SIZE(size))) {
+    return false;
+  }
+  maxBlock = size;
+  return true;
+}
 
-  char progressBar[124];
-  snprintf(progressBar, sizeof(progressBar), "Progress: [");
-  uart_write_bytes(UART_NUM_0, progressBar, strlen(progressBar));
-
-  for (int i = 0; i < PROGRESS_BAR_WIDTH; i++) {
-    uart_write_bytes(UART_NUM_0, (i < filled) ? "\033[42m \033[0m" : "\033[41m \033[0m", 9);
+bool YmodemSender::setFec(bool enable)
+{
+  if (enable && !reserveFrame(YMODEM_FEC_FRAME_SIZE(maxBlock))) {
+    return false;
   }
+  fec = enable;
+  return true;
+}
 
-  unsigned long minutes = remainingTime / 60;
-  unsigned long seconds = remainingTime % 60;
-  snprintf(progressBar, sizeof(progressBar), "\033[0m] %d%% Time: %lum %lus  \r", progress, minutes, seconds);
-  uart_write_bytes(UART_NUM_0, progressBar, strlen(progressBar));
+void YmodemSender::setAttributes(uint32_t modTime, uint32_t mode)
+{
+  this->modTime = modTime;
+  fileMode      = mode;
+}
+
+void YmodemSender::setSkipUnchanged(bool enable)
+{
+  skip = enable;
 }
 
-YmodemPacketStatus sendPacketAndHandleResponse(uint8_t* packet_data, uint16_t& blkNumber, size_t& fileSize, size_t& offset, size_t totalSize,
-                                               unsigned long startTime)
+uint8_t YmodemSender::droppedFields() const
 {
-  YmodemPacketStatus err;
-  size_t             bytesToRead = std::min(fileSize, static_cast<size_t>(PACKET_1K_SIZE));
+  return dropped;
+}
 
-  do {
-    uart_write_bytes(EX_UART_NUM, (char*)packet_data, PACKET_1K_SIZE + PACKET_OVERHEAD);
-    err = Ymodem_WaitResponse(ACK);
+uint8_t YmodemSender::onByte(uint8_t byte, uint32_t now)
+{
+  uint8_t events = YMODEM_EVENT_NONE;
 
-    if (err == YMODEM_RECEIVED_CORRECT) {
-      offset += bytesToRead;   // Mover el offset al siguiente bloque
-      fileSize -= bytesToRead; // Reducir el tamaño restante
-      displayProgress(offset, totalSize, startTime);
+  if (state == WAIT_START) {
+    if (byte != CRC16) {
+      return abort(YMODEM_CRC_ERROR);
     }
-    else if (err == YMODEM_TIMEOUT || err == YMODEM_INVALID_HEADER) {
-      send_CA();
-      return err; // Timeout o respuesta incorrecta
+    events = sendHeader(false);
+  }
+  else if (byte == CA) {
+    return abort(YMODEM_ABORTED_BY_SENDER);
+  }
+  else if (byte == NAK) {
+    events = resend();
+  }
+  else if (byte == ACK) {
+    switch (state) {
+      case WAIT_HEADER_ACK:
+        state  = WAIT_HEADER_C;
+        errors = 0;
+        counters.packets++;
+        break;
+      case WAIT_BLOCK_ACK:
+        // The block is still in the frame, it is added once no matter how many times it was sent
+        fileDigest.update(frame + dataOffset(), blockSize);
+        offset += blockSize;
+        seq++;
+        counters.packets++;
+        counters.bytes += blockSize;
+        events = YMODEM_EVENT_BLOCK | ((offset < fileSize) ? sendBlock() : sendEOT());
+        break;
+      case WAIT_EOT_ACK:
+        fileDigest.finish();
+        state  = WAIT_END_C;
+        errors = 0;
+        events = YMODEM_EVENT_FILE_DONE;
+        break;
+      case WAIT_END_ACK:
+        counters.packets++;
+        return finish(YMODEM_TRANSMIT_OK);
+      default:
+        break; // Repeated ACK
     }
-    else if (err == YMODEM_ABORTED_BY_SENDER) {
-      return err; // Abort
+  }
+  else if (byte == CRC16 || ((byte == LARGE_4K || byte == LARGE_8K) && maxBlock > PACKET_1K_SIZE)) {
+    switch (state) {
+      case WAIT_HEADER_C:
+        // The receiver picks the block size, never above the one announced in the header
+        block = (byte == LARGE_8K) ? PACKET_8K_SIZE : (byte == LARGE_4K) ? PACKET_4K_SIZE : PACKET_1K_SIZE;
+        if (block > maxBlock) {
+          return abort(YMODEM_INVALID_HEADER);
+        }
+        events = YMODEM_EVENT_FILE | ((fileSize > 0) ? sendBlock() : sendEOT());
+        break;
+      case WAIT_END_C:
+        events = sendHeader(true);
+        break;
+      case WAIT_BLOCK_ACK:
+      case WAIT_EOT_ACK:
+        // The receiver repeats its request until the first block, or the EOT of an empty file, arrives
+        if (offset == 0) {
+          events = resend();
+        }
+        break;
+      default:
+        break; // Repeated 'C'
     }
-  } while (err != YMODEM_RECEIVED_CORRECT);
+  }
+  else if (byte == SKIP && skip && (state == WAIT_HEADER_ACK || state == WAIT_HEADER_C)) {
+    // The receiver holds the file, its ACK may have been lost; the batch is closed on its 'C'.
+    // No data was read, so there is no digest to report.
+    fileDigest.begin(YMODEM_DIGEST_NONE);
+    state  = WAIT_END_C;
+    errors = 0;
+    counters.skipped++;
+    counters.skippedBytes += fileSize;
+    events = YMODEM_EVENT_FILE | YMODEM_EVENT_FILE_DONE;
+  }
+  else if (byte == FEC && fec) {
+    // FEC follows the ACK of the header, which may have been lost; later ones are repeated
+    // with the request for data and change nothing
+    if (state == WAIT_HEADER_ACK) {
+      counters.packets++;
+    }
+    if (state == WAIT_HEADER_ACK || state == WAIT_HEADER_C) {
+      state   = WAIT_HEADER_C;
+      errors  = 0;
+      fecFile = true;
+    }
+  }
+  else {
+    return abort(YMODEM_INVALID_HEADER);
+  }
 
-  LED_toggle(); // Indicar progreso con el LED
-  return YMODEM_RECEIVED_OK;
+  if (done) {
+    return events;
+  }
+  armTimer(now, WAIT_TIMEOUT * NAK_TIMEOUT);
+  return events;
 }
 
-YmodemPacketStatus sendFileBlocks(const char* fileName, FileSystem& fs)
+uint8_t YmodemSender::onTimeout(uint32_t now)
 {
-  uint8_t  packet_data[PACKET_1K_SIZE + PACKET_OVERHEAD];
-  uint8_t  buffer[PACKET_1K_SIZE];
-  uint16_t blkNumber = 0x01;
-  size_t   offset    = 0;
-  size_t   fileSize  = fs.getFileSize(fileName);
-  size_t   totalSize = fileSize;
-
-  unsigned long startTime = millis(); // Tiempo de inicio de la transferencia
-
-  while (fileSize > 0) {
-
-    // Leer datos del archivo en bloques
-    YmodemPacketStatus err = readFileBlock(fileName, fs, buffer, fileSize, offset);
-    if (err != YMODEM_READ_FILE_OK) {
-      return err; // Error al leer el bloque
-    }
-
-    // Preparar el paquete con los datos leídos
-    Ymodem_PreparePacket(packet_data, blkNumber, std::min(fileSize, static_cast<size_t>(PACKET_1K_SIZE)), buffer);
+  if (state != WAIT_START) {
+    return abort(YMODEM_TIMEOUT);
+  }
+  if (++errors >= MAX_ERRORS) {
+    return abort(YMODEM_TIMEOUT);
+  }
+  armTimer(now, NAK_TIMEOUT);
+  return YMODEM_EVENT_RETRY | queueByte(CRC16);
+}
 
-    // Enviar el paquete y manejar la respuesta
-    err = sendPacketAndHandleResponse(packet_data, blkNumber, fileSize, offset, totalSize, startTime);
-    if (err != YMODEM_RECEIVED_OK) {
-      return err; // Error al enviar el paquete
+uint8_t YmodemSender::sendHeader(bool last)
+{
+  if (last) {
+    Ymodem_PrepareLastPacket(frame);
+  }
+  else {
+    // Without its name the header would end the batch, without its digest the file would be accepted unverified.
+    // The other fields only select extensions, the file is sent without them
+    dropped = Ymodem_PrepareIntialPacket(frame, fileName, fileSize, announced, maxBlock, modTime, fileMode, skip, fec);
+    if (dropped & (YMODEM_FIELD_NAME | YMODEM_FIELD_DIGEST)) {
+      return abort(YMODEM_HEADER_OVERFLOW);
     }
-    blkNumber++;
+    fecFile = false;
   }
-  uart_write_bytes(UART_NUM_0, "\n", 1); // Finalizar con una nueva línea
-  return YMODEM_TRANSMIT_OK;             // Éxito
+  state  = last ? WAIT_END_ACK : WAIT_HEADER_ACK;
+  errors = 0;
+  return queueFrame(PACKET_SIZE + PACKET_OVERHEAD);
 }
 
-YmodemPacketStatus sendEOT()
+uint8_t YmodemSender::sendBlock()
 {
-  YmodemPacketStatus err;
-
-  send_EOT();
-  do {
-    // Wait for Ack
-    err = Ymodem_WaitResponse(ACK);
-    if (err == YMODEM_RECEIVED_NAK) { // NAK
-      send_EOT();
-    }
-    else if (err == YMODEM_TIMEOUT || err == YMODEM_INVALID_HEADER) {
-      send_CA();
-      return err; // timeout or wrong response
-    }
-    else if (err == YMODEM_ABORTED_BY_SENDER)
-      return err; // abort
-  } while (err != YMODEM_RECEIVED_CORRECT);
+  // The block is read straight into the packet, the Prepare functions only add the framing
+  size_t header = dataOffset();
+  blockSize     = std::min<size_t>(fileSize - offset, block);
+  if (source.read(frame + header, blockSize, offset) != (int)blockSize) {
+    return abort(YMODEM_READ_ERROR);
+  }
+  if (fecFile) {
+    packetSize = Ymodem_PrepareFecPacket(frame, seq, blockSize, block, frame + header);
+  }
+  else if (block > PACKET_1K_SIZE) {
+    packetSize = Ymodem_PrepareLargePacket(frame, seq, blockSize, frame + header);
+  }
+  else {
+    Ymodem_PreparePacket(frame, seq, blockSize, frame + header);
+    packetSize = PACKET_1K_SIZE + PACKET_OVERHEAD;
+  }
 
-  return YMODEM_RECEIVED_OK; // Success
+  state  = WAIT_BLOCK_ACK;
+  errors = 0;
+  return queueFrame(packetSize);
 }
 
-YmodemPacketStatus sendLastPacket()
+uint8_t YmodemSender::sendEOT()
 {
-  uint8_t packet_data[PACKET_1K_SIZE + PACKET_OVERHEAD];
-
-  YmodemPacketStatus err = Ymodem_WaitResponse(CRC16);
-  if (err != YMODEM_RECEIVED_CORRECT) {
-    send_CA();
-    return err;
-  }
-
-  LED_toggle();
-  Ymodem_PrepareLastPacket(packet_data);
-  do {
-    // Send Packet
-    uart_write_bytes(EX_UART_NUM, (char*)packet_data, PACKET_SIZE + PACKET_OVERHEAD);
-    // Wait for Ack
-    err = Ymodem_WaitResponse(ACK);
-    if (err == YMODEM_TIMEOUT || err == YMODEM_INVALID_HEADER) {
-      send_CA();
-      return err; // timeout or wrong response
-    }
-    else if (err == YMODEM_ABORTED_BY_SENDER)
-      return err; // abort
-  } while (err != YMODEM_RECEIVED_CORRECT);
+  state  = WAIT_EOT_ACK;
+  errors = 0;
+  return queueByte(EOT);
+}
+
+/**
+ * @brief Retrieves the position of the file data in the data packets of the current file.
+ */
+size_t YmodemSender::dataOffset() const
+{
+  return (fecFile || block > PACKET_1K_SIZE) ? PACKET_LARGE_HEADER : PACKET_HEADER;
+}
 
-#if YMODEM_LED_ACT
-  digitalWrite(YMODEM_LED_ACT, YMODEM_LED_ACT_ON ^ 1);
-#endif
+uint8_t YmodemSender::resend()
+{
+  if (++errors > MAX_ERRORS) {
+    return abort(YMODEM_MAX_ERRORS);
+  }
 
-  return YMODEM_RECEIVED_OK; // Success
-}
\ No newline at end of file
+  switch (state) {
+    case WAIT_HEADER_ACK:
+    case WAIT_END_ACK:
+      counters.retries++;
+      return YMODEM_EVENT_RETRY | queueFrame(PACKET_SIZE + PACKET_OVERHEAD);
+    case WAIT_BLOCK_ACK:
+      counters.retries++;
+      return YMODEM_EVENT_RETRY | queueFrame(packetSize);
+    case WAIT_EOT_ACK:
+      return queueByte(EOT); // The first EOT is always answered with NAK, it is not counted as a retry
+    default:
+      return YMODEM_EVENT_NONE; // Nothing in flight
+  }
+}
@@ -5,8 +5,8 @@
  * @version 0.1
  * @date 2025-01-24
  *
- * This file contains the functions to transmit files using the Ymodem protocol.
- * Format the packets and send them to the receiver or wait for the receiver response.
+ * This file contains the sender state machine of the Ymodem protocol.
+ * It formats the packets and reacts to the responses of the receiver.
  *
  * @copyright Copyright (c) 2025
  *
@@ -15,62 +15,139 @@
 #define YMODEMTRANSMIT_H
 
 #include "YmodemPaquets.h"
+#include "YmodemSession.h"
 
 /**
- * @brief Waits for a response from the receiver.
+ * @brief Ymodem sender state machine.
  *
- * This function blocks the execution until a response is received from the receiver.
- * It is typically used in communication protocols where the transmitter needs to wait
- * for an acknowledgment or other response from the receiver before proceeding.
+ * The sender waits for the 'C' of the receiver, sends the file header, the data blocks
+ * read from the source and the EOT, and closes the batch with an empty header. The
+ * result of the session is YMODEM_TRANSMIT_OK on success.
  *
- * @return int Returns a status code indicating the result of waiting for the receiver's response.
- *             The specific values and their meanings should be defined in the implementation.
- */
-YmodemPacketStatus waitForReceiverResponse();
-
-/**
- * @brief Sends the initial packet for a file transfer using the Ymodem protocol.
+ * After setBlockSize(), the header announces larger blocks. They are only used when the
+ * receiver accepts them with LARGE_4K or LARGE_8K, a 'C' keeps the standard 1K packets.
  *
- * This function prepares and sends the initial packet containing the file name
- * and size to initiate the Ymodem file transfer process.
+ * After setSkipUnchanged(), the receiver may answer the header with SKIP when it already
+ * holds the file; the file then counts as transferred and the batch is closed.
  *
- * @param sendFileName The name of the file to be sent.
- * @param sizeFile The size of the file to be sent, in bytes.
- * @return int Returns 0 on success, or a negative error code on failure.
+ * After setFec(), the header has a "fec" field. A receiver that answers it with FEC gets
+ * FTX packets carrying Reed-Solomon parity, which it repairs without asking them again.
  */
-YmodemPacketStatus sendInitialPacket(const char* sendFileName, unsigned int sizeFile);
+class YmodemSender : public YmodemSession
+{
+public:
+  /**
+   * @brief Constructor for the YmodemSender class.
+   *
+   * @param source Origin of the file data, it must outlive the sender.
+   * @param fileName Name announced in the file header, it must outlive the sender.
+   * @param fileSize Size of the file in bytes.
+   * @param frame Packet buffer of frameSize bytes, NULL to allocate one, see YmodemSession().
+   * @param frameSize Size of the packet buffer, YMODEM_BLOCK_FRAME_SIZE() of the largest block.
+   */
+  YmodemSender(YmodemTransmitSource& source, const char* fileName, uint32_t fileSize, uint8_t* frame = NULL, size_t frameSize = YMODEM_FRAME_SIZE);
 
-/**
- * @brief Sends file blocks over a communication channel.
- *
- * This function is responsible for transmitting the contents of a file in blocks.
- *
- * @param sizeFile The size of the file to be sent, in bytes.
- * @param fs The file system object representing the file to be sent.
- * @return int Returns 0 on success, or a negative error code on failure.
- */
-YmodemPacketStatus sendFileBlocks(const char* fileName, FileSystem& fs);
+  uint8_t start(uint32_t now) override;
 
-/**
- * @brief Sends the End Of Transmission (EOT) signal.
- *
- * This function is used to signal the end of a transmission process.
- * It typically sends an EOT character to indicate that the transmission
- * is complete.
- *
- * @return int Returns 0 on success, or a negative error code on failure.
- */
-YmodemPacketStatus sendEOT();
+  /**
+   * @brief Announces a digest of the file in the header, so the receiver can verify it.
+   *
+   * The digest must be known before the transfer, for example stored next to a firmware image.
+   *
+   * @param digest Digest such as "sha256:<hex>", it must outlive the sender. NULL for none. The
+   *               session fails with YMODEM_HEADER_OVERFLOW if it does not fit whole in the header.
+   */
+  void setHeaderDigest(const char* digest);
 
-/**
- * @brief Sends the last packet in the Ymodem transmission.
- *
- * This function is responsible for transmitting the final packet
- * in the Ymodem protocol. It ensures that the transmission is
- * properly terminated.
- *
- * @return int Returns 0 on success, or a negative error code on failure.
- */
-YmodemPacketStatus sendLastPacket();
+  /**
+   * @brief Offers blocks of up to size bytes to the receiver.
+   *
+   * Call it before start(). A packet buffer allocated by the session grows to fit.
+   *
+   * @param size PACKET_1K_SIZE, the default, PACKET_4K_SIZE or PACKET_8K_SIZE.
+   * @return true if the size is supported and the packet buffer holds it, false otherwise.
+   */
+  bool setBlockSize(size_t size);
+
+  /**
+   * @brief Announces the modification time and the mode of the file in the header.
+   *
+   * They are the standard fields after the size, receivers that keep them let a later push
+   * of the same file be recognised as unchanged.
+   *
+   * @param modTime Modification time in seconds since 1970, 0 to leave both out.
+   * @param mode Unix file mode, 0 if unknown.
+   */
+  void setAttributes(uint32_t modTime, uint32_t mode);
+
+  /**
+   * @brief Lets the receiver skip the file when it holds it unchanged.
+   *
+   * The receiver compares the size, the attributes and the digest announced with
+   * setHeaderDigest(); the file is not sent when they match.
+   *
+   * @param enable true to announce the "skip" field, false by default.
+   */
+  void setSkipUnchanged(bool enable);
+
+  /**
+   * @brief Offers packets with Reed-Solomon parity to the receiver, for noisy links.
+   *
+   * Call it before start(). The parity adds about 7 % to every packet, and the last block of
+   * a file is padded. A packet buffer allocated by the session grows to fit.
+   *
+   * @param enable true to announce the "fec" field, false by default.
+   * @return true if the packet buffer holds the packets with parity, false otherwise.
+   */
+  bool setFec(bool enable);
+
+  /**
+   * @brief Retrieves the fields left out of the last file header, for lack of room after the name.
+   *
+   * @return uint8_t YmodemHeaderField bits, YMODEM_FIELD_NONE when the header carried every field.
+   */
+  uint8_t droppedFields() const;
+
+protected:
+  uint8_t onByte(uint8_t byte, uint32_t now) override;
+  uint8_t onTimeout(uint32_t now) override;
+
+private:
+  enum State : uint8_t
+  {
+    WAIT_START,      // Waiting for the 'C' that starts the session
+    WAIT_HEADER_ACK, // File header sent, waiting for ACK
+    WAIT_HEADER_C,   // File header acknowledged, waiting for 'C'
+    WAIT_BLOCK_ACK,  // Data block sent, waiting for ACK
+    WAIT_EOT_ACK,    // EOT sent, waiting for ACK
+    WAIT_END_C,      // EOT acknowledged, waiting for 'C'
+    WAIT_END_ACK,    // Empty header sent, waiting for ACK
+  };
+
+  YmodemTransmitSource& source;                      /**< Origin of the file data. */
+  const char*           fileName;                    /**< Name announced in the file header. */
+  uint32_t              fileSize;                    /**< Size of the file in bytes. */
+  State                 state      = WAIT_START;     /**< Current step of the session. */
+  uint32_t              offset     = 0;              /**< Bytes of the file acknowledged by the receiver. */
+  size_t                blockSize  = 0;              /**< File bytes in the data block being sent. */
+  size_t                packetSize = 0;              /**< Bytes of the data packet being sent. */
+  size_t                maxBlock   = PACKET_1K_SIZE; /**< Largest block offered, set with setBlockSize(). */
+  size_t                block      = PACKET_1K_SIZE; /**< Block size accepted by the receiver. */
+  uint16_t              seq        = 1;              /**< Sequence number of the data block being sent. */
+  uint32_t              errors     = 0;              /**< Retries of the current step. */
+  const char*           announced  = NULL;           /**< Digest announced in the file header. */
+  uint32_t              modTime    = 0;              /**< Modification time announced in the file header. */
+  uint32_t              fileMode   = 0;              /**< Mode announced in the file header. */
+  bool                  skip       = false;          /**< True to accept SKIP from the receiver. */
+  bool                  fec        = false;          /**< True to offer packets with parity, set with setFec(). */
+  bool                  fecFile    = false;          /**< True once the receiver asked for parity for the current file. */
+  uint8_t               dropped    = 0;              /**< Fields left out of the last file header. */
+
+  uint8_t sendHeader(bool last);
+  uint8_t sendBlock();
+  uint8_t sendEOT();
+  size_t  dataOffset() const;
+  uint8_t resend();
+};
 
-#endif // YMODEMTRANSMIT_H
\ No newline at end of file
+#endif // YMODEMTRANSMIT_H
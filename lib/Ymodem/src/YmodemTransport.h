@@ -0,0 +1,117 @@
+/**
+ * @file YmodemTransport.h
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Byte stream interface used to carry Ymodem sessions
+ * @version 0.1
+ * @date 2025-05-19
+ *
+ * This file contains the interface between the Ymodem sessions and the link
+ * that carries them. The UART of the ESP32 is one implementation, any other
+ * byte stream (a POSIX file descriptor, a socket, a simulated link) can be
+ * plugged in the same way.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef YMODEMTRANSPORT_H
+#define YMODEMTRANSPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Error codes returned by YmodemTransport::read() and YmodemTransport::write().
+ */
+enum TransportStatus : int8_t
+{
+  TRANSPORT_ERROR   = -1, // The link failed or was closed
+  TRANSPORT_OVERRUN = -2, // Incoming data was lost, the pending input has been discarded
+};
+
+/**
+ * @brief Receive counters collected by the transports that wait for the data of a packet.
+ *
+ * The counters are cumulative until resetStats() is called on the transport.
+ * Dividing wakeups by the number of packets of a session gives the number of
+ * times the protocol task was woken up to assemble one packet. A POSIX tty reports
+ * the overruns counted by its serial driver, when the driver counts them.
+ */
+struct YmodemRxStats
+{
+  uint32_t wakeups;       // UART events or poll() returns that woke the protocol task
+  uint32_t reads;         // Reads that returned all the requested bytes
+  uint32_t fifoOverflows; // UART_FIFO_OVF events or tty overruns (hardware FIFO overrun)
+  uint32_t bufferFull;    // UART_BUFFER_FULL events or tty buffer overruns (driver ring buffer full)
+  uint32_t patterns;      // UART_PATTERN_DET events
+};
+
+/**
+ * @brief Transmit counters collected by the transports that queue the data they write.
+ *
+ * The counters are cumulative until resetStats() is called on the transport. Dividing
+ * blockedUs by the number of packets of a session gives the time the protocol task spent
+ * in write() for every packet, time it could not spend preparing the next one.
+ */
+struct YmodemTxStats
+{
+  uint32_t writes;    // Calls to write()
+  uint32_t bytes;     // Bytes accepted by write()
+  uint32_t blockedUs; // Time spent in write() waiting for room in the TX buffer or FIFO, in microseconds
+  uint32_t drains;    // Calls to waitWriteDone() that found bytes still being sent
+};
+
+/**
+ * @brief Byte stream carrying a Ymodem session.
+ */
+class YmodemTransport
+{
+public:
+  virtual ~YmodemTransport()
+  {
+  }
+
+  /**
+   * @brief Reads bytes from the link.
+   *
+   * The call returns as soon as size bytes have been read, or when the timeout
+   * expires with whatever has been received so far.
+   *
+   * @param data Pointer to the buffer where the received bytes will be stored.
+   * @param size Maximum number of bytes to read.
+   * @param timeoutMs Maximum time to wait, in milliseconds.
+   * @return int Number of bytes read (0 on timeout), or a negative TransportStatus.
+   */
+  virtual int read(uint8_t* data, size_t size, uint32_t timeoutMs) = 0;
+
+  /**
+   * @brief Writes bytes to the link.
+   *
+   * A transport with a TX buffer returns once the bytes are queued, they are still being
+   * sent when the call returns. waitWriteDone() tells when they have left.
+   *
+   * @param data Pointer to the bytes to send.
+   * @param size Number of bytes to send.
+   * @return int Number of bytes accepted by the link, or a negative TransportStatus.
+   */
+  virtual int write(const uint8_t* data, size_t size) = 0;
+
+  /**
+   * @brief Waits until the bytes given to write() have been sent.
+   *
+   * @param timeoutMs Maximum time to wait, in milliseconds.
+   * @return true once the bytes have been sent, false if the timeout expired first.
+   */
+  virtual bool waitWriteDone(uint32_t timeoutMs)
+  {
+    return true;
+  }
+
+  /**
+   * @brief Discards any received data that has not been read yet.
+   */
+  virtual void flushInput()
+  {
+  }
+};
+
+#endif // YMODEMTRANSPORT_H
@@ -0,0 +1,261 @@
+/**
+ * @file YmodemTty.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  POSIX tty transport for Ymodem sessions
+ * @version 0.1
+ * @date 2025-05-27
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef ESP_PLATFORM
+
+#include "YmodemTty.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
+
+/**
+ * @brief Converts a baud rate to its termios constant.
+ *
+ * @param baudRate Baud rate in bits per second.
+ * @return speed_t termios constant, B0 if the rate is not supported.
+ */
+static speed_t ttySpeed(uint32_t baudRate)
+{
+  switch (baudRate) {
+    case 9600:
+      return B9600;
+    case 19200:
+      return B19200;
+    case 38400:
+      return B38400;
+    case 57600:
+      return B57600;
+    case 115200:
+      return B115200;
+    case 230400:
+      return B230400;
+#ifdef B460800
+    case 460800:
+      return B460800;
+#endif
+#ifdef B921600
+    case 921600:
+      return B921600;
+#endif
+#ifdef B1000000
+    case 1000000:
+      return B1000000;
+#endif
+#ifdef B2000000
+    case 2000000:
+      return B2000000;
+#endif
+#ifdef B3000000
+    case 3000000:
+      return B3000000;
+#endif
+#ifdef B4000000
+    case 4000000:
+      return B4000000;
+#endif
+    default:
+      return B0;
+  }
+}
+
+/**
+ * @brief Retrieves a monotonic clock in milliseconds.
+ */
+static uint64_t ttyMillis()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+TtyTransport::TtyTransport()
+{
+}
+
+TtyTransport::~TtyTransport()
+{
+  end();
+}
+
+bool TtyTransport::begin(const char* path, uint32_t baudRate, bool flowControl)
+{
+  end();
+
+  speed_t speed = ttySpeed(baudRate);
+  if (speed == B0) {
+    fprintf(stderr, "Unsupported baud rate %u\n", baudRate);
+    return false;
+  }
+
+  fd = open(path, O_RDWR | O_NOCTTY | O_CLOEXEC);
+  if (fd < 0) {
+    fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+    return false;
+  }
+
+  struct termios tty;
+  if (tcgetattr(fd, &tty) != 0) {
+    fprintf(stderr, "%s is not a tty\n", path);
+    end();
+    return false;
+  }
+  cfmakeraw(&tty);
+  tty.c_cflag &= ~(CSTOPB | PARENB | CRTSCTS);
+  tty.c_cflag |= CLOCAL | CREAD | (flowControl ? CRTSCTS : 0);
+  tty.c_iflag &= ~(IXON | IXOFF | IXANY);
+  tty.c_cc[VMIN]  = 0;
+  tty.c_cc[VTIME] = 0;
+  cfsetispeed(&tty, speed);
+  cfsetospeed(&tty, speed);
+  if (tcsetattr(fd, TCSANOW, &tty) != 0) {
+    fprintf(stderr, "Failed to configure %s: %s\n", path, strerror(errno));
+    end();
+    return false;
+  }
+
+  flushInput();
+  resetStats();
+  return true;
+}
+
+void TtyTransport::end()
+{
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+}
+
+/**
+ * @brief Updates the overrun counters from the serial driver.
+ *
+ * Once the driver has dropped bytes, the bytes still buffered no longer form a
+ * contiguous packet. They are flushed so that the next read starts from a clean state.
+ *
+ * @return true if the driver counted a new overrun since the last call.
+ */
+bool TtyTransport::checkOverrun()
+{
+#ifdef TIOCGICOUNT
+  struct serial_icounter_struct count;
+  if (!countOverruns || ioctl(fd, TIOCGICOUNT, &count) != 0) {
+    return false;
+  }
+  uint32_t fifo   = (uint32_t)count.overrun - overruns;
+  uint32_t buffer = (uint32_t)count.buf_overrun - bufOverruns;
+  if (fifo == stats.fifoOverflows && buffer == stats.bufferFull) {
+    return false;
+  }
+  stats.fifoOverflows = fifo;
+  stats.bufferFull    = buffer;
+  flushInput();
+  return true;
+#else
+  return false;
+#endif
+}
+
+int TtyTransport::read(uint8_t* data, size_t size, uint32_t timeoutMs)
+{
+  if (fd < 0) {
+    return TRANSPORT_ERROR;
+  }
+
+  size_t   got      = 0;
+  uint64_t deadline = ttyMillis() + timeoutMs;
+  while (got < size) {
+    // Once the deadline has passed the line is still polled without waiting, so a read with
+    // no timeout returns the bytes already there
+    uint64_t now  = ttyMillis();
+    int      wait = (now < deadline) ? (int)(deadline - now) : 0;
+
+    struct pollfd request = {fd, POLLIN, 0};
+    int           ready   = poll(&request, 1, wait);
+    if (ready < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ready <= 0) {
+      break;
+    }
+    stats.wakeups++;
+
+    if (request.revents & (POLLERR | POLLHUP | POLLNVAL)) {
+      return got > 0 ? (int)got : TRANSPORT_ERROR;
+    }
+    ssize_t len = ::read(fd, data + got, size - got);
+    if (len < 0 && errno != EAGAIN && errno != EINTR) {
+      return TRANSPORT_ERROR;
+    }
+    if (checkOverrun()) {
+      return TRANSPORT_OVERRUN;
+    }
+    got += (len > 0) ? len : 0;
+  }
+
+  if (got == size) {
+    stats.reads++;
+  }
+  return (int)got;
+}
+
+int TtyTransport::write(const uint8_t* data, size_t size)
+{
+  size_t sent = 0;
+  while (sent < size) {
+    ssize_t len = ::write(fd, data + sent, size - sent);
+    if (len < 0) {
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+      return TRANSPORT_ERROR;
+    }
+    sent += len;
+  }
+  return (int)sent;
+}
+
+void TtyTransport::flushInput()
+{
+  if (fd >= 0) {
+    tcflush(fd, TCIFLUSH);
+  }
+}
+
+const YmodemRxStats& TtyTransport::getStats() const
+{
+  return stats;
+}
+
+void TtyTransport::resetStats()
+{
+  stats         = {};
+  countOverruns = false;
+#ifdef TIOCGICOUNT
+  struct serial_icounter_struct count;
+  if (fd >= 0 && ioctl(fd, TIOCGICOUNT, &count) == 0) {
+    countOverruns = true;
+    overruns      = count.overrun;
+    bufOverruns   = count.buf_overrun;
+  }
+#endif
+}
+
+#endif // ESP_PLATFORM
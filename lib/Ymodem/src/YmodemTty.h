@@ -0,0 +1,86 @@
+/**
+ * @file YmodemTty.h
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  POSIX tty transport for Ymodem sessions
+ * @version 0.1
+ * @date 2025-05-27
+ *
+ * This file contains the host implementation of the Ymodem transport over a
+ * serial device or a pseudo terminal. Reads wait with poll() until the bytes
+ * of the packet in progress have arrived, as the UART transport of the ESP32
+ * waits on its event queue, so both sides of a bench run the same read pattern.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef YMODEMTTY_H
+#define YMODEMTTY_H
+
+#ifndef ESP_PLATFORM
+
+#include "YmodemTransport.h"
+
+/**
+ * @brief Ymodem transport over a POSIX tty, in raw 8N1 mode.
+ */
+class TtyTransport final : public YmodemTransport
+{
+public:
+  TtyTransport();
+
+  /**
+   * @brief Destructor for the TtyTransport class, closes the device.
+   */
+  ~TtyTransport();
+
+  TtyTransport(const TtyTransport&)            = delete;
+  TtyTransport& operator=(const TtyTransport&) = delete;
+
+  /**
+   * @brief Opens and configures the device.
+   *
+   * The device is set to raw 8N1, without software flow control. The baud rate and the
+   * hardware flow control are ignored by pseudo terminals, whose writes block once the
+   * reader falls behind.
+   *
+   * @param path Path of the device, such as /dev/ttyUSB0 or /dev/pts/3.
+   * @param baudRate Baud rate, one of the standard rates up to 4000000.
+   * @param flowControl true for RTS/CTS hardware flow control, to match a UartTransport using it.
+   * @return true if the device was opened and configured, false otherwise.
+   */
+  bool begin(const char* path, uint32_t baudRate, bool flowControl = false);
+
+  /**
+   * @brief Closes the device.
+   */
+  void end();
+
+  int  read(uint8_t* data, size_t size, uint32_t timeoutMs) override;
+  int  write(const uint8_t* data, size_t size) override;
+  void flushInput() override;
+
+  /**
+   * @brief Retrieves the receive counters.
+   *
+   * @return const YmodemRxStats& Reference to the current counters.
+   */
+  const YmodemRxStats& getStats() const;
+
+  /**
+   * @brief Clears the receive counters.
+   */
+  void resetStats();
+
+private:
+  int           fd            = -1;    /**< File descriptor of the device, -1 when closed. */
+  bool          countOverruns = false; /**< True if the serial driver reports its overrun counters. */
+  uint32_t      overruns      = 0;     /**< Driver overrun counter when the stats were cleared. */
+  uint32_t      bufOverruns   = 0;     /**< Driver buffer overrun counter when the stats were cleared. */
+  YmodemRxStats stats         = {};    /**< Counters collected by read(). */
+
+  bool checkOverrun();
+};
+
+#endif // ESP_PLATFORM
+
+#endif // YMODEMTTY_H
@@ -0,0 +1,239 @@
+/**
+ * @file YmodemUart.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  UART transport for Ymodem sessions
+ * @version 0.1
+ * @date 2025-05-19
+ *
+ * This file contains the ESP32 UART implementation of the Ymodem transport.
+ * The driver is installed with an event queue, and reads sleep on that queue
+ * until the requested amount of data has been buffered. With RTS/CTS flow
+ * control, a full receive buffer holds the sender back instead of losing bytes.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "YmodemUart.h"
+#include "YmodemLog.h"
+
+#include <Arduino.h>
+
+UartTransport::UartTransport(uart_port_t port) : port(port)
+{
+}
+
+bool UartTransport::begin(int rxPin, int txPin)
+{
+  uart_config_t uart_config = {
+    .baud_rate           = (int)baudRate,
+    .data_bits           = UART_DATA_8_BITS,
+    .parity              = UART_PARITY_DISABLE,
+    .stop_bits           = UART_STOP_BITS_1,
+    .flow_ctrl           = flowControl() ? UART_HW_FLOWCTRL_CTS_RTS : UART_HW_FLOWCTRL_DISABLE,
+    .rx_flow_ctrl_thresh = flowThreshold,
+    .source_clk          = UART_SCLK_APB,
+  };
+  uart_param_config(port, &uart_config);
+
+  QueueHandle_t* queue = YMODEM_RX_EVENTS ? &eventQueue : NULL;
+  if (uart_driver_install(port, BUF_SIZE * 2, UART_TX_BUFFER_SIZE, YMODEM_RX_EVENTS ? UART_EVENT_QUEUE_SIZE : 0, queue, 0) != ESP_OK) {
+    YMODEM_LOGE("Failed to install UART driver");
+    return false;
+  }
+  uart_set_rx_timeout(port, UART_RX_TIMEOUT_SYMBOLS);
+  uart_set_rx_full_threshold(port, UART_RX_FULL_THRESHOLD);
+  setPins(rxPin, txPin);
+  resetStats();
+  return true;
+}
+
+void UartTransport::setPins(int rxPin, int txPin)
+{
+  uart_set_pin(port, txPin, rxPin, rtsPin, ctsPin);
+  uart_set_baudrate(port, baudRate);
+}
+
+void UartTransport::setBaudRate(uint32_t baudRate)
+{
+  this->baudRate = baudRate;
+  if (uart_is_driver_installed(port)) {
+    // The bytes still queued were meant for the previous rate
+    uart_wait_tx_done(port, pdMS_TO_TICKS(NAK_TIMEOUT));
+    uart_set_baudrate(port, baudRate);
+  }
+}
+
+void UartTransport::setFlowControl(int rtsPin, int ctsPin, uint8_t threshold)
+{
+  this->rtsPin  = rtsPin;
+  this->ctsPin  = ctsPin;
+  flowThreshold = threshold;
+  if (uart_is_driver_installed(port)) {
+    uart_set_hw_flow_ctrl(port, flowControl() ? UART_HW_FLOWCTRL_CTS_RTS : UART_HW_FLOWCTRL_DISABLE, threshold);
+    uart_set_pin(port, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE, rtsPin, ctsPin);
+  }
+}
+
+bool UartTransport::flowControl() const
+{
+  return rtsPin != UART_PIN_NO_CHANGE;
+}
+
+/**
+ * @brief Waits on the UART event queue until the driver buffer holds the requested bytes.
+ *
+ * The task only wakes up when the driver posts an event (RX FIFO threshold reached or
+ * RX line idle), so no time is spent polling the buffer while a packet is on the wire.
+ * The events queued while the bytes were read are taken without waiting before the
+ * buffer is checked: left in the queue, they would fill it during a streaming receive
+ * and the driver would drop the next ones, the overflows included.
+ *
+ * @param count Number of bytes that must be available.
+ * @param timeoutMs Maximum time to wait, in milliseconds.
+ * @return int 0 when the bytes are available or the timeout expired, TRANSPORT_OVERRUN
+ *         if the FIFO or the driver buffer overflowed.
+ */
+int UartTransport::waitForData(size_t count, uint32_t timeoutMs)
+{
+  uart_event_t event;
+  size_t       buffered = 0;
+  TickType_t   start    = xTaskGetTickCount();
+  TickType_t   timeout  = pdMS_TO_TICKS(timeoutMs);
+
+  while (true) {
+    while (xQueueReceive(eventQueue, &event, 0) == pdTRUE) {
+      int err = handleEvent(event);
+      if (err < 0) {
+        return err;
+      }
+    }
+    if (uart_get_buffered_data_len(port, &buffered) != ESP_OK || buffered >= count) {
+      return 0;
+    }
+
+    TickType_t elapsed = xTaskGetTickCount() - start;
+    if (elapsed >= timeout || xQueueReceive(eventQueue, &event, timeout - elapsed) != pdTRUE) {
+      return 0;
+    }
+    stats.wakeups++;
+    int err = handleEvent(event);
+    if (err < 0) {
+      return err;
+    }
+  }
+}
+
+/**
+ * @brief Counts an event of the UART driver and handles the overflows.
+ *
+ * Once the hardware FIFO or the driver ring buffer has overflowed, the bytes still
+ * buffered no longer form a contiguous packet. They are flushed together with the
+ * queued events so that the next read starts from a clean state. With flow control
+ * a full ring buffer has lost nothing: RTS holds the sender back, and the driver
+ * moves the FIFO into the buffer again once it is read.
+ *
+ * @param event Event taken from the queue.
+ * @return int 0, or TRANSPORT_OVERRUN if the FIFO or the driver buffer overflowed.
+ */
+int UartTransport::handleEvent(const uart_event_t& event)
+{
+  switch (event.type) {
+    case UART_FIFO_OVF:
+      stats.fifoOverflows++;
+      flushInput();
+      return TRANSPORT_OVERRUN;
+    case UART_BUFFER_FULL:
+      stats.bufferFull++;
+      if (flowControl()) {
+        return 0;
+      }
+      flushInput();
+      return TRANSPORT_OVERRUN;
+    case UART_PATTERN_DET:
+      stats.patterns++;
+      uart_pattern_pop_pos(port);
+      return 0;
+    default:
+      return 0;
+  }
+}
+
+int UartTransport::read(uint8_t* data, size_t size, uint32_t timeoutMs)
+{
+  if (eventQueue == NULL) {
+    int len = uart_read_bytes(port, data, size, pdMS_TO_TICKS(timeoutMs));
+    return (len < 0) ? TRANSPORT_ERROR : len;
+  }
+
+  int err = waitForData(size, timeoutMs);
+  if (err < 0) {
+    return err;
+  }
+
+  size_t buffered = 0;
+  uart_get_buffered_data_len(port, &buffered);
+  if (buffered == 0) {
+    return 0;
+  }
+
+  int len = uart_read_bytes(port, data, std::min(size, buffered), 0);
+  if (len == (int)size) {
+    stats.reads++;
+  }
+  return (len < 0) ? TRANSPORT_ERROR : len;
+}
+
+int UartTransport::write(const uint8_t* data, size_t size)
+{
+  // With a TX ring buffer the call only waits when the ring is full, the ISR drains it meanwhile
+  uint32_t start = micros();
+  int      len   = uart_write_bytes(port, data, size);
+  txStats.blockedUs += micros() - start;
+  if (len < 0) {
+    return TRANSPORT_ERROR;
+  }
+  txStats.writes++;
+  txStats.bytes += len;
+  return len;
+}
+
+/**
+ * @brief Sleeps on the TX done interrupt until the ring buffer and the FIFO are empty.
+ */
+bool UartTransport::waitWriteDone(uint32_t timeoutMs)
+{
+  if (uart_wait_tx_done(port, 0) == ESP_OK) {
+    return true;
+  }
+  txStats.drains++;
+  return uart_wait_tx_done(port, pdMS_TO_TICKS(timeoutMs)) == ESP_OK;
+}
+
+void UartTransport::flushInput()
+{
+  uart_flush_input(port);
+  if (eventQueue != NULL) {
+    xQueueReset(eventQueue);
+  }
+}
+
+uart_port_t UartTransport::getPort() const
+{
+  return port;
+}
+
+const YmodemRxStats& UartTransport::getStats() const
+{
+  return stats;
+}
+
+const YmodemTxStats& UartTransport::getTxStats() const
+{
+  return txStats;
+}
+
+void UartTransport::resetStats()
+{
+  stats   = {};
+  txStats = {};
+}
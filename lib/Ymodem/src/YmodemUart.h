@@ -0,0 +1,138 @@
+/**
+ * @file YmodemUart.h
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  UART transport for Ymodem sessions
+ * @version 0.1
+ * @date 2025-05-19
+ *
+ * This file contains the ESP32 UART implementation of the Ymodem transport.
+ * The driver is installed with an event queue, and reads sleep on that queue
+ * until the requested amount of data has been buffered. With RTS/CTS flow
+ * control, a full receive buffer holds the sender back instead of losing bytes.
+ * Writes are queued in a TX ring buffer of UART_TX_BUFFER_SIZE bytes, so the
+ * sending task prepares its next packet while the previous one is on the wire.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef YMODEMUART_H
+#define YMODEMUART_H
+
+#include <driver/uart.h>
+
+#include "YmodemDef.h"
+#include "YmodemTransport.h"
+
+/**
+ * @brief Ymodem transport over an ESP32 UART port.
+ */
+class UartTransport : public YmodemTransport
+{
+public:
+  /**
+   * @brief Constructor for the UartTransport class.
+   *
+   * @param port UART port used by the transport. The driver is not installed until begin() is called.
+   */
+  UartTransport(uart_port_t port = EX_UART_NUM);
+
+  /**
+   * @brief Configures the UART and installs its driver.
+   *
+   * The driver is installed with an event queue (unless YMODEM_RX_EVENTS is 0), and the
+   * RX timeout and RX FIFO threshold are tuned so that the reading task is only woken up
+   * by UART events.
+   *
+   * @param rxPin The GPIO pin number to be used for UART RX (receive).
+   * @param txPin The GPIO pin number to be used for UART TX (transmit).
+   * @return true if the driver was installed, false otherwise.
+   */
+  bool begin(int rxPin, int txPin);
+
+  /**
+   * @brief Sets the RX and TX pins and the baud rate of the UART.
+   *
+   * The RTS and CTS pins given to setFlowControl() are routed too.
+   *
+   * @param rxPin The GPIO pin number to be used for UART RX (receive).
+   * @param txPin The GPIO pin number to be used for UART TX (transmit).
+   */
+  void setPins(int rxPin, int txPin);
+
+  /**
+   * @brief Sets the baud rate, 115200 by default.
+   *
+   * It can be called before or after begin().
+   *
+   * @param baudRate Baud rate in bits per second.
+   */
+  void setBaudRate(uint32_t baudRate);
+
+  /**
+   * @brief Enables or disables RTS/CTS hardware flow control.
+   *
+   * The UART deasserts RTS once its RX FIFO holds threshold bytes, and only sends while CTS is
+   * asserted. The FIFO level is checked by the hardware, so the sender is held back even while
+   * the flash writes of LittleFS keep the UART interrupt from draining the FIFO. A full driver
+   * buffer then means back-pressure instead of lost bytes, and read() keeps the buffered data.
+   * It can be called before or after begin().
+   *
+   * @param rtsPin The GPIO pin number driving RTS, UART_PIN_NO_CHANGE to disable flow control.
+   * @param ctsPin The GPIO pin number reading CTS.
+   * @param threshold RX FIFO level, in bytes, below the 128-byte FIFO.
+   */
+  void setFlowControl(int rtsPin, int ctsPin, uint8_t threshold = UART_RX_FLOW_THRESHOLD);
+
+  /**
+   * @brief Checks whether RTS/CTS flow control is enabled.
+   *
+   * @return true if setFlowControl() was given an RTS pin, false otherwise.
+   */
+  bool flowControl() const;
+
+  int  read(uint8_t* data, size_t size, uint32_t timeoutMs) override;
+  int  write(const uint8_t* data, size_t size) override;
+  bool waitWriteDone(uint32_t timeoutMs) override;
+  void flushInput() override;
+
+  /**
+   * @brief Retrieves the UART port used by the transport.
+   *
+   * @return uart_port_t The UART port.
+   */
+  uart_port_t getPort() const;
+
+  /**
+   * @brief Retrieves the UART receive counters.
+   *
+   * @return const YmodemRxStats& Reference to the current counters.
+   */
+  const YmodemRxStats& getStats() const;
+
+  /**
+   * @brief Retrieves the UART transmit counters.
+   *
+   * @return const YmodemTxStats& Reference to the current counters, blockedUs is the time write() kept the caller waiting.
+   */
+  const YmodemTxStats& getTxStats() const;
+
+  /**
+   * @brief Clears the UART receive and transmit counters.
+   */
+  void resetStats();
+
+private:
+  uart_port_t   port;                                   /**< UART port used by the transport. */
+  QueueHandle_t eventQueue    = NULL;                   /**< UART driver event queue, NULL when RX events are disabled. */
+  YmodemRxStats stats         = {};                     /**< Counters collected while waiting on the event queue. */
+  YmodemTxStats txStats       = {};                     /**< Counters collected by write() and waitWriteDone(). */
+  uint32_t      baudRate      = 115200;                 /**< Baud rate of the UART. */
+  int           rtsPin        = UART_PIN_NO_CHANGE;     /**< RTS pin, UART_PIN_NO_CHANGE without flow control. */
+  int           ctsPin        = UART_PIN_NO_CHANGE;     /**< CTS pin, UART_PIN_NO_CHANGE without flow control. */
+  uint8_t       flowThreshold = UART_RX_FLOW_THRESHOLD; /**< RX FIFO level at which RTS is deasserted. */
+
+  int waitForData(size_t count, uint32_t timeoutMs);
+  int handleEvent(const uart_event_t& event);
+};
+
+#endif // YMODEMUART_H
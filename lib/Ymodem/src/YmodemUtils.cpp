@@ -32,16 +32,6 @@ static const uint16_t crc16_table[256] = {
   0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1, 0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8, 0x6E17, 0x7E36, 0x4E55, 0x5E74,
   0x2E93, 0x3EB2, 0x0ED1, 0x1EF0};
 
-void IRAM_ATTR LED_toggle()
-{
-#if YMODEM_LED_ACT
-  if (GPIO.out & (1 << YMODEM_LED_ACT))
-    GPIO.out_w1tc = (1 << YMODEM_LED_ACT);
-  else
-    GPIO.out_w1ts = (1 << YMODEM_LED_ACT);
-#endif
-}
-
 /* Old crc16 calculation function (slower)
 unsigned short crc16(const unsigned char* buf, size_t count)
 {
@@ -61,7 +51,11 @@ unsigned short crc16(const unsigned char* buf, size_t count)
 
 unsigned short crc16(const unsigned char* buf, size_t count)
 {
-  unsigned short crc = 0;
+  return Ymodem_Crc16Update(0, buf, count);
+}
+
+unsigned short Ymodem_Crc16Update(unsigned short crc, const unsigned char* buf, size_t count)
+{
   while (count--) {
     uint8_t tableIndex = (crc >> 8) ^ *buf++;
     crc                = (crc << 8) ^ crc16_table[tableIndex];
@@ -69,11 +63,42 @@ unsigned short crc16(const unsigned char* buf, size_t count)
   return crc;
 }
 
+#ifdef ESP_PLATFORM
+static YmodemTransport* transport = NULL; // Transport used by the byte and packet helpers
+
+void IRAM_ATTR LED_toggle()
+{
+#if YMODEM_LED_ACT
+  if (GPIO.out & (1 << YMODEM_LED_ACT))
+    GPIO.out_w1tc = (1 << YMODEM_LED_ACT);
+  else
+    GPIO.out_w1ts = (1 << YMODEM_LED_ACT);
+#endif
+}
+
+void Ymodem_SetTransport(YmodemTransport* newTransport)
+{
+  transport = newTransport;
+}
+
+ByteOperationStatus Receive_Bytes(uint8_t* data, size_t count, uint32_t timeout)
+{
+  if (transport == NULL) {
+    return BYTE_ERROR;
+  }
+
+  int len = transport->read(data, count, timeout);
+  if (len == TRANSPORT_OVERRUN) {
+    return BYTE_OVERRUN;
+  }
+  return (len == (int)count) ? BYTE_OK : BYTE_ERROR;
+}
+
 ByteOperationStatus Receive_Byte(unsigned char* c, uint32_t timeout)
 {
-  unsigned char ch;
-  int           err = uart_read_bytes(EX_UART_NUM, &ch, 1, timeout / portTICK_RATE_MS);
-  if (err <= 0)
+  unsigned char       ch;
+  ByteOperationStatus err = Receive_Bytes(&ch, 1, timeout);
+  if (err != BYTE_OK)
     return BYTE_ERROR;
   *c = ch;
   return BYTE_OK;
@@ -82,14 +107,13 @@ ByteOperationStatus Receive_Byte(unsigned char* c, uint32_t timeout)
 void uart_consume()
 {
   uint8_t ch[64];
-  while (uart_read_bytes(EX_UART_NUM, ch, 64, 100 / portTICK_RATE_MS) > 0)
+  while (transport != NULL && transport->read(ch, sizeof(ch), 100) > 0)
     ;
 }
 
 ByteOperationStatus Send_Byte(char c)
 {
-  int err = uart_write_bytes(EX_UART_NUM, &c, 1);
-  if (err < 0)
+  if (transport == NULL || transport->write((const uint8_t*)&c, 1) < 0)
     return BYTE_ERROR;
   return BYTE_OK;
 }
@@ -279,33 +303,33 @@ YmodemPacketStatus HandlePacketHeader(unsigned char ch, int* packet_size, int* l
  * @brief Reads packet data from a source with a specified timeout.
  *
  * This function reads a packet of data of the specified size, including
- * the packet overhead, from a source. It ensures that the data does not
- * exceed the maximum buffer size and handles timeout or buffer overflow
- * conditions appropriately.
+ * the packet overhead, from a source. The whole packet is requested at once
+ * so that, in event mode, the task sleeps until the packet has arrived
+ * instead of waking up for every byte.
  *
  * @param data Pointer to the buffer where the received packet data will be stored.
  *             The first byte of the buffer is skipped, and data is written starting
  *             from the second byte.
  * @param packet_size The size of the packet to be read (excluding overhead).
- * @param timeout The timeout duration (in milliseconds) for receiving each byte.
+ * @param timeout The maximum idle time (in milliseconds) while receiving the packet.
  *
  * @return YMODEM_RECEIVED_OK if the packet is successfully read.
- *         YMODEM_TIMEOUT if a timeout occurs while receiving a byte.
- *         YMODEM_BUFFER_OVERFLOW if the buffer size is exceeded.
+ *         YMODEM_TIMEOUT if a timeout occurs while receiving the packet.
+ *         YMODEM_BUFFER_OVERFLOW if the packet is larger than a 1K packet or the UART overflowed.
  */
 YmodemPacketStatus ReadPacketData(uint8_t* data, int packet_size, uint32_t timeout)
 {
-  uint8_t*      dptr = data + 1;
-  unsigned char ch;
+  if (packet_size > PACKET_1K_SIZE) {
+    return YMODEM_BUFFER_OVERFLOW;
+  }
 
-  for (int i = 0; i < (packet_size + PACKET_OVERHEAD - 1); i++) {
-    if (Receive_Byte(&ch, timeout) < 0) {
-      return YMODEM_TIMEOUT;
-    }
-    if (dptr - data >= MAX_BUFFER_SIZE) {
-      return YMODEM_BUFFER_OVERFLOW;
-    }
-    *dptr++ = (uint8_t)ch;
+  // The header byte is already in data[0], read the rest of the packet in one go
+  ByteOperationStatus status = Receive_Bytes(data + 1, packet_size + PACKET_OVERHEAD - 1, timeout);
+  if (status == BYTE_OVERRUN) {
+    return YMODEM_BUFFER_OVERFLOW;
+  }
+  if (status != BYTE_OK) {
+    return YMODEM_TIMEOUT;
   }
 
   return YMODEM_RECEIVED_OK;
@@ -368,4 +392,5 @@ YmodemPacketStatus ReceiveAndValidatePacket(uint8_t* data, int* length, uint32_t
 
   // Validate the packet sequence and CRC
   return ValidatePacket(data, packet_size, length);
-}
\ No newline at end of file
+}
+#endif
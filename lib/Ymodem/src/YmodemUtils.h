@@ -20,17 +20,22 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef ESP_PLATFORM
+#include <Arduino.h>
+
 #include "driver/gpio.h"
-#include "filesystem.h"
 #include "rom/crc.h"
 #include <driver/uart.h>
+#endif
 
 #include "YmodemDef.h"
+#include "YmodemTransport.h"
 
 enum ByteOperationStatus : int8_t
 {
-  BYTE_OK    = 0,  // Successful byte operation
-  BYTE_ERROR = -1, // Error in byte operation
+  BYTE_OK      = 0,  // Successful byte operation
+  BYTE_ERROR   = -1, // Error in byte operation
+  BYTE_OVERRUN = -2, // UART FIFO or driver buffer overflowed, pending data was dropped
 };
 
 enum PacketLengthStatus : int8_t
@@ -66,20 +71,13 @@ enum YmodemPacketStatus : int8_t
   YMODEM_SIZE_NULL           = -12, // Packet size is null
   YMODEM_MAX_ERRORS          = -13, // Maximum errors reached
   YMODEM_READ_ERROR          = -14, // Error reading file
+  YMODEM_DIGEST_ERROR        = -15, // The file digest does not match the one announced in the header
+  YMODEM_NO_SPACE            = -16, // Not enough space for the size announced in the header
+  YMODEM_NO_MEMORY           = -17, // The packet buffers could not be allocated
+  YMODEM_HEADER_OVERFLOW     = -18, // The name or the digest of the file does not fit in the header
 
 };
 
-/**
- * @brief Toggles the state of an LED.
- *
- * This function is marked with the IRAM_ATTR attribute, indicating that it should be placed in
- * the IRAM (Instruction RAM) for faster execution. This is typically used for functions that
- * need to be executed quickly, such as interrupt service routines.
- *
- * Note: Ensure that the LED is properly initialized before calling this function.
- */
-void IRAM_ATTR LED_toggle();
-
 /**
  * @brief Computes the CRC-16 checksum for a given buffer using the CCITT-FALSE polynomial.
  *
@@ -94,6 +92,31 @@ void IRAM_ATTR LED_toggle();
  */
 unsigned short crc16(const unsigned char* buf, size_t count);
 
+/**
+ * @brief Continues a CRC-16 (CCITT-FALSE) over more bytes.
+ *
+ * crc16() is Ymodem_Crc16Update(0, ...). The Zmodem headers use it to add the frame type
+ * and the four header bytes without copying them together.
+ *
+ * @param crc CRC of the previous bytes, 0 to start.
+ * @param buf Pointer to the input buffer.
+ * @param count The number of bytes in the input buffer.
+ * @return The updated 16-bit CRC value.
+ */
+unsigned short Ymodem_Crc16Update(unsigned short crc, const unsigned char* buf, size_t count);
+
+#ifdef ESP_PLATFORM
+/**
+ * @brief Toggles the state of an LED.
+ *
+ * This function is marked with the IRAM_ATTR attribute, indicating that it should be placed in
+ * the IRAM (Instruction RAM) for faster execution. This is typically used for functions that
+ * need to be executed quickly, such as interrupt service routines.
+ *
+ * Note: Ensure that the LED is properly initialized before calling this function.
+ */
+void IRAM_ATTR LED_toggle();
+
 /**
  * @brief Receives a byte from a communication interface.
  *
@@ -106,6 +129,31 @@ unsigned short crc16(const unsigned char* buf, size_t count);
  */
 ByteOperationStatus Receive_Byte(unsigned char* c, uint32_t timeout);
 
+/**
+ * @brief Receives a block of bytes from a communication interface.
+ *
+ * The block is requested from the transport in one call. With the UART transport the
+ * calling task sleeps on the UART event queue until the driver buffer holds the whole
+ * block, and then reads it with a single driver call.
+ *
+ * @param[out] data Pointer to the buffer where the received bytes will be stored.
+ * @param[in] count Number of bytes to receive.
+ * @param[in] timeout Maximum time to wait for the block, in milliseconds.
+ * @return ByteOperationStatus BYTE_OK when all bytes were received, BYTE_ERROR on timeout,
+ *         or BYTE_OVERRUN if the UART FIFO or driver buffer overflowed while waiting.
+ */
+ByteOperationStatus Receive_Bytes(uint8_t* data, size_t count, uint32_t timeout);
+
+/**
+ * @brief Selects the transport used by the byte and packet helpers of this file.
+ *
+ * The Ymodem class selects its UART transport when it is constructed. The helpers
+ * fail with BYTE_ERROR or YMODEM_TIMEOUT while no transport is selected.
+ *
+ * @param transport Transport used to send and receive, or NULL.
+ */
+void Ymodem_SetTransport(YmodemTransport* transport);
+
 /**
  * @brief Sends an End Of Transmission (EOT) signal.
  *
@@ -170,5 +218,6 @@ void send_CRC16();
  *                 while a negative value indicates an error.
  */
 YmodemPacketStatus ReceiveAndValidatePacket(uint8_t* data, int* length, uint32_t timeout);
+#endif
 
 #endif // YMODEMUTILS_H
\ No newline at end of file
@@ -0,0 +1,387 @@
+/**
+ * @file ZmodemFrame.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Zmodem header and data subpacket coding
+ * @version 0.1
+ * @date 2025-06-02
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "ZmodemFrame.h"
+
+#include "YmodemDigest.h"
+#include "YmodemUtils.h"
+
+const uint8_t ZMODEM_CANCEL[ZMODEM_CANCEL_SIZE] = {ZDLE, ZDLE, ZDLE, ZDLE, ZDLE, ZDLE, ZDLE, ZDLE, ZDLE, ZDLE,
+                                                   0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08, 0x08};
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+/**
+ * @brief Reads a 32-bit little endian value.
+ */
+static uint32_t getLE32(const uint8_t* data)
+{
+  return data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+/**
+ * @brief Stores the type and the four header bytes, in the order they are sent and checked.
+ */
+static void packHeader(uint8_t* bytes, uint8_t type, uint32_t arg)
+{
+  bytes[0] = type;
+  for (int i = 0; i < 4; i++) {
+    bytes[1 + i] = (uint8_t)(arg >> (8 * i));
+  }
+}
+
+size_t ZmodemEncoder::put(uint8_t* out, uint8_t byte)
+{
+  bool escape;
+  switch (byte) {
+    case ZDLE:
+    case 0x10:
+    case 0x90:
+    case ZMODEM_XON:
+    case ZMODEM_XON | 0x80:
+    case ZMODEM_XOFF:
+    case ZMODEM_XOFF | 0x80:
+      escape = true;
+      break;
+    case '\r':
+    case '\r' | 0x80:
+      escape = (last & 0x7f) == '@'; // Telenet command escape
+      break;
+    default:
+      escape = false;
+      break;
+  }
+
+  if (!escape) {
+    out[0] = byte;
+    last   = byte;
+    return 1;
+  }
+  out[0] = ZDLE;
+  out[1] = byte ^ 0x40;
+  last   = out[1];
+  return 2;
+}
+
+size_t ZmodemEncoder::hexHeader(uint8_t* out, uint8_t type, uint32_t arg)
+{
+  uint8_t bytes[7];
+  packHeader(bytes, type, arg);
+  uint16_t crc = crc16(bytes, 5);
+  bytes[5]     = crc >> 8;
+  bytes[6]     = crc;
+
+  size_t len = 0;
+  out[len++] = ZPAD;
+  out[len++] = ZPAD;
+  out[len++] = ZDLE;
+  out[len++] = ZHEX;
+  for (size_t i = 0; i < sizeof(bytes); i++) {
+    out[len++] = HEX_DIGITS[bytes[i] >> 4];
+    out[len++] = HEX_DIGITS[bytes[i] & 0x0f];
+  }
+  out[len++] = '\r';
+  out[len++] = '\n' | 0x80;
+  // The XON restarts a sender stopped by line noise, it would be taken as data after these two
+  if (type != ZFIN && type != ZACK) {
+    out[len++] = ZMODEM_XON;
+  }
+  last = out[len - 1];
+  return len;
+}
+
+size_t ZmodemEncoder::binaryHeader(uint8_t* out, uint8_t type, uint32_t arg, bool crc32)
+{
+  uint8_t bytes[9];
+  packHeader(bytes, type, arg);
+  size_t size = 5;
+  if (crc32) {
+    uint32_t crc = Ymodem_Crc32(0, bytes, 5);
+    for (int i = 0; i < 4; i++) {
+      bytes[size++] = (uint8_t)(crc >> (8 * i));
+    }
+  }
+  else {
+    uint16_t crc  = crc16(bytes, 5);
+    bytes[size++] = crc >> 8;
+    bytes[size++] = crc;
+  }
+
+  size_t len = 0;
+  out[len++] = ZPAD;
+  out[len++] = ZDLE;
+  out[len++] = crc32 ? ZBIN32 : ZBIN;
+  for (size_t i = 0; i < size; i++) {
+    len += put(out + len, bytes[i]);
+  }
+  return len;
+}
+
+size_t ZmodemEncoder::subpacket(uint8_t* out, const uint8_t* data, size_t size, uint8_t end, bool crc32)
+{
+  // The CRC is computed first, the data may be overwritten by its own escaping
+  uint8_t check[4];
+  size_t  checkSize;
+  if (crc32) {
+    uint32_t crc = Ymodem_Crc32(Ymodem_Crc32(0, data, size), &end, 1);
+    for (int i = 0; i < 4; i++) {
+      check[i] = (uint8_t)(crc >> (8 * i));
+    }
+    checkSize = 4;
+  }
+  else {
+    uint16_t crc = Ymodem_Crc16Update(crc16(data, size), &end, 1);
+    check[0]     = crc >> 8;
+    check[1]     = crc;
+    checkSize    = 2;
+  }
+
+  size_t len = 0;
+  for (size_t i = 0; i < size; i++) {
+    len += put(out + len, data[i]);
+  }
+  out[len++] = ZDLE;
+  out[len++] = end;
+  last       = end;
+  for (size_t i = 0; i < checkSize; i++) {
+    len += put(out + len, check[i]);
+  }
+  if (end == ZCRCW) {
+    out[len++] = ZMODEM_XON;
+    last       = ZMODEM_XON;
+  }
+  return len;
+}
+
+void ZmodemDecoder::hunt()
+{
+  state   = HUNT;
+  escaped = false;
+}
+
+void ZmodemDecoder::expectData(uint8_t* buffer, size_t capacity)
+{
+  this->buffer   = buffer;
+  this->capacity = capacity;
+  state          = DATA;
+  escaped        = false;
+  size           = 0;
+  end            = 0;
+}
+
+ZmodemToken ZmodemDecoder::feed(uint8_t byte)
+{
+  if (byte != ZDLE) {
+    cancels = 0;
+  }
+  else if (++cancels >= ZMODEM_CANCEL_COUNT) {
+    cancels = 0;
+    hunt();
+    return ZMODEM_TOKEN_CANCEL;
+  }
+
+  switch (state) {
+    case HUNT:
+      if (byte == ZPAD) {
+        state = PAD;
+      }
+      return ZMODEM_TOKEN_NONE;
+    case PAD:
+      if (byte != ZPAD) {
+        state = (byte == ZDLE) ? FORMAT : HUNT;
+      }
+      return ZMODEM_TOKEN_NONE;
+    case FORMAT:
+      headerSize  = 0;
+      escaped     = false;
+      hexFormat   = (byte == ZHEX);
+      headerCrc32 = (byte == ZBIN32);
+      state       = (byte == ZHEX) ? HEX : (byte == ZBIN || byte == ZBIN32) ? BINARY : HUNT;
+      return ZMODEM_TOKEN_NONE;
+    case HEX:
+    case BINARY:
+      return onHeaderByte(byte);
+    default:
+      return onDataByte(byte);
+  }
+}
+
+ZmodemToken ZmodemDecoder::onHeaderByte(uint8_t byte)
+{
+  if (hexFormat) {
+    uint8_t digit;
+    if (byte >= '0' && byte <= '9') {
+      digit = byte - '0';
+    }
+    else if ((byte | 0x20) >= 'a' && (byte | 0x20) <= 'f') {
+      digit = (byte | 0x20) - 'a' + 10;
+    }
+    else {
+      hunt();
+      return ZMODEM_TOKEN_BAD_HEADER;
+    }
+    uint8_t& value = header[headerSize / 2];
+    value          = (headerSize % 2 == 0) ? digit << 4 : value | digit;
+    return (++headerSize < 14) ? ZMODEM_TOKEN_NONE : checkHeader();
+  }
+
+  // Binary header, the flow control bytes are dropped unless escaped
+  if (!escaped) {
+    if (byte == ZDLE) {
+      escaped = true;
+      return ZMODEM_TOKEN_NONE;
+    }
+    if ((byte & 0x7f) == ZMODEM_XON || (byte & 0x7f) == ZMODEM_XOFF) {
+      return ZMODEM_TOKEN_NONE;
+    }
+  }
+  else if (byte == ZDLE) {
+    return ZMODEM_TOKEN_NONE;
+  }
+  else {
+    escaped = false;
+    if (byte == ZRUB0 || byte == ZRUB1) {
+      byte = (byte == ZRUB0) ? 0x7f : 0xff;
+    }
+    else if ((byte & 0x60) == 0x40) {
+      byte ^= 0x40;
+    }
+    else {
+      hunt();
+      return ZMODEM_TOKEN_BAD_HEADER;
+    }
+  }
+  header[headerSize++] = byte;
+  return (headerSize < (headerCrc32 ? 9u : 7u)) ? ZMODEM_TOKEN_NONE : checkHeader();
+}
+
+ZmodemToken ZmodemDecoder::onDataByte(uint8_t byte)
+{
+  // A subpacket that did not end the frame is followed by the next one
+  if (state == DATA && end != 0) {
+    size = 0;
+    end  = 0;
+  }
+
+  if (!escaped) {
+    if (byte == ZDLE) {
+      escaped = true;
+      return ZMODEM_TOKEN_NONE;
+    }
+    if ((byte & 0x7f) == ZMODEM_XON || (byte & 0x7f) == ZMODEM_XOFF) {
+      return ZMODEM_TOKEN_NONE;
+    }
+  }
+  else if (byte == ZDLE) {
+    return ZMODEM_TOKEN_NONE;
+  }
+  else {
+    escaped = false;
+    if (state == DATA && byte >= ZCRCE && byte <= ZCRCW) {
+      end     = byte;
+      crcSize = 0;
+      state   = DATA_CRC;
+      return ZMODEM_TOKEN_NONE;
+    }
+    if (byte == ZRUB0 || byte == ZRUB1) {
+      byte = (byte == ZRUB0) ? 0x7f : 0xff;
+    }
+    else if ((byte & 0x60) == 0x40) {
+      byte ^= 0x40;
+    }
+    else {
+      hunt();
+      return ZMODEM_TOKEN_BAD_DATA;
+    }
+  }
+
+  if (state == DATA_CRC) {
+    crc[crcSize++] = byte;
+    return (crcSize < (dataCrc32 ? 4u : 2u)) ? ZMODEM_TOKEN_NONE : checkData();
+  }
+  if (size >= capacity) {
+    hunt();
+    return ZMODEM_TOKEN_BAD_DATA;
+  }
+  buffer[size++] = byte;
+  return ZMODEM_TOKEN_NONE;
+}
+
+ZmodemToken ZmodemDecoder::checkHeader()
+{
+  state   = HUNT;
+  bool ok = headerCrc32 ? Ymodem_Crc32(0, header, 5) == getLE32(header + 5) : crc16(header, 7) == 0;
+  if (!ok) {
+    return ZMODEM_TOKEN_BAD_HEADER;
+  }
+  lastType  = header[0];
+  lastArg   = getLE32(header + 1);
+  dataCrc32 = headerCrc32;
+  return ZMODEM_TOKEN_HEADER;
+}
+
+ZmodemToken ZmodemDecoder::checkData()
+{
+  bool ok;
+  if (dataCrc32) {
+    ok = Ymodem_Crc32(Ymodem_Crc32(0, buffer, size), &end, 1) == getLE32(crc);
+  }
+  else {
+    ok = Ymodem_Crc16Update(Ymodem_Crc16Update(crc16(buffer, size), &end, 1), crc, 2) == 0;
+  }
+  if (!ok) {
+    hunt();
+    return ZMODEM_TOKEN_BAD_DATA;
+  }
+  state = (end == ZCRCG || end == ZCRCQ) ? DATA : HUNT;
+  return ZMODEM_TOKEN_DATA;
+}
+
+uint8_t ZmodemDecoder::type() const
+{
+  return lastType;
+}
+
+uint32_t ZmodemDecoder::arg() const
+{
+  return lastArg;
+}
+
+bool ZmodemDecoder::crc32() const
+{
+  return dataCrc32;
+}
+
+size_t ZmodemDecoder::dataSize() const
+{
+  return size;
+}
+
+uint8_t ZmodemDecoder::dataEnd() const
+{
+  return end;
+}
+
+size_t ZmodemDecoder::expectedBytes() const
+{
+  size_t crcBytes = dataCrc32 ? 4 : 2;
+  switch (state) {
+    case HEX:
+      return 14 - headerSize;
+    case BINARY:
+      return (headerCrc32 ? 9 : 7) - headerSize;
+    case DATA:
+      return (escaped ? 1 : 2) + crcBytes;
+    case DATA_CRC:
+      return crcBytes - crcSize;
+    default:
+      return 1;
+  }
+}
@@ -0,0 +1,255 @@
+/**
+ * @file ZmodemFrame.h
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Zmodem header and data subpacket coding
+ * @version 0.1
+ * @date 2025-06-02
+ *
+ * This file contains the wire format shared by the Zmodem sender and
+ * receiver: the hex and binary headers, the escaped data subpackets with
+ * their CRC-16 or CRC-32, and a byte-driven decoder that turns the received
+ * bytes into headers and subpackets. The format is the one of the lrzsz
+ * tools, so the sessions interoperate with sz and rz.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef ZMODEMFRAME_H
+#define ZMODEMFRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ==== Z-MODEM defines ====
+#define ZPAD ('*')   /*!< Padding that starts every header */
+#define ZDLE (0x18)  /*!< Escape character, also CAN */
+#define ZBIN ('A')   /*!< Binary header with a CRC-16 */
+#define ZHEX ('B')   /*!< Hex header with a CRC-16 */
+#define ZBIN32 ('C') /*!< Binary header with a CRC-32, its data subpackets use a CRC-32 too */
+
+#define ZCRCE ('h') /*!< Subpacket end, the frame ends and a header follows */
+#define ZCRCG ('i') /*!< Subpacket end, the frame goes on without an answer */
+#define ZCRCQ ('j') /*!< Subpacket end, the frame goes on and a ZACK is expected */
+#define ZCRCW ('k') /*!< Subpacket end, the frame ends and a ZACK is expected */
+#define ZRUB0 ('l') /*!< Escaped 0x7f */
+#define ZRUB1 ('m') /*!< Escaped 0xff */
+
+#define ZMODEM_XON (0x11)  /*!< Flow control byte ignored by the decoder when not escaped */
+#define ZMODEM_XOFF (0x13) /*!< Flow control byte ignored by the decoder when not escaped */
+
+#define CANFDX (0x01)  /*!< ZRINIT flag, the receiver can send and receive at once */
+#define CANOVIO (0x02) /*!< ZRINIT flag, the receiver can receive data while writing */
+#define CANFC32 (0x20) /*!< ZRINIT flag, the receiver checks CRC-32 frames */
+
+#define ZCBIN (1)   /*!< ZFILE conversion option, binary transfer */
+#define ZCRESUM (3) /*!< ZFILE conversion option, continue an interrupted transfer */
+
+#define ZMODEM_SUBPACKET_SIZE (480)    /*!< File bytes in the subpackets sent, escaped they fit in YMODEM_FRAME_SIZE */
+#define ZMODEM_MAX_SUBPACKET (1024)    /*!< Largest subpacket accepted, the size sent by sz */
+#define ZMODEM_HEX_HEADER_SIZE (21)    /*!< Bytes of a hex header with its CR LF and XON */
+#define ZMODEM_BINARY_HEADER_SIZE (22) /*!< Bytes of a binary header with a CRC-32, all escaped */
+#define ZMODEM_CANCEL_SIZE (20)        /*!< Bytes of the cancel sequence, 10 CAN and 10 backspaces */
+#define ZMODEM_CANCEL_COUNT (5)        /*!< Consecutive CAN that cancel a session */
+
+/**
+ * @brief Frame types, the first byte of every header.
+ */
+enum ZmodemFrameType : uint8_t
+{
+  ZRQINIT = 0,  // Request for a ZRINIT
+  ZRINIT  = 1,  // Receiver ready, with its flags and buffer size
+  ZSINIT  = 2,  // Sender options, followed by a subpacket
+  ZACK    = 3,  // Acknowledge, with a position
+  ZFILE   = 4,  // File name and size, followed by a subpacket
+  ZSKIP   = 5,  // The receiver skips the file
+  ZNAK    = 6,  // The last header was garbled
+  ZABORT  = 7,  // Abort the batch
+  ZFIN    = 8,  // End of the session
+  ZRPOS   = 9,  // Resume the data from a position
+  ZDATA   = 10, // Data subpackets follow, from a position
+  ZEOF    = 11, // End of file, with its size
+  ZFERR   = 12, // Fatal file error
+};
+
+/**
+ * @brief Results of ZmodemDecoder::feed().
+ */
+enum ZmodemToken : uint8_t
+{
+  ZMODEM_TOKEN_NONE,       // The byte was consumed, nothing complete yet
+  ZMODEM_TOKEN_HEADER,     // A header with a valid CRC, see type() and arg()
+  ZMODEM_TOKEN_DATA,       // A subpacket with a valid CRC, see dataSize() and dataEnd()
+  ZMODEM_TOKEN_BAD_HEADER, // A header with a wrong CRC or invalid bytes
+  ZMODEM_TOKEN_BAD_DATA,   // A subpacket with a wrong CRC, invalid bytes or too long, the decoder hunts for a header
+  ZMODEM_TOKEN_CANCEL,     // The peer sent the cancel sequence
+};
+
+/**
+ * @brief Cancel sequence sent by the sessions that abort.
+ */
+extern const uint8_t ZMODEM_CANCEL[ZMODEM_CANCEL_SIZE];
+
+/**
+ * @brief Writes the headers and subpackets of one side of a session.
+ *
+ * The four header bytes are given as a 32-bit value sent in little endian order: the
+ * position of ZRPOS, ZDATA, ZEOF and ZACK, or ZF3 ZF2 ZF1 ZF0 from the low byte up for the
+ * flags. The encoder remembers the last byte written, so the CR following an '@' is escaped
+ * as the lrzsz tools do.
+ */
+class ZmodemEncoder
+{
+public:
+  /**
+   * @brief Writes a hex header.
+   *
+   * @param out Destination, ZMODEM_HEX_HEADER_SIZE bytes are always enough.
+   * @param type Frame type.
+   * @param arg Header bytes.
+   * @return size_t Number of bytes written.
+   */
+  size_t hexHeader(uint8_t* out, uint8_t type, uint32_t arg);
+
+  /**
+   * @brief Writes a binary header.
+   *
+   * @param out Destination, ZMODEM_BINARY_HEADER_SIZE bytes are always enough.
+   * @param type Frame type.
+   * @param arg Header bytes.
+   * @param crc32 true for a ZBIN32 header, false for ZBIN.
+   * @return size_t Number of bytes written.
+   */
+  size_t binaryHeader(uint8_t* out, uint8_t type, uint32_t arg, bool crc32);
+
+  /**
+   * @brief Writes a data subpacket.
+   *
+   * Every byte of data is read before the bytes escaping it are written, so the subpacket may
+   * be built in place when data lies in the same buffer, at least size + 1 bytes after out.
+   *
+   * @param out Destination, 2 * size + 10 bytes are always enough.
+   * @param data File bytes of the subpacket.
+   * @param size Number of bytes.
+   * @param end ZCRCE, ZCRCG, ZCRCQ or ZCRCW.
+   * @param crc32 true after a ZBIN32 header, false after a ZBIN or ZHEX one.
+   * @return size_t Number of bytes written.
+   */
+  size_t subpacket(uint8_t* out, const uint8_t* data, size_t size, uint8_t end, bool crc32);
+
+private:
+  uint8_t last = 0; /**< Last byte written, for the CR after '@' rule. */
+
+  size_t put(uint8_t* out, uint8_t byte);
+};
+
+/**
+ * @brief Turns the received bytes into headers and subpackets.
+ *
+ * The decoder starts hunting for a header. After a ZFILE, ZSINIT or ZDATA header the session
+ * calls expectData() to collect the subpackets that follow, until one ends the frame with
+ * ZCRCE or ZCRCW, or an error sends the decoder back to hunting.
+ */
+class ZmodemDecoder
+{
+public:
+  /**
+   * @brief Drops anything in progress and hunts for the next header.
+   */
+  void hunt();
+
+  /**
+   * @brief Collects the subpackets following the last header.
+   *
+   * @param buffer Destination of the unescaped bytes, it must outlive the decoding.
+   * @param capacity Size of the buffer, a longer subpacket is reported as ZMODEM_TOKEN_BAD_DATA.
+   */
+  void expectData(uint8_t* buffer, size_t capacity);
+
+  /**
+   * @brief Decodes one received byte.
+   *
+   * @param byte Received byte.
+   * @return ZmodemToken What the byte completed.
+   */
+  ZmodemToken feed(uint8_t byte);
+
+  /**
+   * @brief Retrieves the type of the last header.
+   *
+   * @return uint8_t ZmodemFrameType.
+   */
+  uint8_t type() const;
+
+  /**
+   * @brief Retrieves the four bytes of the last header, in little endian order.
+   *
+   * @return uint32_t Position or flags.
+   */
+  uint32_t arg() const;
+
+  /**
+   * @brief Checks whether the last header, and so the subpackets following it, used a CRC-32.
+   *
+   * @return true for a ZBIN32 header, false otherwise.
+   */
+  bool crc32() const;
+
+  /**
+   * @brief Retrieves the number of bytes of the last subpacket in the buffer.
+   *
+   * @return size_t Number of bytes.
+   */
+  size_t dataSize() const;
+
+  /**
+   * @brief Retrieves the frame end of the last subpacket.
+   *
+   * @return uint8_t ZCRCE, ZCRCG, ZCRCQ or ZCRCW.
+   */
+  uint8_t dataEnd() const;
+
+  /**
+   * @brief Retrieves the smallest number of bytes that can complete the header or subpacket in progress.
+   *
+   * Escaped bytes only make the real count larger, so a transport can safely wait for it.
+   *
+   * @return size_t Number of bytes, at least 1.
+   */
+  size_t expectedBytes() const;
+
+private:
+  enum State : uint8_t
+  {
+    HUNT,     // Looking for the ZPAD of a header
+    PAD,      // ZPAD received, waiting for more of them or ZDLE
+    FORMAT,   // ZPAD ZDLE received, waiting for the header format
+    HEX,      // Collecting the hex digits of a header
+    BINARY,   // Collecting the escaped bytes of a binary header
+    DATA,     // Collecting the escaped bytes of a subpacket
+    DATA_CRC, // Collecting the CRC following the frame end
+  };
+
+  State    state      = HUNT;   /**< Current step of the decoding. */
+  bool     escaped    = false;  /**< True after a ZDLE inside a binary header or subpacket. */
+  bool     hexFormat  = false;  /**< True while the header being collected is a hex one. */
+  bool     headerCrc32 = false; /**< True if the header being collected uses a CRC-32. */
+  bool     dataCrc32  = false;  /**< True if the last header used a CRC-32. */
+  uint8_t  cancels    = 0;      /**< Consecutive CAN received. */
+  uint8_t  header[9];           /**< Type, four bytes and CRC of the header being collected. */
+  size_t   headerSize = 0;      /**< Bytes of header collected, hex digits for a hex header. */
+  uint8_t  lastType   = 0;      /**< Type of the last valid header. */
+  uint32_t lastArg    = 0;      /**< Bytes of the last valid header. */
+  uint8_t* buffer     = NULL;   /**< Destination of the subpacket bytes. */
+  size_t   capacity   = 0;      /**< Size of buffer. */
+  size_t   size       = 0;      /**< Bytes of the subpacket collected. */
+  uint8_t  end        = 0;      /**< Frame end of the subpacket. */
+  uint8_t  crc[4];              /**< CRC of the subpacket being collected. */
+  size_t   crcSize    = 0;      /**< Bytes of crc collected. */
+
+  ZmodemToken onHeaderByte(uint8_t byte);
+  ZmodemToken onDataByte(uint8_t byte);
+  ZmodemToken checkHeader();
+  ZmodemToken checkData();
+};
+
+#endif // ZMODEMFRAME_H
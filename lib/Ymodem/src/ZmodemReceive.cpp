@@ -0,0 +1,313 @@
+/**
+ * @file ZmodemReceive.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Zmodem receiver state machine
+ * @version 0.1
+ * @date 2025-06-02
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "ZmodemReceive.h"
+
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+
+ZmodemReceiver::ZmodemReceiver(YmodemReceiveSink& sink, uint32_t maxsize, uint8_t* frame) : YmodemSession(frame), sink(sink), maxsize(maxsize)
+{
+}
+
+uint8_t ZmodemReceiver::start(uint32_t now)
+{
+  bool ready  = reset();
+  state       = WAIT_FILE;
+  fileSize    = 0;
+  fileWritten = 0;
+  fileOpen    = false;
+  overCount   = 0;
+  errors      = 0;
+  decoder.hunt();
+  if (!ready) {
+    return finish(YMODEM_NO_MEMORY);
+  }
+
+  armTimer(now, NAK_TIMEOUT);
+  return sendInit();
+}
+
+size_t ZmodemReceiver::expectedBytes() const
+{
+  return (state == WAIT_OVER) ? 2 - overCount : decoder.expectedBytes();
+}
+
+void ZmodemReceiver::setResume(bool enable)
+{
+  resume = enable;
+}
+
+void ZmodemReceiver::setWindow(uint16_t bytes)
+{
+  window = bytes;
+}
+
+uint8_t ZmodemReceiver::onByte(uint8_t byte, uint32_t now)
+{
+  if (state == WAIT_OVER) {
+    if (byte == 'O' && ++overCount == 2) {
+      return finish(fileSize);
+    }
+    return YMODEM_EVENT_NONE;
+  }
+
+  // The idle timer restarts with every byte, except after a ZRPOS: the data the sender had
+  // already sent keeps arriving and would stop the request from being repeated
+  if (state != WAIT_DATA) {
+    armTimer(now, NAK_TIMEOUT);
+  }
+  ZmodemToken token = decoder.feed(byte);
+  if (token == ZMODEM_TOKEN_NONE) {
+    return YMODEM_EVENT_NONE;
+  }
+  return onToken(token, now);
+}
+
+uint8_t ZmodemReceiver::onTimeout(uint32_t now)
+{
+  armTimer(now, NAK_TIMEOUT);
+
+  switch (state) {
+    case WAIT_OVER:
+      return finish(fileSize); // The sender does not always say "OO"
+    case WAIT_DATA:
+    case RECEIVING:
+      return reposition(now);
+    default:
+      // The sender repeats its ZFILE when it sees ZRINIT again
+      state = WAIT_FILE;
+      decoder.hunt();
+      return retry(sendInit());
+  }
+}
+
+uint8_t ZmodemReceiver::abort(int result)
+{
+  queueFrame(0);
+  queueBytes(ZMODEM_CANCEL, ZMODEM_CANCEL_SIZE);
+  return finish(result);
+}
+
+uint8_t ZmodemReceiver::onToken(ZmodemToken token, uint32_t now)
+{
+  switch (token) {
+    case ZMODEM_TOKEN_CANCEL:
+      return finish(YMODEM_ABORTED_BY_SENDER);
+    case ZMODEM_TOKEN_HEADER:
+      return onHeader(now);
+    case ZMODEM_TOKEN_DATA:
+      if (dataType == ZDATA && state == RECEIVING) {
+        return onData();
+      }
+      if (dataType == ZFILE && state == WAIT_INFO) {
+        return onFileInfo();
+      }
+      if (dataType == ZFILE && state == WAIT_DATA) {
+        return sendHeader(ZRPOS, fileWritten); // The sender missed the ZRPOS and repeated its ZFILE
+      }
+      if (dataType == ZSINIT) {
+        return sendHeader(ZACK, 0);
+      }
+      return YMODEM_EVENT_NONE;
+    default:
+      break;
+  }
+
+  // Damaged header or subpacket
+  if (state == RECEIVING) {
+    return reposition(now);
+  }
+  if (state == WAIT_DATA) {
+    return YMODEM_EVENT_NONE; // Rest of the data sent before the ZRPOS
+  }
+  state = WAIT_FILE;
+  return retry(sendHeader(ZNAK, 0));
+}
+
+uint8_t ZmodemReceiver::onHeader(uint32_t now)
+{
+  uint32_t arg = decoder.arg();
+
+  switch (decoder.type()) {
+    case ZRQINIT:
+      if (state == WAIT_FILE) {
+        return sendInit();
+      }
+      return YMODEM_EVENT_NONE;
+    case ZSINIT:
+    case ZFILE:
+      if (state == RECEIVING) {
+        return YMODEM_EVENT_NONE;
+      }
+      dataType   = decoder.type();
+      conversion = arg >> 24;
+      // A ZFILE repeated because the ZRPOS was lost is answered with the same ZRPOS
+      if (dataType == ZFILE && state != WAIT_DATA) {
+        state = WAIT_INFO;
+      }
+      decoder.expectData(frame, ZMODEM_MAX_SUBPACKET);
+      return YMODEM_EVENT_NONE;
+    case ZDATA:
+      if (state != WAIT_DATA && state != RECEIVING) {
+        return YMODEM_EVENT_NONE;
+      }
+      if (arg != fileWritten) {
+        // Data sent before the ZRPOS is dropped, a jump while receiving is asked again
+        if (state == RECEIVING) {
+          return reposition(now);
+        }
+        return YMODEM_EVENT_NONE;
+      }
+      state    = RECEIVING;
+      dataType = ZDATA;
+      armTimer(now, NAK_TIMEOUT);
+      decoder.expectData(frame, ZMODEM_MAX_SUBPACKET);
+      return YMODEM_EVENT_NONE;
+    case ZEOF:
+      if ((state == RECEIVING || state == WAIT_DATA) && arg == fileWritten) {
+        return onEndOfFile();
+      }
+      // The sender missed the ZRINIT answering its ZEOF; one at the wrong place is ignored,
+      // it may have been sent before the ZRPOS was seen
+      if (state == WAIT_FILE) {
+        return sendInit();
+      }
+      return YMODEM_EVENT_NONE;
+    case ZFIN:
+      sendHeader(ZFIN, 0);
+      if (fileOpen) {
+        sink.close();
+        fileOpen = false;
+        return finish(YMODEM_ABORTED_BY_SENDER);
+      }
+      state     = WAIT_OVER;
+      overCount = 0;
+      armTimer(now, NAK_TIMEOUT);
+      return YMODEM_EVENT_OUTPUT;
+    case ZNAK:
+      if (state == WAIT_FILE) {
+        return sendInit();
+      }
+      return YMODEM_EVENT_NONE;
+    case ZABORT:
+    case ZFERR:
+      return abort(YMODEM_ABORTED_BY_SENDER);
+    default:
+      return YMODEM_EVENT_NONE;
+  }
+}
+
+uint8_t ZmodemReceiver::onFileInfo()
+{
+  // "name\0size mtime mode serial files left bytes left\0", only the name and the size are used
+  size_t length = decoder.dataSize();
+  frame[length] = '\0';
+
+  char name[FILE_NAME_LENGTH + 1];
+  strncpy(name, (const char*)frame, FILE_NAME_LENGTH);
+  name[FILE_NAME_LENGTH] = '\0';
+  size_t   nameLength    = strlen((const char*)frame);
+  uint32_t size          = (nameLength + 1 < length) ? strtoul((const char*)frame + nameLength + 1, NULL, 10) : 0;
+
+  if (name[0] == '\0') {
+    return abort(YMODEM_INVALID_HEADER);
+  }
+  if (size < 1 || size > maxsize) {
+    return abort((size < 1) ? YMODEM_SIZE_NULL : YMODEM_SIZE_OVERFLOW);
+  }
+  if (!sink.reserve(size)) {
+    return abort(YMODEM_NO_SPACE);
+  }
+
+  uint32_t offset  = 0;
+  bool     resumed = (resume || conversion == ZCRESUM) && sink.resume(name, size, &offset);
+  if (!resumed && !sink.open(name, size)) {
+    return abort(YMODEM_ERROR_WRITING);
+  }
+  fileOpen    = true;
+  fileSize    = size;
+  fileWritten = resumed ? std::min(offset, size) : 0;
+  errors      = 0;
+  fileDigest.begin(digestType);
+  verified = false;
+  counters.packets++;
+
+  // A file the sink already holds completely is skipped
+  if (fileWritten == fileSize) {
+    fileDigest.finish();
+    sink.close();
+    fileOpen = false;
+    state    = WAIT_FILE;
+    return YMODEM_EVENT_FILE | YMODEM_EVENT_FILE_DONE | sendHeader(ZSKIP, 0);
+  }
+
+  state = WAIT_DATA;
+  return YMODEM_EVENT_FILE | sendHeader(ZRPOS, fileWritten);
+}
+
+uint8_t ZmodemReceiver::onData()
+{
+  size_t length = std::min<size_t>(decoder.dataSize(), fileSize - fileWritten);
+  if (length > 0 && sink.write(frame, length) != (int)length) {
+    return abort(YMODEM_ERROR_WRITING);
+  }
+  fileDigest.update(frame, length);
+  fileWritten += length;
+  errors       = 0;
+  counters.packets++;
+  counters.bytes += length;
+
+  uint8_t end = decoder.dataEnd();
+  if (end == ZCRCQ || end == ZCRCW) {
+    return YMODEM_EVENT_BLOCK | sendHeader(ZACK, fileWritten);
+  }
+  return YMODEM_EVENT_BLOCK;
+}
+
+uint8_t ZmodemReceiver::onEndOfFile()
+{
+  fileDigest.finish();
+  sink.close();
+  fileOpen = false;
+  state    = WAIT_FILE;
+  errors   = 0;
+  decoder.hunt();
+  return YMODEM_EVENT_FILE_DONE | sendInit();
+}
+
+uint8_t ZmodemReceiver::sendHeader(uint8_t type, uint32_t arg)
+{
+  uint8_t header[ZMODEM_HEX_HEADER_SIZE];
+  return queueBytes(header, encoder.hexHeader(header, type, arg));
+}
+
+uint8_t ZmodemReceiver::sendInit()
+{
+  return sendHeader(ZRINIT, window | (uint32_t)(CANFDX | CANOVIO | CANFC32) << 24);
+}
+
+uint8_t ZmodemReceiver::reposition(uint32_t now)
+{
+  state = WAIT_DATA;
+  decoder.hunt();
+  armTimer(now, NAK_TIMEOUT);
+  return retry(sendHeader(ZRPOS, fileWritten));
+}
+
+uint8_t ZmodemReceiver::retry(uint8_t events)
+{
+  counters.retries++;
+  if (++errors > MAX_ERRORS) {
+    return abort(YMODEM_MAX_ERRORS);
+  }
+  return YMODEM_EVENT_RETRY | events;
+}
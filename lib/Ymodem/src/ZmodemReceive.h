@@ -0,0 +1,107 @@
+/**
+ * @file ZmodemReceive.h
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Zmodem receiver state machine
+ * @version 0.1
+ * @date 2025-06-02
+ *
+ * This file contains the receiver of the Zmodem protocol, a YmodemSession
+ * writing into the same sinks as the Ymodem receiver. The sender streams the
+ * file without waiting for acknowledgements; on a damaged subpacket the
+ * receiver asks it to go back to the first byte it is missing with ZRPOS,
+ * so an error costs the data in flight instead of the rest of the file.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef ZMODEMRECEIVE_H
+#define ZMODEMRECEIVE_H
+
+#include "YmodemSession.h"
+#include "ZmodemFrame.h"
+
+/**
+ * @brief Zmodem receiver, compatible with sz.
+ *
+ * The frame given to the session receives the unescaped subpackets, up to ZMODEM_MAX_SUBPACKET
+ * bytes. The result is the size of the last file, as for YmodemReceiver.
+ */
+class ZmodemReceiver : public YmodemSession
+{
+public:
+  /**
+   * @brief Constructor for the ZmodemReceiver class.
+   *
+   * @param sink Destination of the received data, it must outlive the receiver.
+   * @param maxsize Maximum size of the file to be received.
+   * @param frame Packet buffer of YMODEM_FRAME_SIZE bytes, NULL to allocate one, see YmodemSession().
+   */
+  ZmodemReceiver(YmodemReceiveSink& sink, uint32_t maxsize, uint8_t* frame = NULL);
+
+  uint8_t start(uint32_t now) override;
+  size_t  expectedBytes() const override;
+
+  /**
+   * @brief Continues the interrupted transfers of the files the sink already holds a part of.
+   *
+   * The sink is asked with YmodemReceiveSink::resume() for the bytes it kept, and the sender
+   * restarts after them. A sender asking for it in its ZFILE header gets it even when disabled.
+   * Call it before start().
+   *
+   * @param enable true to resume, false to always receive the whole file.
+   */
+  void setResume(bool enable);
+
+  /**
+   * @brief Sets the buffer size announced to the sender, 0 by default.
+   *
+   * With 0 the sender streams the whole file. Otherwise it waits for an acknowledgement every
+   * window bytes, for receivers whose writes can stall longer than their input buffer lasts.
+   * Call it before start().
+   *
+   * @param bytes Bytes the sender may send without an acknowledgement, 0 for no limit.
+   */
+  void setWindow(uint16_t bytes);
+
+protected:
+  uint8_t onByte(uint8_t byte, uint32_t now) override;
+  uint8_t onTimeout(uint32_t now) override;
+  uint8_t abort(int result) override;
+
+private:
+  enum State : uint8_t
+  {
+    WAIT_FILE, // ZRINIT sent, waiting for a ZFILE or the ZFIN that ends the batch
+    WAIT_INFO, // ZFILE received, waiting for its subpacket
+    WAIT_DATA, // ZRPOS sent, waiting for the ZDATA header at the position asked for
+    RECEIVING, // Collecting the data subpackets
+    WAIT_OVER, // ZFIN answered, waiting for the "OO" of the sender
+  };
+
+  YmodemReceiveSink& sink;                    /**< Destination of the received data. */
+  uint32_t           maxsize;                 /**< Maximum size of the file to be received. */
+  ZmodemEncoder      encoder;                 /**< Headers sent to the sender. */
+  ZmodemDecoder      decoder;                 /**< Headers and subpackets of the sender. */
+  State              state       = WAIT_FILE; /**< Current step of the session. */
+  bool               resume      = false;     /**< True to continue interrupted transfers. */
+  uint16_t           window      = 0;         /**< Buffer size announced in ZRINIT. */
+  uint8_t            dataType    = 0;         /**< Header introducing the subpackets being received. */
+  uint8_t            conversion  = 0;         /**< ZF0 of the last ZFILE header. */
+  uint32_t           fileSize    = 0;         /**< Size announced in the file header. */
+  uint32_t           fileWritten = 0;         /**< Bytes of the file handed to the sink, the position asked for. */
+  bool               fileOpen    = false;     /**< True while the sink holds an open file. */
+  uint8_t            overCount   = 0;         /**< 'O' of the final "OO" received. */
+  uint32_t           errors      = 0;         /**< Errors since the last progress. */
+
+  uint8_t onToken(ZmodemToken token, uint32_t now);
+  uint8_t onHeader(uint32_t now);
+  uint8_t onFileInfo();
+  uint8_t onData();
+  uint8_t onEndOfFile();
+  uint8_t sendHeader(uint8_t type, uint32_t arg);
+  uint8_t sendInit();
+  uint8_t reposition(uint32_t now);
+  uint8_t retry(uint8_t events);
+};
+
+#endif // ZMODEMRECEIVE_H
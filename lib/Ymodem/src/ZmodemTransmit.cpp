@@ -0,0 +1,275 @@
+/**
+ * @file ZmodemTransmit.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Zmodem sender state machine
+ * @version 0.1
+ * @date 2025-06-02
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "ZmodemTransmit.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+ZmodemSender::ZmodemSender(YmodemTransmitSource& source, const char* fileName, uint32_t fileSize, uint8_t* frame)
+    : YmodemSession(frame), source(source), fileName(fileName), fileSize(fileSize)
+{
+}
+
+uint8_t ZmodemSender::start(uint32_t now)
+{
+  bool ready  = reset();
+  state       = WAIT_INIT;
+  crc32       = false;
+  window      = 0;
+  offset      = 0;
+  acked       = 0;
+  digested    = 0;
+  lastRestart = 0;
+  needHeader  = false;
+  errors      = 0;
+  decoder.hunt();
+  if (!ready) {
+    return finish(YMODEM_NO_MEMORY);
+  }
+  return sendInit(now);
+}
+
+size_t ZmodemSender::expectedBytes() const
+{
+  // While streaming the line is read without waiting, a whole ZRPOS is taken at once
+  return (state == STREAMING) ? ZMODEM_HEX_HEADER_SIZE : decoder.expectedBytes();
+}
+
+bool ZmodemSender::streaming() const
+{
+  return state == STREAMING;
+}
+
+void ZmodemSender::setResume(bool enable)
+{
+  resume = enable;
+}
+
+uint8_t ZmodemSender::onByte(uint8_t byte, uint32_t now)
+{
+  switch (decoder.feed(byte)) {
+    case ZMODEM_TOKEN_HEADER:
+      return onHeader(now);
+    case ZMODEM_TOKEN_CANCEL:
+      return finish(YMODEM_ABORTED_BY_SENDER);
+    default:
+      return YMODEM_EVENT_NONE; // A damaged header is repeated by the receiver
+  }
+}
+
+uint8_t ZmodemSender::onTimeout(uint32_t now)
+{
+  // The file is complete once its ZEOF has been answered, a missing ZFIN is not an error
+  if (state == WAIT_FIN) {
+    return finish(YMODEM_TRANSMIT_OK);
+  }
+  if (++errors > MAX_ERRORS) {
+    return abort(YMODEM_TIMEOUT);
+  }
+  if (state != WAIT_INIT) {
+    counters.retries++;
+  }
+  return YMODEM_EVENT_RETRY | resend(now);
+}
+
+uint8_t ZmodemSender::onStream(uint32_t now)
+{
+  if (state != STREAMING) {
+    return YMODEM_EVENT_NONE;
+  }
+
+  size_t len = 0;
+  if (needHeader) {
+    len        = encoder.binaryHeader(frame, ZDATA, offset, crc32);
+    needHeader = false;
+  }
+
+  // The file bytes are read at the end of the frame and escaped towards its start
+  size_t   block = std::min<size_t>(fileSize - offset, ZMODEM_SUBPACKET_SIZE);
+  uint8_t* raw   = frame + YMODEM_FRAME_SIZE - block;
+  if (block > 0 && source.read(raw, block, offset) != (int)block) {
+    return abort(YMODEM_READ_ERROR);
+  }
+
+  // Bytes sent again after a ZRPOS are already in the digest
+  uint32_t next = offset + block;
+  if (digested >= offset && digested < next) {
+    fileDigest.update(raw + (digested - offset), next - digested);
+    counters.bytes += next - digested;
+    digested        = next;
+  }
+
+  uint8_t end = ZCRCG;
+  if (next == fileSize) {
+    end = ZCRCE;
+  }
+  else if (window > 0 && next - acked + ZMODEM_SUBPACKET_SIZE > window) {
+    end = ZCRCW;
+  }
+  len    += encoder.subpacket(frame + len, raw, block, end, crc32);
+  offset  = next;
+  counters.packets++;
+
+  if (end == ZCRCE) {
+    fileDigest.finish();
+    len   += encoder.binaryHeader(frame + len, ZEOF, fileSize, crc32);
+    state  = WAIT_EOF;
+    armTimer(now, WAIT_TIMEOUT * NAK_TIMEOUT);
+  }
+  else if (end == ZCRCW) {
+    state      = WAIT_ACK;
+    needHeader = true;
+    armTimer(now, WAIT_TIMEOUT * NAK_TIMEOUT);
+  }
+  return YMODEM_EVENT_BLOCK | queueFrame(len);
+}
+
+uint8_t ZmodemSender::abort(int result)
+{
+  queueFrame(0);
+  queueBytes(ZMODEM_CANCEL, ZMODEM_CANCEL_SIZE);
+  return finish(result);
+}
+
+uint8_t ZmodemSender::onHeader(uint32_t now)
+{
+  uint32_t arg = decoder.arg();
+
+  switch (decoder.type()) {
+    case ZRINIT:
+      // The ZRINIT answering the ZRQINIT crosses the ZFILE, the receiver that missed it asks on its own
+      if (state == WAIT_INIT) {
+        crc32  = ((arg >> 24) & CANFC32) != 0;
+        window = arg & 0xffff;
+        return sendFile(now);
+      }
+      if (state == WAIT_EOF) {
+        return YMODEM_EVENT_FILE_DONE | sendFinish(now);
+      }
+      if (state == WAIT_FIN) {
+        return sendFinish(now);
+      }
+      return YMODEM_EVENT_NONE;
+    case ZRPOS:
+      if (state == WAIT_INIT || state == WAIT_FIN) {
+        return YMODEM_EVENT_NONE;
+      }
+      if (arg > fileSize) {
+        return abort(YMODEM_SEQ_ERROR);
+      }
+      return restart(arg, now);
+    case ZACK:
+      if (state == WAIT_ACK && arg == offset) {
+        acked  = offset;
+        errors = 0;
+        state  = STREAMING;
+      }
+      return YMODEM_EVENT_NONE;
+    case ZSKIP:
+      return (state == WAIT_INIT || state == WAIT_FIN) ? YMODEM_EVENT_NONE : YMODEM_EVENT_FILE_DONE | sendFinish(now);
+    case ZFIN:
+      if (state != WAIT_FIN) {
+        return YMODEM_EVENT_NONE;
+      }
+      queueBytes((const uint8_t*)"OO", 2);
+      return finish(YMODEM_TRANSMIT_OK);
+    case ZNAK:
+      return resend(now);
+    case ZABORT:
+    case ZFERR:
+      return abort(YMODEM_ABORTED_BY_SENDER);
+    default:
+      return YMODEM_EVENT_NONE;
+  }
+}
+
+uint8_t ZmodemSender::sendInit(uint32_t now)
+{
+  // The "rz" starts the receiver when the other end of the line is a shell
+  queueBytes((const uint8_t*)"rz\r", 3);
+  return sendHeader(ZRQINIT, 0, now);
+}
+
+uint8_t ZmodemSender::sendFile(uint32_t now)
+{
+  // "name\0size mtime mode serial files left bytes left\0", without a date nor a mode
+  char info[FILE_NAME_LENGTH + 48];
+  int  nameLength = snprintf(info, FILE_NAME_LENGTH + 1, "%s", fileName);
+  nameLength      = std::min(nameLength, FILE_NAME_LENGTH);
+  int length      = nameLength + 1;
+  length         += snprintf(info + length, sizeof(info) - length, "%lu 0 0 0 1 %lu", (unsigned long)fileSize, (unsigned long)fileSize) + 1;
+
+  state = WAIT_POSITION;
+  sendHeader(ZFILE, (uint32_t)(resume ? ZCRESUM : ZCBIN) << 24, now);
+  return queueFrame(encoder.subpacket(frame, (const uint8_t*)info, length, ZCRCW, crc32));
+}
+
+uint8_t ZmodemSender::sendFinish(uint32_t now)
+{
+  state = WAIT_FIN;
+  return sendHeader(ZFIN, 0, now);
+}
+
+uint8_t ZmodemSender::restart(uint32_t position, uint32_t now)
+{
+  uint8_t events = YMODEM_EVENT_NONE;
+
+  if (state == WAIT_POSITION) {
+    // Starting position of the file, past the part the receiver kept when it resumes
+    digested = position;
+    errors   = 0;
+    counters.packets++;
+    events = YMODEM_EVENT_FILE;
+  }
+  else {
+    errors = (position > lastRestart) ? 0 : errors;
+    counters.retries++;
+    if (++errors > MAX_ERRORS) {
+      return abort(YMODEM_MAX_ERRORS);
+    }
+    events = YMODEM_EVENT_RETRY;
+  }
+
+  lastRestart = position;
+  offset      = position;
+  acked       = position;
+  needHeader  = true;
+  state       = STREAMING;
+  armTimer(now, WAIT_TIMEOUT * NAK_TIMEOUT);
+  return events;
+}
+
+uint8_t ZmodemSender::resend(uint32_t now)
+{
+  switch (state) {
+    case WAIT_INIT:
+      return sendInit(now);
+    case WAIT_POSITION:
+      return sendFile(now);
+    case WAIT_ACK:
+      return restart(acked, now);
+    case WAIT_EOF:
+      return sendHeader(ZEOF, fileSize, now);
+    case WAIT_FIN:
+      return sendFinish(now);
+    default:
+      return YMODEM_EVENT_NONE;
+  }
+}
+
+uint8_t ZmodemSender::sendHeader(uint8_t type, uint32_t arg, uint32_t now)
+{
+  // The session starts and ends with hex headers, as sz does
+  uint8_t header[ZMODEM_BINARY_HEADER_SIZE];
+  size_t  len = (type == ZRQINIT || type == ZFIN) ? encoder.hexHeader(header, type, arg) : encoder.binaryHeader(header, type, arg, crc32);
+  armTimer(now, (state == WAIT_INIT) ? NAK_TIMEOUT : WAIT_TIMEOUT * NAK_TIMEOUT);
+  return queueBytes(header, len);
+}
@@ -0,0 +1,98 @@
+/**
+ * @file ZmodemTransmit.h
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Zmodem sender state machine
+ * @version 0.1
+ * @date 2025-06-02
+ *
+ * This file contains the sender of the Zmodem protocol, a YmodemSession
+ * reading from the same sources as the Ymodem sender. Once the receiver has
+ * given the starting position, the file is streamed in subpackets without
+ * waiting for acknowledgements, and a ZRPOS from the receiver makes the
+ * sender go back to the position it asks for.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef ZMODEMTRANSMIT_H
+#define ZMODEMTRANSMIT_H
+
+#include "YmodemSession.h"
+#include "ZmodemFrame.h"
+
+/**
+ * @brief Zmodem sender, compatible with rz.
+ *
+ * The frame given to the session holds the escaped headers and subpackets being sent. While
+ * the data streams, streaming() is true and every poll() with an empty output() produces the
+ * next subpacket, so the driver must keep polling instead of waiting for the receiver.
+ */
+class ZmodemSender : public YmodemSession
+{
+public:
+  /**
+   * @brief Constructor for the ZmodemSender class.
+   *
+   * @param source Origin of the file data, it must outlive the sender.
+   * @param fileName Name announced in the file header, it must outlive the sender.
+   * @param fileSize Size of the file in bytes.
+   * @param frame Packet buffer of YMODEM_FRAME_SIZE bytes, NULL to allocate one, see YmodemSession().
+   */
+  ZmodemSender(YmodemTransmitSource& source, const char* fileName, uint32_t fileSize, uint8_t* frame = NULL);
+
+  uint8_t start(uint32_t now) override;
+  size_t  expectedBytes() const override;
+  bool    streaming() const override;
+
+  /**
+   * @brief Asks the receiver to continue an interrupted transfer of the file, with ZCRESUM.
+   *
+   * Call it before start().
+   *
+   * @param enable true to ask for it, false for a plain binary transfer.
+   */
+  void setResume(bool enable);
+
+protected:
+  uint8_t onByte(uint8_t byte, uint32_t now) override;
+  uint8_t onTimeout(uint32_t now) override;
+  uint8_t onStream(uint32_t now) override;
+  uint8_t abort(int result) override;
+
+private:
+  enum State : uint8_t
+  {
+    WAIT_INIT,     // ZRQINIT sent, waiting for the ZRINIT of the receiver
+    WAIT_POSITION, // ZFILE sent, waiting for the ZRPOS giving the starting position
+    STREAMING,     // Sending the data subpackets
+    WAIT_ACK,      // Subpacket ending with ZCRCW sent at the end of the receiver window, waiting for ZACK
+    WAIT_EOF,      // ZEOF sent, waiting for the ZRINIT of the next file
+    WAIT_FIN,      // ZFIN sent, waiting for the ZFIN of the receiver
+  };
+
+  YmodemTransmitSource& source;                  /**< Origin of the file data. */
+  const char*           fileName;                /**< Name announced in the file header. */
+  uint32_t              fileSize;                /**< Size of the file in bytes. */
+  ZmodemEncoder         encoder;                 /**< Headers and subpackets sent to the receiver. */
+  ZmodemDecoder         decoder;                 /**< Headers of the receiver. */
+  State                 state       = WAIT_INIT; /**< Current step of the session. */
+  bool                  resume      = false;     /**< True to send ZCRESUM in the ZFILE header. */
+  bool                  crc32       = false;     /**< True once the receiver has announced CANFC32. */
+  uint16_t              window      = 0;         /**< Receiver buffer size, 0 to stream the whole file. */
+  uint32_t              offset      = 0;         /**< Position of the next subpacket. */
+  uint32_t              acked       = 0;         /**< Position the receiver has confirmed. */
+  uint32_t              digested    = 0;         /**< Bytes of the file added to the digest. */
+  uint32_t              lastRestart = 0;         /**< Position of the last ZRPOS. */
+  bool                  needHeader  = false;     /**< True if the next subpacket starts a new ZDATA frame. */
+  uint32_t              errors      = 0;         /**< Errors since the last progress. */
+
+  uint8_t onHeader(uint32_t now);
+  uint8_t sendInit(uint32_t now);
+  uint8_t sendFile(uint32_t now);
+  uint8_t sendFinish(uint32_t now);
+  uint8_t restart(uint32_t position, uint32_t now);
+  uint8_t resend(uint32_t now);
+  uint8_t sendHeader(uint8_t type, uint32_t arg, uint32_t now);
+};
+
+#endif // ZMODEMTRANSMIT_H
@@ -0,0 +1,43 @@
+#include "fileAppender.h"
+
+#define BENCHMARK_RECORDS (500) /*!< Records appended in each run */
+#define BENCHMARK_RECORD (40)   /*!< Size of a record, the size of a Mica measure */
+
+void setup()
+{
+  Serial.begin(115200);
+  vTaskDelay(pdMS_TO_TICKS(1000));
+
+  FileSystem fs;
+  uint8_t    record[BENCHMARK_RECORD] = {0};
+
+  // One open, write, flush and close per record
+  fs.deleteFile("/bench.bin");
+  uint32_t start = micros();
+  for (int i = 0; i < BENCHMARK_RECORDS; i++) {
+    fs.writeToFile("/bench.bin", record, sizeof(record));
+  }
+  uint32_t elapsed = micros() - start;
+  log_i("writeToFile: %u records/s, %u writes", (uint32_t)(BENCHMARK_RECORDS * 1000000ULL / elapsed), BENCHMARK_RECORDS);
+
+  // Records coalesced in block sized writes
+  fs.deleteFile("/bench.bin");
+  start = micros();
+  {
+    FileAppender appender(fs, "/bench.bin");
+    for (int i = 0; i < BENCHMARK_RECORDS; i++) {
+      appender.append(record, sizeof(record));
+    }
+    appender.sync();
+    elapsed = micros() - start;
+    log_i("FileAppender: %u records/s, %u writes", (uint32_t)(BENCHMARK_RECORDS * 1000000ULL / elapsed), appender.writes());
+  }
+
+  log_i("File size: %u bytes", fs.getFileSize("/bench.bin"));
+  fs.deleteFile("/bench.bin");
+}
+
+void loop()
+{
+  vTaskDelete(NULL);
+}
@@ -0,0 +1,51 @@
+#include "fileSystem.h"
+
+#define BENCHMARK_RECORDS (200) /*!< Appends measured in each run */
+#define BENCHMARK_RECORD (40)   /*!< Size of a record, the size of a Mica measure */
+
+/**
+ * @brief Appends records to a file and measures the time of each append.
+ *
+ * @param fs File system used for the appends.
+ * @param label Name of the run shown in the log.
+ */
+void runAppendBenchmark(FileSystem& fs, const char* label)
+{
+  uint8_t  record[BENCHMARK_RECORD] = {0};
+  uint32_t worst                    = 0;
+  uint32_t start                    = micros();
+
+  fs.deleteFile("/bench.bin");
+  for (int i = 0; i < BENCHMARK_RECORDS; i++) {
+    uint32_t t0 = micros();
+    fs.writeToFile("/bench.bin", record, sizeof(record));
+    fs.getFileSize("/bench.bin");
+    uint32_t elapsed = micros() - t0;
+    worst            = (elapsed > worst) ? elapsed : worst;
+  }
+  uint32_t total = micros() - start;
+
+  log_i("%s: %u appends, mean %u us, worst %u us", label, BENCHMARK_RECORDS, total / BENCHMARK_RECORDS, worst);
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  vTaskDelay(pdMS_TO_TICKS(1000));
+
+  FileSystem fs;
+
+  // Previous behaviour: LittleFS.usedBytes() on every append and one open per size query
+  FileSystem::setMetadataCache(false);
+  runAppendBenchmark(fs, "Without cache");
+
+  FileSystem::setMetadataCache(true);
+  runAppendBenchmark(fs, "With cache");
+
+  fs.deleteFile("/bench.bin");
+}
+
+void loop()
+{
+  vTaskDelete(NULL);
+}
@@ -1,6 +1,6 @@
 #include "HTTPClient.h"
 #include "WiFi.h"
-#include "filesystem.h"
+#include "fileSystem.h"
 
 const char* ssid     = "inBiot_devices";                // your network SSID (name)
 const char* password = "inBiot_IAQ";                    // your network password
@@ -34,30 +34,26 @@ void saveLSM1X0AfwAWS(const char* moduleType)
   sprintf(request, "http://%s/%s%s", host, moduleType, binaryFile.c_str());
   HTTP.begin(request);
   HTTP.GET();
-  WiFiClient client  = HTTP.getStream();
-  int        totlen  = HTTP.getSize();
-  int        currlen = 0;
-  FileSystem SPIFFS;
+  WiFiClient& client = HTTP.getStream();
+  int         totlen = HTTP.getSize();
+  FileSystem  SPIFFS;
   SPIFFS.deleteAllFiles();
-  while (currlen < totlen) {
-    int len = client.available();
-    if (len > 0) {
-      char buf[1024];
-      int  read = client.readBytes(buf, sizeof(buf));
-      currlen += read;
-      if (SPIFFS.writeToFile(binaryFile.c_str(), buf, read) != LITTLEFS_OK) {
-        Serial.print("[LORA] ");
-        Serial.println("Error writing to SPIFFS");
-        return;
-      }
-      Serial.printf("Downloading %s: %d%%\r", binaryFile.c_str(), (currlen * 100) / totlen);
-      Serial.printf("\r");
-    }
-    if (currlen >= totlen) {
-      log_i("Download complete: %s\n", binaryFile.c_str());
-      break;
+
+  StreamIngest::Progress progress = [&binaryFile](size_t written, size_t total) {
+    if (total > 0) {
+      Serial.printf("Downloading %s: %d%%\r", binaryFile.c_str(), (int)((written * 100) / total));
     }
+  };
+
+  // The next block is read from the network while the previous one is written to the flash
+  IngestStats        stats;
+  error_code_littefs err = SPIFFS.ingest(binaryFile.c_str(), client, totlen > 0 ? totlen : 0, progress, &stats);
+  if (err != LITTLEFS_OK) {
+    Serial.print("[LORA] ");
+    Serial.println("Error writing to SPIFFS");
+    return;
   }
+  log_i("Download complete: %s, %u bytes/s, %u stalls\n", binaryFile.c_str(), (uint32_t)(stats.bytes * 1000ULL / (stats.elapsedMs + 1)), stats.stalls);
   Serial.printf("File size: %d bytes\n", SPIFFS.getFileSize(binaryFile.c_str()));
   Serial.printf("File system free space: %d bytes\n", SPIFFS.getRemainingSpace());
   SPIFFS.printStoredFiles(); // Print all files in the file system
@@ -0,0 +1,70 @@
+#include "littleFSSegmentStorage.h"
+
+#define BENCHMARK_RECORDS (2000)  /*!< Records appended in each run */
+#define BENCHMARK_QUERY (100)     /*!< Records read by the time range query */
+#define RECORD_SEGMENTS (8)       /*!< Segments in the ring */
+#define RECORDS_PER_SEGMENT (512) /*!< Records in a segment, 20 KB each */
+
+struct Measure
+{
+  time_t  MeasureTime;
+  uint8_t payload[40 - sizeof(time_t)];
+};
+
+void setup()
+{
+  Serial.begin(115200);
+  vTaskDelay(pdMS_TO_TICKS(1000));
+
+  FileSystem fs;
+  Measure    measure = {};
+  Measure    range[BENCHMARK_QUERY];
+
+  // Flat file, one writeToFile per record and one readFromFile per record to find the range
+  fs.deleteFile("/bench.bin");
+  uint32_t start = micros();
+  for (int i = 0; i < BENCHMARK_RECORDS; i++) {
+    measure.MeasureTime = i;
+    fs.writeToFile("/bench.bin", (const uint8_t*)&measure, sizeof(measure));
+  }
+  uint32_t elapsed = micros() - start;
+  log_i("writeToFile: %u records/s", (uint32_t)(BENCHMARK_RECORDS * 1000000ULL / elapsed));
+
+  start        = micros();
+  size_t index = 0;
+  while (fs.readFromFile("/bench.bin", (uint8_t*)&measure, sizeof(measure), index * sizeof(measure)) == LITTLEFS_OK &&
+         measure.MeasureTime < BENCHMARK_RECORDS / 2) {
+    index++;
+  }
+  for (int i = 0; i < BENCHMARK_QUERY; i++) {
+    fs.readFromFile("/bench.bin", (uint8_t*)&range[i], sizeof(measure), (index + i) * sizeof(measure));
+  }
+  log_i("readFromFile scan: %u us for %u records", micros() - start, BENCHMARK_QUERY);
+  fs.deleteFile("/bench.bin");
+
+  // Ring store, buffered appends, binary search and one read per segment
+  LittleFSSegmentStorage storage(fs, "/bench");
+  RecordStore            store(storage, sizeof(Measure), RECORD_SEGMENTS, RECORDS_PER_SEGMENT);
+  store.begin();
+  store.clear();
+  start = micros();
+  for (int i = 0; i < BENCHMARK_RECORDS; i++) {
+    measure.MeasureTime = i;
+    store.append(&measure);
+  }
+  store.sync();
+  elapsed = micros() - start;
+  log_i("RecordStore: %u records/s", (uint32_t)(BENCHMARK_RECORDS * 1000000ULL / elapsed));
+
+  start = micros();
+  index = store.lowerBound(BENCHMARK_RECORDS / 2);
+  store.read(index, BENCHMARK_QUERY, range);
+  log_i("RecordStore query: %u us for %u records", micros() - start, BENCHMARK_QUERY);
+
+  store.clear();
+}
+
+void loop()
+{
+  vTaskDelete(NULL);
+}
@@ -0,0 +1,141 @@
+/**
+ * @file fileAppender.cpp
+ * @author Miguel Ferrer "@MiguelFerrerF"
+ * @brief Implementation of the FileAppender class
+ * @version 0.1
+ * @date 2025-05-26
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "fileAppender.h"
+
+#include <algorithm>
+#include <new>
+
+FileAppender::FileAppender(FileSystem& fs, const char* filename, size_t bufferSize) : fs(fs), filename(filename), capacity(bufferSize)
+{
+  file = LittleFS.open(filename, FILE_APPEND);
+  if (!file) {
+    log_e("Failed to open file for appending");
+    return;
+  }
+  buffer = new (std::nothrow) uint8_t[capacity];
+  if (buffer == NULL) {
+    log_e("Failed to allocate the append buffer");
+    file.close();
+    return;
+  }
+
+  // The first write completes the last block of the file, the next ones are block aligned
+  written = file.size();
+  limit   = capacity - (written % capacity);
+}
+
+FileAppender::~FileAppender()
+{
+  close();
+  delete[] buffer;
+}
+
+bool FileAppender::isOpen() const
+{
+  return buffer != NULL && file;
+}
+
+error_code_littefs FileAppender::append(const void* data, size_t size)
+{
+  if (!isOpen()) {
+    return ERROR_OPENNING_FILE;
+  }
+  if (pending + size + FILESYSTEM_SPACE_MARGIN > fs.getRemainingSpace()) {
+    log_e("Not enough space to write data");
+    return ERROR_NO_ENOUGH_SPACE;
+  }
+
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  while (size > 0) {
+    // Nothing buffered and enough data to reach the boundary: write straight from the caller memory
+    if (pending == 0 && size >= limit) {
+      size_t chunk = limit;
+      if (writeFile(bytes, chunk) != LITTLEFS_OK) {
+        return ERROR_WRITING_FILE;
+      }
+      bytes += chunk;
+      size -= chunk;
+      limit = capacity;
+      continue;
+    }
+
+    size_t chunk = std::min(size, limit - pending);
+    memcpy(buffer + pending, bytes, chunk);
+    pending += chunk;
+    bytes += chunk;
+    size -= chunk;
+    if (pending == limit && writeBuffer() != LITTLEFS_OK) {
+      return ERROR_WRITING_FILE;
+    }
+  }
+  return LITTLEFS_OK;
+}
+
+error_code_littefs FileAppender::sync()
+{
+  if (!isOpen()) {
+    return ERROR_OPENNING_FILE;
+  }
+  error_code_littefs err = writeBuffer();
+  file.flush(); // Commit the file metadata
+  return err;
+}
+
+error_code_littefs FileAppender::close()
+{
+  if (!isOpen()) {
+    return LITTLEFS_OK;
+  }
+  error_code_littefs err = sync();
+  file.close();
+  return err;
+}
+
+size_t FileAppender::size() const
+{
+  return written + pending;
+}
+
+uint32_t FileAppender::writes() const
+{
+  return programs;
+}
+
+error_code_littefs FileAppender::writeFile(const uint8_t* data, size_t size)
+{
+  if (file.write(data, size) != size) {
+    log_e("Failed to write data to file");
+    FileSystem::invalidateCache();
+    return ERROR_WRITING_FILE;
+  }
+  FileSystem::recordAppend(filename.c_str(), written, size);
+  written += size;
+  programs++;
+  return LITTLEFS_OK;
+}
+
+error_code_littefs FileAppender::writeBuffer()
+{
+  if (pending == 0) {
+    return LITTLEFS_OK;
+  }
+  if (writeFile(buffer, pending) != LITTLEFS_OK) {
+    return ERROR_WRITING_FILE;
+  }
+
+  // A partial buffer written by sync() leaves the file short of the boundary
+  limit -= pending;
+  if (limit == 0) {
+    limit = capacity;
+  }
+  pending = 0;
+  return LITTLEFS_OK;
+}
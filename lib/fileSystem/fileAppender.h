@@ -0,0 +1,117 @@
+/**
+ * @file fileAppender.h
+ * @author Miguel Ferrer "@MiguelFerrerF"
+ * @brief Buffered append writer for LittleFS files
+ * @version 0.1
+ * @date 2025-05-26
+ *
+ * This class keeps a file open in append mode and coalesces small appends in a RAM
+ * buffer, so that LittleFS receives block sized, block aligned writes instead of one
+ * open, write, flush and close per record.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef FILEAPPENDER_H
+#define FILEAPPENDER_H
+
+#include <string>
+
+#include "fileMetadataCache.h"
+#include "fileSystem.h"
+
+/**
+ * @brief  Buffered append writer
+ *
+ * @details The appended data is copied once into the buffer, appends larger than the
+ * buffer are written straight from the caller memory. The buffer is written to the file
+ * when it reaches the next block boundary of the file, on sync() and on destruction.
+ * Only sync() commits the file metadata, data appended after the last sync() may be
+ * lost on a power failure.
+ *
+ */
+class FileAppender
+{
+public:
+  /**
+   * @brief Constructor for the FileAppender class.
+   *
+   * Opens the file in append mode and allocates the buffer. Use isOpen() to check the result.
+   *
+   * @param fs File system the file belongs to, used to check the free space.
+   * @param filename The path of the file, it is created if it does not exist.
+   * @param bufferSize Size of the buffer, a multiple of the flash page size. The block size by default.
+   */
+  FileAppender(FileSystem& fs, const char* filename, size_t bufferSize = FILESYSTEM_BLOCK_SIZE);
+
+  /**
+   * @brief Destructor for the FileAppender class, the pending data is synced and the file closed.
+   */
+  ~FileAppender();
+
+  FileAppender(const FileAppender&)            = delete;
+  FileAppender& operator=(const FileAppender&) = delete;
+
+  /**
+   * @brief Checks whether the file is open and the buffer allocated.
+   *
+   * @return true if appends can be done, false otherwise.
+   */
+  bool isOpen() const;
+
+  /**
+   * @brief Appends data to the file.
+   *
+   * @param data A pointer to the data to append.
+   * @param size The number of bytes to append.
+   * @return error_code_littefs Returns LITTLEFS_OK on success, or an appropriate error code on failure:
+   *         - ERROR_OPENNING_FILE: The file is not open.
+   *         - ERROR_NO_ENOUGH_SPACE: Not enough space to write the data.
+   *         - ERROR_WRITING_FILE: Failed to write the buffer to the file.
+   */
+  error_code_littefs append(const void* data, size_t size);
+
+  /**
+   * @brief Writes the buffered data and commits the file.
+   *
+   * @return error_code_littefs Returns LITTLEFS_OK on success, ERROR_WRITING_FILE otherwise.
+   */
+  error_code_littefs sync();
+
+  /**
+   * @brief Syncs and closes the file, further appends fail.
+   *
+   * @return error_code_littefs Result of the final sync().
+   */
+  error_code_littefs close();
+
+  /**
+   * @brief Retrieves the size of the file, including the buffered data.
+   *
+   * @return size_t The size of the file in bytes.
+   */
+  size_t size() const;
+
+  /**
+   * @brief Retrieves the number of writes issued to LittleFS.
+   *
+   * @return uint32_t Write calls since the file was opened.
+   */
+  uint32_t writes() const;
+
+private:
+  FileSystem& fs;              /**< File system the file belongs to. */
+  std::string filename;        /**< Path of the file. */
+  File        file;            /**< File opened in append mode. */
+  uint8_t*    buffer   = NULL; /**< Pending data. */
+  size_t      capacity = 0;    /**< Size of the buffer. */
+  size_t      pending  = 0;    /**< Bytes waiting in the buffer. */
+  size_t      limit    = 0;    /**< Bytes that take the file to the next block boundary. */
+  size_t      written  = 0;    /**< Bytes already handed to LittleFS. */
+  uint32_t    programs = 0;    /**< Write calls issued to LittleFS. */
+
+  error_code_littefs writeFile(const uint8_t* data, size_t size);
+  error_code_littefs writeBuffer();
+};
+
+#endif // FILEAPPENDER_H
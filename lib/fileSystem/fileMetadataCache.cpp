@@ -0,0 +1,120 @@
+/**
+ * @file fileMetadataCache.cpp
+ * @author Miguel Ferrer "@MiguelFerrerF"
+ * @brief Implementation of the FileMetadataCache class
+ * @version 0.1
+ * @date 2025-05-26
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "fileMetadataCache.h"
+
+#include <algorithm>
+
+FileMetadataCache::FileMetadataCache(size_t blockSize) : blockSize(blockSize)
+{
+}
+
+bool FileMetadataCache::needsRefresh() const
+{
+  return !usedValid || appends >= FILESYSTEM_CACHE_REFRESH_WRITES || freeSpace() < FILESYSTEM_CACHE_REFRESH_MARGIN;
+}
+
+void FileMetadataCache::refresh(size_t used, size_t total)
+{
+  usedBytes  = used;
+  totalBytes = total;
+  usedValid  = true;
+  appends    = 0;
+}
+
+size_t FileMetadataCache::remainingSpace() const
+{
+  size_t free = freeSpace();
+  return (free > reservedBytes) ? free - reservedBytes : 0;
+}
+
+bool FileMetadataCache::reserve(size_t size)
+{
+  if (blocks(size) * blockSize + FILESYSTEM_SPACE_MARGIN > remainingSpace()) {
+    return false;
+  }
+  reservedBytes += blocks(size) * blockSize;
+  return true;
+}
+
+void FileMetadataCache::consume(size_t offset, size_t size)
+{
+  size_t newBytes = (blocks(offset + size) - blocks(offset)) * blockSize;
+  reservedBytes -= std::min(newBytes, reservedBytes);
+  usedBytes += newBytes;
+}
+
+void FileMetadataCache::release(size_t offset, size_t size)
+{
+  size_t freedBytes = (blocks(offset + size) - blocks(offset)) * blockSize;
+  reservedBytes -= std::min(freedBytes, reservedBytes);
+}
+
+size_t FileMetadataCache::reservedSpace() const
+{
+  return reservedBytes;
+}
+
+bool FileMetadataCache::fileSize(const char* filename, size_t* size) const
+{
+  std::map<std::string, size_t>::const_iterator it = sizes.find(filename);
+  if (it == sizes.end()) {
+    return false;
+  }
+  *size = it->second;
+  return true;
+}
+
+void FileMetadataCache::setFileSize(const char* filename, size_t size)
+{
+  sizes[filename] = size;
+}
+
+void FileMetadataCache::onAppend(const char* filename, size_t size)
+{
+  std::map<std::string, size_t>::iterator it = sizes.find(filename);
+  size_t                                  newBlocks;
+
+  if (it != sizes.end()) {
+    newBlocks = blocks(it->second + size) - blocks(it->second);
+    it->second += size;
+  }
+  else {
+    newBlocks = blocks(size) + 1;
+  }
+
+  usedBytes += newBlocks * blockSize;
+  appends++;
+}
+
+void FileMetadataCache::onRemove(const char* filename)
+{
+  sizes.erase(filename);
+  usedValid = false; // The blocks released are not known
+}
+
+void FileMetadataCache::invalidate()
+{
+  sizes.clear();
+  usedValid = false;
+}
+
+size_t FileMetadataCache::blocks(size_t size) const
+{
+  return (size + blockSize - 1) / blockSize;
+}
+
+size_t FileMetadataCache::freeSpace() const
+{
+  if (!usedValid || usedBytes >= totalBytes) {
+    return 0;
+  }
+  return totalBytes - usedBytes;
+}
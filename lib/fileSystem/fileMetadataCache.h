@@ -0,0 +1,166 @@
+/**
+ * @file fileMetadataCache.h
+ * @author Miguel Ferrer "@MiguelFerrerF"
+ * @brief In-RAM cache of the file system metadata
+ * @version 0.1
+ * @date 2025-05-26
+ *
+ * This class keeps the used bytes of the file system and the size of the files in RAM,
+ * so that appends do not have to walk the file system to know the free space, and size
+ * queries do not have to open the file. The used bytes are estimated from the appends
+ * with the block granularity of the file system, and refreshed from the file system
+ * periodically or when the free space gets low.
+ *
+ * The class does not access the file system, so it can be tested on the host.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef FILEMETADATACACHE_H
+#define FILEMETADATACACHE_H
+
+#include <map>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#define FILESYSTEM_BLOCK_SIZE (4096)            /*!< LittleFS block size in bytes */
+#define FILESYSTEM_SPACE_MARGIN (4096)          /*!< Free space kept for the file system metadata */
+#define FILESYSTEM_CACHE_REFRESH_WRITES (256)   /*!< Appends after which the used bytes are read again from the file system */
+#define FILESYSTEM_CACHE_REFRESH_MARGIN (16384) /*!< Free space below which the used bytes are read again before every append */
+
+/**
+ * @brief  File system metadata cache
+ *
+ * @details Every operation that changes the file system must be reported to the cache:
+ * appends with onAppend(), deletions with onRemove(), and anything else (format, writes
+ * done without the FileSystem class) with invalidate().
+ *
+ */
+class FileMetadataCache
+{
+public:
+  /**
+   * @brief Constructor for the FileMetadataCache class.
+   *
+   * @param blockSize Block size of the file system, used to estimate the space taken by an append.
+   */
+  FileMetadataCache(size_t blockSize = FILESYSTEM_BLOCK_SIZE);
+
+  /**
+   * @brief Checks whether the used bytes must be read again from the file system.
+   *
+   * @return true if the estimate is unknown, too old, or the free space is close to the limit.
+   */
+  bool needsRefresh() const;
+
+  /**
+   * @brief Stores the used and total bytes read from the file system.
+   *
+   * @param used Bytes used in the file system.
+   * @param total Total bytes of the file system.
+   */
+  void refresh(size_t used, size_t total);
+
+  /**
+   * @brief Retrieves the estimated free space.
+   *
+   * The space reserved with reserve() is not free.
+   *
+   * @return size_t Free bytes, 0 if the used bytes are unknown.
+   */
+  size_t remainingSpace() const;
+
+  /**
+   * @brief Sets aside space for a file whose size is known before it is written.
+   *
+   * The size is counted in whole blocks. The reservation is accounting only: it keeps
+   * other writers from taking the space, the file system itself is not touched.
+   *
+   * @param size The number of bytes to reserve.
+   * @return true if the space was reserved, false if the free space, minus FILESYSTEM_SPACE_MARGIN, is not enough.
+   */
+  bool reserve(size_t size);
+
+  /**
+   * @brief Reports bytes written into a reservation.
+   *
+   * The blocks the bytes begin to fill, counted as onAppend() counts them, move from the
+   * reservation to the used bytes.
+   *
+   * @param offset Offset in the file of the first byte written.
+   * @param size The number of bytes written.
+   */
+  void consume(size_t offset, size_t size);
+
+  /**
+   * @brief Gives back the unused part of a reservation.
+   *
+   * @param offset Offset in the file where the unused part starts.
+   * @param size The number of bytes to release, at most the bytes still reserved.
+   */
+  void release(size_t offset, size_t size);
+
+  /**
+   * @brief Retrieves the blocks reserved and not written yet.
+   *
+   * @return size_t Reserved bytes, a multiple of the block size.
+   */
+  size_t reservedSpace() const;
+
+  /**
+   * @brief Retrieves the cached size of a file.
+   *
+   * @param filename The path of the file.
+   * @param size Pointer where the size is stored when the file is cached.
+   * @return true if the size is cached, false otherwise.
+   */
+  bool fileSize(const char* filename, size_t* size) const;
+
+  /**
+   * @brief Stores the size of a file.
+   *
+   * @param filename The path of the file.
+   * @param size The size of the file in bytes.
+   */
+  void setFileSize(const char* filename, size_t size);
+
+  /**
+   * @brief Reports an append to a file.
+   *
+   * The cached size of the file grows by size, and the used bytes grow by the blocks the
+   * file needs now. If the size of the file is not cached, a whole extra block is counted.
+   *
+   * @param filename The path of the file.
+   * @param size The number of bytes appended.
+   */
+  void onAppend(const char* filename, size_t size);
+
+  /**
+   * @brief Reports the deletion of a file.
+   *
+   * @param filename The path of the file.
+   */
+  void onRemove(const char* filename);
+
+  /**
+   * @brief Forgets everything, the next queries go to the file system.
+   *
+   * The reservations are kept, their files are still being written.
+   */
+  void invalidate();
+
+private:
+  size_t                        blockSize;             /**< Block size of the file system. */
+  bool                          usedValid     = false; /**< True while usedBytes is known. */
+  size_t                        usedBytes     = 0;     /**< Estimated used bytes. */
+  size_t                        totalBytes    = 0;     /**< Total bytes of the file system. */
+  size_t                        reservedBytes = 0;     /**< Bytes reserved and not written yet. */
+  uint32_t                      appends       = 0;     /**< Appends since the last refresh. */
+  std::map<std::string, size_t> sizes;                 /**< Cached file sizes. */
+
+  size_t blocks(size_t size) const;
+  size_t freeSpace() const;
+};
+
+#endif // FILEMETADATACACHE_H
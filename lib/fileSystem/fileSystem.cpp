@@ -10,11 +10,22 @@
  */
 #include "fileSystem.h"
 
+#include <mutex>
+
+#include "fileAppender.h"
+#include "fileMetadataCache.h"
+
+// LittleFS is a single global mount, so the metadata cache is shared by every FileSystem instance
+static FileMetadataCache metadataCache;
+static std::mutex        metadataLock;
+static bool              metadataCacheEnabled = true;
+
 FileSystem::FileSystem()
 {
   if (!LittleFS.begin()) {
     log_w("An Error has occurred while mounting LittleFS. Formatting...");
     LittleFS.format();
+    invalidateCache();
     if (!LittleFS.begin()) {
       log_e("Failed to mount LittleFS after formatting");
       return;
@@ -25,6 +36,7 @@ FileSystem::FileSystem()
 FileSystem::~FileSystem()
 {
   LittleFS.end();
+  invalidateCache();
 }
 
 error_code_littefs FileSystem::writeToFile(const char* filename, const uint8_t* data, size_t size)
@@ -35,28 +47,63 @@ error_code_littefs FileSystem::writeToFile(const char* filename, const uint8_t*
     return ERROR_OPENNING_FILE;
   }
   // Check if we have enough space to write the data
-  if (size > getRemainingSpace() - 4096) {
+  if (size + FILESYSTEM_SPACE_MARGIN > getRemainingSpace()) {
     log_e("Not enough space to write data");
     file.close();
     return ERROR_NO_ENOUGH_SPACE;
   }
+  size_t previousSize = file.size();
   if (file.write(data, size) != size) {
     log_e("Failed to write data to file");
     file.close();
+    invalidateCache();
     return ERROR_WRITING_FILE;
   }
   file.flush(); // Force write to disk
   file.close();
+
+  recordAppend(filename, previousSize, size);
   return LITTLEFS_OK;
 }
 
 error_code_littefs FileSystem::writeToFile(const char* filename, const char* data, size_t size)
 {
-  uint8_t* buffer = new uint8_t[size];
-  memcpy(buffer, data, size);
-  error_code_littefs err = writeToFile(filename, buffer, size);
-  delete[] buffer;
-  return err;
+  return writeToFile(filename, reinterpret_cast<const uint8_t*>(data), size);
+}
+
+error_code_littefs FileSystem::ingest(const char* filename, Stream& stream, size_t length, StreamIngest::Progress progress, IngestStats* stats)
+{
+  if (length > 0 && length + FILESYSTEM_SPACE_MARGIN > getRemainingSpace()) {
+    log_e("Not enough space to write data");
+    return ERROR_NO_ENOUGH_SPACE;
+  }
+  FileAppender appender(*this, filename);
+  if (!appender.isOpen()) {
+    return ERROR_OPENNING_FILE;
+  }
+
+  // The buffers of the ingest are block sized, the appender writes them without copying
+  StreamIngest ingest;
+  ingest.setLength(length);
+  ingest.onProgress(progress);
+  IngestStatus status = ingest.run(StreamIngest::streamReader(stream),
+                                   [&appender](const uint8_t* data, size_t size) { return appender.append(data, size) == LITTLEFS_OK; });
+  error_code_littefs err = appender.close();
+  if (stats != NULL) {
+    *stats = ingest.stats();
+  }
+
+  switch (status) {
+    case INGEST_OK:
+      return err;
+    case INGEST_NO_MEMORY:
+      return ERROR_OPENNING_FILE;
+    case INGEST_WRITE_ERROR:
+      return ERROR_WRITING_FILE;
+    default:
+      log_e("Stream ended before the end of the data");
+      return ERROR_NO_MORE_DATA;
+  }
 }
 
 error_code_littefs FileSystem::readFromFile(const char* filename, uint8_t* data, size_t size, size_t offset)
@@ -92,6 +139,9 @@ error_code_littefs FileSystem::deleteFile(const char* filename)
   else {
     log_w("File deleted: %s", filename);
   }
+
+  std::lock_guard<std::mutex> guard(metadataLock);
+  metadataCache.onRemove(filename);
   return LITTLEFS_OK;
 }
 
@@ -103,6 +153,8 @@ error_code_littefs FileSystem::deleteAllFiles()
     return ERROR_OPENNING_DIR;
   }
 
+  invalidateCache();
+
   bool hasFiles = false;
   for (File file = root.openNextFile(); file; file = root.openNextFile()) {
     hasFiles             = true;
@@ -148,17 +200,109 @@ void FileSystem::printStoredFiles()
 
 size_t FileSystem::getRemainingSpace()
 {
-  return LittleFS.totalBytes() - LittleFS.usedBytes();
+  if (!metadataCacheEnabled) {
+    return LittleFS.totalBytes() - LittleFS.usedBytes();
+  }
+
+  std::lock_guard<std::mutex> guard(metadataLock);
+  if (metadataCache.needsRefresh()) {
+    metadataCache.refresh(LittleFS.usedBytes(), LittleFS.totalBytes());
+  }
+  return metadataCache.remainingSpace();
+}
+
+error_code_littefs FileSystem::reserveSpace(size_t size)
+{
+  bool reserved;
+  if (!metadataCacheEnabled) {
+    reserved = size + FILESYSTEM_SPACE_MARGIN <= LittleFS.totalBytes() - LittleFS.usedBytes();
+  }
+  else {
+    std::lock_guard<std::mutex> guard(metadataLock);
+    if (metadataCache.needsRefresh()) {
+      metadataCache.refresh(LittleFS.usedBytes(), LittleFS.totalBytes());
+    }
+    reserved = metadataCache.reserve(size);
+  }
+
+  if (!reserved) {
+    log_e("Not enough space to reserve %u bytes", size);
+    return ERROR_NO_ENOUGH_SPACE;
+  }
+  return LITTLEFS_OK;
+}
+
+void FileSystem::consumeReservedSpace(size_t offset, size_t size)
+{
+  std::lock_guard<std::mutex> guard(metadataLock);
+  metadataCache.consume(offset, size);
+}
+
+void FileSystem::releaseReservedSpace(size_t offset, size_t size)
+{
+  std::lock_guard<std::mutex> guard(metadataLock);
+  metadataCache.release(offset, size);
 }
 
 size_t FileSystem::getFileSize(const char* filename)
 {
+  size_t size;
+  if (metadataCacheEnabled) {
+    std::lock_guard<std::mutex> guard(metadataLock);
+    if (metadataCache.fileSize(filename, &size)) {
+      return size;
+    }
+  }
+
   File file = LittleFS.open(filename, FILE_READ);
   if (!file) {
     log_e("Failed to open file for reading");
     return 0;
   }
-  size_t size = file.size();
+  size = file.size();
   file.close();
+
+  if (metadataCacheEnabled) {
+    std::lock_guard<std::mutex> guard(metadataLock);
+    metadataCache.setFileSize(filename, size);
+  }
   return size;
+}
+
+time_t FileSystem::getLastWrite(const char* filename)
+{
+  File file = LittleFS.open(filename, FILE_READ);
+  if (!file) {
+    log_e("Failed to open file for reading");
+    return 0;
+  }
+  time_t modTime = file.getLastWrite();
+  file.close();
+  return modTime;
+}
+
+void FileSystem::invalidateCache()
+{
+  std::lock_guard<std::mutex> guard(metadataLock);
+  metadataCache.invalidate();
+}
+
+void FileSystem::setMetadataCache(bool enabled)
+{
+  invalidateCache();
+  metadataCacheEnabled = enabled;
+}
+
+void FileSystem::recordAppend(const char* filename, size_t previousSize, size_t size)
+{
+  if (!metadataCacheEnabled) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> guard(metadataLock);
+  size_t                      cachedSize;
+  if (!metadataCache.fileSize(filename, &cachedSize)) {
+    metadataCache.setFileSize(filename, previousSize);
+  }
+  metadataCache.onAppend(filename, size);
 }
\ No newline at end of file
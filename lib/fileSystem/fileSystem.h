@@ -16,6 +16,8 @@
 
 #include <LittleFS.h>
 
+#include "streamIngest.h"
+
 /**
  * @brief Error codes for the file system
  *
@@ -94,9 +96,9 @@ public:
   /**
    * @brief Writes data to a file in the filesystem.
    * 
-   * This function writes the specified data to a file with the given filename
-   * in the filesystem. If the file does not exist, it will be created. If the
-   * file already exists, its contents will be overwritten.
+   * This function appends the specified data to a file with the given filename
+   * in the filesystem. If the file does not exist, it will be created. The data
+   * is written as is, without an intermediate copy.
    * 
    * @param filename The name of the file to write to. This should include the
    *                 full path if necessary.
@@ -107,6 +109,26 @@ public:
    */
   error_code_littefs writeToFile(const char* filename, const char* data, size_t size);
 
+  /**
+   * @brief Copies a stream into a file, such as the body of an HTTP download.
+   *
+   * The data is appended to the file through a FileAppender while the next buffer is read
+   * from the stream, see StreamIngest. The file is synced once at the end.
+   *
+   * @param filename The name of the file to write to.
+   * @param stream The stream to read.
+   * @param length The length of the stream in bytes, 0 if unknown. An unknown length ends after INGEST_IDLE_TIMEOUT without data.
+   * @param progress Function called with the bytes written and the length, may be empty.
+   * @param stats Pointer where the counters of the ingest will be stored, may be NULL.
+   * @return error_code_littefs Returns LITTLEFS_OK on success, or an appropriate error code on failure:
+   *         - ERROR_OPENNING_FILE: Failed to open the file or to start the ingest.
+   *         - ERROR_NO_ENOUGH_SPACE: Not enough space for the known length.
+   *         - ERROR_WRITING_FILE: Failed to write data to the file.
+   *         - ERROR_NO_MORE_DATA: The stream failed or ended before the known length.
+   */
+  error_code_littefs ingest(const char* filename, Stream& stream, size_t length = 0, StreamIngest::Progress progress = nullptr,
+                            IngestStats* stats = NULL);
+
   /**
    * @brief Reads data from a file in the LittleFS filesystem.
    *
@@ -165,23 +187,97 @@ public:
    * @brief Get the remaining space in the file system.
    *
    * This function calculates the remaining space available in the file system
-   * by subtracting the used bytes from the total bytes.
+   * by subtracting the used bytes from the total bytes. The used bytes are cached and
+   * updated on every append, they are read again from LittleFS every
+   * FILESYSTEM_CACHE_REFRESH_WRITES appends or when the free space gets low.
    *
    * @return size_t The amount of remaining space in bytes.
    */
   size_t getRemainingSpace();
 
+  /**
+   * @brief Sets aside space for a file whose size is known before it is written.
+   *
+   * LittleFS cannot preallocate a file, so the reservation only lives in the metadata cache:
+   * the reserved bytes are no longer reported by getRemainingSpace(), so the other writers
+   * cannot take them while the file is being written. With the cache disabled the free space
+   * is only checked. Report the bytes written with consumeReservedSpace() and give back the
+   * rest with releaseReservedSpace().
+   *
+   * @param size The number of bytes to reserve.
+   * @return error_code_littefs Returns LITTLEFS_OK on success, or ERROR_NO_ENOUGH_SPACE if the space is not available.
+   */
+  static error_code_littefs reserveSpace(size_t size);
+
+  /**
+   * @brief Reports bytes of a reservation written to a file.
+   *
+   * @param offset Offset in the file of the first byte written.
+   * @param size The number of bytes written.
+   */
+  static void consumeReservedSpace(size_t offset, size_t size);
+
+  /**
+   * @brief Gives back the unused part of a reservation.
+   *
+   * @param offset Offset in the file where the unused part starts.
+   * @param size The number of bytes reserved and not written.
+   */
+  static void releaseReservedSpace(size_t offset, size_t size);
+
   /**
    * @brief Retrieves the size of a file in bytes.
    *
-   * This function opens the specified file in read mode, determines its size,
-   * and then closes the file. If the file cannot be opened, an error is logged
-   * and the function returns 0.
+   * This function returns the cached size of the file. On a cache miss it opens the
+   * specified file in read mode, determines its size, and then closes the file. If the
+   * file cannot be opened, an error is logged and the function returns 0.
    *
    * @param filename The path to the file whose size is to be determined.
    * @return The size of the file in bytes, or 0 if the file could not be opened.
    */
   size_t getFileSize(const char* filename);
+
+  /**
+   * @brief Retrieves the modification time of a file.
+   *
+   * LittleFS keeps the time of the last write when it is built with CONFIG_LITTLEFS_USE_MTIME,
+   * which the ESP32 Arduino core does.
+   *
+   * @param filename The path to the file.
+   * @return The modification time in seconds since 1970, or 0 if the file could not be opened.
+   */
+  time_t getLastWrite(const char* filename);
+
+  /**
+   * @brief Discards the cached metadata.
+   *
+   * The used bytes and the file sizes are cached in RAM and kept up to date by the methods of
+   * this class. Call this function after modifying the file system by other means, for example
+   * through a File opened directly with LittleFS.
+   */
+  static void invalidateCache();
+
+  /**
+   * @brief Enables or disables the metadata cache.
+   *
+   * With the cache disabled every call queries LittleFS, as the previous implementation did.
+   * It is enabled by default.
+   *
+   * @param enabled true to use the cache, false to query LittleFS every time.
+   */
+  static void setMetadataCache(bool enabled);
+
+private:
+  friend class FileAppender;
+
+  /**
+   * @brief Records an append in the metadata cache.
+   *
+   * @param filename The path of the file.
+   * @param previousSize The size of the file before the append.
+   * @param size The number of bytes appended.
+   */
+  static void recordAppend(const char* filename, size_t previousSize, size_t size);
 };
 
 #endif // FILESYSTEM_H
\ No newline at end of file
@@ -0,0 +1,142 @@
+/**
+ * @file littleFSSegmentStorage.cpp
+ * @author Miguel Ferrer "@MiguelFerrerF"
+ * @brief Implementation of the LittleFSSegmentStorage class
+ * @version 0.1
+ * @date 2025-05-26
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "littleFSSegmentStorage.h"
+
+#include <algorithm>
+#include <new>
+
+LittleFSSegmentStorage::LittleFSSegmentStorage(FileSystem& fs, const char* directory) : fs(fs), directory(directory)
+{
+  if (!LittleFS.exists(directory) && !LittleFS.mkdir(directory)) {
+    log_e("Failed to create directory %s", directory);
+  }
+}
+
+LittleFSSegmentStorage::~LittleFSSegmentStorage()
+{
+  delete appender;
+  reader.close();
+}
+
+size_t LittleFSSegmentStorage::size(uint16_t segment)
+{
+  if (appender != NULL && appendSegment == segment) {
+    return appender->size();
+  }
+  std::string name = path(segment);
+  if (!LittleFS.exists(name.c_str())) {
+    return 0;
+  }
+  return fs.getFileSize(name.c_str());
+}
+
+bool LittleFSSegmentStorage::read(uint16_t segment, size_t offset, void* data, size_t size)
+{
+  // The reader must see the records still buffered by the appender
+  if (dirty && appendSegment == segment) {
+    sync();
+  }
+  if (!reader || readSegment != segment) {
+    reader.close();
+    reader      = LittleFS.open(path(segment).c_str(), FILE_READ);
+    readSegment = segment;
+    if (!reader) {
+      log_e("Failed to open segment %u", segment);
+      return false;
+    }
+  }
+  if (!reader.seek(offset)) {
+    return false;
+  }
+  return reader.read(static_cast<uint8_t*>(data), size) == size;
+}
+
+bool LittleFSSegmentStorage::append(uint16_t segment, const void* data, size_t size)
+{
+  if (appender == NULL || appendSegment != segment) {
+    delete appender;
+    appender      = new (std::nothrow) FileAppender(fs, path(segment).c_str());
+    appendSegment = segment;
+    dirty         = false;
+    if (appender == NULL || !appender->isOpen()) {
+      delete appender;
+      appender = NULL;
+      return false;
+    }
+  }
+  if (reader && readSegment == segment) {
+    reader.close(); // Reopened with the new size on the next read
+  }
+  dirty = true;
+  return appender->append(data, size) == LITTLEFS_OK;
+}
+
+bool LittleFSSegmentStorage::erase(uint16_t segment)
+{
+  closeSegment(segment);
+  std::string name = path(segment);
+  if (!LittleFS.exists(name.c_str())) {
+    return true;
+  }
+  return fs.deleteFile(name.c_str()) == LITTLEFS_OK;
+}
+
+bool LittleFSSegmentStorage::truncate(uint16_t segment, size_t size)
+{
+  // The Arduino File has no truncate, the kept bytes are copied to a new file
+  closeSegment(segment);
+  std::string name = path(segment);
+  std::string temp = name + ".tmp";
+  File        src  = LittleFS.open(name.c_str(), FILE_READ);
+  File        dst  = LittleFS.open(temp.c_str(), FILE_WRITE);
+  uint8_t     chunk[256];
+  bool        ok = src && dst;
+
+  while (ok && size > 0) {
+    size_t len = src.read(chunk, std::min(size, sizeof(chunk)));
+    ok         = len > 0 && dst.write(chunk, len) == len;
+    size -= len;
+  }
+  src.close();
+  dst.close();
+  ok = ok && LittleFS.remove(name.c_str()) && LittleFS.rename(temp.c_str(), name.c_str());
+  FileSystem::invalidateCache();
+  if (!ok) {
+    log_e("Failed to truncate segment %u", segment);
+  }
+  return ok;
+}
+
+bool LittleFSSegmentStorage::sync()
+{
+  if (appender == NULL) {
+    return true;
+  }
+  dirty = false;
+  return appender->sync() == LITTLEFS_OK;
+}
+
+std::string LittleFSSegmentStorage::path(uint16_t segment) const
+{
+  return directory + "/" + std::to_string(segment) + ".seg";
+}
+
+void LittleFSSegmentStorage::closeSegment(uint16_t segment)
+{
+  if (appender != NULL && appendSegment == segment) {
+    delete appender;
+    appender = NULL;
+    dirty    = false;
+  }
+  if (reader && readSegment == segment) {
+    reader.close();
+  }
+}
@@ -0,0 +1,69 @@
+/**
+ * @file littleFSSegmentStorage.h
+ * @author Miguel Ferrer "@MiguelFerrerF"
+ * @brief Segments of a RecordStore kept as LittleFS files
+ * @version 0.1
+ * @date 2025-05-26
+ *
+ * Every segment is a file of the given directory. The segment being written is kept open
+ * through a FileAppender and the last segment read is kept open for reading, so the
+ * records are not reopened and seeked one by one.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef LITTLEFSSEGMENTSTORAGE_H
+#define LITTLEFSSEGMENTSTORAGE_H
+
+#include <string>
+
+#include "fileAppender.h"
+#include "recordStore.h"
+
+/**
+ * @brief  LittleFS storage for a RecordStore
+ *
+ * @details The segment files are named <directory>/<segment>.seg. Appended records
+ * are buffered by the FileAppender until the next block boundary or sync().
+ *
+ */
+class LittleFSSegmentStorage : public RecordSegmentStorage
+{
+public:
+  /**
+   * @brief Constructor for the LittleFSSegmentStorage class, the directory is created if needed.
+   *
+   * @param fs File system holding the segments, it must outlive the storage.
+   * @param directory Directory of the segment files, for example "/log".
+   */
+  LittleFSSegmentStorage(FileSystem& fs, const char* directory);
+
+  /**
+   * @brief Destructor for the LittleFSSegmentStorage class, the pending records are synced.
+   */
+  ~LittleFSSegmentStorage();
+
+  LittleFSSegmentStorage(const LittleFSSegmentStorage&)            = delete;
+  LittleFSSegmentStorage& operator=(const LittleFSSegmentStorage&) = delete;
+
+  size_t size(uint16_t segment) override;
+  bool   read(uint16_t segment, size_t offset, void* data, size_t size) override;
+  bool   append(uint16_t segment, const void* data, size_t size) override;
+  bool   erase(uint16_t segment) override;
+  bool   truncate(uint16_t segment, size_t size) override;
+  bool   sync() override;
+
+private:
+  FileSystem&   fs;                    /**< File system holding the segments. */
+  std::string   directory;             /**< Directory of the segment files. */
+  FileAppender* appender      = NULL;  /**< Writer of the segment being appended. */
+  uint16_t      appendSegment = 0;     /**< Segment open in the appender. */
+  bool          dirty         = false; /**< True when the appender holds data not synced yet. */
+  File          reader;                /**< Last segment read. */
+  uint16_t      readSegment = 0;       /**< Segment open in the reader. */
+
+  std::string path(uint16_t segment) const;
+  void        closeSegment(uint16_t segment);
+};
+
+#endif // LITTLEFSSEGMENTSTORAGE_H
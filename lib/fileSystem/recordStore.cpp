@@ -0,0 +1,197 @@
+/**
+ * @file recordStore.cpp
+ * @author Miguel Ferrer "@MiguelFerrerF"
+ * @brief Implementation of the RecordStore class
+ * @version 0.1
+ * @date 2025-05-26
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "recordStore.h"
+
+#include <algorithm>
+
+RecordStore::RecordStore(RecordSegmentStorage& storage, uint16_t recordSize, uint16_t segments, uint32_t recordsPerSegment)
+    : storage(storage), recordSize(recordSize), segments(std::max<uint16_t>(segments, 2)), recordsPerSegment(std::max<uint32_t>(recordsPerSegment, 1))
+{
+}
+
+bool RecordStore::begin()
+{
+  SegmentHeader header;
+  size_t        segmentBytes = sizeof(SegmentHeader) + (size_t)recordsPerSegment * recordSize;
+  bool          found        = false;
+  uint32_t      newest       = 0;
+
+  head    = 0;
+  records = 0;
+
+  // The newest segment is the valid one with the highest sequence number
+  for (uint16_t s = 0; s < segments; s++) {
+    size_t size = storage.size(s);
+    if (size == 0) {
+      continue;
+    }
+    if (size < sizeof(SegmentHeader) || !storage.read(s, 0, &header, sizeof(header)) || header.magic != RECORD_STORE_MAGIC ||
+        header.recordSize != recordSize || header.firstSeq % recordsPerSegment != 0 || segmentOf(header.firstSeq) != s) {
+      storage.erase(s);
+      continue;
+    }
+    if (!found || (int32_t)(header.firstSeq - newest) > 0) {
+      newest = header.firstSeq;
+      found  = true;
+    }
+  }
+  if (!found) {
+    return true;
+  }
+
+  // A record cut by a power loss is dropped from the end of the newest segment
+  uint16_t segment = segmentOf(newest);
+  size_t   size    = storage.size(segment);
+  size_t   full    = std::min<size_t>((size - sizeof(SegmentHeader)) / recordSize, recordsPerSegment);
+  if (size != sizeof(SegmentHeader) + full * recordSize && !storage.truncate(segment, sizeof(SegmentHeader) + full * recordSize)) {
+    return false;
+  }
+  head    = newest;
+  records = full;
+
+  // Walk back while the previous segments are complete and in sequence, anything older is stale
+  uint16_t kept = 1;
+  while (kept < segments) {
+    uint32_t seq = head - recordsPerSegment;
+    segment      = segmentOf(seq);
+    if (storage.size(segment) != segmentBytes || !storage.read(segment, 0, &header, sizeof(header)) || header.firstSeq != seq) {
+      break;
+    }
+    head = seq;
+    records += recordsPerSegment;
+    kept++;
+  }
+  for (uint16_t k = kept; k < segments; k++) {
+    storage.erase(segmentOf(newest + (uint32_t)(segments - k) * recordsPerSegment));
+  }
+  return true;
+}
+
+bool RecordStore::append(const void* record)
+{
+  uint32_t seq = head + records;
+
+  if (seq % recordsPerSegment == 0 && !startSegment(seq)) {
+    return false;
+  }
+  if (!storage.append(segmentOf(seq), record, recordSize)) {
+    return false;
+  }
+  records++;
+  return true;
+}
+
+bool RecordStore::read(uint32_t index, void* record)
+{
+  return read(index, 1, record);
+}
+
+bool RecordStore::read(uint32_t index, uint32_t count, void* records)
+{
+  if (index >= this->records || count > this->records - index) {
+    return false;
+  }
+
+  uint8_t* out = static_cast<uint8_t*>(records);
+  uint32_t seq = head + index;
+  while (count > 0) {
+    uint32_t chunk = std::min(count, recordsPerSegment - seq % recordsPerSegment);
+    if (!storage.read(segmentOf(seq), offsetOf(seq), out, (size_t)chunk * recordSize)) {
+      return false;
+    }
+    out += (size_t)chunk * recordSize;
+    seq += chunk;
+    count -= chunk;
+  }
+  return true;
+}
+
+uint32_t RecordStore::lowerBound(time_t timestamp)
+{
+  uint32_t low  = 0;
+  uint32_t high = records;
+
+  if (recordSize < sizeof(time_t)) {
+    return records;
+  }
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    uint32_t seq = head + mid;
+    time_t   time;
+    if (!storage.read(segmentOf(seq), offsetOf(seq), &time, sizeof(time))) {
+      return records;
+    }
+    if (time < timestamp) {
+      low = mid + 1;
+    }
+    else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+bool RecordStore::sync()
+{
+  return storage.sync();
+}
+
+bool RecordStore::clear()
+{
+  bool ok = true;
+  for (uint16_t s = 0; s < segments; s++) {
+    ok = storage.erase(s) && ok;
+  }
+
+  // The sequence keeps growing, the next record starts a new segment
+  uint32_t next = head + records;
+  head          = next + (recordsPerSegment - next % recordsPerSegment) % recordsPerSegment;
+  records       = 0;
+  return ok;
+}
+
+uint32_t RecordStore::count() const
+{
+  return records;
+}
+
+uint32_t RecordStore::firstSequence() const
+{
+  return head;
+}
+
+uint16_t RecordStore::segmentOf(uint32_t seq) const
+{
+  return (seq / recordsPerSegment) % segments;
+}
+
+size_t RecordStore::offsetOf(uint32_t seq) const
+{
+  return sizeof(SegmentHeader) + (size_t)(seq % recordsPerSegment) * recordSize;
+}
+
+bool RecordStore::startSegment(uint32_t seq)
+{
+  uint32_t ring = (uint32_t)segments * recordsPerSegment;
+
+  // The segment still holds the oldest records when the ring is full
+  if (records > 0 && seq - head >= ring - recordsPerSegment) {
+    uint32_t evicted = seq - head - (ring - recordsPerSegment);
+    head += evicted;
+    records -= evicted;
+  }
+  if (!storage.erase(segmentOf(seq))) {
+    return false;
+  }
+
+  SegmentHeader header = {RECORD_STORE_MAGIC, seq, recordSize, 0};
+  return storage.append(segmentOf(seq), &header, sizeof(header));
+}
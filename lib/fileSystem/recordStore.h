@@ -0,0 +1,217 @@
+/**
+ * @file recordStore.h
+ * @author Miguel Ferrer "@MiguelFerrerF"
+ * @brief Circular store of fixed size records
+ * @version 0.1
+ * @date 2025-05-26
+ *
+ * This class stores fixed size records, such as the sensor measurements, in a ring of
+ * segments. When the ring is full the oldest segment is erased and reused, so the log
+ * keeps the most recent measurements instead of stopping when the flash is full.
+ * Appending and looking up a record by index take constant time, and records whose
+ * leading field is a timestamp can be searched by time.
+ *
+ * The segments are accessed through the RecordSegmentStorage interface, so the store
+ * can run on LittleFS or, for the tests, in memory.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef RECORDSTORE_H
+#define RECORDSTORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#define RECORD_STORE_MAGIC (0x52435331) /*!< "RCS1", marks a valid segment header */
+
+/**
+ * @brief Storage holding the segments of a RecordStore.
+ */
+class RecordSegmentStorage
+{
+public:
+  virtual ~RecordSegmentStorage()
+  {
+  }
+
+  /**
+   * @brief Retrieves the size of a segment.
+   *
+   * @param segment Number of the segment.
+   * @return size_t Bytes stored in the segment, 0 if it does not exist.
+   */
+  virtual size_t size(uint16_t segment) = 0;
+
+  /**
+   * @brief Reads bytes from a segment.
+   *
+   * @param segment Number of the segment.
+   * @param offset Position in the segment.
+   * @param data Pointer to the buffer where the bytes will be stored.
+   * @param size Number of bytes to read.
+   * @return true if all the bytes were read, false otherwise.
+   */
+  virtual bool read(uint16_t segment, size_t offset, void* data, size_t size) = 0;
+
+  /**
+   * @brief Appends bytes to a segment, the segment is created if it does not exist.
+   *
+   * @param segment Number of the segment.
+   * @param data Pointer to the bytes to append.
+   * @param size Number of bytes to append.
+   * @return true if all the bytes were appended, false otherwise.
+   */
+  virtual bool append(uint16_t segment, const void* data, size_t size) = 0;
+
+  /**
+   * @brief Deletes a segment.
+   *
+   * @param segment Number of the segment.
+   * @return true if the segment no longer exists, false otherwise.
+   */
+  virtual bool erase(uint16_t segment) = 0;
+
+  /**
+   * @brief Shortens a segment, only used by RecordStore::begin() after a power loss.
+   *
+   * @param segment Number of the segment.
+   * @param size New size of the segment in bytes.
+   * @return true on success, false otherwise.
+   */
+  virtual bool truncate(uint16_t segment, size_t size) = 0;
+
+  /**
+   * @brief Makes the appended data persistent.
+   *
+   * @return true on success, false otherwise.
+   */
+  virtual bool sync()
+  {
+    return true;
+  }
+};
+
+/**
+ * @brief  Circular store of fixed size records
+ *
+ * @details Records are numbered with an absolute sequence number that grows with every
+ * append. Record n lives in segment (n / recordsPerSegment) % segments, and every
+ * segment starts with a header holding the sequence number of its first record, which
+ * is all begin() needs to recover the store. Indexes passed to the read functions are
+ * relative to the oldest record kept.
+ *
+ */
+class RecordStore
+{
+public:
+  /**
+   * @brief Constructor for the RecordStore class.
+   *
+   * @param storage Storage holding the segments, it must outlive the store.
+   * @param recordSize Size of a record in bytes.
+   * @param segments Number of segments in the ring, at least 2.
+   * @param recordsPerSegment Number of records in a segment.
+   */
+  RecordStore(RecordSegmentStorage& storage, uint16_t recordSize, uint16_t segments, uint32_t recordsPerSegment);
+
+  /**
+   * @brief Recovers the records kept in the storage.
+   *
+   * Segments with an invalid header or another record size are erased.
+   *
+   * @return true on success, false if the storage could not be read.
+   */
+  bool begin();
+
+  /**
+   * @brief Appends a record, erasing the oldest segment when the ring is full.
+   *
+   * @param record Pointer to the record.
+   * @return true on success, false otherwise.
+   */
+  bool append(const void* record);
+
+  /**
+   * @brief Reads a record.
+   *
+   * @param index Index of the record, 0 is the oldest record kept.
+   * @param record Pointer to the buffer where the record will be stored.
+   * @return true on success, false if the index is out of range or the storage failed.
+   */
+  bool read(uint32_t index, void* record);
+
+  /**
+   * @brief Reads consecutive records, with one storage read per segment.
+   *
+   * @param index Index of the first record, 0 is the oldest record kept.
+   * @param count Number of records to read.
+   * @param records Pointer to the buffer where the records will be stored.
+   * @return true on success, false if the range is out of bounds or the storage failed.
+   */
+  bool read(uint32_t index, uint32_t count, void* records);
+
+  /**
+   * @brief Finds the first record whose timestamp is not older than the given one.
+   *
+   * The records must start with a time_t and be appended in chronological order.
+   *
+   * @param timestamp Time to search for.
+   * @return uint32_t Index of the record, count() if every record is older.
+   */
+  uint32_t lowerBound(time_t timestamp);
+
+  /**
+   * @brief Makes the appended records persistent.
+   *
+   * @return true on success, false otherwise.
+   */
+  bool sync();
+
+  /**
+   * @brief Erases every record.
+   *
+   * @return true on success, false otherwise.
+   */
+  bool clear();
+
+  /**
+   * @brief Retrieves the number of records kept.
+   *
+   * @return uint32_t Number of records.
+   */
+  uint32_t count() const;
+
+  /**
+   * @brief Retrieves the sequence number of the oldest record kept.
+   *
+   * @return uint32_t Sequence number, it grows by one with every append.
+   */
+  uint32_t firstSequence() const;
+
+private:
+  /**
+   * @brief Header at the start of every segment.
+   */
+  struct SegmentHeader
+  {
+    uint32_t magic;      // RECORD_STORE_MAGIC
+    uint32_t firstSeq;   // Sequence number of the first record of the segment
+    uint16_t recordSize; // Size of the records of the segment
+    uint16_t reserved;   // Always 0
+  };
+
+  RecordSegmentStorage& storage;           /**< Storage holding the segments. */
+  uint16_t              recordSize;        /**< Size of a record in bytes. */
+  uint16_t              segments;          /**< Number of segments in the ring. */
+  uint32_t              recordsPerSegment; /**< Number of records in a segment. */
+  uint32_t              head    = 0;       /**< Sequence number of the oldest record. */
+  uint32_t              records = 0;       /**< Number of records kept. */
+
+  uint16_t segmentOf(uint32_t seq) const;
+  size_t   offsetOf(uint32_t seq) const;
+  bool     startSegment(uint32_t seq);
+};
+
+#endif // RECORDSTORE_H
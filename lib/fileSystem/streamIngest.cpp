@@ -0,0 +1,293 @@
+/**
+ * @file streamIngest.cpp
+ * @author Miguel Ferrer "@MiguelFerrerF"
+ * @brief Implementation of the StreamIngest class
+ * @version 0.1
+ * @date 2025-05-26
+ *
+ * The reader fills one buffer while the writer worker stores the other one. The buffer in
+ * flight is exchanged through a mutex and a condition variable on both platforms, only the
+ * worker differs: a FreeRTOS task on the ESP32, so its stack can be sized, or a std::thread
+ * on the host.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "streamIngest.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <new>
+
+#ifdef ESP_PLATFORM
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#include <chrono>
+#include <errno.h>
+#include <poll.h>
+#include <thread>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Buffer exchange between the reader and the writer worker.
+ */
+struct IngestChannel
+{
+  StreamIngest::Writer    writer;          // Destination of the data
+  std::mutex              lock;            // Protects every field below
+  std::condition_variable signal;          // Notified on every change
+  const uint8_t*          data    = NULL;  // Buffer in flight, NULL when the writer is idle
+  size_t                  size    = 0;     // Bytes of the buffer in flight
+  bool                    stop    = false; // Set by the reader once everything has been handed off
+  bool                    exited  = false; // Set by the writer before returning
+  bool                    failed  = false; // Set when a write fails, later buffers are dropped
+  size_t                  written = 0;     // Bytes written
+  uint32_t                writes  = 0;     // Buffers written
+};
+
+static uint32_t ingestMillis()
+{
+#ifdef ESP_PLATFORM
+  return millis();
+#else
+  using namespace std::chrono;
+  return (uint32_t)duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static void writerLoop(IngestChannel& channel)
+{
+  std::unique_lock<std::mutex> guard(channel.lock);
+  while (true) {
+    channel.signal.wait(guard, [&channel]() { return channel.data != NULL || channel.stop; });
+    if (channel.data == NULL) {
+      break; // Stopped and nothing left
+    }
+
+    const uint8_t* data = channel.data;
+    size_t         size = channel.size;
+    bool           skip = channel.failed;
+    guard.unlock();
+    bool ok = !skip && channel.writer(data, size);
+    guard.lock();
+
+    if (ok) {
+      channel.written += size;
+      channel.writes++;
+    }
+    else {
+      channel.failed = true;
+    }
+    channel.data = NULL;
+    channel.signal.notify_all();
+  }
+  channel.exited = true;
+  channel.signal.notify_all();
+}
+
+#ifdef ESP_PLATFORM
+/**
+ * @brief Entry point of the FreeRTOS writer task.
+ *
+ * @param param Pointer to the IngestChannel, owned by StreamIngest::run().
+ */
+static void writerTask(void* param)
+{
+  writerLoop(*static_cast<IngestChannel*>(param));
+  vTaskDelete(NULL);
+}
+#endif
+
+/**
+ * @brief Hands a full buffer to the writer, waiting for the previous one to be written.
+ *
+ * @return true if the buffer was handed off, false if a previous write failed.
+ */
+static bool handOff(IngestChannel& channel, const uint8_t* data, size_t size, IngestStats& counters)
+{
+  std::unique_lock<std::mutex> guard(channel.lock);
+  if (channel.data != NULL) {
+    counters.stalls++;
+    channel.signal.wait(guard, [&channel]() { return channel.data == NULL; });
+  }
+  if (channel.failed) {
+    return false;
+  }
+  channel.data = data;
+  channel.size = size;
+  channel.signal.notify_all();
+  return true;
+}
+
+StreamIngest::StreamIngest(size_t bufferSize) : bufferSize(std::max<size_t>(bufferSize, 1))
+{
+}
+
+void StreamIngest::setLength(size_t total)
+{
+  this->total = total;
+}
+
+void StreamIngest::setTimeout(uint32_t timeoutMs)
+{
+  this->timeoutMs = timeoutMs;
+}
+
+void StreamIngest::onProgress(Progress progress)
+{
+  this->progress = progress;
+}
+
+IngestStatus StreamIngest::run(Reader reader, Writer writer)
+{
+  uint32_t start = ingestMillis();
+  counters       = IngestStats();
+
+  std::unique_ptr<uint8_t[]> buffers(new (std::nothrow) uint8_t[2 * bufferSize]);
+  if (!buffers) {
+    return INGEST_NO_MEMORY;
+  }
+
+  IngestChannel channel;
+  channel.writer = writer;
+#ifdef ESP_PLATFORM
+  BaseType_t core = (INGEST_TASK_CORE < 0) ? tskNO_AFFINITY : INGEST_TASK_CORE;
+  if (xTaskCreatePinnedToCore(writerTask, "ingest", INGEST_TASK_STACK_SIZE, &channel, INGEST_TASK_PRIORITY, NULL, core) != pdPASS) {
+    log_e("Failed to create ingest task");
+    return INGEST_NO_MEMORY;
+  }
+#else
+  std::thread worker(writerLoop, std::ref(channel));
+#endif
+
+  IngestStatus status   = INGEST_OK;
+  uint8_t*     fill     = buffers.get();
+  size_t       used     = 0;
+  size_t       received = 0;
+  bool         end      = false;
+
+  while (!end) {
+    size_t want = bufferSize - used;
+    if (total > 0) {
+      want = std::min(want, total - received);
+    }
+
+    bool error = false;
+    int  len   = reader(fill + used, want, timeoutMs, error);
+    if (len > 0) {
+      used += len;
+      received += len;
+      end = (total > 0 && received >= total);
+    }
+    else if (len == 0) {
+      // Without a known length a silent stream is a finished one
+      status = (total > 0) ? INGEST_TIMEOUT : INGEST_OK;
+      end    = true;
+    }
+    else {
+      status = error ? INGEST_READ_ERROR : ((total > 0) ? INGEST_SHORT : INGEST_OK);
+      end    = true;
+    }
+
+    if (used == bufferSize || (end && used > 0)) {
+      if (!handOff(channel, fill, used, counters)) {
+        status = INGEST_WRITE_ERROR;
+        break;
+      }
+      fill = (fill == buffers.get()) ? buffers.get() + bufferSize : buffers.get();
+      used = 0;
+      if (progress) {
+        size_t written;
+        {
+          std::lock_guard<std::mutex> guard(channel.lock);
+          written = channel.written;
+        }
+        progress(written, total);
+      }
+    }
+  }
+
+  {
+    std::unique_lock<std::mutex> guard(channel.lock);
+    channel.stop = true;
+    channel.signal.notify_all();
+    channel.signal.wait(guard, [&channel]() { return channel.exited; });
+    if (channel.failed) {
+      status = INGEST_WRITE_ERROR;
+    }
+    counters.bytes  = channel.written;
+    counters.writes = channel.writes;
+  }
+#ifndef ESP_PLATFORM
+  worker.join();
+#endif
+
+  counters.elapsedMs = ingestMillis() - start;
+  if (progress) {
+    progress(counters.bytes, total);
+  }
+  return status;
+}
+
+const IngestStats& StreamIngest::stats() const
+{
+  return counters;
+}
+
+#ifdef ESP_PLATFORM
+StreamIngest::Reader StreamIngest::streamReader(Stream& stream)
+{
+  return [&stream](uint8_t* data, size_t size, uint32_t timeoutMs, bool& error) -> int {
+    uint32_t start     = millis();
+    int      available = stream.available();
+    while (available <= 0) {
+      if (millis() - start >= timeoutMs) {
+        return 0;
+      }
+      vTaskDelay(1);
+      available = stream.available();
+    }
+    return stream.readBytes(data, std::min<size_t>(size, available));
+  };
+}
+#else
+StreamIngest::Reader StreamIngest::fdReader(int fd)
+{
+  return [fd](uint8_t* data, size_t size, uint32_t timeoutMs, bool& error) -> int {
+    struct pollfd request = {fd, POLLIN, 0};
+    int           ready   = poll(&request, 1, (int)timeoutMs);
+    if (ready == 0) {
+      return 0;
+    }
+    ssize_t len = (ready > 0) ? read(fd, data, size) : -1;
+    if (len < 0) {
+      error = true;
+      return -1;
+    }
+    return (len == 0) ? -1 : (int)len;
+  };
+}
+
+StreamIngest::Writer StreamIngest::fdWriter(int fd)
+{
+  return [fd](const uint8_t* data, size_t size) -> bool {
+    while (size > 0) {
+      ssize_t len = write(fd, data, size);
+      if (len < 0 && errno == EINTR) {
+        continue;
+      }
+      if (len <= 0) {
+        return false;
+      }
+      data += len;
+      size -= len;
+    }
+    return true;
+  };
+}
+#endif
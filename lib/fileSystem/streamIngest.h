@@ -0,0 +1,172 @@
+/**
+ * @file streamIngest.h
+ * @author Miguel Ferrer "@MiguelFerrerF"
+ * @brief Double-buffered copy of a stream into a file
+ * @version 0.1
+ * @date 2025-05-26
+ *
+ * This class copies a stream, such as the body of an HTTP download, into a file. It uses two
+ * buffers: while the writer worker stores one of them in the flash, the caller keeps filling the
+ * other one from the stream, so the network and the flash work at the same time.
+ *
+ * The class only moves buffers between a reader and a writer function, so it can be tested on
+ * the host. Readers for an Arduino Stream and, on the host, for a POSIX file descriptor are provided.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef STREAMINGEST_H
+#define STREAMINGEST_H
+
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fileMetadataCache.h"
+
+#define INGEST_IDLE_TIMEOUT (5000)    /*!< Time without data after which the ingest ends, in ms */
+#define INGEST_TASK_STACK_SIZE (4096) /*!< Stack size of the writer worker task in bytes */
+#define INGEST_TASK_PRIORITY (5)      /*!< Priority of the writer worker task */
+#define INGEST_TASK_CORE (-1)         /*!< Core the writer worker task is pinned to, -1 for no affinity */
+
+#ifdef ESP_PLATFORM
+class Stream;
+#endif
+
+/**
+ * @brief Result of an ingest.
+ */
+enum IngestStatus : uint8_t
+{
+  INGEST_OK,          // Everything was read and written
+  INGEST_READ_ERROR,  // The reader failed
+  INGEST_WRITE_ERROR, // The writer failed
+  INGEST_TIMEOUT,     // No data for the timeout before the known length was reached
+  INGEST_SHORT,       // The stream ended before the known length was reached
+  INGEST_NO_MEMORY,   // The buffers or the writer worker could not be allocated
+};
+
+/**
+ * @brief Counters of an ingest.
+ */
+struct IngestStats
+{
+  size_t   bytes     = 0; /*!< Bytes written */
+  uint32_t writes    = 0; /*!< Buffers handed to the writer */
+  uint32_t stalls    = 0; /*!< Times the reader waited for the writer to free a buffer */
+  uint32_t elapsedMs = 0; /*!< Duration of the ingest */
+};
+
+/**
+ * @brief  Double-buffered stream ingest
+ *
+ * @details run() reads on the calling thread and writes on a worker: a FreeRTOS task on the
+ * ESP32 or a std::thread on the host. Only one buffer is in flight at a time, the reader waits
+ * for the writer when both buffers are full.
+ *
+ */
+class StreamIngest
+{
+public:
+  /**
+   * @brief Reads up to size bytes, waiting at most timeoutMs for the first one.
+   *
+   * Returns the number of bytes read, 0 if nothing arrived in time, or -1 at the end of the
+   * stream or on error. Set error to true to report a failure instead of the end of the stream.
+   */
+  typedef std::function<int(uint8_t* data, size_t size, uint32_t timeoutMs, bool& error)> Reader;
+
+  /**
+   * @brief Writes size bytes, returns false on error. It is called from the writer worker.
+   */
+  typedef std::function<bool(const uint8_t* data, size_t size)> Writer;
+
+  /**
+   * @brief Reports the bytes written so far and the total length, 0 if unknown. It is called from run().
+   */
+  typedef std::function<void(size_t written, size_t total)> Progress;
+
+  /**
+   * @brief Constructor for the StreamIngest class.
+   *
+   * @param bufferSize Size of each of the two buffers, the block size by default.
+   */
+  StreamIngest(size_t bufferSize = FILESYSTEM_BLOCK_SIZE);
+
+  /**
+   * @brief Sets the length of the stream.
+   *
+   * With a known length the ingest ends once it has been read, and ending earlier is an error.
+   * With an unknown length the ingest ends at the end of the stream or after the timeout without data.
+   *
+   * @param total Length of the stream in bytes, 0 if unknown.
+   */
+  void setLength(size_t total);
+
+  /**
+   * @brief Sets the time without data after which the ingest ends.
+   *
+   * @param timeoutMs Timeout in milliseconds, INGEST_IDLE_TIMEOUT by default.
+   */
+  void setTimeout(uint32_t timeoutMs);
+
+  /**
+   * @brief Sets the function called after every buffer handed to the writer and at the end.
+   *
+   * @param progress Progress function, may be empty.
+   */
+  void onProgress(Progress progress);
+
+  /**
+   * @brief Copies the stream into the writer.
+   *
+   * @param reader Origin of the data.
+   * @param writer Destination of the data.
+   * @return IngestStatus INGEST_OK on success, the cause of the failure otherwise.
+   */
+  IngestStatus run(Reader reader, Writer writer);
+
+  /**
+   * @brief Retrieves the counters of the last run().
+   *
+   * @return const IngestStats& Counters.
+   */
+  const IngestStats& stats() const;
+
+#ifdef ESP_PLATFORM
+  /**
+   * @brief Creates a reader for an Arduino Stream, such as the WiFiClient of an HTTPClient.
+   *
+   * A Stream cannot tell the end of the data, with an unknown length the ingest ends after the timeout.
+   *
+   * @param stream Stream to read, it must outlive the ingest.
+   * @return Reader Reader of the stream.
+   */
+  static Reader streamReader(Stream& stream);
+#else
+  /**
+   * @brief Creates a reader for a POSIX file descriptor, such as a pipe or a socket.
+   *
+   * @param fd File descriptor to read, read() returning 0 is the end of the stream.
+   * @return Reader Reader of the file descriptor.
+   */
+  static Reader fdReader(int fd);
+
+  /**
+   * @brief Creates a writer for a POSIX file descriptor.
+   *
+   * @param fd File descriptor to write.
+   * @return Writer Writer of the file descriptor.
+   */
+  static Writer fdWriter(int fd);
+#endif
+
+private:
+  size_t      bufferSize;                      /**< Size of each buffer. */
+  size_t      total     = 0;                   /**< Length of the stream, 0 if unknown. */
+  uint32_t    timeoutMs = INGEST_IDLE_TIMEOUT; /**< Time without data after which the ingest ends. */
+  Progress    progress;                        /**< Progress function. */
+  IngestStats counters;                        /**< Counters of the last run. */
+};
+
+#endif // STREAMINGEST_H
@@ -0,0 +1,112 @@
+/**
+ * @file test_async.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Host tests for the asynchronous transfer handle
+ * @version 0.1
+ * @date 2025-05-12
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "YmodemAsync.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <unity.h>
+
+static void sleepMs(int ms)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void test_transfer_result(void)
+{
+  YmodemTransfer transfer = YmodemTransfer::start(
+    []() {
+      sleepMs(50);
+      return 42;
+    },
+    nullptr);
+
+  TEST_ASSERT_TRUE(transfer.valid());
+  TEST_ASSERT_FALSE(transfer.poll());
+  TEST_ASSERT_EQUAL_INT(YmodemTransfer::PENDING, transfer.result());
+  TEST_ASSERT_TRUE(transfer.wait(1000));
+  TEST_ASSERT_TRUE(transfer.poll());
+  TEST_ASSERT_EQUAL_INT(42, transfer.result());
+}
+
+void test_transfer_wait_timeout(void)
+{
+  YmodemTransfer transfer = YmodemTransfer::start(
+    []() {
+      sleepMs(200);
+      return 1;
+    },
+    nullptr);
+
+  TEST_ASSERT_FALSE(transfer.wait(10));
+  TEST_ASSERT_FALSE(transfer.poll());
+  TEST_ASSERT_TRUE(transfer.wait(1000));
+  TEST_ASSERT_EQUAL_INT(1, transfer.result());
+}
+
+void test_transfer_cancel(void)
+{
+  std::shared_ptr<std::atomic<bool>> stop = std::make_shared<std::atomic<bool>>(false);
+
+  YmodemTransfer transfer = YmodemTransfer::start(
+    [stop]() {
+      while (!*stop) {
+        sleepMs(1);
+      }
+      return -6;
+    },
+    [stop]() { *stop = true; });
+
+  TEST_ASSERT_FALSE(transfer.wait(20));
+  transfer.cancel();
+  TEST_ASSERT_TRUE(transfer.cancelled());
+  TEST_ASSERT_TRUE(transfer.wait(1000));
+  TEST_ASSERT_EQUAL_INT(-6, transfer.result());
+}
+
+void test_transfer_copies_share_state(void)
+{
+  YmodemTransfer transfer = YmodemTransfer::start([]() { return 7; }, nullptr);
+  YmodemTransfer copy     = transfer;
+
+  TEST_ASSERT_TRUE(copy.wait(1000));
+  TEST_ASSERT_TRUE(transfer.poll());
+  TEST_ASSERT_EQUAL_INT(7, transfer.result());
+}
+
+void test_empty_handle(void)
+{
+  YmodemTransfer transfer;
+
+  TEST_ASSERT_FALSE(transfer.valid());
+  TEST_ASSERT_FALSE(transfer.poll());
+  TEST_ASSERT_FALSE(transfer.wait(10));
+  TEST_ASSERT_EQUAL_INT(YmodemTransfer::PENDING, transfer.result());
+  transfer.cancel();
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_transfer_result);
+  RUN_TEST(test_transfer_wait_timeout);
+  RUN_TEST(test_transfer_cancel);
+  RUN_TEST(test_transfer_copies_share_state);
+  RUN_TEST(test_empty_handle);
+  return UNITY_END();
+}
@@ -0,0 +1,230 @@
+/**
+ * @file test_blocks.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Host tests for the negotiated 4K and 8K blocks
+ * @version 0.1
+ * @date 2025-06-09
+ *
+ * The sessions are connected through a simulated serial line at 921600 baud with
+ * a round-trip latency, driven by a virtual clock. The receiver pays a fixed cost
+ * per block before its ACK leaves, the LittleFS write call, so the time of a
+ * transfer shows what the larger blocks save per block.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "../ymodem_fixtures.h"
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+#include <vector>
+
+#define LINE_BYTE_NS (10851)    // One byte at 921600 baud
+#define WRITE_CALL_US (1500)    // Fixed cost of a flash write call on the receiver
+#define CORRUPT_BYTE (20000)    // Byte of the transfer damaged by the error test
+
+/**
+ * @brief Sink that holds the answers of the receiver for the duration of a flash write call.
+ */
+class SlowSink : public MemorySink
+{
+public:
+  uint32_t writes  = 0;
+  uint64_t nowUs   = 0; // Time of the session, set by the loop
+  uint64_t readyUs = 0; // End of the last write call, the answers wait for it
+
+  int write(const uint8_t* block, size_t length) override
+  {
+    writes++;
+    readyUs = nowUs + WRITE_CALL_US;
+    return MemorySink::write(block, length);
+  }
+};
+
+/**
+ * @brief Runs a transfer over the simulated line, every byte arrives half the round trip after it was sent.
+ *
+ * @return uint64_t Time the transfer took, in microseconds.
+ */
+static uint64_t transfer(YmodemSession& tx, YmodemSession& rx, SlowSink& sink, uint64_t rttUs, Line& toReceiver)
+{
+  Line toSender(LINE_BYTE_NS, rttUs / 2);
+
+  toReceiver.byteNs    = LINE_BYTE_NS;
+  toReceiver.latencyUs = rttUs / 2;
+  toSender.heldUntilUs = &sink.readyUs;
+  return runLine(tx, rx, toReceiver, toSender, [&sink](uint64_t nowUs) {
+    sink.nowUs = nowUs;
+    return true;
+  });
+}
+
+void test_blocks_packets(void)
+{
+  uint8_t packet[PACKET_8K_SIZE + PACKET_LARGE_OVERHEAD];
+  uint8_t data[100];
+  for (int i = 0; i < 100; i++) {
+    data[i] = (uint8_t)i;
+  }
+
+  // LTX, sequence number and its complement, length, unpadded data and CRC-32, big endian
+  TEST_ASSERT_EQUAL_size_t(100 + PACKET_LARGE_OVERHEAD, Ymodem_PrepareLargePacket(packet, 0x1234, 100, data));
+  const uint8_t header[] = {LTX, 0x12, 0x34, 0xed, 0xcb, 0x00, 100};
+  TEST_ASSERT_EQUAL_MEMORY(header, packet, PACKET_LARGE_HEADER);
+  TEST_ASSERT_EQUAL_MEMORY(data, packet + PACKET_LARGE_HEADER, 100);
+  uint32_t crc = Ymodem_Crc32(0, packet + 1, PACKET_LARGE_HEADER - 1 + 100);
+  TEST_ASSERT_EQUAL_HEX32(crc, ((uint32_t)packet[107] << 24) | (packet[108] << 16) | (packet[109] << 8) | packet[110]);
+
+  // The header announces the block size after the digest, receivers that do not know it ignore it
+  Ymodem_PrepareIntialPacket(packet, "data.bin", 5000, "crc32:cbf43926", PACKET_8K_SIZE);
+  TEST_ASSERT_EQUAL_STRING("5000 crc32:cbf43926 blk:8192", (const char*)packet + PACKET_HEADER + 9);
+  TEST_ASSERT_EQUAL_UINT32(PACKET_8K_SIZE, extractFileBlockSize(packet));
+  char digest[YMODEM_DIGEST_TEXT_SIZE];
+  TEST_ASSERT_EQUAL_INT(YMODEM_DIGEST_CRC32, extractFileDigest(packet, digest, sizeof(digest)));
+  int  size = 0;
+  char name[FILE_NAME_LENGTH + 1];
+  extractFileInfo(packet, name, &size);
+  TEST_ASSERT_EQUAL_INT(5000, size);
+
+  Ymodem_PrepareIntialPacket(packet, "data.bin", 5000, NULL, PACKET_4K_SIZE);
+  TEST_ASSERT_EQUAL_UINT32(PACKET_4K_SIZE, extractFileBlockSize(packet));
+  Ymodem_PrepareIntialPacket(packet, "data.bin", 5000);
+  TEST_ASSERT_EQUAL_UINT32(PACKET_1K_SIZE, extractFileBlockSize(packet));
+
+  // Without room for the whole field the block size is not announced
+  char longName[FILE_NAME_LENGTH + 1];
+  memset(longName, 'n', FILE_NAME_LENGTH);
+  longName[FILE_NAME_LENGTH] = '\0';
+  TEST_ASSERT_EQUAL_UINT8(YMODEM_FIELD_BLOCK_SIZE,
+                          Ymodem_PrepareIntialPacket(packet, longName, 5000, "sha256:0123456789abcdef0123456789abcdef0123456789", PACKET_8K_SIZE));
+  TEST_ASSERT_EQUAL_UINT32(PACKET_1K_SIZE, extractFileBlockSize(packet));
+}
+
+void test_blocks_negotiation(void)
+{
+  MemorySource source(50000);
+  struct
+  {
+    size_t  sender;
+    size_t  receiver;
+    uint8_t start;   // Start of the data packets
+    size_t  packets; // Data packets of the file
+  } cases[] = {
+      {PACKET_8K_SIZE, PACKET_8K_SIZE, LTX, 7},
+      {PACKET_8K_SIZE, PACKET_4K_SIZE, LTX, 13},
+      {PACKET_4K_SIZE, PACKET_8K_SIZE, LTX, 13},
+      {PACKET_8K_SIZE, PACKET_1K_SIZE, STX, 49},
+      {PACKET_1K_SIZE, PACKET_8K_SIZE, STX, 49},
+  };
+
+  for (const auto& c : cases) {
+    SlowSink       sink;
+    YmodemSender   tx(source, "data.bin", source.data.size());
+    YmodemReceiver rx(sink, 100000);
+    Line           line;
+    TEST_ASSERT_TRUE(tx.setBlockSize(c.sender));
+    TEST_ASSERT_TRUE(rx.setBlockSize(c.receiver));
+    rx.setDigest(YMODEM_DIGEST_CRC32);
+    tx.setDigest(YMODEM_DIGEST_CRC32);
+    transfer(tx, rx, sink, 2000, line);
+
+    TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, tx.result());
+    TEST_ASSERT_EQUAL_INT(50000, rx.result());
+    TEST_ASSERT_TRUE(sink.data == source.data);
+    TEST_ASSERT_EQUAL_size_t(c.packets, line.countStarts(c.start));
+    TEST_ASSERT_EQUAL_UINT32(c.packets, sink.writes);
+    TEST_ASSERT_EQUAL_UINT32(0, rx.stats().retries);
+    TEST_ASSERT_EQUAL_MEMORY(tx.digest().value(), rx.digest().value(), 4);
+  }
+
+  // A damaged large packet is refused and sent again
+  SlowSink       sink;
+  YmodemSender   tx(source, "data.bin", source.data.size());
+  YmodemReceiver rx(sink, 100000);
+  Line           line;
+  line.corruptAt = CORRUPT_BYTE;
+  tx.setBlockSize(PACKET_8K_SIZE);
+  rx.setBlockSize(PACKET_8K_SIZE);
+  transfer(tx, rx, sink, 2000, line);
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, tx.result());
+  TEST_ASSERT_TRUE(sink.data == source.data);
+  TEST_ASSERT_EQUAL_UINT32(1, rx.stats().retries);
+  TEST_ASSERT_EQUAL_size_t(8, line.countStarts(LTX));
+  TEST_ASSERT_EQUAL_UINT8(YMODEM_FIELD_NONE, tx.droppedFields());
+
+  // A long name leaves no room for the block size after the digest, the file goes in 1K blocks
+  char           digest[YMODEM_DIGEST_TEXT_SIZE];
+  SlowSink       longSink;
+  YmodemSender   longTx(source, "firmware_lsm1x0a_module_v2.3.17_release.bin", source.data.size());
+  YmodemReceiver longRx(longSink, 100000);
+  Line           longLine;
+  YmodemDigest   expected;
+  expected.begin(YMODEM_DIGEST_SHA256);
+  expected.update(source.data.data(), source.data.size());
+  expected.finish();
+  expected.format(digest, sizeof(digest));
+  longTx.setHeaderDigest(digest);
+  longTx.setBlockSize(PACKET_8K_SIZE);
+  longRx.setBlockSize(PACKET_8K_SIZE);
+  transfer(longTx, longRx, longSink, 2000, longLine);
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, longTx.result());
+  TEST_ASSERT_TRUE(longSink.data == source.data);
+  TEST_ASSERT_TRUE(longRx.digestVerified());
+  TEST_ASSERT_EQUAL_UINT8(YMODEM_FIELD_BLOCK_SIZE, longTx.droppedFields());
+  TEST_ASSERT_EQUAL_size_t(0, longLine.countStarts(LTX));
+  TEST_ASSERT_EQUAL_size_t(49, longLine.countStarts(STX));
+
+  // Unsupported sizes, and a buffer given to the constructor that is too small
+  uint8_t        frame[YMODEM_FRAME_SIZE];
+  YmodemReceiver small(sink, 100000, frame);
+  TEST_ASSERT_FALSE(small.setBlockSize(PACKET_4K_SIZE));
+  TEST_ASSERT_FALSE(small.setBlockSize(2048));
+  TEST_ASSERT_TRUE(small.setBlockSize(PACKET_1K_SIZE));
+}
+
+void test_blocks_throughput(void)
+{
+  MemorySource   source(256 * 1024);
+  const size_t   sizes[] = {PACKET_1K_SIZE, PACKET_4K_SIZE, PACKET_8K_SIZE};
+  const uint32_t rtts[]  = {2000, 20000, 100000};
+
+  for (uint32_t rtt : rtts) {
+    uint32_t bytesPerSecond[3];
+    for (int i = 0; i < 3; i++) {
+      SlowSink       sink;
+      YmodemSender   tx(source, "data.bin", source.data.size());
+      YmodemReceiver rx(sink, 1000000);
+      Line           line;
+      tx.setBlockSize(sizes[i]);
+      rx.setBlockSize(sizes[i]);
+      uint64_t us = transfer(tx, rx, sink, rtt, line);
+      TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, tx.result());
+      TEST_ASSERT_TRUE(sink.data == source.data);
+      bytesPerSecond[i] = (uint32_t)(source.data.size() * 1000000ULL / us);
+    }
+
+    char message[128];
+    snprintf(message, sizeof(message), "921600 baud, %3u ms RTT: 1K %6u B/s, 4K %6u B/s, 8K %6u B/s", (unsigned)(rtt / 1000), bytesPerSecond[0],
+             bytesPerSecond[1], bytesPerSecond[2]);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE(bytesPerSecond[1] > bytesPerSecond[0]);
+    TEST_ASSERT_TRUE(bytesPerSecond[2] > bytesPerSecond[1]);
+  }
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_blocks_packets);
+  RUN_TEST(test_blocks_negotiation);
+  RUN_TEST(test_blocks_throughput);
+  return UNITY_END();
+}
@@ -0,0 +1,283 @@
+/**
+ * @file test_boot.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Host tests for the bootloader handshake
+ * @version 0.1
+ * @date 2025-06-11
+ *
+ * The module is replaced by a scripted bootloader on the other end of a socket
+ * pair: it starts when the reset hook is called, prints its banner, waits for
+ * the command selecting the download, then repeats its 'C' until the header
+ * packet arrives and receives the file like the module would.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "../ymodem_fixtures.h"
+#include "YmodemBoot.h"
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <unity.h>
+#include <vector>
+
+#define FILE_BYTES (8 * 1024) /*!< Size of the firmware image */
+
+enum BootStep : uint8_t
+{
+  BOOT_DELAY,  // Waits ms milliseconds
+  BOOT_SEND,   // Sends text
+  BOOT_EXPECT, // Reads until text has been received
+  BOOT_READY,  // Sends a 'C' every ms milliseconds until a packet arrives, then receives the file
+};
+
+struct BootScript
+{
+  BootStep    step;
+  uint32_t    ms;
+  const char* text;
+};
+
+/**
+ * @brief Stand-in for the bootloader of the module, it plays a script on its end of the link.
+ */
+class ScriptedBootloader
+{
+public:
+  MemorySink sink;
+  uint32_t   readies  = 0; // 'C' sent before the header packet
+  uint32_t   headerMs = 0; // From the start to the first byte of the header packet
+  int        result   = 0; // Result of the receiver session
+
+  ScriptedBootloader(int fd, const BootScript* script, size_t steps) : port(fd), script(script), steps(steps)
+  {
+  }
+
+  ~ScriptedBootloader()
+  {
+    if (thread.joinable()) {
+      thread.join();
+    }
+  }
+
+  // Called by the reset hook: the module leaves reset and runs its script
+  void reset()
+  {
+    thread = std::thread([this]() { run(); });
+  }
+
+  void join()
+  {
+    thread.join();
+  }
+
+private:
+  SocketPort        port;
+  const BootScript* script;
+  size_t            steps;
+  std::thread       thread;
+
+  void run()
+  {
+    uint32_t start = Ymodem_Millis();
+    for (size_t i = 0; i < steps; i++) {
+      const BootScript& step = script[i];
+      switch (step.step) {
+        case BOOT_DELAY:
+          std::this_thread::sleep_for(std::chrono::milliseconds(step.ms));
+          break;
+        case BOOT_SEND:
+          port.write((const uint8_t*)step.text, strlen(step.text));
+          break;
+        case BOOT_EXPECT:
+          for (size_t matched = 0; matched < strlen(step.text);) {
+            uint8_t byte;
+            if (port.read(&byte, 1, 1000) != 1) {
+              return;
+            }
+            matched = (byte == (uint8_t)step.text[matched]) ? matched + 1 : 0;
+          }
+          break;
+        case BOOT_READY:
+          ready(step.ms, start);
+          return;
+      }
+    }
+  }
+
+  void ready(uint32_t intervalMs, uint32_t start)
+  {
+    const uint8_t c = CRC16;
+    uint8_t       byte;
+    do {
+      port.write(&c, 1);
+      readies++;
+      // The wake-up 'C' of the sender is not a packet
+      do {
+        if (port.read(&byte, 1, intervalMs) != 1) {
+          byte = 0;
+        }
+      } while (byte == CRC16);
+    } while (byte != SOH && byte != STX);
+    headerMs = Ymodem_Millis() - start;
+
+    // The receiver starts with the header in hand, its own 'C' has already been sent
+    YmodemReceiver receiver(sink, FILE_BYTES);
+    uint8_t        rx[YMODEM_FRAME_SIZE];
+    uint32_t       now = Ymodem_Millis();
+    receiver.start(now);
+    receiver.consumeOutput(receiver.outputSize());
+    receiver.feed(&byte, 1, now);
+    while (true) {
+      while (receiver.outputSize() > 0) {
+        port.write(receiver.output(), receiver.outputSize());
+        receiver.consumeOutput(receiver.outputSize());
+      }
+      if (receiver.isDone()) {
+        break;
+      }
+      now          = Ymodem_Millis();
+      int32_t wait = std::max<int32_t>(0, (int32_t)(receiver.nextDeadline() - now));
+      int     len  = port.read(rx, receiver.expectedBytes(), wait);
+      now          = Ymodem_Millis();
+      if (len > 0) {
+        receiver.feed(rx, len, now);
+      }
+      receiver.poll(now);
+    }
+    result = receiver.result();
+  }
+};
+
+static const char BANNER[] = "LSM100A bootloader\r\n1. Download\r\n";
+
+/**
+ * @brief Flashes the module through the handshake, the 'C' it found is handed to the sender.
+ */
+static void flash(const BootScript* script, size_t steps, ScriptedBootloader** module, YmodemBootStats& stats, int& result)
+{
+  int fds[2];
+  TEST_ASSERT_EQUAL_INT(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  SocketPort          port(fds[0]);
+  YmodemBootTransport boot(port);
+  MemorySource        source(FILE_BYTES, 13, 7);
+  YmodemSender        sender(source, "module.bin", FILE_BYTES);
+  *module = new ScriptedBootloader(fds[1], script, steps);
+
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_START, boot.handshake([module]() { (*module)->reset(); }, "1", 2000));
+  TEST_ASSERT_TRUE(boot.ready());
+  result = Ymodem_RunSession(sender, boot);
+  stats  = boot.stats();
+  (*module)->join();
+  close(fds[0]);
+  close(fds[1]);
+  TEST_ASSERT_TRUE(source.data == (*module)->sink.data);
+}
+
+void test_boot_handover(void)
+{
+  const BootScript script[] = {{BOOT_DELAY, 20, NULL}, {BOOT_SEND, 0, BANNER}, {BOOT_EXPECT, 0, "1"}, {BOOT_READY, 1000, NULL}};
+
+  ScriptedBootloader* module = NULL;
+  YmodemBootStats     stats;
+  int                 result = 0;
+  flash(script, 4, &module, stats, result);
+
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, result);
+  TEST_ASSERT_EQUAL_INT(FILE_BYTES, module->result);
+  // The header answered the first 'C', the bootloader never had to repeat it
+  TEST_ASSERT_EQUAL_UINT32(1, module->readies);
+  TEST_ASSERT_EQUAL_UINT32(strlen(BANNER), stats.discarded);
+  TEST_ASSERT_TRUE(stats.resetToFirstByteUs >= 20000);
+  TEST_ASSERT_TRUE(stats.resetToReadyUs >= stats.resetToFirstByteUs);
+  TEST_ASSERT_TRUE(stats.resetToHeaderUs >= stats.resetToReadyUs);
+  TEST_ASSERT_TRUE(stats.resetToHeaderUs - stats.resetToReadyUs < 5000);
+  delete module;
+}
+
+void test_boot_latency_against_polling(void)
+{
+  const BootScript script[] = {{BOOT_DELAY, 20, NULL}, {BOOT_SEND, 0, BANNER}, {BOOT_EXPECT, 0, "1"}, {BOOT_READY, 500, NULL}};
+
+  // Handshake handing its 'C' over
+  ScriptedBootloader* module = NULL;
+  YmodemBootStats     stats;
+  int                 result = 0;
+  flash(script, 4, &module, stats, result);
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, result);
+  uint32_t handover = module->headerMs;
+  delete module;
+
+  // The previous sequence: the 'C' is consumed by the wait, the sender waits for the next one
+  int fds[2];
+  TEST_ASSERT_EQUAL_INT(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  SocketPort         port(fds[0]);
+  MemorySource       source(FILE_BYTES, 13, 7);
+  YmodemSender       sender(source, "module.bin", FILE_BYTES);
+  ScriptedBootloader polled(fds[1], script, 4);
+  polled.reset();
+  port.write((const uint8_t*)"1", 1);
+  uint8_t byte = 0;
+  while (byte != CRC16) {
+    TEST_ASSERT_EQUAL_INT(1, port.read(&byte, 1, 100));
+  }
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, Ymodem_RunSession(sender, port));
+  polled.join();
+  close(fds[0]);
+  close(fds[1]);
+  TEST_ASSERT_EQUAL_UINT32(2, polled.readies);
+
+  char message[120];
+  snprintf(message, sizeof(message), "reset to header: %u ms handed over, %u ms polled; 'C' after %u us, header %u us later", handover,
+           polled.headerMs, stats.resetToReadyUs, stats.resetToHeaderUs - stats.resetToReadyUs);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE(handover + 400 < polled.headerMs);
+}
+
+void test_boot_timeout(void)
+{
+  // A module stuck in its menu prints the banner and never sends its 'C'
+  const BootScript script[] = {{BOOT_SEND, 0, BANNER}, {BOOT_EXPECT, 0, "2"}};
+
+  int fds[2];
+  TEST_ASSERT_EQUAL_INT(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  SocketPort          port(fds[0]);
+  YmodemBootTransport boot(port);
+  ScriptedBootloader  module(fds[1], script, 2);
+
+  uint32_t start = Ymodem_Millis();
+  TEST_ASSERT_EQUAL_INT(YMODEM_TIMEOUT, boot.handshake([&module]() { module.reset(); }, "1", 200));
+  uint32_t elapsed = Ymodem_Millis() - start;
+  TEST_ASSERT_TRUE(elapsed >= 200 && elapsed < 400);
+  TEST_ASSERT_FALSE(boot.ready());
+  TEST_ASSERT_EQUAL_UINT32(strlen(BANNER), boot.stats().discarded);
+  TEST_ASSERT_EQUAL_UINT32(0, boot.stats().resetToReadyUs);
+
+  // Without a pending 'C' the reads go to the link
+  uint8_t byte;
+  TEST_ASSERT_EQUAL_INT(0, boot.read(&byte, 1, 10));
+  module.join();
+  close(fds[0]);
+  close(fds[1]);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_boot_handover);
+  RUN_TEST(test_boot_latency_against_polling);
+  RUN_TEST(test_boot_timeout);
+  return UNITY_END();
+}
@@ -0,0 +1,200 @@
+/**
+ * @file test_broadcast.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Host tests for the one-to-many Ymodem transmission
+ * @version 0.1
+ * @date 2025-05-28
+ *
+ * Every receiver runs on its own thread at the end of a socket pair. The sender
+ * side of each pair is throttled to simulate the baud rate of a UART, so the
+ * time of a broadcast can be compared with the same transfers run one after
+ * the other.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "../ymodem_fixtures.h"
+#include "YmodemBroadcast.h"
+#include <sys/socket.h>
+#include <unity.h>
+
+#define PORTS (3)                /*!< Simulated receivers */
+#define FILE_BYTES (48 * 1024)   /*!< Size of the broadcast file */
+#define US_PER_BYTE (2)          /*!< Throttle of the simulated ports */
+
+struct SocketPair
+{
+  int fds[2];
+
+  SocketPair()
+  {
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+  }
+
+  ~SocketPair()
+  {
+    close(fds[0]);
+    close(fds[1]);
+  }
+};
+
+/**
+ * @brief Receiver thread at the end of a simulated port.
+ */
+struct Target
+{
+  SocketPair     pair;
+  SocketPort     sender;
+  SocketPort     receiverPort;
+  MemorySink     sink;
+  YmodemReceiver receiver;
+  int            received = 0;
+  std::thread    thread;
+
+  explicit Target(uint32_t usPerByte) : sender(pair.fds[0], usPerByte), receiverPort(pair.fds[1], 0), receiver(sink, FILE_BYTES)
+  {
+  }
+
+  ~Target()
+  {
+    join();
+  }
+
+  void start()
+  {
+    thread = std::thread([this]() { received = Ymodem_RunSession(receiver, receiverPort); });
+  }
+
+  void join()
+  {
+    if (thread.joinable()) {
+      thread.join();
+    }
+  }
+};
+
+void test_block_window(void)
+{
+  MemorySource      source(16 * PACKET_1K_SIZE, 13, 10);
+  YmodemBlockWindow window(source, 4);
+  uint8_t           block[PACKET_1K_SIZE];
+
+  // The leader reads every block from the source, a follower inside the window copies them
+  for (uint32_t i = 0; i < 4; i++) {
+    TEST_ASSERT_EQUAL_INT(PACKET_1K_SIZE, window.read(block, PACKET_1K_SIZE, i * PACKET_1K_SIZE));
+  }
+  TEST_ASSERT_EQUAL_INT(PACKET_1K_SIZE, window.read(block, PACKET_1K_SIZE, 0));
+  TEST_ASSERT_EQUAL_MEMORY(source.data.data(), block, PACKET_1K_SIZE);
+  TEST_ASSERT_EQUAL_UINT32(4, source.reads);
+
+  // Once the leader is more than the window ahead, the follower reads from the source again
+  for (uint32_t i = 4; i < 8; i++) {
+    window.read(block, PACKET_1K_SIZE, i * PACKET_1K_SIZE);
+  }
+  TEST_ASSERT_EQUAL_INT(PACKET_1K_SIZE, window.read(block, PACKET_1K_SIZE, PACKET_1K_SIZE));
+  TEST_ASSERT_EQUAL_MEMORY(source.data.data() + PACKET_1K_SIZE, block, PACKET_1K_SIZE);
+
+  YmodemBroadcastStats stats = {};
+  window.fillStats(stats);
+  TEST_ASSERT_EQUAL_UINT32(8, stats.sourceReads);
+  TEST_ASSERT_EQUAL_UINT32(1, stats.windowHits);
+  TEST_ASSERT_EQUAL_UINT32(1, stats.rereads);
+}
+
+void test_broadcast_against_sequential(void)
+{
+  MemorySource source(FILE_BYTES, 13, 10);
+  uint32_t     sequentialMs;
+
+  // N transfers one after the other
+  {
+    std::vector<std::unique_ptr<Target>> targets;
+    uint32_t                             start = Ymodem_Millis();
+    for (int i = 0; i < PORTS; i++) {
+      targets.emplace_back(new Target(US_PER_BYTE));
+      targets[i]->start();
+      YmodemSender sender(source, "data.bin", FILE_BYTES);
+      int          result = Ymodem_RunSession(sender, targets[i]->sender);
+      targets[i]->join();
+      TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, result);
+    }
+    sequentialMs = Ymodem_Millis() - start;
+  }
+
+  // The same N transfers as one broadcast
+  std::vector<std::unique_ptr<Target>> targets;
+  YmodemBroadcast                      broadcast(source, "data.bin", FILE_BYTES);
+  for (int i = 0; i < PORTS; i++) {
+    targets.emplace_back(new Target(US_PER_BYTE));
+    targets[i]->start();
+    TEST_ASSERT_TRUE(broadcast.addTarget(targets[i]->sender));
+  }
+  source.reads = 0;
+  int result   = broadcast.run();
+  for (int i = 0; i < PORTS; i++) {
+    targets[i]->join();
+  }
+
+  const YmodemBroadcastStats& stats = broadcast.stats();
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, result);
+  for (int i = 0; i < PORTS; i++) {
+    TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, stats.results[i]);
+    TEST_ASSERT_EQUAL_INT(FILE_BYTES, targets[i]->received);
+    TEST_ASSERT_TRUE(source.data == targets[i]->sink.data);
+  }
+  TEST_ASSERT_EQUAL_UINT32(FILE_BYTES / PACKET_1K_SIZE, stats.sourceReads);
+  TEST_ASSERT_EQUAL_UINT32(stats.sourceReads + stats.rereads, source.reads);
+  TEST_ASSERT_LESS_THAN_UINT32(sequentialMs, stats.elapsedMs);
+
+  char message[128];
+  snprintf(message, sizeof(message), "%d targets: broadcast %u ms, sequential %u ms, %u source reads, %u rereads", PORTS, stats.elapsedMs,
+           sequentialMs, stats.sourceReads, stats.rereads);
+  TEST_MESSAGE(message);
+}
+
+void test_broadcast_slow_and_failed_targets(void)
+{
+  MemorySource    source(FILE_BYTES, 13, 10);
+  Target          fast(US_PER_BYTE);
+  Target          slow(4 * US_PER_BYTE);
+  Target          failing(US_PER_BYTE);
+  YmodemBroadcast broadcast(source, "data.bin", FILE_BYTES, 4);
+
+  failing.sink.failAfter = 8;
+  for (Target* target : {&fast, &slow, &failing}) {
+    target->start();
+    broadcast.addTarget(target->sender);
+  }
+  int result = broadcast.run();
+  fast.join();
+  slow.join();
+  failing.join();
+
+  // The failing receiver cancels its own transfer only, the slow one does not hold back the fast one
+  const YmodemBroadcastStats& stats = broadcast.stats();
+  TEST_ASSERT_EQUAL_INT(YMODEM_ABORTED_BY_SENDER, result);
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, stats.results[0]);
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, stats.results[1]);
+  TEST_ASSERT_EQUAL_INT(YMODEM_ABORTED_BY_SENDER, stats.results[2]);
+  TEST_ASSERT_TRUE(source.data == fast.sink.data);
+  TEST_ASSERT_TRUE(source.data == slow.sink.data);
+  TEST_ASSERT_GREATER_THAN_UINT32(0, stats.rereads);
+  TEST_ASSERT_LESS_THAN_UINT32(stats.finishedMs[1] / 2, stats.finishedMs[0]);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_block_window);
+  RUN_TEST(test_broadcast_against_sequential);
+  RUN_TEST(test_broadcast_slow_and_failed_targets);
+  return UNITY_END();
+}
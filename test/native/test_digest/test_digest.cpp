@@ -0,0 +1,107 @@
+/**
+ * @file test_digest.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Host tests for the running file digest
+ * @version 0.1
+ * @date 2025-05-26
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "YmodemDigest.h"
+#include <algorithm>
+#include <string.h>
+#include <unity.h>
+#include <vector>
+
+static void digestOf(YmodemDigest& digest, YmodemDigestType type, const char* text)
+{
+  digest.begin(type);
+  digest.update((const uint8_t*)text, strlen(text));
+  digest.finish();
+}
+
+void test_crc32_check_value(void)
+{
+  YmodemDigest digest;
+  char         text[YMODEM_DIGEST_TEXT_SIZE];
+
+  digestOf(digest, YMODEM_DIGEST_CRC32, "123456789");
+  TEST_ASSERT_EQUAL_size_t(4, digest.size());
+  TEST_ASSERT_TRUE(digest.format(text, sizeof(text)));
+  TEST_ASSERT_EQUAL_STRING("crc32:cbf43926", text);
+}
+
+void test_sha256_known_answers(void)
+{
+  YmodemDigest digest;
+  char         text[YMODEM_DIGEST_TEXT_SIZE];
+
+  digestOf(digest, YMODEM_DIGEST_SHA256, "");
+  digest.format(text, sizeof(text));
+  TEST_ASSERT_EQUAL_STRING("sha256:e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855", text);
+
+  digestOf(digest, YMODEM_DIGEST_SHA256, "abc");
+  digest.format(text, sizeof(text));
+  TEST_ASSERT_EQUAL_STRING("sha256:ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", text);
+
+  digestOf(digest, YMODEM_DIGEST_SHA256, "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq");
+  digest.format(text, sizeof(text));
+  TEST_ASSERT_EQUAL_STRING("sha256:248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1", text);
+}
+
+void test_incremental_updates_match_one_pass(void)
+{
+  std::vector<uint8_t> data(5000);
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = (uint8_t)(i * 31);
+  }
+
+  for (int type = YMODEM_DIGEST_CRC32; type <= YMODEM_DIGEST_SHA256; type++) {
+    YmodemDigest whole;
+    YmodemDigest pieces;
+    whole.begin((YmodemDigestType)type);
+    whole.update(data.data(), data.size());
+    whole.finish();
+
+    // Uneven pieces, like the last block of a file
+    pieces.begin((YmodemDigestType)type);
+    for (size_t offset = 0, step = 1; offset < data.size(); offset += step, step = step * 3 + 1) {
+      pieces.update(data.data() + offset, std::min(step, data.size() - offset));
+    }
+    pieces.finish();
+    TEST_ASSERT_EQUAL_MEMORY(whole.value(), pieces.value(), whole.size());
+  }
+}
+
+void test_parse_and_match(void)
+{
+  YmodemDigest digest;
+  digestOf(digest, YMODEM_DIGEST_CRC32, "123456789");
+
+  TEST_ASSERT_EQUAL_UINT8(YMODEM_DIGEST_CRC32, YmodemDigest::parseType("crc32:CBF43926"));
+  TEST_ASSERT_EQUAL_UINT8(YMODEM_DIGEST_NONE, YmodemDigest::parseType("crc32:cbf4392"));
+  TEST_ASSERT_EQUAL_UINT8(YMODEM_DIGEST_NONE, YmodemDigest::parseType("md5:cbf43926"));
+  TEST_ASSERT_EQUAL_UINT8(YMODEM_DIGEST_NONE, YmodemDigest::parseType("1234"));
+  TEST_ASSERT_TRUE(digest.matches("crc32:CBF43926"));
+  TEST_ASSERT_FALSE(digest.matches("crc32:cbf43927"));
+  TEST_ASSERT_FALSE(digest.matches("sha256:ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"));
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_crc32_check_value);
+  RUN_TEST(test_sha256_known_answers);
+  RUN_TEST(test_incremental_updates_match_one_pass);
+  RUN_TEST(test_parse_and_match);
+  return UNITY_END();
+}
@@ -0,0 +1,295 @@
+/**
+ * @file test_engine.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Host tests for the compile-time specialized Ymodem engine
+ * @version 0.1
+ * @date 2025-05-26
+ *
+ * The engines run on two threads connected by a socket pair. The session state
+ * machines are run over the same link to check that both implementations
+ * interoperate and to compare their cost per block.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "../ymodem_fixtures.h"
+#include "YmodemEngine.h"
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unity.h>
+
+/**
+ * @brief Shared fixtures made final, so the engine can inline their calls.
+ */
+class EnginePort final : public SocketPort
+{
+public:
+  using SocketPort::SocketPort;
+};
+
+class EngineSink final : public MemorySink
+{
+};
+
+/**
+ * @brief Port losing one of the bytes it writes.
+ */
+class LossyPort final : public SocketPort
+{
+public:
+  size_t dropAt = SIZE_MAX; // Written byte lost, counted from 0
+
+  using SocketPort::SocketPort;
+
+  int write(const uint8_t* data, size_t size) override
+  {
+    size_t first = written;
+    written += size;
+    if (dropAt < first || dropAt >= written) {
+      return SocketPort::write(data, size);
+    }
+    size_t index = dropAt - first;
+    if (index > 0 && SocketPort::write(data, index) != (int)index) {
+      return TRANSPORT_ERROR;
+    }
+    if (index + 1 < size && SocketPort::write(data + index + 1, size - index - 1) != (int)(size - index - 1)) {
+      return TRANSPORT_ERROR;
+    }
+    return (int)size;
+  }
+
+private:
+  size_t written = 0;
+};
+
+typedef YmodemEngine<EnginePort, EngineSink>                                  Engine;
+typedef YmodemEngine<EnginePort, EngineSink, PACKET_SIZE, YmodemCrcBitwise<>> SmallEngine;
+typedef YmodemEngine<LossyPort, EngineSink>                                   LossyEngine;
+typedef std::chrono::steady_clock                                             Clock;
+
+struct Link
+{
+  int fds[2];
+
+  Link()
+  {
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+  }
+
+  ~Link()
+  {
+    close(fds[0]);
+    close(fds[1]);
+  }
+};
+
+static uint32_t elapsedUs(Clock::time_point start)
+{
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+}
+
+void test_crc_policies(void)
+{
+  MemorySource source(PACKET_1K_SIZE);
+  uint16_t     expected = crc16(source.data.data(), source.data.size());
+
+  TEST_ASSERT_EQUAL_HEX16(expected, YmodemCrcTable<>::compute(source.data.data(), source.data.size()));
+  TEST_ASSERT_EQUAL_HEX16(expected, YmodemCrcBitwise<>::compute(source.data.data(), source.data.size()));
+
+  // Cost of the CRC of a 1K block with each routine
+  const int         rounds = 2000;
+  volatile uint16_t sink   = 0;
+  Clock::time_point start  = Clock::now();
+  for (int i = 0; i < rounds; i++) {
+    sink = sink + crc16(source.data.data(), source.data.size());
+  }
+  uint32_t library = elapsedUs(start);
+  start            = Clock::now();
+  for (int i = 0; i < rounds; i++) {
+    sink = sink + YmodemCrcTable<>::compute(source.data.data(), source.data.size());
+  }
+  uint32_t table = elapsedUs(start);
+  start          = Clock::now();
+  for (int i = 0; i < rounds; i++) {
+    sink = sink + YmodemCrcBitwise<>::compute(source.data.data(), source.data.size());
+  }
+  uint32_t bitwise = elapsedUs(start);
+
+  char message[128];
+  snprintf(message, sizeof(message), "CRC of a 1K block: crc16 %u ns, table %u ns, bitwise %u ns", library * 1000 / rounds, table * 1000 / rounds,
+           bitwise * 1000 / rounds);
+  TEST_MESSAGE(message);
+}
+
+void test_engine_transfer(void)
+{
+  Link         link;
+  EnginePort   rxLink(link.fds[0]);
+  EnginePort   txLink(link.fds[1]);
+  MemorySource source(5000);
+  EngineSink   sink;
+  Engine       rx(rxLink);
+  Engine       tx(txLink);
+
+  int         sent = 0;
+  std::thread sender([&]() { sent = tx.transmit(source, "data.bin", source.data.size()); });
+  int         received = rx.receive(sink, 1024 * 1024);
+  sender.join();
+
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, sent);
+  TEST_ASSERT_EQUAL_INT(5000, received);
+  TEST_ASSERT_EQUAL_STRING("data.bin", sink.name.c_str());
+  TEST_ASSERT_TRUE(sink.closed);
+  TEST_ASSERT_TRUE(source.data == sink.data);
+  TEST_ASSERT_EQUAL_UINT32(6, rx.stats().packets); // Header and 5 blocks
+}
+
+void test_engine_name_overflow(void)
+{
+  Link         link;
+  EnginePort   rxLink(link.fds[0]);
+  EnginePort   txLink(link.fds[1]);
+  MemorySource source(5000);
+  EngineSink   sink;
+  Engine       rx(rxLink);
+  Engine       tx(txLink);
+  std::string  name(PACKET_SIZE - 4, 'a');
+
+  // The name fits in the header but not with its size, the engine cancels instead of cutting it
+  int         sent = 0;
+  std::thread sender([&]() { sent = tx.transmit(source, name.c_str(), source.data.size()); });
+  int         received = rx.receive(sink, 1024 * 1024);
+  sender.join();
+
+  TEST_ASSERT_EQUAL_INT(YMODEM_HEADER_OVERFLOW, sent);
+  TEST_ASSERT_TRUE(received < 0);
+  TEST_ASSERT_EQUAL_UINT32(0, tx.stats().packets);
+  TEST_ASSERT_EQUAL_UINT32(0, sink.data.size());
+}
+
+void test_engine_lost_answer(void)
+{
+  MemorySource source(3000);
+
+  // The receiver writes 'C', the ACK of the header, then 'C' for the data: either answer may be lost
+  for (size_t dropAt = 1; dropAt <= 2; dropAt++) {
+    Link        link;
+    LossyPort   rxLink(link.fds[0]);
+    EnginePort  txLink(link.fds[1]);
+    EngineSink  sink;
+    LossyEngine rx(rxLink);
+    Engine      tx(txLink);
+    rxLink.dropAt = dropAt;
+
+    int         sent = 0;
+    std::thread sender([&]() { sent = tx.transmit(source, "data.bin", source.data.size()); });
+    int         received = rx.receive(sink, 1024 * 1024);
+    sender.join();
+
+    TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, sent);
+    TEST_ASSERT_EQUAL_INT(3000, received);
+    TEST_ASSERT_TRUE(source.data == sink.data);
+    // A lost ACK is answered by the 'C' behind it, a lost 'C' by the receiver once it times out
+    TEST_ASSERT_EQUAL_UINT32(dropAt - 1, rx.stats().timeouts);
+  }
+}
+
+void test_engine_interoperates_with_sessions(void)
+{
+  MemorySource source(3000);
+
+  // 128-byte engine receiving from the session sender, which always uses 1K blocks
+  {
+    Link         link;
+    EnginePort   rxLink(link.fds[0]);
+    EnginePort   txLink(link.fds[1]);
+    EngineSink   sink;
+    SmallEngine  rx(rxLink);
+    YmodemSender tx(source, "data.bin", source.data.size());
+    std::thread  sender([&]() { Ymodem_RunSession(tx, txLink); });
+    int          received = rx.receive(sink, 1024 * 1024);
+    sender.join();
+    TEST_ASSERT_EQUAL_INT(YMODEM_BUFFER_OVERFLOW, received);
+    TEST_ASSERT_EQUAL_INT(YMODEM_ABORTED_BY_SENDER, tx.result());
+  }
+
+  // Session receiver fed by a 128-byte engine
+  {
+    Link           link;
+    EnginePort     rxLink(link.fds[0]);
+    EnginePort     txLink(link.fds[1]);
+    EngineSink     sink;
+    SmallEngine    tx(txLink);
+    YmodemReceiver rx(sink, 1024 * 1024);
+    int            sent = 0;
+    std::thread    sender([&]() { sent = tx.transmit(source, "data.bin", source.data.size()); });
+    int            received = Ymodem_RunSession(rx, rxLink);
+    sender.join();
+    TEST_ASSERT_EQUAL_INT(3000, received);
+    TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, sent);
+    TEST_ASSERT_TRUE(source.data == sink.data);
+  }
+}
+
+void test_engine_against_sessions(void)
+{
+  const size_t size = 512 * 1024;
+  MemorySource source(size);
+  char         message[128];
+  uint32_t     engineUs, sessionUs;
+
+  {
+    Link        link;
+    EnginePort  rxLink(link.fds[0]);
+    EnginePort  txLink(link.fds[1]);
+    EngineSink  sink;
+    Engine      rx(rxLink);
+    Engine      tx(txLink);
+
+    Clock::time_point start = Clock::now();
+    std::thread       sender([&]() { tx.transmit(source, "data.bin", size); });
+    int               received = rx.receive(sink, size);
+    sender.join();
+    engineUs = elapsedUs(start);
+    TEST_ASSERT_EQUAL_INT(size, received);
+  }
+  {
+    Link           link;
+    EnginePort     rxLink(link.fds[0]);
+    EnginePort     txLink(link.fds[1]);
+    EngineSink     sink;
+    YmodemReceiver rx(sink, size);
+    YmodemSender   tx(source, "data.bin", size);
+
+    Clock::time_point start = Clock::now();
+    std::thread       sender([&]() { Ymodem_RunSession(tx, txLink); });
+    int               received = Ymodem_RunSession(rx, rxLink);
+    sender.join();
+    sessionUs = elapsedUs(start);
+    TEST_ASSERT_EQUAL_INT(size, received);
+  }
+
+  snprintf(message, sizeof(message), "Per 1K block: engine %u ns, sessions %u ns", (unsigned)(engineUs * 1000ULL / (size / PACKET_1K_SIZE)),
+           (unsigned)(sessionUs * 1000ULL / (size / PACKET_1K_SIZE)));
+  TEST_MESSAGE(message);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_crc_policies);
+  RUN_TEST(test_engine_transfer);
+  RUN_TEST(test_engine_name_overflow);
+  RUN_TEST(test_engine_lost_answer);
+  RUN_TEST(test_engine_interoperates_with_sessions);
+  RUN_TEST(test_engine_against_sessions);
+  return UNITY_END();
+}
@@ -0,0 +1,222 @@
+/**
+ * @file test_fec.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Host tests for the Reed-Solomon parity of the Ymodem packets
+ * @version 0.1
+ * @date 2025-06-18
+ *
+ * The sessions are connected through a simulated serial line at 115200 baud
+ * with a round-trip latency and a bit error rate on the data direction, driven
+ * by a virtual clock, so the goodput with and without the parity can be
+ * compared as the line gets noisier.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "../ymodem_fixtures.h"
+#include "YmodemFec.h"
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+#include <vector>
+
+#define LINE_BYTE_US (87)      // One byte at 115200 baud
+#define LINE_RTT_US (20000)    // Round trip of the line, a long cable with a USB adapter at each end
+#define FILE_BYTES (64 * 1024) // Size of the file of the goodput test
+
+/**
+ * @brief Runs a transfer over the simulated line, every byte arrives half a round trip after it was sent.
+ *
+ * @return uint64_t Time the transfer took, in microseconds.
+ */
+static uint64_t transfer(YmodemSession& tx, YmodemSession& rx, Line& toReceiver)
+{
+  Line toSender(LINE_BYTE_US * 1000, LINE_RTT_US / 2, true);
+
+  toReceiver.byteNs    = LINE_BYTE_US * 1000;
+  toReceiver.latencyUs = LINE_RTT_US / 2;
+  toReceiver.paced     = true;
+  return runLine(tx, rx, toReceiver, toSender);
+}
+
+void test_fec_packets(void)
+{
+  static uint8_t packet[YMODEM_FEC_FRAME_SIZE(PACKET_8K_SIZE)];
+  static uint8_t sent[YMODEM_FEC_FRAME_SIZE(PACKET_8K_SIZE)];
+  static uint8_t data[PACKET_8K_SIZE];
+  for (int i = 0; i < PACKET_8K_SIZE; i++) {
+    data[i] = (uint8_t)(i * 13 + (i >> 8));
+  }
+
+  // The header of the large packets, the data padded to the block, the CRC-32 and 5 codewords of parity
+  TEST_ASSERT_EQUAL_INT(5, YMODEM_FEC_CODEWORDS(PACKET_1K_SIZE));
+  TEST_ASSERT_EQUAL_size_t(YMODEM_FEC_FRAME_SIZE(PACKET_1K_SIZE), Ymodem_PrepareFecPacket(packet, 0x1234, 100, PACKET_1K_SIZE, data));
+  const uint8_t header[] = {FTX, 0x12, 0x34, 0xed, 0xcb, 0x00, 100};
+  TEST_ASSERT_EQUAL_MEMORY(header, packet, PACKET_LARGE_HEADER);
+  TEST_ASSERT_EQUAL_MEMORY(data, packet + PACKET_LARGE_HEADER, 100);
+  static const uint8_t zeros[PACKET_1K_SIZE] = {};
+  TEST_ASSERT_EQUAL_MEMORY(zeros, packet + PACKET_LARGE_HEADER + 100, PACKET_1K_SIZE - 100);
+  const uint8_t* crc = packet + PACKET_LARGE_HEADER + PACKET_1K_SIZE;
+  TEST_ASSERT_EQUAL_HEX32(Ymodem_Crc32(0, packet + 1, PACKET_LARGE_HEADER - 1 + PACKET_1K_SIZE),
+                          ((uint32_t)crc[0] << 24) | (crc[1] << 16) | (crc[2] << 8) | crc[3]);
+  TEST_ASSERT_EQUAL_INT(0, Ymodem_FecRepair(packet + 1, YMODEM_FEC_MESSAGE_SIZE(PACKET_1K_SIZE)));
+
+  // Up to 8 damaged bytes per codeword are repaired; interleaved, so is a burst of 8 bytes per codeword
+  size_t message = YMODEM_FEC_MESSAGE_SIZE(PACKET_8K_SIZE);
+  size_t count   = YMODEM_FEC_CODEWORDS(PACKET_8K_SIZE);
+  size_t size    = Ymodem_PrepareFecPacket(sent, 7, PACKET_8K_SIZE, PACKET_8K_SIZE, data);
+  memcpy(packet, sent, size);
+  for (size_t i = 0; i < YMODEM_FEC_PARITY / 2 * count; i++) {
+    packet[3000 + i] ^= 0xa5;
+  }
+  TEST_ASSERT_EQUAL_INT(YMODEM_FEC_PARITY / 2 * count, Ymodem_FecRepair(packet + 1, message));
+  TEST_ASSERT_EQUAL_MEMORY(sent, packet, size);
+
+  // The damage may hit the parity as well
+  packet[1 + message + 3] ^= 0xff;
+  packet[1 + message + count * YMODEM_FEC_PARITY - 1] ^= 0x01;
+  TEST_ASSERT_EQUAL_INT(2, Ymodem_FecRepair(packet + 1, message));
+  TEST_ASSERT_EQUAL_MEMORY(sent, packet, size);
+
+  // One byte more in a codeword is beyond the parity
+  for (size_t i = 0; i <= YMODEM_FEC_PARITY / 2; i++) {
+    packet[1 + i * count] ^= 0x5a;
+  }
+  TEST_ASSERT_EQUAL_INT(-1, Ymodem_FecRepair(packet + 1, message));
+
+  // The header announces the parity after the other fields
+  Ymodem_PrepareIntialPacket(packet, "data.bin", 5000, NULL, PACKET_4K_SIZE, 0, 0, true, true);
+  TEST_ASSERT_EQUAL_STRING("5000 blk:4096 skip fec", (const char*)packet + PACKET_HEADER + 9);
+  TEST_ASSERT_TRUE(extractFileFec(packet));
+  TEST_ASSERT_TRUE(extractFileSkip(packet));
+  Ymodem_PrepareIntialPacket(packet, "data.bin", 5000);
+  TEST_ASSERT_FALSE(extractFileFec(packet));
+
+  // A long name leaves room for the skip, not for the fec after it
+  char name[PACKET_SIZE];
+  memset(name, 'n', sizeof(name));
+  name[114] = '\0';
+  TEST_ASSERT_EQUAL_UINT8(YMODEM_FIELD_FEC, Ymodem_PrepareIntialPacket(packet, name, 5000, NULL, PACKET_1K_SIZE, 0, 0, true, true));
+  TEST_ASSERT_EQUAL_STRING("5000 skip", (const char*)packet + PACKET_HEADER + 115);
+  TEST_ASSERT_FALSE(extractFileFec(packet));
+}
+
+void test_fec_negotiation(void)
+{
+  MemorySource source(50000);
+  struct
+  {
+    bool    sender;
+    bool    receiver;
+    size_t  block;
+    uint8_t start;   // Start of the data packets
+    size_t  packets; // Data packets of the file
+  } cases[] = {
+      {true, true, PACKET_1K_SIZE, FTX, 49},
+      {true, true, PACKET_8K_SIZE, FTX, 7},
+      {true, false, PACKET_1K_SIZE, STX, 49},
+      {false, true, PACKET_1K_SIZE, STX, 49},
+      {false, true, PACKET_4K_SIZE, LTX, 13},
+  };
+
+  for (const auto& c : cases) {
+    MemorySink     sink;
+    YmodemSender   tx(source, "data.bin", source.data.size());
+    YmodemReceiver rx(sink, 100000);
+    Line           line;
+    TEST_ASSERT_TRUE(tx.setFec(c.sender));
+    TEST_ASSERT_TRUE(rx.setFec(c.receiver));
+    TEST_ASSERT_TRUE(tx.setBlockSize(c.block));
+    TEST_ASSERT_TRUE(rx.setBlockSize(c.block));
+    tx.setDigest(YMODEM_DIGEST_CRC32);
+    rx.setDigest(YMODEM_DIGEST_CRC32);
+    transfer(tx, rx, line);
+
+    TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, tx.result());
+    TEST_ASSERT_EQUAL_INT(50000, rx.result());
+    TEST_ASSERT_TRUE(sink.data == source.data);
+    TEST_ASSERT_EQUAL_size_t(c.packets, line.countStarts(c.start));
+    TEST_ASSERT_EQUAL_UINT32(0, rx.stats().retries);
+    TEST_ASSERT_EQUAL_MEMORY(tx.digest().value(), rx.digest().value(), 4);
+  }
+
+  // Damaged packets are repaired without a NAK
+  MemorySink     sink;
+  YmodemSender   tx(source, "data.bin", source.data.size());
+  YmodemReceiver rx(sink, 100000);
+  Line           line;
+  line.ber = 2e-4;
+  tx.setFec(true);
+  rx.setFec(true);
+  transfer(tx, rx, line);
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, tx.result());
+  TEST_ASSERT_TRUE(sink.data == source.data);
+  TEST_ASSERT_TRUE(rx.stats().repaired > 20);
+  TEST_ASSERT_TRUE(rx.stats().retries < rx.stats().repaired / 4);
+
+  // A buffer given to the constructor that is too small
+  uint8_t        frame[YMODEM_FRAME_SIZE];
+  YmodemReceiver small(sink, 100000, frame);
+  TEST_ASSERT_FALSE(small.setFec(true));
+  TEST_ASSERT_TRUE(small.setFec(false));
+}
+
+void test_fec_goodput_vs_ber(void)
+{
+  MemorySource source(FILE_BYTES);
+  const double rates[] = {0, 1e-5, 5e-5, 1e-4, 2e-4, 5e-4};
+
+  for (double ber : rates) {
+    uint32_t bytesPerSecond[2];
+    uint32_t retries[2];
+    uint32_t repaired = 0;
+    for (int fec = 0; fec < 2; fec++) {
+      MemorySink     sink;
+      YmodemSender   tx(source, "data.bin", source.data.size());
+      YmodemReceiver rx(sink, 100000);
+      Line           line;
+      line.ber = ber;
+      tx.setFec(fec != 0);
+      rx.setFec(fec != 0);
+      uint64_t us = transfer(tx, rx, line);
+
+      // A transfer that gave up has no goodput
+      bool complete       = tx.result() == YMODEM_TRANSMIT_OK && sink.data == source.data;
+      bytesPerSecond[fec] = complete ? (uint32_t)(source.data.size() * 1000000ULL / us) : 0;
+      retries[fec]        = rx.stats().retries;
+      if (fec) {
+        repaired = rx.stats().repaired;
+        TEST_ASSERT_TRUE(complete);
+      }
+    }
+
+    char message[128];
+    snprintf(message, sizeof(message), "BER %.0e: without FEC %5u B/s %4u NAK, with FEC %5u B/s %4u NAK %4u repaired", ber, bytesPerSecond[0],
+             retries[0], bytesPerSecond[1], retries[1], repaired);
+    TEST_MESSAGE(message);
+    if (ber == 0) {
+      // The price of the parity on a clean line
+      TEST_ASSERT_TRUE(bytesPerSecond[1] * 100 > bytesPerSecond[0] * 85);
+    }
+    else if (ber >= 5e-5) {
+      TEST_ASSERT_TRUE(bytesPerSecond[1] > bytesPerSecond[0]);
+    }
+  }
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_fec_packets);
+  RUN_TEST(test_fec_negotiation);
+  RUN_TEST(test_fec_goodput_vs_ber);
+  return UNITY_END();
+}
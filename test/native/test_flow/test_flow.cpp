@@ -0,0 +1,307 @@
+/**
+ * @file test_flow.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Host tests for the receive path with and without RTS/CTS flow control
+ * @version 0.1
+ * @date 2025-06-05
+ *
+ * The receiving ESP32 is modelled byte by byte on a simulated clock: a 128-byte
+ * hardware FIFO, the driver ring buffer of BUF_SIZE * 2 bytes, and LittleFS
+ * writes that stall the receiving task and keep the UART interrupt from
+ * draining the FIFO while the flash is busy. Without flow control the bytes
+ * arriving meanwhile are lost and the transport reports an overrun, as
+ * UartTransport does; with it, RTS holds the sender back once the FIFO reaches
+ * UART_RX_FLOW_THRESHOLD bytes.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "../ymodem_fixtures.h"
+#include "ZmodemReceive.h"
+#include "ZmodemTransmit.h"
+#include <deque>
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+#include <vector>
+
+#define SIM_FIFO_SIZE (128)        // Hardware RX FIFO of the ESP32 UART
+#define SIM_RING_SIZE (BUF_SIZE * 2) // Driver ring buffer installed by UartTransport
+#define SIM_STALL_EVERY (4096)     // Bytes written between two LittleFS block erases
+#define SIM_STALL_NS (25000000ULL) // Duration of a block erase, the flash cache is disabled meanwhile
+#define SIM_HOST_BUFFER (4096)     // Output buffer of the sending host tty driver
+
+/**
+ * @brief State of the simulated receiving UART and of its task.
+ */
+struct SimUart
+{
+  bool                flow       = false; // RTS/CTS enabled
+  std::deque<uint8_t> fifo;               // Hardware FIFO
+  std::deque<uint8_t> ring;               // Driver ring buffer
+  bool                overrun    = false; // Bytes lost since the last read
+  uint32_t            overruns   = 0;     // Reads that returned TRANSPORT_OVERRUN
+  uint64_t            stallUntil = 0;     // End of the flash write in progress, in ns
+
+  bool rts() const
+  {
+    return !flow || fifo.size() < UART_RX_FLOW_THRESHOLD;
+  }
+
+  void arrive(uint8_t byte)
+  {
+    if (fifo.size() >= SIM_FIFO_SIZE) {
+      overrun = true;
+      return;
+    }
+    fifo.push_back(byte);
+  }
+
+  // UART interrupt, only while the flash is idle. A full ring leaves the bytes in the FIFO.
+  void drain()
+  {
+    while (!fifo.empty() && ring.size() < SIM_RING_SIZE) {
+      ring.push_back(fifo.front());
+      fifo.pop_front();
+    }
+  }
+};
+
+class StallingSink : public YmodemReceiveSink
+{
+public:
+  std::vector<uint8_t> data;
+  SimUart&             uart;
+  const uint64_t&      now;
+
+  StallingSink(SimUart& uart, const uint64_t& now) : uart(uart), now(now)
+  {
+  }
+
+  bool open(const char* fileName, uint32_t fileSize) override
+  {
+    data.clear();
+    return true;
+  }
+
+  int write(const uint8_t* block, size_t length) override
+  {
+    if ((data.size() + length) / SIM_STALL_EVERY != data.size() / SIM_STALL_EVERY) {
+      uart.stallUntil = std::max(uart.stallUntil, now) + SIM_STALL_NS;
+    }
+    data.insert(data.end(), block, block + length);
+    return length;
+  }
+};
+
+struct FlowResult
+{
+  uint32_t bytesPerSecond;
+  uint32_t retries;
+  uint32_t overruns;
+};
+
+/**
+ * @brief Moves all the output of a session, control bytes and packet, to a driver buffer.
+ */
+static void takeOutput(YmodemSession& session, std::deque<uint8_t>& buffer)
+{
+  while (session.outputSize() > 0) {
+    buffer.insert(buffer.end(), session.output(), session.output() + session.outputSize());
+    session.consumeOutput(session.outputSize());
+  }
+}
+
+/**
+ * @brief Runs a transfer from a host sender to the simulated receiver.
+ */
+static FlowResult runFlow(YmodemSession& tx, YmodemSession& rx, SimUart& uart, uint64_t& now, uint32_t baudRate, size_t size)
+{
+  uint64_t                                 byteNs  = 10ULL * 1000000000ULL / baudRate;
+  uint64_t                                 txFree  = 0;
+  bool                                     sending = false;
+  uint64_t                                 arrival = 0;
+  uint8_t                                  onWire  = 0;
+  std::deque<std::pair<uint64_t, uint8_t>> answers;
+  uint64_t                                 answerFree = 0;
+  std::deque<uint8_t>                      hostOut; // Driver buffer of the sending host, written at once
+
+  now = 1000000000ULL;
+  rx.start(now / 1000000);
+  tx.start(now / 1000000);
+  for (long steps = 0; steps < 50000000 && !(tx.isDone() && rx.isDone()); steps++) {
+    uint32_t ms      = now / 1000000;
+    bool     stalled = now < uart.stallUntil;
+
+    // Receiving task: a read reports the overrun and drops what is buffered, or hands the bytes over
+    if (!stalled) {
+      uart.drain();
+      if (uart.overrun) {
+        uart.overrun = false;
+        uart.overruns++;
+        uart.fifo.clear();
+        uart.ring.clear();
+      }
+      else if (!uart.ring.empty() && !rx.isDone()) {
+        std::vector<uint8_t> bytes(uart.ring.begin(), uart.ring.end());
+        uart.ring.clear();
+        rx.feed(bytes.data(), bytes.size(), ms);
+      }
+      rx.poll(ms);
+      // The answers leave once the write that produced them has returned
+      if (rx.outputSize() > 0 && now >= uart.stallUntil) {
+        std::deque<uint8_t> bytes;
+        takeOutput(rx, bytes);
+        for (uint8_t byte : bytes) {
+          answerFree = std::max(answerFree, now) + byteNs;
+          answers.push_back(std::make_pair(answerFree, byte));
+        }
+      }
+    }
+
+    // Sending host, never stalled: its output is written to the driver as soon as it is produced
+    std::vector<uint8_t> arrived;
+    while (!answers.empty() && answers.front().first <= now) {
+      arrived.push_back(answers.front().second);
+      answers.pop_front();
+    }
+    if (!arrived.empty() && !tx.isDone()) {
+      tx.feed(arrived.data(), arrived.size(), ms);
+    }
+    // A streaming sender is polled while its blocks fit in the driver buffer, as a blocking write would do
+    if (!tx.streaming() || hostOut.size() < SIM_HOST_BUFFER) {
+      tx.poll(ms);
+      takeOutput(tx, hostOut);
+    }
+
+    // Line from the host to the receiver, a byte starts only while CTS is asserted
+    if (sending && arrival <= now) {
+      uart.arrive(onWire);
+      sending = false;
+    }
+    if (!sending && !hostOut.empty() && txFree <= now && uart.rts()) {
+      onWire  = hostOut.front();
+      arrival = now + byteNs;
+      hostOut.pop_front();
+      txFree  = arrival;
+      sending = true;
+    }
+
+    if (now >= uart.stallUntil && !rx.isDone() && (!uart.ring.empty() || (!uart.fifo.empty() && uart.ring.size() < SIM_RING_SIZE) || uart.overrun)) {
+      continue;
+    }
+    uint64_t next = UINT64_MAX;
+    if (sending) {
+      next = arrival;
+    }
+    if (now < uart.stallUntil) {
+      next = std::min(next, uart.stallUntil);
+    }
+    if (!answers.empty()) {
+      next = std::min(next, answers.front().first);
+    }
+    const YmodemSession* sessions[] = {&tx, &rx};
+    for (const YmodemSession* session : sessions) {
+      uint64_t deadline = (uint64_t)session->nextDeadline() * 1000000;
+      if (!session->isDone() && deadline > now) {
+        next = std::min(next, deadline);
+      }
+    }
+    if (next == UINT64_MAX) {
+      break;
+    }
+    now = std::max(now, next);
+  }
+
+  uint64_t elapsedNs = now - 1000000000ULL;
+  return {(uint32_t)(size * 1000000000ULL / elapsedNs), rx.stats().retries, uart.overruns};
+}
+
+/**
+ * @brief Runs a Zmodem transfer to the simulated receiver.
+ */
+static void runZmodem(uint32_t baudRate, bool flow, uint16_t window, MemorySource& source, FlowResult& result)
+{
+  SimUart        uart;
+  uint64_t       now = 0;
+  StallingSink   sink(uart, now);
+  ZmodemSender   tx(source, "data.bin", source.data.size());
+  ZmodemReceiver rx(sink, 1000000);
+  uart.flow = flow;
+  rx.setWindow(window);
+
+  result = runFlow(tx, rx, uart, now, baudRate, source.data.size());
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, tx.result());
+  TEST_ASSERT_TRUE(sink.data == source.data);
+}
+
+/**
+ * @brief Compares Zmodem with flow control, streaming the whole file, with the two receivers that do without.
+ */
+static void compareFlow(uint32_t baudRate)
+{
+  MemorySource source(128 * 1024);
+  FlowResult   lossy, windowed, flow;
+  runZmodem(baudRate, false, 0, source, lossy);
+  runZmodem(baudRate, false, BUF_SIZE, source, windowed);
+  runZmodem(baudRate, true, 0, source, flow);
+
+  char message[160];
+  snprintf(message, sizeof(message), "%u baud: no flow control %u B/s %u retries, window %u B/s %u retries, RTS/CTS %u B/s %u retries", baudRate,
+           lossy.bytesPerSecond, lossy.retries, windowed.bytesPerSecond, windowed.retries, flow.bytesPerSecond, flow.retries);
+  TEST_MESSAGE(message);
+
+  TEST_ASSERT_TRUE(lossy.retries > 0);
+  TEST_ASSERT_TRUE(lossy.overruns > 0);
+  TEST_ASSERT_EQUAL_UINT32(0, flow.retries);
+  TEST_ASSERT_EQUAL_UINT32(0, flow.overruns);
+  TEST_ASSERT_TRUE(flow.bytesPerSecond > lossy.bytesPerSecond);
+  TEST_ASSERT_TRUE(flow.bytesPerSecond > windowed.bytesPerSecond);
+}
+
+void test_flow_921600(void)
+{
+  compareFlow(921600);
+}
+
+void test_flow_2000000(void)
+{
+  compareFlow(2000000);
+}
+
+void test_flow_ymodem_unchanged(void)
+{
+  // Ymodem writes a block before its ACK, the sender is idle during the stall with or without flow control
+  MemorySource source(64 * 1024);
+  FlowResult   results[2];
+  for (int flow = 0; flow < 2; flow++) {
+    SimUart        uart;
+    uint64_t       now = 0;
+    StallingSink   sink(uart, now);
+    YmodemSender   tx(source, "data.bin", source.data.size());
+    YmodemReceiver rx(sink, 1000000);
+    uart.flow     = flow;
+    results[flow] = runFlow(tx, rx, uart, now, 921600, source.data.size());
+    TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, tx.result());
+    TEST_ASSERT_TRUE(sink.data == source.data);
+    TEST_ASSERT_EQUAL_UINT32(0, results[flow].retries);
+  }
+  TEST_ASSERT_EQUAL_UINT32(results[0].bytesPerSecond, results[1].bytesPerSecond);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_flow_921600);
+  RUN_TEST(test_flow_2000000);
+  RUN_TEST(test_flow_ymodem_unchanged);
+  return UNITY_END();
+}
@@ -0,0 +1,216 @@
+/**
+ * @file test_ingest.cpp
+ * @author Miguel Ferrer "@MiguelFerrerF"
+ * @brief  Host tests for the double-buffered stream ingest
+ * @version 0.1
+ * @date 2025-05-26
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "streamIngest.h"
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <unity.h>
+#include <vector>
+
+#define BUFFER_SIZE 4096
+
+static std::vector<uint8_t> pattern(size_t size)
+{
+  std::vector<uint8_t> data(size);
+  for (size_t i = 0; i < size; i++) {
+    data[i] = (uint8_t)(i * 7 + (i >> 8));
+  }
+  return data;
+}
+
+/**
+ * @brief Writes the data to a pipe from another thread, in chunks, and closes it.
+ */
+static std::thread startProducer(int fd, std::vector<uint8_t> data, size_t chunk)
+{
+  return std::thread([fd, data, chunk]() {
+    for (size_t sent = 0; sent < data.size();) {
+      ssize_t len = write(fd, data.data() + sent, std::min(chunk, data.size() - sent));
+      if (len <= 0) {
+        break;
+      }
+      sent += len;
+    }
+    close(fd);
+  });
+}
+
+static StreamIngest::Writer vectorWriter(std::vector<uint8_t>& out)
+{
+  return [&out](const uint8_t* data, size_t size) {
+    out.insert(out.end(), data, data + size);
+    return true;
+  };
+}
+
+void test_known_length(void)
+{
+  int                  fds[2];
+  std::vector<uint8_t> data = pattern(10000);
+  std::vector<uint8_t> out;
+  size_t               lastProgress = 0;
+  uint32_t             calls        = 0;
+
+  TEST_ASSERT_EQUAL_INT(0, pipe(fds));
+  std::thread producer = startProducer(fds[1], data, 1000);
+
+  StreamIngest ingest(BUFFER_SIZE);
+  ingest.setLength(data.size());
+  ingest.onProgress([&](size_t written, size_t total) {
+    TEST_ASSERT_EQUAL_size_t(data.size(), total);
+    TEST_ASSERT_TRUE(written >= lastProgress);
+    lastProgress = written;
+    calls++;
+  });
+  TEST_ASSERT_EQUAL_UINT8(INGEST_OK, ingest.run(StreamIngest::fdReader(fds[0]), vectorWriter(out)));
+  producer.join();
+  close(fds[0]);
+
+  TEST_ASSERT_EQUAL_size_t(data.size(), ingest.stats().bytes);
+  TEST_ASSERT_EQUAL_UINT32(3, ingest.stats().writes);
+  TEST_ASSERT_EQUAL_size_t(data.size(), lastProgress);
+  TEST_ASSERT_EQUAL_UINT32(4, calls);
+  TEST_ASSERT_TRUE(out == data);
+}
+
+void test_unknown_length_ends_at_eof(void)
+{
+  int                  fds[2];
+  std::vector<uint8_t> data = pattern(3 * BUFFER_SIZE);
+  std::vector<uint8_t> out;
+
+  TEST_ASSERT_EQUAL_INT(0, pipe(fds));
+  std::thread producer = startProducer(fds[1], data, 512);
+
+  StreamIngest ingest(BUFFER_SIZE);
+  TEST_ASSERT_EQUAL_UINT8(INGEST_OK, ingest.run(StreamIngest::fdReader(fds[0]), vectorWriter(out)));
+  producer.join();
+  close(fds[0]);
+
+  TEST_ASSERT_EQUAL_UINT32(3, ingest.stats().writes);
+  TEST_ASSERT_TRUE(out == data);
+}
+
+void test_short_stream_and_timeout(void)
+{
+  int                  fds[2];
+  std::vector<uint8_t> out;
+
+  // The stream ends before the announced length
+  TEST_ASSERT_EQUAL_INT(0, pipe(fds));
+  std::thread producer = startProducer(fds[1], pattern(5000), 5000);
+  StreamIngest ingest(BUFFER_SIZE);
+  ingest.setLength(8000);
+  TEST_ASSERT_EQUAL_UINT8(INGEST_SHORT, ingest.run(StreamIngest::fdReader(fds[0]), vectorWriter(out)));
+  producer.join();
+  close(fds[0]);
+  TEST_ASSERT_EQUAL_size_t(5000, ingest.stats().bytes);
+
+  // The stream stays open without data
+  TEST_ASSERT_EQUAL_INT(0, pipe(fds));
+  ingest.setTimeout(20);
+  TEST_ASSERT_EQUAL_UINT8(INGEST_TIMEOUT, ingest.run(StreamIngest::fdReader(fds[0]), vectorWriter(out)));
+  close(fds[0]);
+  close(fds[1]);
+}
+
+void test_write_error_stops_ingest(void)
+{
+  int                  fds[2];
+  std::vector<uint8_t> data   = pattern(8 * BUFFER_SIZE);
+  uint32_t             writes = 0;
+
+  TEST_ASSERT_EQUAL_INT(0, pipe(fds));
+  std::thread producer = startProducer(fds[1], data, BUFFER_SIZE);
+
+  StreamIngest ingest(BUFFER_SIZE);
+  ingest.setLength(data.size());
+  IngestStatus status = ingest.run(StreamIngest::fdReader(fds[0]), [&writes](const uint8_t* data, size_t size) { return ++writes < 2; });
+  close(fds[0]); // Unblocks the producer
+  producer.join();
+
+  TEST_ASSERT_EQUAL_UINT8(INGEST_WRITE_ERROR, status);
+  TEST_ASSERT_EQUAL_size_t(BUFFER_SIZE, ingest.stats().bytes);
+  TEST_ASSERT_EQUAL_UINT32(2, writes);
+}
+
+void test_http_download_throughput(void)
+{
+  const size_t         body = 1024 * 1024;
+  std::vector<uint8_t> data = pattern(body);
+  int                  fds[2];
+  char                 header[128];
+
+  // Stand-in HTTP server: a response header followed by the body, paced like a network link
+  TEST_ASSERT_EQUAL_INT(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  std::thread server([&]() {
+    int len = snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-Length: %u\r\n\r\n", (unsigned)body);
+    write(fds[1], header, len);
+    for (size_t sent = 0; sent < body; sent += 1460) {
+      write(fds[1], data.data() + sent, std::min<size_t>(1460, body - sent));
+      if (sent % (16 * 1460) == 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+      }
+    }
+    close(fds[1]);
+  });
+
+  // Parse the header byte by byte until the empty line
+  std::string response;
+  char        c;
+  while (response.find("\r\n\r\n") == std::string::npos && read(fds[0], &c, 1) == 1) {
+    response += c;
+  }
+  size_t length = strtoul(response.c_str() + response.find("Content-Length:") + 15, NULL, 10);
+  TEST_ASSERT_EQUAL_size_t(body, length);
+
+  // Flash writes of a few hundred microseconds per block, overlapped with the reads
+  std::vector<uint8_t> out;
+  StreamIngest         ingest(BUFFER_SIZE);
+  ingest.setLength(length);
+  IngestStatus status = ingest.run(StreamIngest::fdReader(fds[0]), [&out](const uint8_t* data, size_t size) {
+    std::this_thread::sleep_for(std::chrono::microseconds(300));
+    out.insert(out.end(), data, data + size);
+    return true;
+  });
+  server.join();
+  close(fds[0]);
+
+  TEST_ASSERT_EQUAL_UINT8(INGEST_OK, status);
+  TEST_ASSERT_TRUE(out == data);
+
+  char message[96];
+  snprintf(message, sizeof(message), "%u KB/s, %u writes, %u stalls", (unsigned)(body / std::max<uint32_t>(ingest.stats().elapsedMs, 1)),
+           ingest.stats().writes, ingest.stats().stalls);
+  TEST_MESSAGE(message);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_known_length);
+  RUN_TEST(test_unknown_length_ends_at_eof);
+  RUN_TEST(test_short_stream_and_timeout);
+  RUN_TEST(test_write_error_stops_ingest);
+  RUN_TEST(test_http_download_throughput);
+  return UNITY_END();
+}
@@ -0,0 +1,204 @@
+/**
+ * @file test_log.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Host tests for the deferred log
+ * @version 0.1
+ * @date 2025-06-13
+ *
+ * The records are drained into a string instead of the console. The last test
+ * compares the cost of a log call on the transfer path with formatting and
+ * writing the same line synchronously.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "YmodemLog.h"
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <unity.h>
+#include <vector>
+
+#define PRODUCERS (4)      /*!< Tasks logging at the same time */
+#define RECORDS (20000)    /*!< Records logged by every producer */
+#define BURST (8)          /*!< Records logged by a producer between two pauses */
+#define TIMED_CALLS (2000) /*!< Calls timed by the cost comparison */
+
+static const YmodemLogEvent BLOCK_EVENT = {YMODEM_LOG_INFO, "Block %u of %u", NULL};
+static const YmodemLogEvent ERROR_EVENT = {YMODEM_LOG_ERROR, "Error %d", NULL};
+static const YmodemLogEvent DEBUG_EVENT = {YMODEM_LOG_DEBUG, "Debug %x", NULL};
+
+static int formatPercent(char* text, size_t size, const uint32_t* args)
+{
+  return snprintf(text, size, "%u%%\r", (unsigned)(args[0] * 100 / args[1]));
+}
+
+static const YmodemLogEvent PERCENT_EVENT = {YMODEM_LOG_INFO, NULL, formatPercent};
+
+static std::string drainAll(YmodemLog& log)
+{
+  std::string text;
+  log.drain([&text](const char* line, size_t size) { text.append(line, size); });
+  return text;
+}
+
+static uint64_t nowNs()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void test_log_format(void)
+{
+  YmodemLog log(8);
+  TEST_ASSERT_TRUE(log.log(&BLOCK_EVENT, 3, 40));
+  TEST_ASSERT_TRUE(log.log(&ERROR_EVENT, -5));
+  TEST_ASSERT_TRUE(log.log(&PERCENT_EVENT, 512, 1024));
+  log.setLevel(YMODEM_LOG_INFO);
+  TEST_ASSERT_FALSE(log.log(&DEBUG_EVENT, 0xbeef));
+
+  std::string text = drainAll(log);
+  TEST_ASSERT_NOT_NULL(strstr(text.c_str(), "][I] Block 3 of 40\n"));
+  TEST_ASSERT_NOT_NULL(strstr(text.c_str(), "][E] Error -5\n"));
+  // A formatter writes its own line, without the prefix
+  TEST_ASSERT_NOT_NULL(strstr(text.c_str(), "\n50%\r"));
+  TEST_ASSERT_NULL(strstr(text.c_str(), "beef"));
+
+  YmodemLogStats stats = log.stats();
+  TEST_ASSERT_EQUAL_UINT32(3, stats.recorded);
+  TEST_ASSERT_EQUAL_UINT32(3, stats.drained);
+  TEST_ASSERT_EQUAL_UINT32(0, stats.dropped);
+  TEST_ASSERT_EQUAL_UINT32(3, stats.peak);
+  TEST_ASSERT_EQUAL_size_t(0, log.drain([](const char*, size_t) {}));
+}
+
+void test_log_drop_policy(void)
+{
+  YmodemLog log(16);
+
+  // Info records stop at three quarters of the ring
+  uint32_t stored = 0;
+  for (uint32_t i = 0; i < 20; i++) {
+    stored += log.log(&BLOCK_EVENT, i, 20) ? 1 : 0;
+  }
+  TEST_ASSERT_EQUAL_UINT32(12, stored);
+
+  // Errors still fit in the last quarter, then they are dropped too
+  stored = 0;
+  for (uint32_t i = 0; i < 6; i++) {
+    stored += log.log(&ERROR_EVENT, i) ? 1 : 0;
+  }
+  TEST_ASSERT_EQUAL_UINT32(4, stored);
+  TEST_ASSERT_EQUAL_UINT32(10, log.stats().dropped);
+  TEST_ASSERT_EQUAL_UINT32(16, log.stats().peak);
+
+  // The oldest records come out first and the drops are reported once
+  std::string text = drainAll(log);
+  TEST_ASSERT_NOT_NULL(strstr(text.c_str(), "Block 0 of 20\n"));
+  TEST_ASSERT_NOT_NULL(strstr(text.c_str(), "Error 3\n"));
+  TEST_ASSERT_TRUE(strstr(text.c_str(), "Block 11 of 20") < strstr(text.c_str(), "Error 0"));
+  TEST_ASSERT_NULL(strstr(text.c_str(), "Block 12 of 20"));
+  TEST_ASSERT_NOT_NULL(strstr(text.c_str(), "][W] 10 log records dropped\n"));
+  TEST_ASSERT_EQUAL_STRING("", drainAll(log).c_str());
+
+  // Drained slots are reused
+  TEST_ASSERT_TRUE(log.log(&BLOCK_EVENT, 1, 1));
+}
+
+void test_log_concurrent_cost(void)
+{
+  YmodemLog         log(256);
+  std::atomic<bool> done{false};
+  std::vector<int>  seen(PRODUCERS * RECORDS, 0);
+  uint32_t          lines = 0;
+
+  std::thread drain([&]() {
+    auto parse = [&](const char* line, size_t size) {
+      unsigned    block = 0;
+      unsigned    total = 0;
+      const char* body  = strstr(line, "Block ");
+      if (body != NULL && sscanf(body, "Block %u of %u", &block, &total) == 2 && block < seen.size()) {
+        seen[block]++;
+        lines++;
+      }
+    };
+    while (!done.load()) {
+      log.drain(parse);
+      std::this_thread::yield();
+    }
+    log.drain(parse);
+  });
+
+  std::vector<std::thread> producers;
+  for (uint32_t p = 0; p < PRODUCERS; p++) {
+    producers.emplace_back([&log, p]() {
+      for (uint32_t i = 0; i < RECORDS; i++) {
+        log.log(&BLOCK_EVENT, p * RECORDS + i, PRODUCERS * RECORDS);
+        // A few records per block, the transfer waits for the link in between
+        if (i % BURST == BURST - 1) {
+          std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+      }
+    });
+  }
+  for (std::thread& producer : producers) {
+    producer.join();
+  }
+  done = true;
+  drain.join();
+
+  // Every record was either printed once or counted as dropped
+  YmodemLogStats stats = log.stats();
+  TEST_ASSERT_EQUAL_UINT32(PRODUCERS * RECORDS, stats.recorded + stats.dropped);
+  TEST_ASSERT_EQUAL_UINT32(stats.recorded, stats.drained);
+  TEST_ASSERT_EQUAL_UINT32(stats.recorded, lines);
+  TEST_ASSERT_TRUE(stats.peak <= 256);
+  for (int count : seen) {
+    TEST_ASSERT_TRUE(count <= 1);
+  }
+
+  // Cost on the transfer path: a record against formatting and writing the line at once
+  YmodemLog quiet(4096);
+  uint64_t  start = nowNs();
+  for (uint32_t i = 0; i < TIMED_CALLS; i++) {
+    quiet.log(&BLOCK_EVENT, i, TIMED_CALLS);
+  }
+  uint64_t deferredNs = (nowNs() - start) / TIMED_CALLS;
+
+  FILE* sink = fopen("/dev/null", "w");
+  TEST_ASSERT_NOT_NULL(sink);
+  setvbuf(sink, NULL, _IONBF, 0);
+  char line[YMODEM_LOG_LINE_SIZE];
+  start = nowNs();
+  for (uint32_t i = 0; i < TIMED_CALLS; i++) {
+    int length = snprintf(line, sizeof(line), "[%6u][I] Block %u of %u\n", (unsigned)i, (unsigned)i, (unsigned)TIMED_CALLS);
+    fwrite(line, 1, length, sink);
+  }
+  uint64_t syncNs = (nowNs() - start) / TIMED_CALLS;
+  fclose(sink);
+
+  char message[120];
+  snprintf(message, sizeof(message), "%u records, %u dropped, peak %u; %u ns per deferred call, %u ns formatted and written", stats.recorded,
+           stats.dropped, stats.peak, (unsigned)deferredNs, (unsigned)syncNs);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE(deferredNs < syncNs);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_log_format);
+  RUN_TEST(test_log_drop_policy);
+  RUN_TEST(test_log_concurrent_cost);
+  return UNITY_END();
+}
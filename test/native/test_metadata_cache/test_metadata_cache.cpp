@@ -0,0 +1,161 @@
+/**
+ * @file test_metadata_cache.cpp
+ * @author Miguel Ferrer "@MiguelFerrerF"
+ * @brief  Host tests for the file system metadata cache
+ * @version 0.1
+ * @date 2025-05-26
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "fileMetadataCache.h"
+#include <unity.h>
+
+#define TOTAL_BYTES (1024 * 1024)
+
+void test_cache_starts_empty(void)
+{
+  FileMetadataCache cache;
+  size_t            size;
+
+  TEST_ASSERT_TRUE(cache.needsRefresh());
+  TEST_ASSERT_EQUAL_size_t(0, cache.remainingSpace());
+  TEST_ASSERT_FALSE(cache.fileSize("/a.bin", &size));
+}
+
+void test_append_counts_new_blocks_only(void)
+{
+  FileMetadataCache cache(4096);
+  cache.refresh(8192, TOTAL_BYTES);
+  cache.setFileSize("/a.bin", 4000);
+
+  // 4000 + 40 bytes still fit in the first block
+  cache.onAppend("/a.bin", 40);
+  TEST_ASSERT_EQUAL_size_t(TOTAL_BYTES - 8192, cache.remainingSpace());
+
+  // 4040 + 100 bytes need a second block
+  cache.onAppend("/a.bin", 100);
+  TEST_ASSERT_EQUAL_size_t(TOTAL_BYTES - 8192 - 4096, cache.remainingSpace());
+
+  size_t size = 0;
+  TEST_ASSERT_TRUE(cache.fileSize("/a.bin", &size));
+  TEST_ASSERT_EQUAL_size_t(4140, size);
+  TEST_ASSERT_FALSE(cache.needsRefresh());
+}
+
+void test_append_to_unknown_file_is_conservative(void)
+{
+  FileMetadataCache cache(4096);
+  cache.refresh(0, TOTAL_BYTES);
+
+  cache.onAppend("/b.bin", 10);
+  TEST_ASSERT_EQUAL_size_t(TOTAL_BYTES - 2 * 4096, cache.remainingSpace());
+}
+
+void test_remove_and_invalidate(void)
+{
+  FileMetadataCache cache;
+  size_t            size;
+  cache.refresh(0, TOTAL_BYTES);
+  cache.setFileSize("/a.bin", 10);
+  cache.setFileSize("/b.bin", 20);
+
+  cache.onRemove("/a.bin");
+  TEST_ASSERT_FALSE(cache.fileSize("/a.bin", &size));
+  TEST_ASSERT_TRUE(cache.fileSize("/b.bin", &size));
+  TEST_ASSERT_TRUE(cache.needsRefresh());
+
+  cache.refresh(0, TOTAL_BYTES);
+  cache.invalidate();
+  TEST_ASSERT_FALSE(cache.fileSize("/b.bin", &size));
+  TEST_ASSERT_TRUE(cache.needsRefresh());
+}
+
+void test_refresh_policy(void)
+{
+  FileMetadataCache cache(4096);
+
+  // Periodic refresh to bound the drift of the estimate
+  cache.refresh(0, TOTAL_BYTES);
+  cache.setFileSize("/a.bin", 0);
+  for (int i = 0; i < FILESYSTEM_CACHE_REFRESH_WRITES - 1; i++) {
+    cache.onAppend("/a.bin", 1);
+  }
+  TEST_ASSERT_FALSE(cache.needsRefresh());
+  cache.onAppend("/a.bin", 1);
+  TEST_ASSERT_TRUE(cache.needsRefresh());
+
+  // Exact figures when the file system is almost full
+  cache.refresh(TOTAL_BYTES - FILESYSTEM_CACHE_REFRESH_MARGIN + 1, TOTAL_BYTES);
+  TEST_ASSERT_TRUE(cache.needsRefresh());
+}
+
+void test_reservation(void)
+{
+  FileMetadataCache cache(4096);
+  cache.refresh(0, 10 * 4096);
+
+  // The margin stays free and the size is counted in whole blocks
+  TEST_ASSERT_FALSE(cache.reserve(9 * 4096 + 1));
+  TEST_ASSERT_TRUE(cache.reserve(6000));
+  TEST_ASSERT_EQUAL_size_t(8 * 4096, cache.remainingSpace());
+  TEST_ASSERT_FALSE(cache.reserve(8 * 4096));
+
+  // Written blocks move from the reservation to the used bytes, the rest is given back
+  cache.consume(0, 4000);
+  TEST_ASSERT_EQUAL_size_t(4096, cache.reservedSpace());
+  TEST_ASSERT_EQUAL_size_t(8 * 4096, cache.remainingSpace());
+  cache.release(4000, 2000);
+  TEST_ASSERT_EQUAL_size_t(0, cache.reservedSpace());
+  TEST_ASSERT_EQUAL_size_t(9 * 4096, cache.remainingSpace());
+
+  // A reservation survives an invalidation, its file is still being written
+  TEST_ASSERT_TRUE(cache.reserve(4096));
+  cache.invalidate();
+  cache.refresh(0, 10 * 4096);
+  TEST_ASSERT_EQUAL_size_t(9 * 4096, cache.remainingSpace());
+}
+
+void test_reservation_while_receiving(void)
+{
+  FileMetadataCache cache(4096);
+  cache.refresh(0, 10 * 4096);
+
+  // The first byte of a receive takes a whole block, the second block stays reserved
+  TEST_ASSERT_TRUE(cache.reserve(4097));
+  cache.consume(0, 1);
+  TEST_ASSERT_EQUAL_size_t(4096, cache.reservedSpace());
+  TEST_ASSERT_EQUAL_size_t(8 * 4096, cache.remainingSpace());
+
+  // A second receive is only granted the blocks that are really free
+  TEST_ASSERT_TRUE(cache.reserve(4097));
+  TEST_ASSERT_EQUAL_size_t(6 * 4096, cache.remainingSpace());
+  TEST_ASSERT_FALSE(cache.reserve(6 * 4096));
+
+  // The end of the first file fills its reserved block, nothing is left to give back
+  cache.consume(1, 4096);
+  cache.release(4097, 0);
+  TEST_ASSERT_EQUAL_size_t(2 * 4096, cache.reservedSpace());
+  TEST_ASSERT_EQUAL_size_t(6 * 4096, cache.remainingSpace());
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_cache_starts_empty);
+  RUN_TEST(test_append_counts_new_blocks_only);
+  RUN_TEST(test_append_to_unknown_file_is_conservative);
+  RUN_TEST(test_remove_and_invalidate);
+  RUN_TEST(test_refresh_policy);
+  RUN_TEST(test_reservation);
+  RUN_TEST(test_reservation_while_receiving);
+  return UNITY_END();
+}
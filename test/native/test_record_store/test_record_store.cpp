@@ -0,0 +1,198 @@
+/**
+ * @file test_record_store.cpp
+ * @author Miguel Ferrer "@MiguelFerrerF"
+ * @brief  Host tests for the circular record store
+ * @version 0.1
+ * @date 2025-05-26
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "recordStore.h"
+#include <string.h>
+#include <unity.h>
+#include <vector>
+
+#define SEGMENTS            4
+#define RECORDS_PER_SEGMENT 8
+
+struct Measure
+{
+  time_t   time;
+  uint32_t value;
+};
+
+/**
+ * @brief Segments kept in RAM.
+ */
+class MemorySegmentStorage : public RecordSegmentStorage
+{
+public:
+  std::vector<std::vector<uint8_t>> segments = std::vector<std::vector<uint8_t>>(SEGMENTS);
+
+  size_t size(uint16_t segment) override
+  {
+    return segments[segment].size();
+  }
+  bool read(uint16_t segment, size_t offset, void* data, size_t size) override
+  {
+    if (offset + size > segments[segment].size()) {
+      return false;
+    }
+    memcpy(data, segments[segment].data() + offset, size);
+    return true;
+  }
+  bool append(uint16_t segment, const void* data, size_t size) override
+  {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    segments[segment].insert(segments[segment].end(), bytes, bytes + size);
+    return true;
+  }
+  bool erase(uint16_t segment) override
+  {
+    segments[segment].clear();
+    return true;
+  }
+  bool truncate(uint16_t segment, size_t size) override
+  {
+    segments[segment].resize(size);
+    return true;
+  }
+};
+
+static void appendMeasures(RecordStore& store, uint32_t first, uint32_t count)
+{
+  for (uint32_t i = first; i < first + count; i++) {
+    Measure measure = {(time_t)(1000 + 10 * i), i};
+    TEST_ASSERT_TRUE(store.append(&measure));
+  }
+}
+
+void test_append_and_read(void)
+{
+  MemorySegmentStorage storage;
+  RecordStore          store(storage, sizeof(Measure), SEGMENTS, RECORDS_PER_SEGMENT);
+  Measure              measure;
+
+  TEST_ASSERT_TRUE(store.begin());
+  TEST_ASSERT_EQUAL_UINT32(0, store.count());
+  TEST_ASSERT_FALSE(store.read(0, &measure));
+
+  appendMeasures(store, 0, 20);
+  TEST_ASSERT_EQUAL_UINT32(20, store.count());
+  TEST_ASSERT_TRUE(store.read(13, &measure));
+  TEST_ASSERT_EQUAL_UINT32(13, measure.value);
+  TEST_ASSERT_FALSE(store.read(20, &measure));
+}
+
+void test_range_read_spans_segments(void)
+{
+  MemorySegmentStorage storage;
+  RecordStore          store(storage, sizeof(Measure), SEGMENTS, RECORDS_PER_SEGMENT);
+  Measure              measures[12];
+
+  store.begin();
+  appendMeasures(store, 0, 20);
+  TEST_ASSERT_TRUE(store.read(5, 12, measures));
+  for (uint32_t i = 0; i < 12; i++) {
+    TEST_ASSERT_EQUAL_UINT32(5 + i, measures[i].value);
+  }
+  TEST_ASSERT_FALSE(store.read(10, 11, measures));
+}
+
+void test_full_ring_overwrites_oldest_segment(void)
+{
+  MemorySegmentStorage storage;
+  RecordStore          store(storage, sizeof(Measure), SEGMENTS, RECORDS_PER_SEGMENT);
+  Measure              measure;
+
+  store.begin();
+  appendMeasures(store, 0, SEGMENTS * RECORDS_PER_SEGMENT);
+  TEST_ASSERT_EQUAL_UINT32(SEGMENTS * RECORDS_PER_SEGMENT, store.count());
+
+  // The next record reuses the segment of records 0 to 7
+  appendMeasures(store, SEGMENTS * RECORDS_PER_SEGMENT, 1);
+  TEST_ASSERT_EQUAL_UINT32((SEGMENTS - 1) * RECORDS_PER_SEGMENT + 1, store.count());
+  TEST_ASSERT_EQUAL_UINT32(RECORDS_PER_SEGMENT, store.firstSequence());
+  TEST_ASSERT_TRUE(store.read(0, &measure));
+  TEST_ASSERT_EQUAL_UINT32(RECORDS_PER_SEGMENT, measure.value);
+  TEST_ASSERT_TRUE(store.read(store.count() - 1, &measure));
+  TEST_ASSERT_EQUAL_UINT32(SEGMENTS * RECORDS_PER_SEGMENT, measure.value);
+}
+
+void test_begin_recovers_and_drops_torn_record(void)
+{
+  MemorySegmentStorage storage;
+  Measure              measure;
+  {
+    RecordStore store(storage, sizeof(Measure), SEGMENTS, RECORDS_PER_SEGMENT);
+    store.begin();
+    appendMeasures(store, 0, 3 * SEGMENTS * RECORDS_PER_SEGMENT + 5);
+  }
+  // Power lost in the middle of a record
+  storage.segments[0].push_back(0xAA);
+
+  RecordStore store(storage, sizeof(Measure), SEGMENTS, RECORDS_PER_SEGMENT);
+  TEST_ASSERT_TRUE(store.begin());
+  TEST_ASSERT_EQUAL_UINT32((SEGMENTS - 1) * RECORDS_PER_SEGMENT + 5, store.count());
+  TEST_ASSERT_EQUAL_UINT32(2 * SEGMENTS * RECORDS_PER_SEGMENT + RECORDS_PER_SEGMENT, store.firstSequence());
+
+  appendMeasures(store, 3 * SEGMENTS * RECORDS_PER_SEGMENT + 5, 1);
+  TEST_ASSERT_TRUE(store.read(store.count() - 1, &measure));
+  TEST_ASSERT_EQUAL_UINT32(3 * SEGMENTS * RECORDS_PER_SEGMENT + 5, measure.value);
+}
+
+void test_lower_bound_by_timestamp(void)
+{
+  MemorySegmentStorage storage;
+  RecordStore          store(storage, sizeof(Measure), SEGMENTS, RECORDS_PER_SEGMENT);
+
+  store.begin();
+  TEST_ASSERT_EQUAL_UINT32(0, store.lowerBound(1000));
+  appendMeasures(store, 0, 40); // Records 8 to 39 kept, times 1080 to 1390
+
+  TEST_ASSERT_EQUAL_UINT32(0, store.lowerBound(0));
+  TEST_ASSERT_EQUAL_UINT32(0, store.lowerBound(1080));
+  TEST_ASSERT_EQUAL_UINT32(2, store.lowerBound(1095));
+  TEST_ASSERT_EQUAL_UINT32(2, store.lowerBound(1100));
+  TEST_ASSERT_EQUAL_UINT32(31, store.lowerBound(1390));
+  TEST_ASSERT_EQUAL_UINT32(32, store.lowerBound(1391));
+}
+
+void test_clear_keeps_sequence_growing(void)
+{
+  MemorySegmentStorage storage;
+  RecordStore          store(storage, sizeof(Measure), SEGMENTS, RECORDS_PER_SEGMENT);
+
+  store.begin();
+  appendMeasures(store, 0, 10);
+  TEST_ASSERT_TRUE(store.clear());
+  TEST_ASSERT_EQUAL_UINT32(0, store.count());
+  TEST_ASSERT_EQUAL_UINT32(2 * RECORDS_PER_SEGMENT, store.firstSequence());
+
+  appendMeasures(store, 0, 3);
+  RecordStore recovered(storage, sizeof(Measure), SEGMENTS, RECORDS_PER_SEGMENT);
+  TEST_ASSERT_TRUE(recovered.begin());
+  TEST_ASSERT_EQUAL_UINT32(3, recovered.count());
+  TEST_ASSERT_EQUAL_UINT32(2 * RECORDS_PER_SEGMENT, recovered.firstSequence());
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_append_and_read);
+  RUN_TEST(test_range_read_spans_segments);
+  RUN_TEST(test_full_ring_overwrites_oldest_segment);
+  RUN_TEST(test_begin_recovers_and_drops_torn_record);
+  RUN_TEST(test_lower_bound_by_timestamp);
+  RUN_TEST(test_clear_keeps_sequence_growing);
+  return UNITY_END();
+}
@@ -0,0 +1,194 @@
+/**
+ * @file test_replay.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Host tests for the replay of wire traces
+ * @version 0.1
+ * @date 2025-05-30
+ *
+ * A transfer is recorded through a socket pair on one side, then its peer is
+ * replayed against new sessions of the same side. A noisy link corrupts a
+ * burst of bytes of the sender, so the recorded receiver takes the NAK and
+ * retry path.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "../ymodem_fixtures.h"
+#include "YmodemReplay.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <unity.h>
+#include <vector>
+
+#define FILE_BYTES (12 * 1024) /*!< Size of the recorded file */
+
+/**
+ * @brief Runs a transfer over a socket pair, recording the sender or the receiver side.
+ */
+struct Recording
+{
+  MemorySource         source{FILE_BYTES, 29, 8};
+  MemorySink           sink;
+  YmodemTrace          trace{256 * 1024};
+  std::vector<uint8_t> file;
+  int                  sent     = 0;
+  int                  received = 0;
+  YmodemSessionStats   recorded = {};
+
+  void run(bool senderSide, size_t noiseAt, size_t noiseBytes)
+  {
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    SocketPort           senderPort(fds[0]);
+    SocketPort           receiverPort(fds[1]);
+    YmodemTraceTransport senderLink(senderPort, senderSide ? &trace : NULL);
+    YmodemTraceTransport receiverLink(receiverPort, senderSide ? NULL : &trace);
+    YmodemReceiver       receiver(sink, FILE_BYTES);
+    YmodemSender         sender(source, "field.bin", FILE_BYTES);
+    senderPort.noiseAt    = noiseAt;
+    senderPort.noiseBytes = noiseBytes;
+
+    std::thread thread([&]() { received = Ymodem_RunSession(receiver, receiverLink); });
+    sent = Ymodem_RunSession(sender, senderLink);
+    thread.join();
+    close(fds[0]);
+    close(fds[1]);
+
+    recorded = senderSide ? sender.stats() : receiver.stats();
+    trace.dump([this](const uint8_t* data, size_t size) {
+      file.insert(file.end(), data, data + size);
+      return true;
+    });
+  }
+};
+
+/**
+ * @brief Delays the records of a dumped trace from the given peer record on, as a stalled answer.
+ */
+static void delayPeer(std::vector<uint8_t>& file, size_t peerRecord, uint32_t delayUs)
+{
+  size_t position = YMODEM_TRACE_FILE_HEADER;
+  size_t peer     = 0;
+  bool   late     = false;
+  while (position < file.size()) {
+    uint8_t* header = file.data() + position;
+    uint16_t info   = header[4] | header[5] << 8;
+    late           |= (info >> 12) == YMODEM_TRACE_RX && peer++ == peerRecord;
+    if (late) {
+      uint32_t time = (header[0] | header[1] << 8 | header[2] << 16 | (uint32_t)header[3] << 24) + delayUs;
+      for (int i = 0; i < 4; i++) {
+        header[i] = (uint8_t)(time >> (8 * i));
+      }
+    }
+    position += YMODEM_TRACE_RECORD_HEADER + (info & YMODEM_TRACE_MAX_CHUNK);
+  }
+}
+
+void test_replay_sender_trace(void)
+{
+  Recording recording;
+  recording.run(true, 0, 0);
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, recording.sent);
+
+  YmodemReplay replay;
+  TEST_ASSERT_TRUE(replay.load(recording.file.data(), recording.file.size()));
+  TEST_ASSERT_EQUAL_UINT32(0, replay.dropped());
+
+  // With the original timing and with the time compressed, the sender writes the recorded bytes
+  const uint32_t speedups[] = {1, 10, YMODEM_REPLAY_ASAP};
+  for (uint32_t speedup : speedups) {
+    MemorySource             source(FILE_BYTES, 29, 8);
+    YmodemSender             sender(source, "field.bin", FILE_BYTES);
+    const YmodemReplayStats& stats = replay.run(sender, speedup);
+    TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, stats.result);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.divergences);
+    TEST_ASSERT_EQUAL_INT32(-1, stats.firstDivergence);
+    TEST_ASSERT_EQUAL_UINT32(stats.recordedBytes, stats.producedBytes);
+    TEST_ASSERT_EQUAL_UINT32(recording.recorded.packets, stats.packets);
+    TEST_ASSERT_EQUAL_UINT32(recording.recorded.retries, stats.retries);
+    TEST_ASSERT_TRUE(speedup == YMODEM_REPLAY_ASAP || stats.sessionMs <= stats.recordedMs / speedup + 1);
+  }
+
+  // With the original timing, an ACK stalled past the timeout makes the sender give up and send
+  // CA CA; the compressed replay only keeps the order of the bytes and completes
+  delayPeer(recording.file, 4, (WAIT_TIMEOUT * NAK_TIMEOUT + 500) * 1000);
+  TEST_ASSERT_TRUE(replay.load(recording.file.data(), recording.file.size()));
+  MemorySource             source(FILE_BYTES, 29, 8);
+  YmodemSender             stalled(source, "field.bin", FILE_BYTES);
+  const YmodemReplayStats& stats = replay.run(stalled, 1);
+  TEST_ASSERT_EQUAL_INT(YMODEM_TIMEOUT, stats.result);
+  TEST_ASSERT_EQUAL_UINT32(1, stats.timeouts);
+  TEST_ASSERT_GREATER_THAN_UINT32(0, stats.divergences);
+  TEST_ASSERT_TRUE(stats.firstDivergence > 0);
+  TEST_ASSERT_TRUE(stats.sessionMs >= WAIT_TIMEOUT * NAK_TIMEOUT);
+
+  YmodemSender compressed(source, "field.bin", FILE_BYTES);
+  replay.run(compressed, YMODEM_REPLAY_ASAP);
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, replay.stats().result);
+  TEST_ASSERT_EQUAL_UINT32(0, replay.stats().divergences);
+}
+
+void test_replay_noisy_receiver_trace(void)
+{
+  // The burst hits the second data packet
+  Recording recording;
+  recording.run(false, 1 + PACKET_SIZE + PACKET_OVERHEAD + PACKET_1K_SIZE + 200, 8);
+  TEST_ASSERT_EQUAL_INT(FILE_BYTES, recording.received);
+  TEST_ASSERT_GREATER_THAN_UINT32(0, recording.recorded.retries);
+
+  YmodemReplay replay;
+  TEST_ASSERT_TRUE(replay.load(recording.file.data(), recording.file.size()));
+
+  MemorySink               sink;
+  YmodemReceiver           receiver(sink, FILE_BYTES);
+  const YmodemReplayStats& stats = replay.run(receiver, 1);
+  TEST_ASSERT_EQUAL_INT(FILE_BYTES, stats.result);
+  TEST_ASSERT_EQUAL_UINT32(recording.recorded.retries, stats.retries);
+  TEST_ASSERT_EQUAL_UINT32(0, stats.divergences);
+  TEST_ASSERT_TRUE(recording.source.data == sink.data);
+
+  char message[160];
+  snprintf(message, sizeof(message), "Replay of %u records: %u retries, session %u ms on %u ms recorded, %u us of host time", (unsigned)replay.records(),
+           stats.retries, stats.sessionMs, stats.recordedMs, stats.hostUs);
+  TEST_MESSAGE(message);
+}
+
+void test_replay_divergence(void)
+{
+  Recording recording;
+  recording.run(true, 0, 0);
+
+  YmodemReplay replay;
+  TEST_ASSERT_TRUE(replay.load(recording.file.data(), recording.file.size()));
+
+  // A sender announcing another name differs from the header packet on
+  MemorySource             source(FILE_BYTES, 29, 8);
+  YmodemSender             sender(source, "other.bin", FILE_BYTES);
+  const YmodemReplayStats& stats = replay.run(sender, YMODEM_REPLAY_ASAP);
+  TEST_ASSERT_GREATER_THAN_UINT32(0, stats.divergences);
+  TEST_ASSERT_EQUAL_INT32(1 + PACKET_HEADER, stats.firstDivergence);
+
+  // A truncated trace is refused
+  TEST_ASSERT_FALSE(replay.load(recording.file.data(), recording.file.size() - 1));
+  TEST_ASSERT_FALSE(replay.load(recording.file.data(), 8));
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_replay_sender_trace);
+  RUN_TEST(test_replay_noisy_receiver_trace);
+  RUN_TEST(test_replay_divergence);
+  return UNITY_END();
+}
@@ -0,0 +1,313 @@
+/**
+ * @file test_scheduler.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Host tests for the prioritized transfer queue
+ * @version 0.1
+ * @date 2025-06-20
+ *
+ * Every port of the scheduler is one end of a socket pair, throttled to
+ * simulate the baud rate of a UART. The peer at the other end runs one session
+ * after the other on its own thread and records the files in the order they
+ * arrive.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "../ymodem_fixtures.h"
+#include "YmodemScheduler.h"
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <unity.h>
+#include <vector>
+
+#define FILE_BYTES (16 * 1024) /*!< Size of every file */
+#define US_PER_BYTE (2)        /*!< Throttle of the simulated ports */
+
+/**
+ * @brief Sink that records the names of the files it receives.
+ */
+class NamingSink : public MemorySink
+{
+public:
+  std::vector<std::string> names; // Files in the order they were opened
+
+  bool open(const char* fileName, uint32_t fileSize) override
+  {
+    names.push_back(fileName);
+    return MemorySink::open(fileName, fileSize);
+  }
+};
+
+/**
+ * @brief Simulated port and the peer at its other end.
+ */
+struct Peer
+{
+  int         fds[2];
+  SocketPort* port;     // End given to the scheduler
+  SocketPort* peerPort; // End of the peer
+  NamingSink  sink;
+  std::thread thread;
+  int         results[8];
+
+  Peer()
+  {
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    port     = new SocketPort(fds[0], US_PER_BYTE);
+    peerPort = new SocketPort(fds[1], 0);
+  }
+
+  ~Peer()
+  {
+    join();
+    delete port;
+    delete peerPort;
+    close(fds[0]);
+    close(fds[1]);
+  }
+
+  /**
+   * @brief Receives files one session after the other.
+   */
+  void receive(int sessions)
+  {
+    thread = std::thread([this, sessions]() {
+      for (int i = 0; i < sessions; i++) {
+        YmodemReceiver receiver(sink, FILE_BYTES);
+        results[i] = Ymodem_RunSession(receiver, *peerPort);
+      }
+    });
+  }
+
+  /**
+   * @brief Sends one file.
+   */
+  void send(MemorySource& source, const char* fileName)
+  {
+    thread = std::thread([this, &source, fileName]() {
+      YmodemSender sender(source, fileName, source.data.size());
+      results[0] = Ymodem_RunSession(sender, *peerPort);
+    });
+  }
+
+  void join()
+  {
+    if (thread.joinable()) {
+      thread.join();
+    }
+  }
+};
+
+static YmodemJob transmitJob(MemorySource& source, const char* fileName, int priority, size_t port = 0)
+{
+  YmodemJob job;
+  job.direction = YMODEM_JOB_TRANSMIT;
+  job.port      = port;
+  job.source    = &source;
+  job.fileName  = fileName;
+  job.fileSize  = source.data.size();
+  job.priority  = priority;
+  return job;
+}
+
+void test_scheduler_priority_order(void)
+{
+  MemorySource    source(FILE_BYTES);
+  Peer            peer;
+  YmodemScheduler scheduler;
+  TEST_ASSERT_EQUAL_INT(0, scheduler.addPort(*peer.port));
+  peer.receive(4);
+
+  // The first job takes the port, the others queue up behind it in any order
+  YmodemJobFuture first = scheduler.submit(transmitJob(source, "first.bin", 0));
+  while (scheduler.pending(0) > 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  char            name[16];
+  YmodemJobFuture jobs[3];
+  const int       priorities[3] = {1, 5, 3};
+  for (int i = 0; i < 3; i++) {
+    snprintf(name, sizeof(name), "p%d.bin", priorities[i]);
+    jobs[i] = scheduler.submit(transmitJob(source, name, priorities[i]));
+    TEST_ASSERT_TRUE(jobs[i].valid());
+  }
+  TEST_ASSERT_EQUAL_UINT32(3, scheduler.pending(0));
+  TEST_ASSERT_FALSE(jobs[0].poll());
+  TEST_ASSERT_EQUAL_INT(YmodemJobFuture::PENDING, jobs[0].result());
+
+  TEST_ASSERT_TRUE(jobs[0].wait(10000));
+  peer.join();
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, first.result());
+  for (int i = 0; i < 3; i++) {
+    TEST_ASSERT_TRUE(jobs[i].poll());
+    TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, jobs[i].result());
+    TEST_ASSERT_EQUAL_UINT32(FILE_BYTES, jobs[i].stats().bytes);
+  }
+
+  // Highest priority first, and every job waited at least for the ones that ran before it
+  TEST_ASSERT_EQUAL_UINT32(4, peer.sink.names.size());
+  TEST_ASSERT_EQUAL_STRING("first.bin", peer.sink.names[0].c_str());
+  TEST_ASSERT_EQUAL_STRING("p5.bin", peer.sink.names[1].c_str());
+  TEST_ASSERT_EQUAL_STRING("p3.bin", peer.sink.names[2].c_str());
+  TEST_ASSERT_EQUAL_STRING("p1.bin", peer.sink.names[3].c_str());
+  TEST_ASSERT_TRUE(source.data == peer.sink.data);
+  TEST_ASSERT_TRUE(jobs[2].times().waitMs >= first.times().serviceMs);
+  TEST_ASSERT_TRUE(jobs[0].times().waitMs >= jobs[1].times().waitMs + jobs[1].times().serviceMs);
+
+  YmodemSchedulerStats stats = scheduler.stats(0);
+  TEST_ASSERT_EQUAL_UINT32(4, stats.completed);
+  TEST_ASSERT_EQUAL_UINT32(0, stats.failed);
+  TEST_ASSERT_EQUAL_UINT32(3, stats.maxDepth);
+  TEST_ASSERT_EQUAL_UINT32(jobs[0].times().waitMs, stats.maxWaitMs);
+
+  char message[160];
+  snprintf(message, sizeof(message), "4 jobs: %u ms waiting in total, at most %u ms; %u ms running in total, at most %u ms", stats.totalWaitMs,
+           stats.maxWaitMs, stats.totalServiceMs, stats.maxServiceMs);
+  TEST_MESSAGE(message);
+}
+
+void test_scheduler_ports_in_parallel(void)
+{
+  MemorySource    source(FILE_BYTES);
+  MemorySource    incoming(FILE_BYTES / 2);
+  Peer            peers[2];
+  YmodemScheduler scheduler;
+  for (int i = 0; i < 2; i++) {
+    TEST_ASSERT_EQUAL_INT(i, scheduler.addPort(*peers[i].port));
+  }
+  peers[0].receive(2);
+
+  // Port 0 sends two files while port 1 receives one, on the same scheduler
+  uint32_t        start = Ymodem_Millis();
+  YmodemJobFuture sends[2];
+  sends[0] = scheduler.submit(transmitJob(source, "a.bin", 0, 0));
+  sends[1] = scheduler.submit(transmitJob(source, "b.bin", 0, 0));
+  peers[1].send(incoming, "log.txt");
+  NamingSink receiveSink;
+  YmodemJob  job;
+  job.direction           = YMODEM_JOB_RECEIVE;
+  job.port                = 1;
+  job.sink                = &receiveSink;
+  job.maxSize             = FILE_BYTES;
+  YmodemJobFuture receive = scheduler.submit(job);
+  TEST_ASSERT_TRUE(receive.valid());
+
+  TEST_ASSERT_TRUE(sends[1].wait(10000));
+  TEST_ASSERT_TRUE(receive.wait(10000));
+  uint32_t elapsedMs = Ymodem_Millis() - start;
+  peers[0].join();
+  peers[1].join();
+
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, sends[0].result());
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, sends[1].result());
+  TEST_ASSERT_EQUAL_INT(FILE_BYTES / 2, receive.result());
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, peers[1].results[0]);
+  TEST_ASSERT_TRUE(incoming.data == receiveSink.data);
+  TEST_ASSERT_EQUAL_STRING("log.txt", receiveSink.names[0].c_str());
+
+  // The same transport served both jobs of port 0, one after the other
+  TEST_ASSERT_EQUAL_STRING("a.bin", peers[0].sink.names[0].c_str());
+  TEST_ASSERT_EQUAL_STRING("b.bin", peers[0].sink.names[1].c_str());
+  TEST_ASSERT_TRUE(sends[1].times().waitMs >= sends[0].times().serviceMs);
+  TEST_ASSERT_EQUAL_UINT32(2, scheduler.stats(0).completed);
+  TEST_ASSERT_EQUAL_UINT32(1, scheduler.stats(1).completed);
+  // Port 1 did not wait for port 0
+  TEST_ASSERT_TRUE(receive.times().waitMs < sends[0].times().serviceMs);
+  TEST_ASSERT_TRUE(elapsedMs < sends[0].times().serviceMs + sends[1].times().serviceMs + receive.times().serviceMs);
+}
+
+void test_scheduler_deadline_cancel_and_stop(void)
+{
+  MemorySource    source(FILE_BYTES);
+  Peer            peer;
+  YmodemScheduler scheduler;
+  scheduler.addPort(*peer.port);
+  peer.receive(2);
+
+  // Jobs the scheduler refuses
+  YmodemJob missing = transmitJob(source, "x.bin", 0);
+  missing.source    = NULL;
+  TEST_ASSERT_FALSE(scheduler.submit(missing).valid());
+  TEST_ASSERT_FALSE(scheduler.submit(transmitJob(source, "x.bin", 0, 1)).valid());
+  YmodemJob large = transmitJob(source, "x.bin", 0);
+  large.blockSize = 2048;
+  TEST_ASSERT_FALSE(scheduler.submit(large).valid());
+
+  YmodemJobFuture running = scheduler.submit(transmitJob(source, "running.bin", 0));
+  while (scheduler.pending(0) > 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  // A job cancelled while queued finishes at once and never reaches the peer
+  YmodemJobFuture cancelled = scheduler.submit(transmitJob(source, "cancelled.bin", 9));
+  cancelled.cancel();
+  TEST_ASSERT_TRUE(cancelled.poll());
+  TEST_ASSERT_TRUE(cancelled.cancelled());
+  TEST_ASSERT_EQUAL_INT(YMODEM_ABORTED_BY_TRANSFER, cancelled.result());
+  TEST_ASSERT_EQUAL_UINT32(0, cancelled.times().serviceMs);
+
+  // A job whose deadline passes behind the running one is dropped
+  YmodemJob late         = transmitJob(source, "late.bin", 9);
+  late.deadlineMs         = 5;
+  YmodemJobFuture expired = scheduler.submit(late);
+  YmodemJobFuture next    = scheduler.submit(transmitJob(source, "next.bin", 0));
+
+  // The queue is bounded, the cancelled job is purged to make room for one more
+  std::vector<YmodemJobFuture> filler;
+  for (int i = 0; i < YMODEM_SCHEDULER_MAX_JOBS; i++) {
+    YmodemJobFuture future = scheduler.submit(transmitJob(source, "filler.bin", -1));
+    if (future.valid()) {
+      filler.push_back(future);
+    }
+  }
+  TEST_ASSERT_EQUAL_UINT32(YMODEM_SCHEDULER_MAX_JOBS - 2, filler.size());
+
+  TEST_ASSERT_TRUE(next.wait(10000));
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, running.result());
+  TEST_ASSERT_EQUAL_INT(YMODEM_TIMEOUT, expired.result());
+  TEST_ASSERT_TRUE(expired.times().waitMs > late.deadlineMs);
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, next.result());
+  peer.join();
+  TEST_ASSERT_EQUAL_UINT32(2, peer.sink.names.size());
+  TEST_ASSERT_EQUAL_STRING("next.bin", peer.sink.names[1].c_str());
+
+  // stop() cancels the first filler, which waits for a peer that is gone, and drops the others
+  while (scheduler.pending(0) == filler.size()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  scheduler.stop();
+  TEST_ASSERT_TRUE(filler[0].poll());
+  TEST_ASSERT_EQUAL_INT(YMODEM_ABORTED_BY_TRANSFER, filler[0].result());
+  TEST_ASSERT_EQUAL_INT(YMODEM_ABORTED_BY_TRANSFER, filler[1].result());
+  TEST_ASSERT_EQUAL_UINT32(0, filler[1].times().serviceMs);
+  TEST_ASSERT_FALSE(scheduler.submit(transmitJob(source, "after.bin", 0)).valid());
+
+  YmodemSchedulerStats stats = scheduler.stats(0);
+  TEST_ASSERT_EQUAL_UINT32(1, stats.expired);
+  TEST_ASSERT_EQUAL_UINT32(filler.size(), stats.cancelled);
+  TEST_ASSERT_EQUAL_UINT32(3, stats.completed);
+  TEST_ASSERT_EQUAL_UINT32(1, stats.failed);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_scheduler_priority_order);
+  RUN_TEST(test_scheduler_ports_in_parallel);
+  RUN_TEST(test_scheduler_deadline_cancel_and_stop);
+  return UNITY_END();
+}
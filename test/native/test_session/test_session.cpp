@@ -0,0 +1,413 @@
+/**
+ * @file test_session.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Host tests for the Ymodem session state machines
+ * @version 0.1
+ * @date 2025-05-19
+ *
+ * The sender and the receiver are connected back to back in memory and driven
+ * with a simulated clock, so the tests run without any UART or delay.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "../ymodem_fixtures.h"
+#include <unity.h>
+
+/**
+ * @brief Moves up to chunk bytes of output from one session to the other.
+ *
+ * @param corruptAt Index, counted over all the bytes moved by this link, of a byte to flip. -1 for none.
+ * @param dropAt Index, counted the same way, of a byte lost on the way. -1 for none.
+ */
+struct Link
+{
+  size_t moved     = 0;
+  long   corruptAt = -1;
+  long   dropAt    = -1;
+
+  size_t pump(YmodemSession& from, YmodemSession& to, size_t chunk, uint32_t now)
+  {
+    size_t length = std::min(from.outputSize(), chunk);
+    if (length == 0) {
+      return 0;
+    }
+    std::vector<uint8_t> bytes(from.output(), from.output() + length);
+    from.consumeOutput(length);
+    if (corruptAt >= (long)moved && corruptAt < (long)(moved + length)) {
+      bytes[corruptAt - moved] ^= 0x55;
+    }
+    size_t kept = length;
+    if (dropAt >= (long)moved && dropAt < (long)(moved + length)) {
+      bytes.erase(bytes.begin() + (dropAt - moved));
+      kept--;
+    }
+    moved += length;
+    if (!to.isDone() && kept > 0) {
+      to.feed(bytes.data(), kept, now);
+    }
+    return length;
+  }
+};
+
+/**
+ * @brief Runs a sender and a receiver back to back until both have finished.
+ *
+ * @param cancelAfter Number of bytes sent after which the receiver is cancelled, 0 for never.
+ * @param toSender Link carrying the answers of the receiver, NULL for a clean one.
+ * @return uint32_t Simulated time taken by the transfer, in milliseconds.
+ */
+static uint32_t runLoopback(YmodemSender& tx, YmodemReceiver& rx, Link& toReceiver, size_t chunk, size_t cancelAfter = 0, Link* toSender = NULL)
+{
+  Link     clean;
+  Link&    answers = (toSender != NULL) ? *toSender : clean;
+  uint32_t now     = 1000;
+
+  rx.start(now);
+  tx.start(now);
+  for (int steps = 0; steps < 100000 && !(tx.isDone() && rx.isDone()); steps++) {
+    size_t moved = toReceiver.pump(tx, rx, chunk, now) + answers.pump(rx, tx, chunk, now);
+    if (cancelAfter > 0 && toReceiver.moved >= cancelAfter) {
+      rx.cancel();
+      cancelAfter = 0;
+    }
+    if (moved == 0) {
+      now += 100;
+      tx.poll(now);
+      rx.poll(now);
+    }
+  }
+  return now - 1000;
+}
+
+void test_session_transfer(void)
+{
+  MemorySource   source(3000);
+  MemorySink     sink;
+  YmodemSender   tx(source, "data.bin", source.data.size());
+  YmodemReceiver rx(sink, 10000);
+  Link           link;
+
+  runLoopback(tx, rx, link, SIZE_MAX);
+
+  TEST_ASSERT_TRUE(tx.isDone());
+  TEST_ASSERT_TRUE(rx.isDone());
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, tx.result());
+  TEST_ASSERT_EQUAL_INT(3000, rx.result());
+  TEST_ASSERT_TRUE(sink.name == "data.bin");
+  TEST_ASSERT_EQUAL_UINT32(3000, sink.size);
+  TEST_ASSERT_TRUE(sink.closed);
+  TEST_ASSERT_TRUE(sink.data == source.data);
+  TEST_ASSERT_EQUAL_UINT32(3000, rx.stats().bytes);
+  TEST_ASSERT_EQUAL_UINT32(0, tx.stats().retries);
+}
+
+void test_session_byte_by_byte(void)
+{
+  MemorySource   source(PACKET_1K_SIZE * 2);
+  MemorySink     sink;
+  YmodemSender   tx(source, "exact.bin", source.data.size());
+  YmodemReceiver rx(sink, 10000);
+  Link           link;
+
+  runLoopback(tx, rx, link, 1);
+
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, tx.result());
+  TEST_ASSERT_EQUAL_INT(PACKET_1K_SIZE * 2, rx.result());
+  TEST_ASSERT_TRUE(sink.data == source.data);
+}
+
+void test_session_corrupted_block(void)
+{
+  MemorySource   source(3000);
+  MemorySink     sink;
+  YmodemSender   tx(source, "data.bin", source.data.size());
+  YmodemReceiver rx(sink, 10000);
+  Link           link;
+
+  // Second data block: header packet, first data block, then a few bytes in
+  link.corruptAt = (PACKET_SIZE + PACKET_OVERHEAD) + (PACKET_1K_SIZE + PACKET_OVERHEAD) + 100;
+  runLoopback(tx, rx, link, SIZE_MAX);
+
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, tx.result());
+  TEST_ASSERT_EQUAL_INT(3000, rx.result());
+  TEST_ASSERT_TRUE(sink.data == source.data);
+  TEST_ASSERT_EQUAL_UINT32(1, tx.stats().retries);
+  TEST_ASSERT_EQUAL_UINT32(1, rx.stats().retries);
+}
+
+void test_session_corrupted_header(void)
+{
+  MemorySource   source(500);
+  MemorySink     sink;
+  YmodemSender   tx(source, "data.bin", source.data.size());
+  YmodemReceiver rx(sink, 10000);
+  Link           link;
+
+  // The 'C' sent by the sender on start is the first byte on the link
+  link.corruptAt = 1 + PACKET_HEADER + 2;
+  runLoopback(tx, rx, link, SIZE_MAX);
+
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, tx.result());
+  TEST_ASSERT_EQUAL_INT(500, rx.result());
+  TEST_ASSERT_TRUE(sink.name == "data.bin");
+  TEST_ASSERT_EQUAL_UINT32(1, tx.stats().retries);
+}
+
+void test_session_lost_data_request(void)
+{
+  MemorySource   source(3000);
+  MemorySink     sink;
+  YmodemSender   tx(source, "data.bin", source.data.size());
+  YmodemReceiver rx(sink, 10000);
+  Link           link;
+  Link           answers;
+
+  // The receiver answers the header with ACK then 'C', the 'C' is lost
+  answers.dropAt   = 2;
+  uint32_t elapsed = runLoopback(tx, rx, link, SIZE_MAX, 0, &answers);
+
+  // The receiver repeats its request after NAK_TIMEOUT instead of a NAK the sender would ignore
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, tx.result());
+  TEST_ASSERT_EQUAL_INT(3000, rx.result());
+  TEST_ASSERT_TRUE(sink.data == source.data);
+  TEST_ASSERT_EQUAL_UINT32(1, rx.stats().retries);
+  TEST_ASSERT_TRUE(elapsed < 2 * NAK_TIMEOUT);
+}
+
+void test_session_lost_first_block(void)
+{
+  MemorySource   source(3000);
+  MemorySink     sink;
+  YmodemSender   tx(source, "data.bin", source.data.size());
+  YmodemReceiver rx(sink, 10000);
+  Link           link;
+
+  // A byte of the first block is lost, the receiver times out and repeats its request for data
+  link.dropAt      = PACKET_SIZE + PACKET_OVERHEAD + 10;
+  uint32_t elapsed = runLoopback(tx, rx, link, SIZE_MAX);
+
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, tx.result());
+  TEST_ASSERT_EQUAL_INT(3000, rx.result());
+  TEST_ASSERT_TRUE(sink.data == source.data);
+  TEST_ASSERT_EQUAL_UINT32(1, tx.stats().retries);
+  TEST_ASSERT_TRUE(elapsed < 2 * NAK_TIMEOUT);
+}
+
+void test_session_cancel(void)
+{
+  MemorySource   source(8000);
+  MemorySink     sink;
+  YmodemSender   tx(source, "data.bin", source.data.size());
+  YmodemReceiver rx(sink, 10000);
+  Link           link;
+
+  runLoopback(tx, rx, link, SIZE_MAX, 3000);
+
+  TEST_ASSERT_EQUAL_INT(YMODEM_ABORTED_BY_TRANSFER, rx.result());
+  TEST_ASSERT_EQUAL_INT(YMODEM_ABORTED_BY_SENDER, tx.result());
+  TEST_ASSERT_FALSE(sink.closed);
+}
+
+void test_session_arena_frames(void)
+{
+  YmodemArena    arena(YMODEM_ARENA_SIZE);
+  MemorySource   source(5000);
+  MemorySink     sink;
+  YmodemSender   tx(source, "data.bin", source.data.size(), arena.allocate(YMODEM_FRAME_SIZE));
+  YmodemReceiver rx(sink, 1024 * 1024, arena.allocate(YMODEM_FRAME_SIZE));
+  Link           link;
+
+  // Both packets fit, with the alignment of the second one, and nothing else is left
+  TEST_ASSERT_NULL(arena.allocate(4));
+  TEST_ASSERT_EQUAL_size_t(YMODEM_ARENA_SIZE - 3, arena.peak());
+
+  runLoopback(tx, rx, link, 256);
+
+  TEST_ASSERT_EQUAL_INT(5000, rx.result());
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, tx.result());
+  TEST_ASSERT_TRUE(source.data == sink.data);
+
+  arena.reset();
+  TEST_ASSERT_NOT_NULL(arena.allocate(YMODEM_FRAME_SIZE));
+}
+
+void test_receiver_size_overflow(void)
+{
+  MemorySource   source(3000);
+  MemorySink     sink;
+  YmodemSender   tx(source, "data.bin", source.data.size());
+  YmodemReceiver rx(sink, 2000);
+  Link           link;
+
+  runLoopback(tx, rx, link, SIZE_MAX);
+
+  TEST_ASSERT_EQUAL_INT(YMODEM_SIZE_OVERFLOW, rx.result());
+  TEST_ASSERT_EQUAL_INT(YMODEM_ABORTED_BY_SENDER, tx.result());
+  TEST_ASSERT_EQUAL_size_t(0, sink.data.size());
+}
+
+void test_receiver_no_space(void)
+{
+  MemorySource   source(3000);
+  MemorySink     sink;
+  YmodemSender   tx(source, "data.bin", source.data.size());
+  YmodemReceiver rx(sink, 1024 * 1024);
+  Link           link;
+  sink.space = 2000;
+
+  runLoopback(tx, rx, link, SIZE_MAX);
+
+  // Refused at the header, before any block was sent
+  TEST_ASSERT_EQUAL_INT(YMODEM_NO_SPACE, rx.result());
+  TEST_ASSERT_EQUAL_INT(YMODEM_ABORTED_BY_SENDER, tx.result());
+  TEST_ASSERT_EQUAL_STRING("", sink.name.c_str());
+  TEST_ASSERT_EQUAL_UINT32(0, tx.stats().bytes);
+}
+
+void test_sender_timeout(void)
+{
+  MemorySource source(100);
+  YmodemSender tx(source, "data.bin", source.data.size());
+  uint32_t     now      = 0xfffff000; // The clock wraps around during the test
+  int          requests = 0;
+
+  tx.start(now);
+  while (!tx.isDone()) {
+    if (tx.outputSize() > 0) {
+      TEST_ASSERT_EQUAL_HEX8(CRC16, tx.output()[0]);
+      requests++;
+      tx.consumeOutput(tx.outputSize());
+    }
+    now = tx.nextDeadline();
+    tx.poll(now);
+  }
+
+  TEST_ASSERT_EQUAL_INT(YMODEM_TIMEOUT, tx.result());
+  TEST_ASSERT_EQUAL_INT(MAX_ERRORS, requests);
+  TEST_ASSERT_EQUAL_size_t(2, tx.outputSize()); // CA CA
+}
+
+void test_session_digest_verified(void)
+{
+  MemorySource   source(3000);
+  MemorySink     sink;
+  YmodemDigest   expected;
+  char           announced[YMODEM_DIGEST_TEXT_SIZE];
+  YmodemSender   tx(source, "data.bin", source.data.size());
+  YmodemReceiver rx(sink, 10000);
+  Link           link;
+
+  expected.begin(YMODEM_DIGEST_SHA256);
+  expected.update(source.data.data(), source.data.size());
+  expected.finish();
+  expected.format(announced, sizeof(announced));
+
+  // The sender computes a CRC-32 of its own, the receiver follows the header
+  tx.setDigest(YMODEM_DIGEST_CRC32);
+  tx.setHeaderDigest(announced);
+  link.corruptAt = 1200; // A block is sent twice, the digest must only count it once
+  runLoopback(tx, rx, link, SIZE_MAX);
+
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, tx.result());
+  TEST_ASSERT_EQUAL_INT(3000, rx.result());
+  TEST_ASSERT_EQUAL_UINT32(1, tx.stats().retries);
+  TEST_ASSERT_TRUE(rx.digestVerified());
+  TEST_ASSERT_EQUAL_UINT8(YMODEM_DIGEST_SHA256, rx.digest().type());
+  TEST_ASSERT_EQUAL_MEMORY(expected.value(), rx.digest().value(), 32);
+
+  expected.begin(YMODEM_DIGEST_CRC32);
+  expected.update(source.data.data(), source.data.size());
+  expected.finish();
+  TEST_ASSERT_EQUAL_MEMORY(expected.value(), tx.digest().value(), 4);
+}
+
+void test_session_digest_long_name(void)
+{
+  MemorySource   source(3000);
+  MemorySink     sink;
+  YmodemDigest   expected;
+  char           announced[YMODEM_DIGEST_TEXT_SIZE];
+  uint8_t        header[PACKET_SIZE + PACKET_OVERHEAD];
+  const char*    name = "firmware_lsm1x0a_module_v2.3.17_release.bin";
+  YmodemSender   tx(source, name, source.data.size());
+  YmodemReceiver rx(sink, 10000);
+  Link           link;
+
+  expected.begin(YMODEM_DIGEST_SHA256);
+  expected.update(source.data.data(), source.data.size());
+  expected.finish();
+  expected.format(announced, sizeof(announced));
+
+  // The name and the size leave room for the digest, not with the attributes as well: the attributes give way
+  TEST_ASSERT_EQUAL_UINT8(YMODEM_FIELD_NONE, Ymodem_PrepareIntialPacket(header, name, 3000, announced));
+  TEST_ASSERT_EQUAL_UINT8(YMODEM_FIELD_ATTRIBUTES, Ymodem_PrepareIntialPacket(header, name, 3000, announced, PACKET_1K_SIZE, 1718000000, 0100644));
+  TEST_ASSERT_NOT_NULL(strstr((const char*)header + PACKET_HEADER + strlen(name) + 1, announced));
+
+  tx.setHeaderDigest(announced);
+  tx.setAttributes(1718000000, 0100644);
+  runLoopback(tx, rx, link, SIZE_MAX);
+
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, tx.result());
+  TEST_ASSERT_EQUAL_INT(3000, rx.result());
+  TEST_ASSERT_TRUE(sink.data == source.data);
+
+  // Without room for the digest the sender cancels instead of sending the file unverified
+  std::string    longName = std::string(name) + "_" + std::string(20, 'x');
+  MemorySink     longSink;
+  YmodemSender   longTx(source, longName.c_str(), source.data.size());
+  YmodemReceiver longRx(longSink, 10000);
+  Link           longLink;
+  TEST_ASSERT_EQUAL_UINT8(YMODEM_FIELD_DIGEST, Ymodem_PrepareIntialPacket(header, longName.c_str(), 3000, announced));
+  longTx.setHeaderDigest(announced);
+  runLoopback(longTx, longRx, longLink, SIZE_MAX);
+
+  TEST_ASSERT_EQUAL_INT(YMODEM_HEADER_OVERFLOW, longTx.result());
+  TEST_ASSERT_TRUE(longRx.result() < 0);
+  TEST_ASSERT_EQUAL_UINT32(0, longSink.data.size());
+}
+
+void test_session_digest_mismatch(void)
+{
+  MemorySource   source(3000);
+  MemorySink     sink;
+  YmodemSender   tx(source, "data.bin", source.data.size());
+  YmodemReceiver rx(sink, 10000);
+  Link           link;
+
+  tx.setHeaderDigest("crc32:00000000");
+  runLoopback(tx, rx, link, SIZE_MAX);
+
+  TEST_ASSERT_EQUAL_INT(YMODEM_DIGEST_ERROR, rx.result());
+  TEST_ASSERT_EQUAL_INT(YMODEM_ABORTED_BY_SENDER, tx.result());
+  TEST_ASSERT_FALSE(rx.digestVerified());
+  TEST_ASSERT_FALSE(sink.closed);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_session_transfer);
+  RUN_TEST(test_session_byte_by_byte);
+  RUN_TEST(test_session_corrupted_block);
+  RUN_TEST(test_session_corrupted_header);
+  RUN_TEST(test_session_lost_data_request);
+  RUN_TEST(test_session_lost_first_block);
+  RUN_TEST(test_session_cancel);
+  RUN_TEST(test_session_arena_frames);
+  RUN_TEST(test_receiver_size_overflow);
+  RUN_TEST(test_receiver_no_space);
+  RUN_TEST(test_sender_timeout);
+  RUN_TEST(test_session_digest_verified);
+  RUN_TEST(test_session_digest_mismatch);
+  RUN_TEST(test_session_digest_long_name);
+  return UNITY_END();
+}
@@ -0,0 +1,246 @@
+/**
+ * @file test_skip.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Host tests for skipping the files the receiver holds unchanged
+ * @version 0.1
+ * @date 2025-06-10
+ *
+ * The sessions are connected through a simulated serial line at 115200 baud with
+ * a 20 ms round trip, driven by a virtual clock, so the time of a repeated push
+ * can be compared with the first one.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "../ymodem_fixtures.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <unity.h>
+#include <vector>
+
+#define LINE_BYTE_US (87)   // One byte at 115200 baud
+#define LINE_RTT_US (20000) // Round trip of the line
+#define FILE_TIME (1718000000)
+#define FILE_MODE (0100644)
+
+/**
+ * @brief Sink keeping one stored file with its attributes, as a directory would.
+ */
+class StoredSink : public YmodemReceiveSink
+{
+public:
+  std::vector<uint8_t> data;
+  std::string          name;
+  uint32_t             modTime   = 0;
+  uint32_t             mode      = 0;
+  uint32_t             opens     = 0;
+  uint32_t             questions = 0; // Calls to unchanged()
+
+  bool open(const char* fileName, uint32_t fileSize) override
+  {
+    name = fileName;
+    data.clear();
+    opens++;
+    return true;
+  }
+
+  int write(const uint8_t* block, size_t length) override
+  {
+    data.insert(data.end(), block, block + length);
+    return length;
+  }
+
+  bool unchanged(const YmodemFileInfo& info) override
+  {
+    questions++;
+    return name == info.name && data.size() == info.size && info.modTime != 0 && modTime == info.modTime && mode == info.mode;
+  }
+
+  void attributes(uint32_t modTime, uint32_t mode) override
+  {
+    this->modTime = modTime;
+    this->mode    = mode;
+  }
+};
+
+/**
+ * @brief Runs a transfer over the simulated line, every byte arrives half a round trip after it was sent.
+ *
+ * @param dropToSender Byte of the receiver lost on the line, counted from 1, 0 for none. 2 is the ACK of the header.
+ * @return uint64_t Time the transfer took, in microseconds.
+ */
+static uint64_t transfer(YmodemSession& tx, YmodemSession& rx, size_t dropToSender = 0)
+{
+  Line toReceiver(LINE_BYTE_US * 1000, LINE_RTT_US / 2);
+  Line toSender(LINE_BYTE_US * 1000, LINE_RTT_US / 2);
+
+  toSender.dropAt = dropToSender;
+  return runLine(tx, rx, toReceiver, toSender);
+}
+
+void test_skip_header_fields(void)
+{
+  uint8_t  packet[YMODEM_FRAME_SIZE];
+  uint32_t modTime, mode;
+
+  // Standard modification time and mode in octal after the size, the extensions after them
+  Ymodem_PrepareIntialPacket(packet, "data.bin", 5000, "crc32:cbf43926", PACKET_8K_SIZE, FILE_TIME, FILE_MODE, true);
+  TEST_ASSERT_EQUAL_STRING("5000 14631514600 100644 crc32:cbf43926 blk:8192 skip", (const char*)packet + PACKET_HEADER + 9);
+  extractFileAttributes(packet, &modTime, &mode);
+  TEST_ASSERT_EQUAL_UINT32(FILE_TIME, modTime);
+  TEST_ASSERT_EQUAL_UINT32(FILE_MODE, mode);
+  TEST_ASSERT_TRUE(extractFileSkip(packet));
+  TEST_ASSERT_EQUAL_UINT32(PACKET_8K_SIZE, extractFileBlockSize(packet));
+  char digest[YMODEM_DIGEST_TEXT_SIZE];
+  TEST_ASSERT_EQUAL_INT(YMODEM_DIGEST_CRC32, extractFileDigest(packet, digest, sizeof(digest)));
+  int size = 0;
+  extractFileInfo(packet, NULL, &size);
+  TEST_ASSERT_EQUAL_INT(5000, size);
+
+  // The header of lsz carries a serial number and more after the mode, and no skip
+  memset(packet, 0, sizeof(packet));
+  memcpy(packet + PACKET_HEADER, "data.bin\0" "5000 14631514600 100600 0 1 5000", 42);
+  extractFileAttributes(packet, &modTime, &mode);
+  TEST_ASSERT_EQUAL_UINT32(FILE_TIME, modTime);
+  TEST_ASSERT_EQUAL_UINT32(0100600, mode);
+  TEST_ASSERT_FALSE(extractFileSkip(packet));
+
+  // Without attributes the extensions are not taken for them
+  Ymodem_PrepareIntialPacket(packet, "data.bin", 5000, "crc32:cbf43926", PACKET_1K_SIZE, 0, 0, true);
+  TEST_ASSERT_EQUAL_STRING("5000 crc32:cbf43926 skip", (const char*)packet + PACKET_HEADER + 9);
+  extractFileAttributes(packet, &modTime, &mode);
+  TEST_ASSERT_EQUAL_UINT32(0, modTime);
+  TEST_ASSERT_EQUAL_UINT32(0, mode);
+  Ymodem_PrepareIntialPacket(packet, "data.bin", 5000);
+  extractFileAttributes(packet, &modTime, &mode);
+  TEST_ASSERT_EQUAL_UINT32(0, modTime);
+  TEST_ASSERT_FALSE(extractFileSkip(packet));
+
+  // A long name leaves room for the attributes, not for the skip after them
+  char name[PACKET_SIZE];
+  memset(name, 'n', sizeof(name));
+  name[100] = '\0';
+  TEST_ASSERT_EQUAL_UINT8(YMODEM_FIELD_SKIP, Ymodem_PrepareIntialPacket(packet, name, 5000, NULL, PACKET_1K_SIZE, FILE_TIME, FILE_MODE, true));
+  TEST_ASSERT_EQUAL_STRING("5000 14631514600 100644", (const char*)packet + PACKET_HEADER + 101);
+  TEST_ASSERT_FALSE(extractFileSkip(packet));
+
+  // A longer one leaves no room for the attributes, they are not cut into another time
+  name[100] = 'n';
+  name[110] = '\0';
+  TEST_ASSERT_EQUAL_UINT8(YMODEM_FIELD_ATTRIBUTES, Ymodem_PrepareIntialPacket(packet, name, 5000, NULL, PACKET_1K_SIZE, FILE_TIME, FILE_MODE, true));
+  TEST_ASSERT_EQUAL_STRING("5000 skip", (const char*)packet + PACKET_HEADER + 111);
+  extractFileAttributes(packet, &modTime, &mode);
+  TEST_ASSERT_EQUAL_UINT32(0, modTime);
+  TEST_ASSERT_EQUAL_UINT32(0, mode);
+
+  // Without room for the name every field is reported
+  name[110]             = 'n';
+  name[PACKET_SIZE - 1] = '\0';
+  TEST_ASSERT_EQUAL_UINT8(YMODEM_FIELD_NAME | YMODEM_FIELD_ATTRIBUTES | YMODEM_FIELD_SKIP,
+                          Ymodem_PrepareIntialPacket(packet, name, 5000, NULL, PACKET_1K_SIZE, FILE_TIME, FILE_MODE, true));
+}
+
+void test_skip_unchanged_file(void)
+{
+  MemorySource source(20000);
+  StoredSink   sink;
+
+  // The first push stores the file and its attributes
+  YmodemSender   first(source, "data.bin", source.data.size());
+  YmodemReceiver rx1(sink, 100000);
+  first.setAttributes(FILE_TIME, FILE_MODE);
+  first.setSkipUnchanged(true);
+  transfer(first, rx1);
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, first.result());
+  TEST_ASSERT_TRUE(sink.data == source.data);
+  TEST_ASSERT_EQUAL_UINT32(FILE_TIME, sink.modTime);
+  TEST_ASSERT_EQUAL_UINT32(FILE_MODE, sink.mode);
+
+  // The same push again is skipped, even when the ACK of the header is lost
+  for (size_t drop = 0, round = 0; round < 2; round++, drop = 2) {
+    YmodemSender   again(source, "data.bin", source.data.size());
+    YmodemReceiver rx(sink, 100000);
+    again.setAttributes(FILE_TIME, FILE_MODE);
+    again.setSkipUnchanged(true);
+    source.reads = 0;
+    sink.opens   = 0;
+    transfer(again, rx, drop);
+    TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, again.result());
+    TEST_ASSERT_EQUAL_INT(20000, rx.result());
+    TEST_ASSERT_EQUAL_UINT32(0, source.reads);
+    TEST_ASSERT_EQUAL_UINT32(0, sink.opens);
+    TEST_ASSERT_EQUAL_UINT32(1, again.stats().skipped);
+    TEST_ASSERT_EQUAL_UINT32(20000, again.stats().skippedBytes);
+    TEST_ASSERT_EQUAL_UINT32(1, rx.stats().skipped);
+    TEST_ASSERT_EQUAL_UINT32(0, again.stats().bytes);
+  }
+
+  // A newer file is sent, and a sender that does not accept SKIP is never asked
+  struct
+  {
+    uint32_t modTime;
+    bool     skip;
+  } cases[] = {{FILE_TIME + 1, true}, {FILE_TIME + 1, false}};
+  for (const auto& c : cases) {
+    YmodemSender   sender(source, "data.bin", source.data.size());
+    YmodemReceiver rx(sink, 100000);
+    sender.setAttributes(c.modTime, FILE_MODE);
+    sender.setSkipUnchanged(c.skip);
+    sink.questions = 0;
+    sink.opens     = 0;
+    transfer(sender, rx);
+    TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, sender.result());
+    TEST_ASSERT_EQUAL_UINT32(1, sink.opens);
+    TEST_ASSERT_EQUAL_UINT32(c.skip ? 1 : 0, sink.questions);
+    TEST_ASSERT_EQUAL_UINT32(0, sender.stats().skipped);
+    TEST_ASSERT_EQUAL_UINT32(c.modTime, sink.modTime);
+  }
+}
+
+void test_skip_repeated_push(void)
+{
+  // A batch of four files pushed twice, as a retried job does; every push is one session
+  const size_t sizes[] = {64 * 1024, 16 * 1024, 4 * 1024, 100 * 1024};
+  StoredSink   sinks[4];
+  uint64_t     pushUs[2] = {0, 0};
+  uint32_t     skippedBytes = 0;
+
+  for (int push = 0; push < 2; push++) {
+    for (int i = 0; i < 4; i++) {
+      MemorySource   source(sizes[i]);
+      YmodemSender   tx(source, "data.bin", source.data.size());
+      YmodemReceiver rx(sinks[i], 1000000);
+      tx.setAttributes(FILE_TIME + i, FILE_MODE);
+      tx.setSkipUnchanged(true);
+      pushUs[push] += transfer(tx, rx);
+      TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, tx.result());
+      TEST_ASSERT_TRUE(sinks[i].data == source.data);
+      skippedBytes += tx.stats().skippedBytes;
+    }
+  }
+
+  char message[128];
+  snprintf(message, sizeof(message), "115200 baud, 20 ms RTT: first push %u ms, repeated push %u ms, %u bytes not sent", (unsigned)(pushUs[0] / 1000),
+           (unsigned)(pushUs[1] / 1000), skippedBytes);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_EQUAL_UINT32(184 * 1024, skippedBytes);
+  TEST_ASSERT_TRUE(pushUs[1] * 50 < pushUs[0]);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_skip_header_fields);
+  RUN_TEST(test_skip_unchanged_file);
+  RUN_TEST(test_skip_repeated_push);
+  return UNITY_END();
+}
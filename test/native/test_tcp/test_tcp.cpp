@@ -0,0 +1,201 @@
+/**
+ * @file test_tcp.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Host tests for the TCP transport
+ * @version 0.1
+ * @date 2025-06-16
+ *
+ * Both ends run on the loopback interface: a receiver listens and accepts on
+ * a worker thread, the sender connects to it. The throughput is compared with
+ * the time the same bytes take on the UART at 115200 baud.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "../ymodem_fixtures.h"
+#include "YmodemTcp.h"
+#include "ZmodemReceive.h"
+#include "ZmodemTransmit.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <unity.h>
+#include <vector>
+
+#define FILE_BYTES (256 * 1024) /*!< Size of the file sent over the loopback */
+#define UART_BAUD (115200)      /*!< Baud rate of the baseline */
+#define ROUND_TRIPS (50)        /*!< Frames exchanged by the batching test */
+
+/**
+ * @brief Sends the file from a client to a server on the loopback, with Ymodem or Zmodem.
+ *
+ * @param elapsedMs Duration of the transfer in milliseconds, as seen by the sender.
+ */
+static void transfer(bool zmodem, uint32_t& elapsedMs, YmodemTcpStats& senderStats)
+{
+  TcpTransport server;
+  TEST_ASSERT_TRUE(server.listen(0));
+  uint16_t port = server.localPort();
+  TEST_ASSERT_TRUE(port != 0);
+
+  MemorySink  sink;
+  int         received = -1;
+  std::thread receiver([&]() {
+    if (!server.accept(2000)) {
+      return;
+    }
+    YmodemReceiver yreceiver(sink, FILE_BYTES);
+    ZmodemReceiver zreceiver(sink, FILE_BYTES);
+    received = Ymodem_RunSession(zmodem ? (YmodemSession&)zreceiver : yreceiver, server);
+  });
+
+  TcpTransport client;
+  MemorySource source(FILE_BYTES, 31, 9);
+  YmodemSender ysender(source, "bundle.bin", FILE_BYTES);
+  ZmodemSender zsender(source, "bundle.bin", FILE_BYTES);
+  bool connected = client.connect("127.0.0.1", port, 1000);
+  if (!connected) {
+    receiver.join();
+  }
+  TEST_ASSERT_TRUE(connected);
+  TEST_ASSERT_TRUE(client.connected());
+
+  uint32_t start  = Ymodem_Millis();
+  int      result = Ymodem_RunSession(zmodem ? (YmodemSession&)zsender : ysender, client);
+  elapsedMs       = Ymodem_Millis() - start;
+  receiver.join();
+
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, result);
+  TEST_ASSERT_EQUAL_INT(FILE_BYTES, received);
+  TEST_ASSERT_TRUE(source.data == sink.data);
+  senderStats = client.getStats();
+}
+
+void test_tcp_throughput_against_uart(void)
+{
+  YmodemTcpStats ystats   = {};
+  YmodemTcpStats zstats   = {};
+  uint32_t       ymodemMs = 0;
+  uint32_t       zmodemMs = 0;
+  transfer(false, ymodemMs, ystats);
+  transfer(true, zmodemMs, zstats);
+
+  // The same bytes on the UART, 10 bits per byte, without any turnaround
+  uint32_t uartMs = (uint32_t)((uint64_t)ystats.bytesSent * 10 * 1000 / UART_BAUD);
+  uint32_t blocks = FILE_BYTES / PACKET_1K_SIZE;
+
+  char message[160];
+  snprintf(message, sizeof(message), "%u KB: Ymodem %u ms, Zmodem %u ms over TCP, %u ms on the UART; %u sends for %u blocks", FILE_BYTES / 1024,
+           ymodemMs, zmodemMs, uartMs, ystats.sends, blocks);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE(ymodemMs * 10 < uartMs);
+  TEST_ASSERT_TRUE(zmodemMs * 10 < uartMs);
+  // One segment per frame, the header, data and CRC of a block are not split
+  TEST_ASSERT_TRUE(ystats.sends <= blocks + 8);
+}
+
+void test_tcp_batching(void)
+{
+  TcpTransport server;
+  TEST_ASSERT_TRUE(server.listen(0));
+  uint16_t port = server.localPort();
+
+  // The peer answers one byte once a whole frame has arrived
+  int         frames = 0;
+  std::thread echo([&]() {
+    uint8_t frame[PACKET_1K_SIZE + PACKET_OVERHEAD];
+    if (!server.accept(2000)) {
+      return;
+    }
+    while (frames < ROUND_TRIPS && server.read(frame, sizeof(frame), 1000) == (int)sizeof(frame)) {
+      const uint8_t ack = ACK;
+      server.write(&ack, 1);
+      frames++;
+    }
+    server.waitWriteDone(1000);
+  });
+
+  TcpTransport client;
+  client.connect("127.0.0.1", port, 1000);
+  uint8_t  header[PACKET_HEADER] = {STX, 1, 0xfe};
+  uint8_t  data[PACKET_1K_SIZE]  = {};
+  uint8_t  crc[PACKET_TRAILER]   = {0x12, 0x34};
+  uint32_t start                 = Ymodem_Micros();
+  int      acks                  = 0;
+  for (int i = 0; i < ROUND_TRIPS; i++) {
+    // Three writes, as a session that writes the parts of a frame separately
+    client.write(header, sizeof(header));
+    client.write(data, sizeof(data));
+    client.write(crc, sizeof(crc));
+    uint8_t reply = 0;
+    if (client.read(&reply, 1, 1000) != 1 || reply != ACK) {
+      break;
+    }
+    acks++;
+  }
+  uint32_t roundTripUs = (Ymodem_Micros() - start) / ROUND_TRIPS;
+  echo.join();
+
+  TEST_ASSERT_EQUAL_INT(ROUND_TRIPS, frames);
+  TEST_ASSERT_EQUAL_INT(ROUND_TRIPS, acks);
+
+  const YmodemTcpStats& stats = client.getStats();
+  TEST_ASSERT_EQUAL_UINT32(3 * ROUND_TRIPS, stats.writes);
+  TEST_ASSERT_EQUAL_UINT32(ROUND_TRIPS, stats.sends);
+  TEST_ASSERT_EQUAL_UINT32(ROUND_TRIPS * (PACKET_1K_SIZE + PACKET_OVERHEAD), stats.bytesSent);
+  TEST_ASSERT_EQUAL_UINT32(ROUND_TRIPS, stats.bytesReceived);
+  TEST_ASSERT_EQUAL_UINT32(ROUND_TRIPS, server.getStats().sends);
+
+  char message[100];
+  snprintf(message, sizeof(message), "%u us per frame and ACK, %u writes in %u sends", roundTripUs, stats.writes, stats.sends);
+  TEST_MESSAGE(message);
+  // Well below the 40 ms delayed ACK that a split frame could wait for
+  TEST_ASSERT_TRUE(roundTripUs < 10000);
+}
+
+void test_tcp_errors(void)
+{
+  // No peer: accept() gives up after its timeout, connect() to a closed port fails
+  TcpTransport server;
+  TEST_ASSERT_FALSE(server.accept(10));
+  TEST_ASSERT_TRUE(server.listen(0));
+  uint16_t port  = server.localPort();
+  uint32_t start = Ymodem_Millis();
+  TEST_ASSERT_FALSE(server.accept(100));
+  TEST_ASSERT_TRUE(Ymodem_Millis() - start >= 100);
+
+  TcpTransport client;
+  uint8_t      byte = 0;
+  TEST_ASSERT_EQUAL_INT(TRANSPORT_ERROR, client.read(&byte, 1, 10));
+  TEST_ASSERT_EQUAL_INT(TRANSPORT_ERROR, client.write(&byte, 1));
+  server.end();
+  TEST_ASSERT_FALSE(client.connect("127.0.0.1", port, 500));
+
+  // A read times out with nothing, and fails once the peer has closed the connection
+  TEST_ASSERT_TRUE(server.listen(0));
+  port = server.localPort();
+  TEST_ASSERT_TRUE(client.connect("127.0.0.1", port, 500));
+  TEST_ASSERT_TRUE(server.accept(500));
+  TEST_ASSERT_EQUAL_INT(0, client.read(&byte, 1, 20));
+  server.end();
+  TEST_ASSERT_EQUAL_INT(TRANSPORT_ERROR, client.read(&byte, 1, 500));
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_tcp_throughput_against_uart);
+  RUN_TEST(test_tcp_batching);
+  RUN_TEST(test_tcp_errors);
+  return UNITY_END();
+}
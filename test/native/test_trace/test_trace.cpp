@@ -0,0 +1,231 @@
+/**
+ * @file test_trace.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Host tests for the wire-level trace recorder
+ * @version 0.1
+ * @date 2025-05-29
+ *
+ * The ring is checked on its own, then a session is recorded through a socket
+ * pair and the dumped trace is parsed back.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "../ymodem_fixtures.h"
+#include "YmodemTrace.h"
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <unity.h>
+#include <vector>
+
+#define FILE_BYTES (20 * 1024) /*!< Size of the recorded file */
+
+struct Record
+{
+  uint32_t             time;
+  YmodemTraceType      type;
+  std::vector<uint8_t> data;
+};
+
+/**
+ * @brief Parses a dumped trace, checking its file header.
+ */
+static void parse(const std::vector<uint8_t>& file, std::vector<Record>& records, uint32_t* dropped)
+{
+  records.clear();
+  TEST_ASSERT_TRUE(file.size() >= YMODEM_TRACE_FILE_HEADER);
+  TEST_ASSERT_EQUAL_MEMORY(YMODEM_TRACE_MAGIC, file.data(), 4);
+  TEST_ASSERT_EQUAL_UINT8(YMODEM_TRACE_VERSION, file[4]);
+  TEST_ASSERT_EQUAL_UINT16(YMODEM_TRACE_RECORD_HEADER, file[6] | file[7] << 8);
+  *dropped       = file[8] | file[9] << 8 | file[10] << 16 | (uint32_t)file[11] << 24;
+  uint32_t bytes = file[12] | file[13] << 8 | file[14] << 16 | (uint32_t)file[15] << 24;
+  TEST_ASSERT_EQUAL_UINT32(file.size() - YMODEM_TRACE_FILE_HEADER, bytes);
+
+  size_t position = YMODEM_TRACE_FILE_HEADER;
+  while (position < file.size()) {
+    const uint8_t* header = file.data() + position;
+    Record         record;
+    record.time   = header[0] | header[1] << 8 | header[2] << 16 | (uint32_t)header[3] << 24;
+    uint16_t info = header[4] | header[5] << 8;
+    record.type   = (YmodemTraceType)(info >> 12);
+    size_t size   = info & YMODEM_TRACE_MAX_CHUNK;
+    position     += YMODEM_TRACE_RECORD_HEADER;
+    TEST_ASSERT_TRUE(position + size <= file.size());
+    record.data.assign(file.data() + position, file.data() + position + size);
+    position += size;
+    records.push_back(record);
+  }
+}
+
+static void dumpToMemory(const YmodemTrace& trace, std::vector<uint8_t>& file)
+{
+  file.clear();
+  TEST_ASSERT_TRUE(trace.dump([&file](const uint8_t* data, size_t size) {
+    file.insert(file.end(), data, data + size);
+    return true;
+  }));
+}
+
+void test_trace_ring_wrap(void)
+{
+  YmodemTrace trace(64);
+  uint8_t     payload[40];
+  for (size_t i = 0; i < sizeof(payload); i++) {
+    payload[i] = (uint8_t)i;
+  }
+
+  // Two records of 6 + 20 bytes fit, the third one drops the oldest
+  trace.record(YMODEM_TRACE_TX, payload, 20);
+  trace.record(YMODEM_TRACE_RX, payload + 1, 20);
+  TEST_ASSERT_EQUAL_UINT32(0, trace.dropped());
+  trace.record(YMODEM_TRACE_TX, payload + 2, 20);
+  trace.record(YMODEM_TRACE_FLUSH, NULL, 0);
+  TEST_ASSERT_EQUAL_UINT32(1, trace.dropped());
+  TEST_ASSERT_EQUAL(2 * 26 + 6, trace.size());
+
+  // A record larger than the ring is dropped without touching the others
+  trace.record(YMODEM_TRACE_RX, payload, 60);
+  TEST_ASSERT_EQUAL_UINT32(2, trace.dropped());
+
+  uint32_t             dropped = 0;
+  std::vector<uint8_t> file;
+  std::vector<Record>  records;
+  dumpToMemory(trace, file);
+  parse(file, records, &dropped);
+  TEST_ASSERT_EQUAL_UINT32(2, dropped);
+  TEST_ASSERT_EQUAL(3, records.size());
+  TEST_ASSERT_EQUAL(YMODEM_TRACE_RX, records[0].type);
+  TEST_ASSERT_EQUAL_MEMORY(payload + 1, records[0].data.data(), 20);
+  TEST_ASSERT_EQUAL(YMODEM_TRACE_TX, records[1].type);
+  TEST_ASSERT_EQUAL_MEMORY(payload + 2, records[1].data.data(), 20);
+  TEST_ASSERT_EQUAL(YMODEM_TRACE_FLUSH, records[2].type);
+  TEST_ASSERT_EQUAL(0, records[2].data.size());
+
+  // Writes longer than a record are split
+  YmodemTrace          large(3 * YMODEM_TRACE_MAX_CHUNK);
+  std::vector<uint8_t> block(YMODEM_TRACE_MAX_CHUNK + 100, 0x5a);
+  large.record(YMODEM_TRACE_TX, block.data(), block.size());
+  dumpToMemory(large, file);
+  parse(file, records, &dropped);
+  TEST_ASSERT_EQUAL(2, records.size());
+  TEST_ASSERT_EQUAL(YMODEM_TRACE_MAX_CHUNK, records[0].data.size());
+  TEST_ASSERT_EQUAL(100, records[1].data.size());
+
+  trace.clear();
+  TEST_ASSERT_EQUAL(0, trace.size());
+  TEST_ASSERT_EQUAL_UINT32(0, trace.dropped());
+}
+
+void test_trace_session(void)
+{
+  int fds[2];
+  TEST_ASSERT_EQUAL_INT(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+
+  SocketPort     senderPort(fds[0]);
+  SocketPort     receiverPort(fds[1]);
+  MemorySource   source(FILE_BYTES, 31, 9);
+  MemorySink     sink;
+  YmodemReceiver receiver(sink, FILE_BYTES);
+  YmodemSender   sender(source, "data.bin", FILE_BYTES);
+  YmodemTrace    trace(64 * 1024);
+
+  int         received = 0;
+  std::thread thread([&]() { received = Ymodem_RunSession(receiver, receiverPort); });
+
+  YmodemTraceTransport link(senderPort, &trace);
+  int                  result = Ymodem_RunSession(sender, link);
+  thread.join();
+  close(fds[0]);
+  close(fds[1]);
+
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, result);
+  TEST_ASSERT_EQUAL_INT(FILE_BYTES, received);
+  TEST_ASSERT_TRUE(source.data == sink.data);
+
+  // The dumped trace holds every byte of the session, in order
+  uint32_t             dropped = 0;
+  std::vector<uint8_t> file;
+  std::vector<Record>  records;
+  dumpToMemory(trace, file);
+  parse(file, records, &dropped);
+  TEST_ASSERT_EQUAL_UINT32(0, dropped);
+  // The sender wakes the receiver up with a C, which answers with its own C
+  TEST_ASSERT_EQUAL(YMODEM_TRACE_TX, records[0].type);
+  TEST_ASSERT_EQUAL(YMODEM_TRACE_RX, records[1].type);
+  TEST_ASSERT_EQUAL_UINT8(CRC16, records[1].data[0]);
+
+  std::vector<uint8_t> sent;
+  uint32_t             previous = records[0].time;
+  size_t               acks     = 0;
+  for (const Record& record : records) {
+    TEST_ASSERT_TRUE(record.time - previous < 10 * 1000 * 1000);
+    previous = record.time;
+    if (record.type == YMODEM_TRACE_TX) {
+      sent.insert(sent.end(), record.data.begin(), record.data.end());
+    }
+    else if (record.type == YMODEM_TRACE_RX) {
+      acks += std::count(record.data.begin(), record.data.end(), ACK);
+    }
+  }
+  TEST_ASSERT_TRUE(acks > FILE_BYTES / PACKET_1K_SIZE);
+  TEST_ASSERT_EQUAL_UINT8(STX, sent[1 + PACKET_OVERHEAD + PACKET_SIZE]);
+  TEST_ASSERT_EQUAL_MEMORY(source.data.data(), sent.data() + 1 + PACKET_OVERHEAD + PACKET_SIZE + PACKET_HEADER, PACKET_1K_SIZE);
+
+  // The file dump is the same as the one in memory
+  char path[] = "/tmp/test_trace_XXXXXX";
+  int  fd     = mkstemp(path);
+  close(fd);
+  TEST_ASSERT_TRUE(trace.dump(path));
+  FILE*                written = fopen(path, "rb");
+  std::vector<uint8_t> copy(file.size() + 1);
+  size_t               length = fread(copy.data(), 1, copy.size(), written);
+  fclose(written);
+  unlink(path);
+  TEST_ASSERT_EQUAL(file.size(), length);
+  TEST_ASSERT_EQUAL_MEMORY(file.data(), copy.data(), length);
+}
+
+void test_trace_overhead(void)
+{
+  YmodemTrace trace;
+  uint8_t     packet[PACKET_1K_SIZE + PACKET_OVERHEAD];
+  memset(packet, 0xa5, sizeof(packet));
+
+  const int rounds = 20000;
+  auto      start  = std::chrono::steady_clock::now();
+  for (int i = 0; i < rounds; i++) {
+    trace.record(YMODEM_TRACE_TX, packet, sizeof(packet));
+    trace.record(YMODEM_TRACE_RX, packet, 1);
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / rounds;
+
+  // A 1K packet and its ACK cost a copy, not a formatted log line
+  TEST_ASSERT_LESS_THAN_UINT32(20000, (uint32_t)ns);
+  TEST_ASSERT_GREATER_THAN_UINT32(0, trace.dropped());
+
+  char message[96];
+  snprintf(message, sizeof(message), "Trace overhead: %.0f ns per 1K packet and its ACK", ns);
+  TEST_MESSAGE(message);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_trace_ring_wrap);
+  RUN_TEST(test_trace_session);
+  RUN_TEST(test_trace_overhead);
+  return UNITY_END();
+}
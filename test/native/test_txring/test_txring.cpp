@@ -0,0 +1,289 @@
+/**
+ * @file test_txring.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Host tests for the transmit path with and without the UART TX ring buffer
+ * @version 0.1
+ * @date 2025-06-12
+ *
+ * The sending ESP32 is modelled on a simulated clock. Without a TX buffer,
+ * write() returns once all but the last 128 bytes are in the hardware FIFO;
+ * with the ring of UART_TX_BUFFER_SIZE bytes it returns as soon as the packet
+ * fits in the ring and the FIFO. Every block read from LittleFS keeps the task
+ * busy for SIM_READ_NS, which overlaps with the drain only with the ring, or
+ * at low baud rates where the FIFO alone lasts longer than the read.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "../ymodem_fixtures.h"
+#include "ZmodemReceive.h"
+#include "ZmodemTransmit.h"
+#include <algorithm>
+#include <deque>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <unity.h>
+#include <vector>
+
+#define SIM_FIFO_SIZE (128)         // Hardware TX FIFO of the ESP32 UART
+#define SIM_READ_NS (2000000ULL)    // LittleFS read of a block, the task is busy meanwhile
+#define SIM_TURNAROUND_NS (500000)  // Time the receiver takes to answer a packet
+
+/**
+ * @brief TX side of the simulated UART: the line, the FIFO and the driver ring.
+ */
+struct SimTx
+{
+  uint64_t byteNs;
+  size_t   ring;
+  uint64_t idleAt    = 0; // End of the last byte queued
+  uint64_t blockedNs = 0; // Time spent in write()
+  uint32_t writes    = 0;
+
+  /**
+   * @brief Queues a write started at now, the bytes arrive in order at the receiver.
+   *
+   * @return uint64_t Time at which write() returns.
+   */
+  uint64_t write(uint64_t now, const uint8_t* data, size_t size, std::deque<std::pair<uint64_t, uint8_t>>& line)
+  {
+    uint64_t start = std::max(now, idleAt);
+    for (size_t i = 0; i < size; i++) {
+      line.push_back(std::make_pair(start + (i + 1) * byteNs, data[i]));
+    }
+    idleAt = start + size * byteNs;
+
+    // The call returns once what is left to send fits in the FIFO and the ring
+    uint64_t capacityNs = (SIM_FIFO_SIZE + ring) * byteNs;
+    uint64_t done       = (idleAt > capacityNs) ? std::max(now, idleAt - capacityNs) : now;
+    blockedNs          += done - now;
+    writes++;
+    return done;
+  }
+};
+
+struct TxResult
+{
+  uint64_t elapsedNs;
+  uint64_t blockedPerBlockNs;
+};
+
+/**
+ * @brief Runs a transfer from the simulated sender to a receiver answering after SIM_TURNAROUND_NS.
+ */
+static TxResult runTx(YmodemSession& tx, YmodemSession& rx, MemorySource& source, uint32_t baudRate, size_t ring)
+{
+  SimTx                                    uart = {10ULL * 1000000000ULL / baudRate, ring};
+  std::deque<std::pair<uint64_t, uint8_t>> line;    // Sender to receiver
+  std::deque<std::pair<uint64_t, uint8_t>> answers; // Receiver to sender
+  uint64_t                                 now      = 1000000000ULL;
+  uint64_t                                 taskFree = now; // The sending task is in write() or reading LittleFS until then
+  uint64_t                                 answerAt = 0;
+  uint32_t                                 first    = source.reads;
+
+  rx.start(now / 1000000);
+  tx.start(now / 1000000);
+  for (long steps = 0; steps < 10000000 && !(tx.isDone() && rx.isDone()); steps++) {
+    uint32_t ms = now / 1000000;
+
+    // Receiver, on its own device
+    std::vector<uint8_t> arrived;
+    while (!line.empty() && line.front().first <= now) {
+      arrived.push_back(line.front().second);
+      line.pop_front();
+    }
+    if (!arrived.empty() && !rx.isDone()) {
+      rx.feed(arrived.data(), arrived.size(), ms);
+    }
+    rx.poll(ms);
+    while (rx.outputSize() > 0) {
+      for (size_t i = 0; i < rx.outputSize(); i++) {
+        answerAt = std::max(answerAt, now + SIM_TURNAROUND_NS) + uart.byteNs;
+        answers.push_back(std::make_pair(answerAt, rx.output()[i]));
+      }
+      rx.consumeOutput(rx.outputSize());
+    }
+
+    // Sending task, once it is free again
+    if (taskFree <= now) {
+      arrived.clear();
+      while (!answers.empty() && answers.front().first <= now) {
+        arrived.push_back(answers.front().second);
+        answers.pop_front();
+      }
+      uint32_t reads = source.reads;
+      if (!arrived.empty() && !tx.isDone()) {
+        tx.feed(arrived.data(), arrived.size(), ms);
+      }
+      tx.poll(ms);
+      uint64_t at = now + (source.reads - reads) * SIM_READ_NS;
+      while (tx.outputSize() > 0) {
+        at = uart.write(at, tx.output(), tx.outputSize(), line);
+        tx.consumeOutput(tx.outputSize());
+      }
+      taskFree = at;
+    }
+
+    // A streaming sender produces its next subpacket as soon as the task is free
+    uint64_t next = (taskFree > now || (tx.streaming() && !tx.isDone())) ? taskFree : UINT64_MAX;
+    if (!line.empty()) {
+      next = std::min(next, line.front().first);
+    }
+    if (!answers.empty()) {
+      next = std::min(next, std::max(answers.front().first, taskFree));
+    }
+    const YmodemSession* sessions[] = {&tx, &rx};
+    for (const YmodemSession* session : sessions) {
+      uint64_t deadline = (uint64_t)session->nextDeadline() * 1000000;
+      if (!session->isDone() && deadline > now) {
+        next = std::min(next, deadline);
+      }
+    }
+    if (next == UINT64_MAX) {
+      break;
+    }
+    now = std::max(now + 1, next);
+  }
+
+  uint32_t blocks = std::max<uint32_t>(1, source.reads - first);
+  return {now - 1000000000ULL, uart.blockedNs / blocks};
+}
+
+static void compareYmodem(size_t blockSize, TxResult& blocking, TxResult& ring)
+{
+  MemorySource source(64 * 1024, 11, 8);
+  TxResult*    results[] = {&blocking, &ring};
+  for (int buffered = 0; buffered < 2; buffered++) {
+    MemorySink     sink;
+    YmodemSender   tx(source, "data.bin", source.data.size());
+    YmodemReceiver rx(sink, 1000000);
+    tx.setBlockSize(blockSize);
+    rx.setBlockSize(blockSize);
+    *results[buffered] = runTx(tx, rx, source, 115200, buffered ? UART_TX_BUFFER_SIZE : 0);
+    TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, tx.result());
+    TEST_ASSERT_TRUE(sink.data == source.data);
+  }
+}
+
+void test_txring_ymodem_busy(void)
+{
+  TxResult blocking, ring;
+  compareYmodem(PACKET_1K_SIZE, blocking, ring);
+
+  char message[160];
+  snprintf(message, sizeof(message), "ymodem 1K: write() busy %u us per block blocking, %u us with the ring; %u ms and %u ms",
+           (unsigned)(blocking.blockedPerBlockNs / 1000), (unsigned)(ring.blockedPerBlockNs / 1000), (unsigned)(blocking.elapsedNs / 1000000),
+           (unsigned)(ring.elapsedNs / 1000000));
+  TEST_MESSAGE(message);
+
+  // The 1029-byte packet fits in the ring, the task is free while it drains
+  TEST_ASSERT_TRUE(blocking.blockedPerBlockNs > 70000000ULL);
+  TEST_ASSERT_TRUE(ring.blockedPerBlockNs == 0);
+  // Each block waits for its ACK either way, the transfer takes the same time
+  TEST_ASSERT_TRUE(ring.elapsedNs <= blocking.elapsedNs);
+
+  // A 4K block does not fit, the task only waits for the part above the ring
+  compareYmodem(PACKET_4K_SIZE, blocking, ring);
+  uint64_t byteNs = 10ULL * 1000000000ULL / 115200;
+  TEST_ASSERT_TRUE(ring.blockedPerBlockNs + UART_TX_BUFFER_SIZE * byteNs / 2 < blocking.blockedPerBlockNs);
+}
+
+void test_txring_zmodem_overlap(void)
+{
+  MemorySource source(64 * 1024, 11, 8);
+  TxResult     results[2];
+  for (int buffered = 0; buffered < 2; buffered++) {
+    MemorySink     sink;
+    ZmodemSender   tx(source, "data.bin", source.data.size());
+    ZmodemReceiver rx(sink, 1000000);
+    results[buffered] = runTx(tx, rx, source, 921600, buffered ? UART_TX_BUFFER_SIZE : 0);
+    TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, tx.result());
+    TEST_ASSERT_TRUE(sink.data == source.data);
+  }
+
+  char message[160];
+  snprintf(message, sizeof(message), "zmodem stream at 921600 baud: %u ms blocking, %u ms with the ring, write() busy %u us and %u us per subpacket",
+           (unsigned)(results[0].elapsedNs / 1000000), (unsigned)(results[1].elapsedNs / 1000000),
+           (unsigned)(results[0].blockedPerBlockNs / 1000), (unsigned)(results[1].blockedPerBlockNs / 1000));
+  TEST_MESSAGE(message);
+
+  // The FIFO drains in 1.4 ms, less than a read from LittleFS; the ring keeps the line busy meanwhile
+  uint64_t reads  = source.data.size() / ZMODEM_SUBPACKET_SIZE;
+  uint64_t fifoNs = SIM_FIFO_SIZE * 10ULL * 1000000000ULL / 921600;
+  TEST_ASSERT_TRUE(results[1].elapsedNs + reads * (SIM_READ_NS - fifoNs) * 3 / 4 < results[0].elapsedNs);
+}
+
+/**
+ * @brief Socket end that counts the calls to waitWriteDone() and the writes made after the last one.
+ */
+class DrainedPort : public SocketPort
+{
+public:
+  uint32_t drains     = 0;
+  uint32_t lateWrites = 0;
+
+  explicit DrainedPort(int fd) : SocketPort(fd)
+  {
+  }
+
+  int write(const uint8_t* data, size_t size) override
+  {
+    if (drains > 0) {
+      lateWrites++;
+    }
+    return SocketPort::write(data, size);
+  }
+
+  bool waitWriteDone(uint32_t timeoutMs) override
+  {
+    drains++;
+    return true;
+  }
+};
+
+void test_txring_session_drains(void)
+{
+  int fds[2];
+  TEST_ASSERT_EQUAL_INT(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  DrainedPort    senderPort(fds[0]);
+  DrainedPort    receiverPort(fds[1]);
+  MemorySource   source(8 * 1024, 11, 8);
+  MemorySink     sink;
+  YmodemSender   sender(source, "data.bin", source.data.size());
+  YmodemReceiver receiver(sink, 1000000);
+
+  int         received = 0;
+  std::thread thread([&]() { received = Ymodem_RunSession(receiver, receiverPort); });
+  int         result = Ymodem_RunSession(sender, senderPort);
+  thread.join();
+  close(fds[0]);
+  close(fds[1]);
+
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, result);
+  TEST_ASSERT_EQUAL_INT(source.data.size(), received);
+  // Both sessions wait for their last bytes to leave before returning, and write nothing after
+  TEST_ASSERT_EQUAL_UINT32(1, senderPort.drains);
+  TEST_ASSERT_EQUAL_UINT32(1, receiverPort.drains);
+  TEST_ASSERT_EQUAL_UINT32(0, senderPort.lateWrites);
+  TEST_ASSERT_EQUAL_UINT32(0, receiverPort.lateWrites);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_txring_ymodem_busy);
+  RUN_TEST(test_txring_zmodem_overlap);
+  RUN_TEST(test_txring_session_drains);
+  return UNITY_END();
+}
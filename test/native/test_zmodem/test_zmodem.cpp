@@ -0,0 +1,204 @@
+/**
+ * @file test_zmodem.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Host tests for the Zmodem sessions
+ * @version 0.1
+ * @date 2025-06-02
+ *
+ * The sessions are connected through a simulated serial line with a baud rate,
+ * a latency and injected errors, driven by a virtual clock, so the time a
+ * transfer takes can be compared between Zmodem and Ymodem.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "../ymodem_fixtures.h"
+#include "ZmodemReceive.h"
+#include "ZmodemTransmit.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <unity.h>
+#include <vector>
+
+#define LINE_BYTE_US (87)        // One byte at 115200 baud
+#define LINE_LATENCY_US (20000)  // One way latency of the line, a USB adapter and a radio link
+#define LINE_ERROR_EVERY (15000) // Bytes sent to the receiver between two corrupted ones
+
+/**
+ * @brief Runs a transfer over the simulated line.
+ *
+ * @param stopAt Bytes held by the sink after which the transfer is abandoned, 0 to run it to the end.
+ * @return uint64_t Time the receiver took to finish, in microseconds.
+ */
+static uint64_t transfer(YmodemSession& tx, YmodemSession& rx, MemorySink& sink, size_t corruptEvery, size_t stopAt = 0)
+{
+  Line toReceiver(LINE_BYTE_US * 1000, LINE_LATENCY_US, true);
+  Line toSender(LINE_BYTE_US * 1000, LINE_LATENCY_US, true);
+
+  toReceiver.corruptEvery = corruptEvery;
+  return runLine(tx, rx, toReceiver, toSender, [&sink, stopAt](uint64_t) { return stopAt == 0 || sink.data.size() < stopAt; });
+}
+
+/**
+ * @brief Feeds bytes to a decoder and returns the first token they complete.
+ */
+static ZmodemToken decode(ZmodemDecoder& decoder, const uint8_t* data, size_t size)
+{
+  ZmodemToken token = ZMODEM_TOKEN_NONE;
+  for (size_t i = 0; i < size; i++) {
+    ZmodemToken next = decoder.feed(data[i]);
+    token            = (token == ZMODEM_TOKEN_NONE) ? next : token;
+  }
+  return token;
+}
+
+void test_zmodem_frames(void)
+{
+  ZmodemEncoder encoder;
+  ZmodemDecoder decoder;
+  uint8_t       wire[2 * 256 + 32];
+  uint8_t       data[256];
+  size_t        len;
+
+  // Same bytes as sz and rz
+  len = encoder.hexHeader(wire, ZRQINIT, 0);
+  TEST_ASSERT_EQUAL_INT(ZMODEM_HEX_HEADER_SIZE, len);
+  TEST_ASSERT_EQUAL_MEMORY("**\x18" "B00000000000000\r\x8a\x11", wire, len);
+  len = encoder.hexHeader(wire, ZRINIT, (uint32_t)(CANFDX | CANOVIO | CANFC32) << 24);
+  TEST_ASSERT_EQUAL_MEMORY("**\x18" "B0100000023be50\r\x8a\x11", wire, len);
+
+  TEST_ASSERT_EQUAL_INT(ZMODEM_TOKEN_HEADER, decode(decoder, wire, len));
+  TEST_ASSERT_EQUAL_UINT8(ZRINIT, decoder.type());
+  TEST_ASSERT_EQUAL_HEX32(0x23000000, decoder.arg());
+
+  // Binary header and subpacket with every byte value, with both CRC
+  for (int i = 0; i < 256; i++) {
+    data[i] = (uint8_t)i;
+  }
+  for (int crc32 = 0; crc32 < 2; crc32++) {
+    uint8_t received[256];
+    len = encoder.binaryHeader(wire, ZDATA, 0x12345678, crc32);
+    TEST_ASSERT_EQUAL_INT(ZMODEM_TOKEN_HEADER, decode(decoder, wire, len));
+    TEST_ASSERT_EQUAL_UINT8(ZDATA, decoder.type());
+    TEST_ASSERT_EQUAL_HEX32(0x12345678, decoder.arg());
+    TEST_ASSERT_EQUAL(crc32 != 0, decoder.crc32());
+
+    decoder.expectData(received, sizeof(received));
+    len = encoder.subpacket(wire, data, sizeof(data), ZCRCG, crc32);
+    TEST_ASSERT_EQUAL_INT(ZMODEM_TOKEN_DATA, decode(decoder, wire, len));
+    TEST_ASSERT_EQUAL_INT(256, decoder.dataSize());
+    TEST_ASSERT_EQUAL_UINT8(ZCRCG, decoder.dataEnd());
+    TEST_ASSERT_EQUAL_MEMORY(data, received, sizeof(data));
+
+    // The frame goes on, a damaged subpacket is reported and the decoder hunts for a header
+    len       = encoder.subpacket(wire, data, 100, ZCRCE, crc32);
+    wire[50] ^= 0x01;
+    TEST_ASSERT_EQUAL_INT(ZMODEM_TOKEN_BAD_DATA, decode(decoder, wire, len));
+  }
+
+  TEST_ASSERT_EQUAL_INT(ZMODEM_TOKEN_CANCEL, decode(decoder, ZMODEM_CANCEL, ZMODEM_CANCEL_SIZE));
+
+  // A ZRINIT that crosses the ZFILE draws no second ZFILE, whose ZRPOS(0) would rewind the data
+  MemorySource source(1000);
+  ZmodemSender tx(source, "data.bin", source.data.size());
+  size_t       sent = 0;
+  tx.start(0);
+  len = encoder.hexHeader(wire, ZRINIT, (uint32_t)CANFC32 << 24);
+  for (int i = 0; i < 2; i++) {
+    tx.consumeOutput(tx.outputSize());
+    tx.feed(wire, len, 10);
+    for (sent = 0; tx.outputSize() > 0; tx.consumeOutput(tx.outputSize())) {
+      sent += tx.outputSize();
+    }
+    TEST_ASSERT_EQUAL(i == 0, sent > 0);
+  }
+  TEST_ASSERT_FALSE(tx.isDone());
+}
+
+void test_zmodem_errors_goodput(void)
+{
+  MemorySource source(64 * 1024);
+  char         message[96];
+
+  MemorySink     ysink;
+  YmodemSender   ytx(source, "data.bin", source.data.size());
+  YmodemReceiver yrx(ysink, 100000);
+  uint64_t       yus = transfer(ytx, yrx, ysink, LINE_ERROR_EVERY);
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, ytx.result());
+  TEST_ASSERT_TRUE(ysink.data == source.data);
+
+  MemorySink     zsink;
+  ZmodemSender   ztx(source, "data.bin", source.data.size());
+  ZmodemReceiver zrx(zsink, 100000);
+  uint64_t       zus = transfer(ztx, zrx, zsink, LINE_ERROR_EVERY);
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, ztx.result());
+  TEST_ASSERT_EQUAL_INT(64 * 1024, zrx.result());
+  TEST_ASSERT_TRUE(zsink.name == "data.bin");
+  TEST_ASSERT_TRUE(zsink.data == source.data);
+  TEST_ASSERT_TRUE(zrx.stats().retries > 0);
+
+  snprintf(message, sizeof(message), "goodput with errors: ymodem %u B/s, zmodem %u B/s", (unsigned)(source.data.size() * 1000000ULL / yus),
+           (unsigned)(source.data.size() * 1000000ULL / zus));
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE(zus < yus);
+
+  // A receiver window makes the sender wait for acknowledgements, the data still goes through
+  MemorySink     wsink;
+  ZmodemSender   wtx(source, "data.bin", source.data.size());
+  ZmodemReceiver wrx(wsink, 100000);
+  wrx.setWindow(4096);
+  transfer(wtx, wrx, wsink, LINE_ERROR_EVERY);
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, wtx.result());
+  TEST_ASSERT_TRUE(wsink.data == source.data);
+}
+
+void test_zmodem_resume(void)
+{
+  MemorySource source(20000);
+  MemorySink   sink;
+
+  // The first transfer is interrupted, the sink keeps what it has received
+  ZmodemSender   first(source, "data.bin", source.data.size());
+  ZmodemReceiver cut(sink, 100000);
+  transfer(first, cut, sink, 0, 8000);
+  size_t kept = sink.data.size();
+  TEST_ASSERT_TRUE(kept >= 8000 && kept < source.data.size());
+
+  ZmodemSender   tx(source, "data.bin", source.data.size());
+  ZmodemReceiver rx(sink, 100000);
+  rx.setResume(true);
+  transfer(tx, rx, sink, 0);
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, tx.result());
+  TEST_ASSERT_EQUAL_INT(20000, rx.result());
+  TEST_ASSERT_TRUE(sink.data == source.data);
+  TEST_ASSERT_EQUAL_UINT32(20000 - kept, tx.stats().bytes);
+  TEST_ASSERT_EQUAL_UINT32(20000 - kept, rx.stats().bytes);
+
+  // A file already complete is skipped
+  ZmodemSender   again(source, "data.bin", source.data.size());
+  ZmodemReceiver skip(sink, 100000);
+  skip.setResume(true);
+  transfer(again, skip, sink, 0);
+  TEST_ASSERT_EQUAL_INT(YMODEM_TRANSMIT_OK, again.result());
+  TEST_ASSERT_EQUAL_INT(20000, skip.result());
+  TEST_ASSERT_EQUAL_UINT32(0, again.stats().bytes);
+  TEST_ASSERT_TRUE(sink.data == source.data);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_zmodem_frames);
+  RUN_TEST(test_zmodem_errors_goodput);
+  RUN_TEST(test_zmodem_resume);
+  return UNITY_END();
+}
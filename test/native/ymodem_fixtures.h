@@ -0,0 +1,324 @@
+/**
+ * @file ymodem_fixtures.h
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Fixtures shared by the host tests
+ * @version 0.1
+ * @date 2025-05-28
+ *
+ * This file contains the sinks, sources and transports that stand in for
+ * LittleFS and the UART in the suites of test/native. Each suite includes it
+ * and keeps only the fixtures that model its own subject.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef YMODEM_FIXTURES_H
+#define YMODEM_FIXTURES_H
+
+#include "YmodemReceive.h"
+#include "YmodemTransmit.h"
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <poll.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * @brief Sink that keeps the received file in memory.
+ */
+class MemorySink : public YmodemReceiveSink
+{
+public:
+  std::string          name;
+  uint32_t             size = 0;
+  std::vector<uint8_t> data;
+  size_t               failAfter = 0;          // Blocks accepted before the writes fail, 0 for never
+  uint32_t             space     = UINT32_MAX; // Largest file the reservation accepts
+  bool                 closed    = false;      // Set by close()
+
+  bool reserve(uint32_t fileSize) override
+  {
+    return fileSize <= space;
+  }
+
+  bool open(const char* fileName, uint32_t fileSize) override
+  {
+    name = fileName;
+    size = fileSize;
+    data.clear();
+    return true;
+  }
+
+  int write(const uint8_t* block, size_t length) override
+  {
+    if (failAfter > 0 && data.size() >= failAfter * PACKET_1K_SIZE) {
+      return -1;
+    }
+    data.insert(data.end(), block, block + length);
+    return length;
+  }
+
+  bool resume(const char* fileName, uint32_t fileSize, uint32_t* offset) override
+  {
+    name    = fileName;
+    size    = fileSize;
+    *offset = data.size();
+    return true;
+  }
+
+  void close() override
+  {
+    closed = true;
+  }
+};
+
+/**
+ * @brief Source that reads a file filled with a pattern from memory.
+ */
+class MemorySource : public YmodemTransmitSource
+{
+public:
+  std::vector<uint8_t> data;
+  uint32_t             reads = 0; // Calls to read()
+
+  /**
+   * @brief Constructs a file whose byte i is i * step + (i >> shift).
+   */
+  explicit MemorySource(size_t size, unsigned step = 7, unsigned shift = 8)
+  {
+    for (size_t i = 0; i < size; i++) {
+      data.push_back((uint8_t)(i * step + (i >> shift)));
+    }
+  }
+
+  int read(uint8_t* block, size_t length, uint32_t offset) override
+  {
+    memcpy(block, data.data() + offset, length);
+    reads++;
+    return length;
+  }
+};
+
+/**
+ * @brief Transport over one end of a socket pair, with the writes delayed as on a serial line.
+ */
+class SocketPort : public YmodemTransport
+{
+public:
+  size_t noiseAt    = 0; // First written byte corrupted by the noise burst
+  size_t noiseBytes = 0; // Bytes corrupted, 0 for a clean link
+
+  /**
+   * @param usPerByte Time of a byte on the line, 0 to write at once.
+   */
+  explicit SocketPort(int fd, uint32_t usPerByte = 0) : fd(fd), usPerByte(usPerByte)
+  {
+  }
+
+  int read(uint8_t* data, size_t size, uint32_t timeoutMs) override
+  {
+    size_t got = 0;
+    while (got < size) {
+      struct pollfd request = {fd, POLLIN, 0};
+      if (poll(&request, 1, (int)timeoutMs) <= 0) {
+        break;
+      }
+      ssize_t len = ::read(fd, data + got, size - got);
+      if (len <= 0) {
+        return got > 0 ? (int)got : TRANSPORT_ERROR;
+      }
+      got += len;
+    }
+    return (int)got;
+  }
+
+  int write(const uint8_t* data, size_t size) override
+  {
+    if (usPerByte > 0) {
+      std::this_thread::sleep_for(std::chrono::microseconds(size * usPerByte));
+    }
+    std::vector<uint8_t> copy(data, data + size);
+    for (size_t i = 0; i < size; i++, written++) {
+      if (written >= noiseAt && written < noiseAt + noiseBytes) {
+        copy[i] ^= 0x55;
+      }
+    }
+    ssize_t len = ::write(fd, copy.data(), size);
+    return (len < 0) ? TRANSPORT_ERROR : (int)len;
+  }
+
+  void flushInput() override
+  {
+    uint8_t discard[64];
+    while (read(discard, sizeof(discard), 0) > 0) {
+    }
+  }
+
+private:
+  int      fd;
+  uint32_t usPerByte;
+  size_t   written = 0;
+};
+
+/**
+ * @brief One direction of a simulated serial line, driven by a virtual clock.
+ *
+ * The bytes written by a session leave one after the other at the speed of the line, arrive
+ * after its latency, and may be damaged on the way.
+ */
+struct Line
+{
+  std::deque<std::pair<uint64_t, uint8_t>> bytes;                     // Bytes in flight and their arrival time in microseconds
+  uint64_t                                 byteNs       = 0;          // Time of one byte on the line
+  uint64_t                                 latencyUs    = 0;          // Time from the end of a byte to its arrival
+  bool                                     paced        = false;      // The session writes only once the line is idle
+  const uint64_t*                          heldUntilUs  = NULL;       // Time before which the session cannot write, NULL for none
+  size_t                                   corruptEvery = 0;          // Bytes sent between two corrupted ones, 0 for a clean line
+  size_t                                   corruptAt    = 0;          // Single byte corrupted, counted from 1, 0 for none
+  size_t                                   dropAt       = 0;          // Single byte lost, counted from 1, 0 for none
+  double                                   ber          = 0;          // Probability of every bit to be flipped, 0 for none
+  uint32_t                                 random       = 0x12345678; // State of the sequence the flipped bits are drawn from
+  uint64_t                                 freeNs       = 0;          // End of the last byte written
+  size_t                                   sent         = 0;          // Bytes written
+  std::vector<uint8_t>                     starts;                    // First byte of every packet and control byte written
+
+  Line(uint64_t byteNs = 0, uint64_t latencyUs = 0, bool paced = false) : byteNs(byteNs), latencyUs(latencyUs), paced(paced)
+  {
+  }
+
+  /**
+   * @brief Retrieves the time at which the session can write again, 0 if it can write at any time.
+   */
+  uint64_t readyUs() const
+  {
+    uint64_t readyUs = paced ? freeNs / 1000 : 0;
+    return heldUntilUs ? std::max(readyUs, *heldUntilUs) : readyUs;
+  }
+
+  /**
+   * @brief Draws whether the next bit is flipped, from a fixed sequence so that the runs repeat.
+   */
+  bool flip()
+  {
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+    return random < ber * 4294967296.0;
+  }
+
+  /**
+   * @brief Counts the packets of a given type written on the line.
+   */
+  size_t countStarts(uint8_t start) const
+  {
+    return (size_t)std::count(starts.begin(), starts.end(), start);
+  }
+
+  void write(YmodemSession& from, uint64_t nowUs)
+  {
+    freeNs = std::max(freeNs, nowUs * 1000);
+    while (from.outputSize() > 0 && readyUs() <= nowUs) {
+      starts.push_back(from.output()[0]);
+      for (size_t i = 0; i < from.outputSize(); i++) {
+        uint8_t byte  = from.output()[i];
+        size_t  count = ++sent;
+        if ((corruptEvery > 0 && count % corruptEvery == 0) || count == corruptAt) {
+          byte ^= 0x55;
+        }
+        for (int bit = 0; bit < 8 && ber > 0; bit++) {
+          if (flip()) {
+            byte ^= 1 << bit;
+          }
+        }
+        freeNs += byteNs;
+        if (count != dropAt) {
+          bytes.push_back(std::make_pair(freeNs / 1000 + latencyUs, byte));
+        }
+      }
+      from.consumeOutput(from.outputSize());
+    }
+  }
+
+  void deliver(YmodemSession& to, uint64_t nowUs)
+  {
+    std::vector<uint8_t> arrived;
+    while (!bytes.empty() && bytes.front().first <= nowUs) {
+      arrived.push_back(bytes.front().second);
+      bytes.pop_front();
+    }
+    if (!arrived.empty() && !to.isDone()) {
+      to.feed(arrived.data(), arrived.size(), nowUs / 1000);
+    }
+  }
+
+  /**
+   * @brief Moves the next event forward to the next one of this line and its session: a byte
+   *        arriving, the session able to write again or its timer.
+   */
+  uint64_t nextEvent(const YmodemSession& from, uint64_t nowUs, uint64_t next) const
+  {
+    if (!bytes.empty()) {
+      next = std::min(next, bytes.front().first);
+    }
+    if (from.isDone()) {
+      return next;
+    }
+    if (from.outputSize() > 0 && readyUs() > nowUs) {
+      next = std::min(next, readyUs());
+    }
+    uint64_t deadlineUs = (uint64_t)from.nextDeadline() * 1000;
+    if (deadlineUs > nowUs) {
+      next = std::min(next, deadlineUs);
+    }
+    return next;
+  }
+};
+
+/**
+ * @brief Runs a transfer over a pair of simulated lines.
+ *
+ * @param tick Called every time the clock moves, before the bytes arrive, returns false to
+ *             abandon the transfer. Empty to run it to the end.
+ * @return uint64_t Time the transfer took, in microseconds.
+ */
+static inline uint64_t runLine(YmodemSession& tx, YmodemSession& rx, Line& toReceiver, Line& toSender,
+                               const std::function<bool(uint64_t)>& tick = std::function<bool(uint64_t)>())
+{
+  uint64_t nowUs = 1000000;
+
+  if (tick && !tick(nowUs)) {
+    return 0;
+  }
+  rx.start(nowUs / 1000);
+  tx.start(nowUs / 1000);
+  for (long steps = 0; steps < 10000000 && !(tx.isDone() && rx.isDone()); steps++) {
+    toReceiver.write(tx, nowUs);
+    toSender.write(rx, nowUs);
+    // A streaming sender produces its next block once the previous one is on the line
+    if (tx.streaming() && tx.outputSize() == 0 && !tx.isDone()) {
+      tx.poll(nowUs / 1000);
+      continue;
+    }
+
+    uint64_t next = toSender.nextEvent(rx, nowUs, toReceiver.nextEvent(tx, nowUs, UINT64_MAX));
+    if (next == UINT64_MAX) {
+      break;
+    }
+    nowUs = std::max(nowUs, next);
+    if (tick && !tick(nowUs)) {
+      break;
+    }
+    toReceiver.deliver(rx, nowUs);
+    toSender.deliver(tx, nowUs);
+    tx.poll(nowUs / 1000);
+    rx.poll(nowUs / 1000);
+  }
+  return nowUs - 1000000;
+}
+
+#endif // YMODEM_FIXTURES_H
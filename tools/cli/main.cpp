@@ -0,0 +1,738 @@
+/**
+ * @file main.cpp
+ * @author Miguel Ferrer (mferrer@inbiot.es)
+ * @brief  Command-line Ymodem sender and receiver for Linux
+ * @version 0.1
+ * @date 2025-05-27
+ *
+ * This file contains a host program built from the sources of lib/Ymodem. It
+ * sends or receives a file over a serial device, a pseudo terminal or TCP with the
+ * Ymodem or Zmodem sessions or with the compile-time engine, and prints the same
+ * counters as the ESP32 examples, so bench measurements taken on both sides of
+ * a link can be compared line by line.
+ *
+ * Build and run it with PlatformIO:
+ *   pio run -e cli
+ *   .pio/build/cli/program receive /dev/ttyUSB0 ./incoming
+ *   .pio/build/cli/program send /dev/ttyUSB0 firmware.bin --digest sha256
+ *   .pio/build/cli/program receive /dev/ttyUSB0 ./incoming --zmodem --resume
+ *   .pio/build/cli/program replay field.ymtr firmware.bin --speed 0
+ *   .pio/build/cli/program receive tcp://:5555 ./incoming
+ *   .pio/build/cli/program send tcp://192.168.1.20:5555 firmware.bin
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fcntl.h>
+#include <getopt.h>
+#include <memory>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "YmodemEngine.h"
+#include "YmodemReceive.h"
+#include "YmodemLog.h"
+#include "YmodemReplay.h"
+#include "YmodemTcp.h"
+#include "YmodemTrace.h"
+#include "YmodemTransmit.h"
+#include "YmodemTty.h"
+#include "ZmodemReceive.h"
+#include "ZmodemTransmit.h"
+
+#define CLI_DEFAULT_BAUD (115200)               /*!< Baud rate used when none is given */
+#define CLI_DEFAULT_MAX_SIZE (16 * 1024 * 1024) /*!< Largest file accepted by default, in bytes */
+#define CLI_TRACE_SIZE (4 * 1024 * 1024)        /*!< Capacity of the trace recorded with --trace, in bytes */
+#define CLI_TCP_PREFIX "tcp://"                 /*!< Device prefix selecting TCP, tcp://host:port connects, tcp://:port listens */
+
+/**
+ * @brief Settings selected on the command line.
+ */
+struct CliOptions
+{
+  bool             send      = false;                 // Send a file instead of receiving one
+  bool             replay    = false;                 // Replay a trace instead of using a device
+  const char*      device    = NULL;                  // Serial device, pseudo terminal or tcp:// address, or trace to replay
+  const char*      path      = NULL;                  // File to send, or directory receiving the file
+  uint32_t         baudRate  = CLI_DEFAULT_BAUD;      // Baud rate of the device
+  bool             engine    = false;                 // Use the compile-time engine instead of the sessions
+  bool             zmodem    = false;                 // Use the Zmodem sessions instead of the Ymodem ones
+  bool             resume    = false;                 // Continue interrupted Zmodem transfers
+  bool             flow      = false;                 // RTS/CTS hardware flow control
+  bool             skip      = false;                 // Skip the files the receiver holds unchanged
+  bool             fec       = false;                 // Reed-Solomon parity on the blocks, repaired by the receiver
+  size_t           blockSize = PACKET_1K_SIZE;        // Block size, up to PACKET_1K_SIZE for the engine, PACKET_8K_SIZE for the sessions
+  bool             bitwise   = false;                 // Engine CRC computed without the table
+  YmodemDigestType digest    = YMODEM_DIGEST_NONE;    // Whole-file digest computed by the sessions
+  uint32_t         maxSize   = CLI_DEFAULT_MAX_SIZE;  // Largest file accepted by the receiver
+  bool             quiet     = false;                 // No progress bar
+  const char*      trace     = NULL;                  // File receiving the wire trace of the session
+  uint32_t         speedup   = 1;                     // Replay speedup, YMODEM_REPLAY_ASAP to keep only the order
+};
+
+static std::atomic<bool> cancelRequested(false);
+
+static uint32_t cliMicros()
+{
+  using namespace std::chrono;
+  return (uint32_t)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Computes the digest of a whole file.
+ */
+static void digestFile(int fd, YmodemDigestType type, YmodemDigest& digest)
+{
+  uint8_t buffer[4096];
+  off_t   offset = 0;
+  ssize_t len;
+
+  digest.begin(type);
+  while ((len = pread(fd, buffer, sizeof(buffer), offset)) > 0) {
+    digest.update(buffer, len);
+    offset += len;
+  }
+  digest.finish();
+}
+
+/**
+ * @brief Receive sink writing the file into a directory, with the write counters of YmodemFileSink.
+ *
+ * The announced size is checked against the free space of the file system, as the
+ * reservation of YmodemFileSink does on the device. The received file takes the
+ * modification time and the permissions announced by the sender, so with skipping
+ * enabled a later push of the same file is recognised without its data.
+ */
+class DirectorySink final : public YmodemReceiveSink
+{
+public:
+  DirectorySink(const char* directory, bool skip) : directory(directory), skip(skip)
+  {
+  }
+
+  ~DirectorySink()
+  {
+    close();
+  }
+
+  bool reserve(uint32_t size) override
+  {
+    struct statvfs fs;
+    if (statvfs(directory.c_str(), &fs) == 0 && (uint64_t)fs.f_bavail * fs.f_frsize < size) {
+      return false;
+    }
+    counters.reserved = size;
+    return true;
+  }
+
+  bool open(const char* fileName, uint32_t fileSize) override
+  {
+    return openFile(fileName, "wb");
+  }
+
+  bool resume(const char* fileName, uint32_t fileSize, uint32_t* offset) override
+  {
+    if (!openFile(fileName, "ab")) {
+      return false;
+    }
+    fseek(file, 0, SEEK_END);
+    *offset = (uint32_t)ftell(file);
+    return true;
+  }
+
+  bool unchanged(const YmodemFileInfo& info) override
+  {
+    // Same size, then the digest when one is announced, the modification time and the mode otherwise
+    struct stat stored;
+    std::string path = directory + "/" + baseName(info.name);
+    if (!skip || stat(path.c_str(), &stored) != 0 || !S_ISREG(stored.st_mode) || stored.st_size != (off_t)info.size) {
+      return false;
+    }
+    bool same;
+    if (info.digest[0] != '\0') {
+      int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0) {
+        return false;
+      }
+      YmodemDigest digest;
+      digestFile(fd, YmodemDigest::parseType(info.digest), digest);
+      ::close(fd);
+      same = digest.matches(info.digest);
+    }
+    else {
+      same = info.modTime != 0 && (uint32_t)stored.st_mtime == info.modTime && (info.mode == 0 || (stored.st_mode & 07777) == (info.mode & 07777));
+    }
+    if (same) {
+      name = baseName(info.name);
+    }
+    return same;
+  }
+
+  void attributes(uint32_t modTime, uint32_t mode) override
+  {
+    std::string    path     = directory + "/" + name;
+    struct timeval times[2] = {{(time_t)modTime, 0}, {(time_t)modTime, 0}};
+    utimes(path.c_str(), times);
+    if (mode != 0) {
+      chmod(path.c_str(), mode & 0777);
+    }
+  }
+
+  int write(const uint8_t* data, size_t size) override
+  {
+    uint32_t start   = cliMicros();
+    size_t   written = fwrite(data, 1, size, file);
+    uint32_t elapsed = cliMicros() - start;
+
+    counters.writes++;
+    counters.totalUs += elapsed;
+    counters.maxUs = std::max(counters.maxUs, elapsed);
+    return (written == size) ? (int)size : -1;
+  }
+
+  void close() override
+  {
+    if (file != NULL) {
+      fclose(file);
+      file = NULL;
+    }
+  }
+
+  const std::string& fileName() const
+  {
+    return name;
+  }
+
+  YmodemWriteStats& stats()
+  {
+    return counters;
+  }
+
+private:
+  std::string      directory;     /**< Directory receiving the file. */
+  bool             skip;          /**< Report the files already stored as unchanged. */
+  std::string      name;          /**< Name of the received file. */
+  FILE*            file = NULL;   /**< File being written, NULL when closed. */
+  YmodemWriteStats counters = {}; /**< Write counters. */
+
+  // Keep the received file inside the directory
+  static const char* baseName(const char* fileName)
+  {
+    const char* base = strrchr(fileName, '/');
+    return (base != NULL) ? base + 1 : fileName;
+  }
+
+  bool openFile(const char* fileName, const char* mode)
+  {
+    name = baseName(fileName);
+    file = fopen((directory + "/" + name).c_str(), mode);
+    return file != NULL;
+  }
+};
+
+/**
+ * @brief Transmit source reading a local file.
+ */
+class PathSource final : public YmodemTransmitSource
+{
+public:
+  explicit PathSource(int fd) : fd(fd)
+  {
+  }
+
+  int read(uint8_t* data, size_t size, uint32_t offset) override
+  {
+    ssize_t len = pread(fd, data, size, offset);
+    return (len < 0) ? -1 : (int)len;
+  }
+
+  int descriptor() const
+  {
+    return fd;
+  }
+
+private:
+  int fd; /**< Descriptor of the file. */
+};
+
+/**
+ * @brief Shows the progress of a transfer on stderr, with the bar of the ESP32 transmit.
+ */
+static void displayProgress(size_t offset, size_t totalSize, uint32_t startTime)
+{
+  if (totalSize == 0) {
+    return;
+  }
+  int      progress      = (offset * 100) / totalSize;
+  int      filled        = (offset * PROGRESS_BAR_WIDTH) / totalSize;
+  uint32_t elapsedTime   = Ymodem_Millis() - startTime;
+  uint32_t remainingTime = 0;
+
+  if (offset > 0 && offset < totalSize) {
+    uint64_t estimatedTotalTime = (uint64_t)elapsedTime * totalSize / offset;
+    remainingTime               = (estimatedTotalTime > elapsedTime) ? (estimatedTotalTime - elapsedTime) / 1000 : 0;
+  }
+
+  fprintf(stderr, "Progress: [");
+  for (int i = 0; i < PROGRESS_BAR_WIDTH; i++) {
+    fputs((i < filled) ? "\033[42m \033[0m" : "\033[41m \033[0m", stderr);
+  }
+  fprintf(stderr, "\033[0m] %d%% Time: %um %us  \r", progress, remainingTime / 60, remainingTime % 60);
+}
+
+/**
+ * @brief Prints the counters of a transfer in the format of the ESP32 examples.
+ */
+static void printStats(const TtyTransport* tty, const TcpTransport& tcp, const YmodemSessionStats& session, const YmodemWriteStats& writes,
+                       uint32_t elapsedMs)
+{
+  if (tty != NULL) {
+    const YmodemRxStats& stats = tty->getStats();
+    printf("UART wakeups=%u packets=%u retries=%u FIFO overflows=%u buffer full=%u\n", stats.wakeups, session.packets, session.retries,
+           stats.fifoOverflows, stats.bufferFull);
+  }
+  else {
+    const YmodemTcpStats& stats = tcp.getStats();
+    printf("TCP packets=%u retries=%u writes=%u sends=%u sent=%u received=%u blocked=%u us\n", session.packets, session.retries, stats.writes,
+           stats.sends, stats.bytesSent, stats.bytesReceived, stats.blockedUs);
+  }
+  printf("Session %u ms, %u writes, write latency avg=%u us max=%u us\n", elapsedMs, writes.writes,
+         writes.writes ? writes.totalUs / writes.writes : 0, writes.maxUs);
+  printf("Throughput %u bytes/s, %u timeouts\n", elapsedMs ? (uint32_t)((uint64_t)session.bytes * 1000 / elapsedMs) : 0, session.timeouts);
+  if (session.skipped > 0) {
+    printf("Skipped %u unchanged files, %u bytes not sent\n", session.skipped, session.skippedBytes);
+  }
+  if (session.repaired > 0) {
+    printf("Repaired %u damaged packets with their parity\n", session.repaired);
+  }
+}
+
+/**
+ * @brief With --skip, announces the attributes of the file sent and lets the receiver skip it.
+ *
+ * With --digest the digest of the whole file is computed first and announced in the header,
+ * so the receiver compares the content instead of the modification time.
+ */
+static void configureSender(const CliOptions& options, YmodemSender& sender, const PathSource& source, char* announced)
+{
+  struct stat info;
+  if (!options.skip || source.descriptor() < 0 || fstat(source.descriptor(), &info) != 0) {
+    return;
+  }
+  sender.setAttributes((uint32_t)info.st_mtime, info.st_mode);
+  sender.setSkipUnchanged(true);
+  if (options.digest != YMODEM_DIGEST_NONE) {
+    YmodemDigest digest;
+    digestFile(source.descriptor(), options.digest, digest);
+    digest.format(announced, YMODEM_DIGEST_TEXT_SIZE);
+    sender.setHeaderDigest(announced);
+  }
+}
+
+static void printDigest(const YmodemDigest& digest)
+{
+  char text[YMODEM_DIGEST_TEXT_SIZE];
+  if (digest.format(text, sizeof(text))) {
+    printf("Digest %s\n", text);
+  }
+}
+
+/**
+ * @brief Runs a transfer with the compile-time engine.
+ *
+ * @tparam BlockSize Engine block size.
+ * @tparam CrcPolicy Engine CRC routine.
+ */
+template <size_t BlockSize, class CrcPolicy>
+static int runEngine(const CliOptions& options, TtyTransport& tty, DirectorySink& sink, PathSource& source, const char* name, uint32_t size,
+                     YmodemSessionStats& stats)
+{
+  YmodemEngine<TtyTransport, DirectorySink, BlockSize, CrcPolicy> engine(tty);
+
+  int result = options.send ? engine.transmit(source, name, size) : engine.receive(sink, options.maxSize);
+  stats      = engine.stats();
+  return result;
+}
+
+static int runEngine(const CliOptions& options, TtyTransport& tty, DirectorySink& sink, PathSource& source, const char* name, uint32_t size,
+                     YmodemSessionStats& stats)
+{
+  if (options.blockSize == PACKET_SIZE) {
+    return options.bitwise ? runEngine<PACKET_SIZE, YmodemCrcBitwise<>>(options, tty, sink, source, name, size, stats)
+                           : runEngine<PACKET_SIZE, YmodemCrcTable<>>(options, tty, sink, source, name, size, stats);
+  }
+  return options.bitwise ? runEngine<PACKET_1K_SIZE, YmodemCrcBitwise<>>(options, tty, sink, source, name, size, stats)
+                         : runEngine<PACKET_1K_SIZE, YmodemCrcTable<>>(options, tty, sink, source, name, size, stats);
+}
+
+/**
+ * @brief Runs a transfer with the session state machines, as the Ymodem class does.
+ */
+static int runSession(const CliOptions& options, YmodemTransport& transport, DirectorySink& sink, PathSource& source, const char* name,
+                      uint32_t size, YmodemSessionStats& stats)
+{
+  YmodemReceiver  receiver(sink, options.maxSize);
+  YmodemSender    sender(source, name, size);
+  ZmodemReceiver  zreceiver(sink, options.maxSize);
+  ZmodemSender    zsender(source, name, size);
+  YmodemSession&  session   = options.zmodem ? (options.send ? (YmodemSession&)zsender : (YmodemSession&)zreceiver)
+                                             : (options.send ? (YmodemSession&)sender : (YmodemSession&)receiver);
+  uint32_t        startTime = Ymodem_Millis();
+  YmodemEventHook progress;
+
+  zreceiver.setResume(options.resume);
+  zsender.setResume(options.resume);
+  if (options.blockSize > PACKET_1K_SIZE) {
+    receiver.setBlockSize(options.blockSize);
+    sender.setBlockSize(options.blockSize);
+  }
+  receiver.setFec(options.fec);
+  sender.setFec(options.fec);
+  char announced[YMODEM_DIGEST_TEXT_SIZE];
+  configureSender(options, sender, source, announced);
+
+  session.setDigest(options.digest);
+  if (!options.quiet) {
+    // The receiver learns the file size from the header, when the sink reserves it
+    progress = [&options, &sink, size, startTime](YmodemSession& session, uint8_t events) {
+      if (events & YMODEM_EVENT_BLOCK) {
+        displayProgress(session.stats().bytes, options.send ? size : sink.stats().reserved, startTime);
+      }
+      if (events & YMODEM_EVENT_FILE_DONE) {
+        fputc('\n', stderr);
+      }
+    };
+  }
+
+  std::unique_ptr<YmodemTrace> trace(options.trace ? new YmodemTrace(CLI_TRACE_SIZE) : NULL);
+  YmodemTraceTransport         link(transport, trace.get());
+
+  int result = Ymodem_RunSession(session, link, &cancelRequested, progress);
+  stats      = session.stats();
+  printDigest(session.digest());
+  if (&session == &sender && sender.droppedFields() != YMODEM_FIELD_NONE) {
+    fprintf(stderr, "Header fields 0x%02x left out, the file name is too long for them\n", sender.droppedFields());
+  }
+  if (trace && !trace->dump(options.trace)) {
+    fprintf(stderr, "Error writing the trace \"%s\"\n", options.trace);
+  }
+  return result;
+}
+
+/**
+ * @brief Replays the peer of a trace against a session playing the recorded side.
+ */
+static int runReplay(const CliOptions& options, bool sending, DirectorySink& sink, PathSource& source, const char* name, uint32_t size)
+{
+  YmodemReplay replay;
+  if (!replay.load(options.device)) {
+    fprintf(stderr, "Error reading the trace \"%s\"\n", options.device);
+    return 1;
+  }
+  if (replay.dropped() > 0) {
+    fprintf(stderr, "The trace lost %u records, the replay starts in the middle of the session\n", replay.dropped());
+  }
+
+  YmodemReceiver           receiver(sink, options.maxSize);
+  YmodemSender             sender(source, name, size);
+  ZmodemReceiver           zreceiver(sink, options.maxSize);
+  ZmodemSender             zsender(source, name, size);
+  YmodemSession&           session = options.zmodem ? (sending ? (YmodemSession&)zsender : (YmodemSession&)zreceiver)
+                                                    : (sending ? (YmodemSession&)sender : (YmodemSession&)receiver);
+  zreceiver.setResume(options.resume);
+  zsender.setResume(options.resume);
+  if (options.blockSize > PACKET_1K_SIZE) {
+    receiver.setBlockSize(options.blockSize);
+    sender.setBlockSize(options.blockSize);
+  }
+  receiver.setFec(options.fec);
+  sender.setFec(options.fec);
+  char announced[YMODEM_DIGEST_TEXT_SIZE];
+  configureSender(options, sender, source, announced);
+  const YmodemReplayStats& stats = replay.run(session, options.speedup);
+
+  printf("Replay of %u records as the %s, %u ms recorded\n", (unsigned)replay.records(), sending ? "sender" : "receiver", stats.recordedMs);
+  printf("Session %u ms, result=%d packets=%u retries=%u timeouts=%u\n", stats.sessionMs, stats.result, stats.packets, stats.retries, stats.timeouts);
+  printf("Output %u of %u bytes, divergences=%u first at byte %d\n", stats.producedBytes, stats.recordedBytes, stats.divergences,
+         stats.firstDivergence);
+  printf("Host time %u us\n", stats.hostUs);
+  return (stats.divergences == 0) ? 0 : 1;
+}
+
+static void usage(const char* program)
+{
+  fprintf(stderr,
+          "Usage: %s send <device|tcp://host:port|tcp://:port> <file> [options]\n"
+          "       %s receive <device|tcp://host:port|tcp://:port> [directory] [options]\n"
+          "       %s replay <trace> [file|directory] [options]\n"
+          "Options:\n"
+          "  -b, --baud <rate>            Baud rate, %u by default\n"
+          "  -F, --flow                   RTS/CTS hardware flow control\n"
+          "  -e, --engine                 Use the compile-time engine instead of the session state machines\n"
+          "  -z, --zmodem                 Use the Zmodem sessions, compatible with lrz and lsz\n"
+          "  -R, --resume                 Continue an interrupted Zmodem transfer\n"
+          "  -s, --block <128|1024|4096|8192>\n"
+          "                               Block size, 1024 by default. 128 needs --engine, 4096 and 8192 the Ymodem\n"
+          "                               sessions on both sides, a peer without them stays at 1024\n"
+          "  -k, --skip                   Skip the files the receiver holds unchanged, on both sides\n"
+          "  -f, --fec                    Reed-Solomon parity on the blocks for noisy links, on both sides\n"
+          "  -c, --crc <table|bitwise>    Engine CRC routine, table by default\n"
+          "  -d, --digest <crc32|sha256>  Whole-file digest computed by the sessions\n"
+          "  -m, --max <bytes>            Largest file accepted by the receiver, %u by default\n"
+          "  -q, --quiet                  No progress bar\n"
+          "  -t, --trace <file>           Record the bytes of the session into a binary trace\n"
+          "  -r, --speed <factor>         Replay speedup, 1 by default, 0 to keep only the order of the bytes\n",
+          program, program, program, CLI_DEFAULT_BAUD, CLI_DEFAULT_MAX_SIZE);
+}
+
+static bool parseOptions(int argc, char** argv, CliOptions& options)
+{
+  static const struct option longOptions[] = {
+    {"baud", required_argument, NULL, 'b'},   {"engine", no_argument, NULL, 'e'},       {"block", required_argument, NULL, 's'},
+    {"crc", required_argument, NULL, 'c'},    {"digest", required_argument, NULL, 'd'}, {"max", required_argument, NULL, 'm'},
+    {"quiet", no_argument, NULL, 'q'},        {"trace", required_argument, NULL, 't'},  {"speed", required_argument, NULL, 'r'},
+    {"zmodem", no_argument, NULL, 'z'},       {"resume", no_argument, NULL, 'R'},       {"flow", no_argument, NULL, 'F'},
+    {"skip", no_argument, NULL, 'k'},         {"fec", no_argument, NULL, 'f'},
+    {NULL, 0, NULL, 0},
+  };
+
+  int option;
+  while ((option = getopt_long(argc, argv, "b:es:c:d:m:qt:r:zRFkf", longOptions, NULL)) != -1) {
+    switch (option) {
+      case 'b':
+        options.baudRate = strtoul(optarg, NULL, 10);
+        break;
+      case 'e':
+        options.engine = true;
+        break;
+      case 's':
+        options.blockSize = strtoul(optarg, NULL, 10);
+        if (options.blockSize != PACKET_SIZE && options.blockSize != PACKET_1K_SIZE && options.blockSize != PACKET_4K_SIZE &&
+            options.blockSize != PACKET_8K_SIZE) {
+          fprintf(stderr, "Block size must be %d, %d, %d or %d\n", PACKET_SIZE, PACKET_1K_SIZE, PACKET_4K_SIZE, PACKET_8K_SIZE);
+          return false;
+        }
+        break;
+      case 'c':
+        options.bitwise = (strcmp(optarg, "bitwise") == 0);
+        break;
+      case 'd':
+        options.digest = (strcmp(optarg, "crc32") == 0) ? YMODEM_DIGEST_CRC32 : (strcmp(optarg, "sha256") == 0) ? YMODEM_DIGEST_SHA256 : YMODEM_DIGEST_NONE;
+        if (options.digest == YMODEM_DIGEST_NONE) {
+          fprintf(stderr, "Unknown digest %s\n", optarg);
+          return false;
+        }
+        break;
+      case 'm':
+        options.maxSize = strtoul(optarg, NULL, 10);
+        break;
+      case 'q':
+        options.quiet = true;
+        break;
+      case 't':
+        options.trace = optarg;
+        break;
+      case 'r':
+        options.speedup = strtoul(optarg, NULL, 10);
+        break;
+      case 'z':
+        options.zmodem = true;
+        break;
+      case 'R':
+        options.resume = true;
+        break;
+      case 'F':
+        options.flow = true;
+        break;
+      case 'k':
+        options.skip = true;
+        break;
+      case 'f':
+        options.fec = true;
+        break;
+      default:
+        return false;
+    }
+  }
+
+  if (argc - optind < 2) {
+    return false;
+  }
+  options.send   = (strcmp(argv[optind], "send") == 0);
+  options.replay = (strcmp(argv[optind], "replay") == 0);
+  options.device = argv[optind + 1];
+  options.path   = (argc - optind > 2) ? argv[optind + 2] : ".";
+  if (!options.send && !options.replay && strcmp(argv[optind], "receive") != 0) {
+    return false;
+  }
+  if (options.replay && options.engine) {
+    fprintf(stderr, "The replay drives the sessions, --engine cannot be replayed\n");
+    return false;
+  }
+  if (options.send && argc - optind < 3) {
+    return false;
+  }
+  if (options.engine && options.digest != YMODEM_DIGEST_NONE) {
+    fprintf(stderr, "The engine computes no digest, --digest needs the sessions\n");
+    return false;
+  }
+  if (options.engine && options.zmodem) {
+    fprintf(stderr, "The engine speaks Ymodem only, --zmodem needs the sessions\n");
+    return false;
+  }
+  if (options.resume && !options.zmodem) {
+    fprintf(stderr, "Only Zmodem transfers resume, --resume needs --zmodem\n");
+    return false;
+  }
+  if (options.engine && strncmp(options.device, CLI_TCP_PREFIX, strlen(CLI_TCP_PREFIX)) == 0) {
+    fprintf(stderr, "The engine is bound to the serial device, %s needs the sessions\n", CLI_TCP_PREFIX);
+    return false;
+  }
+  if (options.engine && options.trace != NULL) {
+    fprintf(stderr, "The engine is bound to the serial device, --trace needs the sessions\n");
+    return false;
+  }
+  if (!options.engine && options.send && options.blockSize == PACKET_SIZE) {
+    fprintf(stderr, "The sessions send 1K blocks, --block 128 needs --engine\n");
+    return false;
+  }
+  if (options.skip && (options.engine || options.zmodem)) {
+    fprintf(stderr, "Only the Ymodem sessions skip unchanged files, --skip needs neither --engine nor --zmodem\n");
+    return false;
+  }
+  if (options.fec && (options.engine || options.zmodem)) {
+    fprintf(stderr, "Only the Ymodem sessions add parity, --fec needs neither --engine nor --zmodem\n");
+    return false;
+  }
+  if (options.blockSize > PACKET_1K_SIZE && (options.engine || options.zmodem)) {
+    fprintf(stderr, "Only the Ymodem sessions negotiate large blocks, --block %u needs neither --engine nor --zmodem\n", (unsigned)options.blockSize);
+    return false;
+  }
+  return true;
+}
+
+static void onSignal(int signal)
+{
+  cancelRequested = true;
+}
+
+/**
+ * @brief Connects to host:port, or listens on :port and waits for the peer until interrupted.
+ */
+static bool openTcp(const char* address, TcpTransport& tcp)
+{
+  const char* colon = strrchr(address, ':');
+  if (colon == NULL || colon[1] == '\0') {
+    fprintf(stderr, "Expected %shost:port or %s:port\n", CLI_TCP_PREFIX, CLI_TCP_PREFIX);
+    return false;
+  }
+  uint16_t    port = (uint16_t)strtoul(colon + 1, NULL, 10);
+  std::string host(address, colon - address);
+  if (!host.empty()) {
+    if (!tcp.connect(host.c_str(), port)) {
+      fprintf(stderr, "Failed to connect to %s\n", address);
+      return false;
+    }
+    return true;
+  }
+
+  if (!tcp.listen(port)) {
+    fprintf(stderr, "Failed to listen on port %u\n", port);
+    return false;
+  }
+  fprintf(stderr, "Waiting for the peer on port %u...\n", tcp.localPort());
+  while (!cancelRequested) {
+    if (tcp.accept(NAK_TIMEOUT)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int main(int argc, char** argv)
+{
+  CliOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  // A trace is replayed as the sender when it is given the file, as the receiver when it is given a directory
+  struct stat info;
+  bool        sending = options.send || (options.replay && stat(options.path, &info) == 0 && S_ISREG(info.st_mode));
+  int         fd      = -1;
+  uint32_t    size    = 0;
+  const char* name    = NULL;
+  if (sending) {
+    fd = open(options.path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &info) != 0 || info.st_size == 0) {
+      fprintf(stderr, "Error reading file \"%s\"\n", options.path);
+      return 1;
+    }
+    size = (uint32_t)info.st_size;
+    name = strrchr(options.path, '/') ? strrchr(options.path, '/') + 1 : options.path;
+  }
+
+  DirectorySink sink(options.path, options.skip);
+  PathSource    source(fd);
+  if (options.replay) {
+    int result = runReplay(options, sending, sink, source, name, size);
+    if (fd >= 0) {
+      close(fd);
+    }
+    return result;
+  }
+
+  // The library reports the socket errors through its log
+  Ymodem_StartLogTask();
+  signal(SIGINT, onSignal);
+
+  TtyTransport tty;
+  TcpTransport tcp;
+  bool         network = (strncmp(options.device, CLI_TCP_PREFIX, strlen(CLI_TCP_PREFIX)) == 0);
+  if (network ? !openTcp(options.device + strlen(CLI_TCP_PREFIX), tcp) : !tty.begin(options.device, options.baudRate, options.flow)) {
+    return 1;
+  }
+
+  YmodemSessionStats stats = {};
+  if (network) {
+    fprintf(stderr, "%s %s with the %s...\n", options.send ? "Sending" : "Receiving", options.device, options.zmodem ? "Zmodem sessions" : "sessions");
+  }
+  else {
+    fprintf(stderr, "%s %s at %u baud%s with the %s...\n", options.send ? "Sending" : "Receiving", options.device, options.baudRate,
+            options.flow ? " and RTS/CTS" : "", options.engine ? "engine" : options.zmodem ? "Zmodem sessions" : "sessions");
+  }
+
+  uint32_t start     = Ymodem_Millis();
+  int      result    = options.engine ? runEngine(options, tty, sink, source, name, size, stats)
+                                      : runSession(options, network ? (YmodemTransport&)tcp : tty, sink, source, name, size, stats);
+  uint32_t elapsedMs = Ymodem_Millis() - start;
+  sink.close();
+  if (fd >= 0) {
+    close(fd);
+  }
+
+  tcp.end();
+  printStats(network ? NULL : &tty, tcp, stats, sink.stats(), elapsedMs);
+  if (options.send ? (result == YMODEM_TRANSMIT_OK) : (result >= 0)) {
+    if (options.send) {
+      printf("Transfer complete. Size=%u, Name: \"%s\"\n", size, name);
+    }
+    else {
+      printf("Transfer complete. Size=%d, Original name: \"%s\"\n", result, sink.fileName().c_str());
+    }
+    return 0;
+  }
+  printf("Transfer error. Error code=%d\n", result);
+  return 1;
+}